@@ -41,6 +41,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_PARSER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -55,19 +57,88 @@
 /* Prototypes for local functions */
 static void raptor_ntriples_generate_statement(raptor_parser* parser, raptor_term* subject_term, raptor_term* predicate_term, raptor_term* object_term, raptor_term* graph_term);
 
+
+#define MAX_NTRIPLES_TERMS 4
+
+/* Smallest input window allocated */
+#define RAPTOR_NTRIPLES_WINDOW_MIN_SIZE (RAPTOR_READ_BUFFER_SIZE << 1)
+
+/* Parallel parsing: bytes of input given to a worker at a time */
+#define RAPTOR_NTRIPLES_RANGE_SIZE (1 << 18)
+
+/* Parallel parsing: ranges per worker collected in the input window
+ * before the workers are started */
+#define RAPTOR_NTRIPLES_RANGES_PER_THREAD 16
+
+/* Parallel parsing: most input collected before the workers are
+ * started, so however many threads there are the window stays bounded
+ * by this plus one chunk of input and the longest line */
+#define RAPTOR_NTRIPLES_BATCH_MAX_SIZE (1 << 24)
+
+
+/*
+ * A run of complete lines from the input window parsed by a worker
+ * thread (see RAPTOR_OPTION_PARSE_THREADS).
+ *
+ * A worker parses quietly and stops at the first line that would
+ * report anything; the calling thread parses the rest of the range
+ * itself so errors, warnings and their locations are the same as
+ * when parsing on one thread.
+ */
+typedef struct {
+  raptor_thread_task task;
+
+  raptor_parser* rdf_parser;
+
+  /* lines to parse; they start and end on line boundaries */
+  unsigned char *start;
+  unsigned char *end;
+
+  /* line end character seen before @start; for CR LF */
+  char last_char;
+
+  /* location of the line being parsed */
+  raptor_locator locator;
+
+  /* copy of the line being parsed since parsing edits it in place */
+  unsigned char *scratch;
+  size_t scratch_size;
+
+  /* terms of parsed statements; MAX_NTRIPLES_TERMS per statement */
+  raptor_term** terms;
+  size_t terms_count;
+  size_t terms_size;
+
+  /* where the terms are made with RAPTOR_OPTION_PARSE_ARENA or NULL */
+  raptor_arena* arena;
+
+  /* first line not parsed by the worker or NULL if all were */
+  unsigned char *stop;
+  char stop_last_char;
+  int stop_line;
+  int stop_byte;
+
+  /* non-0 if an N-Quad had a literal graph; where the first one was */
+  int literal_graph;
+  raptor_locator literal_graph_locator;
+} raptor_ntriples_range;
+
+
 /*
  * NTriples parser object
  */
 struct raptor_ntriples_parser_context_s {
-  /* current line */
+  /* input window holding unconsumed input; reused across chunks */
   unsigned char *line;
-  /* current line length */
+  /* bytes of input in the window */
   size_t line_length;
+  /* allocated size of the window */
+  size_t line_size;
   /* current char in line buffer */
   size_t offset;
 
   char last_char;
-  
+
   /* static statement for use in passing to user code */
   raptor_statement statement;
 
@@ -75,12 +146,47 @@ struct raptor_ntriples_parser_context_s {
   int is_nquads;
 
   int literal_graph_warning;
+
+  /* line end scanner chosen for this CPU */
+  raptor_ntriples_line_scanner scan_line;
+
+  /* worker threads or NULL when parsing on the calling thread */
+  raptor_thread_pool* pool;
+  int threads;
+
+  /* ranges being parsed by workers; twice the threads so the workers
+   * have more to do while statements are delivered */
+  raptor_ntriples_range* ranges;
+  int ranges_count;
+
+  /* input collected in the window before starting the workers */
+  size_t batch_size;
+
+  /* non-0 to deliver statements from ranges in the order they finish */
+  int unordered;
+
+  /* where terms are made with RAPTOR_OPTION_PARSE_ARENA or NULL;
+   * reset after each statement is delivered */
+  raptor_arena* arena;
 };
 
 
 typedef struct raptor_ntriples_parser_context_s raptor_ntriples_parser_context;
 
 
+/*
+ * Where the next range of lines starts while splitting the window
+ */
+typedef struct {
+  unsigned char *ptr;
+  unsigned char *end;
+  int is_end;
+  char last_char;
+  int line;
+  int byte;
+} raptor_ntriples_splitter;
+
+
 
 /**
  * raptor_ntriples_parse_init:
@@ -100,31 +206,87 @@ raptor_ntriples_parse_init(raptor_parser* rdf_parser, const char *name)
 
   if(!strcmp(name, "nquads"))
     ntriples_parser->is_nquads = 1;
-  
+
+  ntriples_parser->scan_line = raptor_ntriples_get_line_scanner(RAPTOR_NTRIPLES_SCANNER_BEST);
+
   return 0;
 }
 
 
+static void
+raptor_ntriples_range_free_terms(raptor_ntriples_range* range)
+{
+  size_t i;
+
+  for(i = 0; i < range->terms_count; i++) {
+    if(range->terms[i])
+      raptor_free_term(range->terms[i]);
+  }
+  range->terms_count = 0;
+
+  if(range->arena)
+    raptor_arena_reset(range->arena);
+}
+
+
+static void
+raptor_ntriples_free_threads(raptor_ntriples_parser_context *ntriples_parser)
+{
+  int i;
+
+  /* waits for any running workers */
+  if(ntriples_parser->pool) {
+    raptor_free_thread_pool(ntriples_parser->pool);
+    ntriples_parser->pool = NULL;
+  }
+
+  if(ntriples_parser->ranges) {
+    for(i = 0; i < ntriples_parser->ranges_count; i++) {
+      raptor_ntriples_range* range = &ntriples_parser->ranges[i];
+
+      raptor_ntriples_range_free_terms(range);
+      if(range->terms)
+        RAPTOR_FREE(raptor_term**, range->terms);
+      if(range->scratch)
+        RAPTOR_FREE(cdata, range->scratch);
+      if(range->arena)
+        raptor_free_arena(range->arena);
+    }
+    RAPTOR_FREE(raptor_ntriples_range*, ntriples_parser->ranges);
+    ntriples_parser->ranges = NULL;
+  }
+
+  ntriples_parser->ranges_count = 0;
+  ntriples_parser->threads = 0;
+}
+
+
 /* PUBLIC FUNCTIONS */
 
 
 /*
  * raptor_ntriples_parse_terminate - Free the Raptor NTriples parser
  * @rdf_parser: parser object
- * 
+ *
  **/
 static void
 raptor_ntriples_parse_terminate(raptor_parser* rdf_parser)
 {
   raptor_ntriples_parser_context *ntriples_parser;
   ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
-  if(ntriples_parser->line_length)
+
+  raptor_ntriples_free_threads(ntriples_parser);
+
+  if(ntriples_parser->arena)
+    raptor_free_arena(ntriples_parser->arena);
+
+  if(ntriples_parser->line)
     RAPTOR_FREE(cdata, ntriples_parser->line);
 }
 
 
 static void
-raptor_ntriples_generate_statement(raptor_parser* parser, 
+raptor_ntriples_generate_statement(raptor_parser* parser,
                                    raptor_term *subject,
                                    raptor_term *predicate,
                                    raptor_term *object,
@@ -159,50 +321,97 @@ raptor_ntriples_generate_statement(raptor_parser* parser,
 }
 
 
+/* store the terms of a statement parsed by a worker */
+static int
+raptor_ntriples_range_add_terms(raptor_ntriples_range* range,
+                                raptor_term** terms)
+{
+  if(range->terms_count + MAX_NTRIPLES_TERMS > range->terms_size) {
+    size_t new_size = range->terms_size << 1;
+    raptor_term** new_terms;
+
+    if(!new_size)
+      new_size = MAX_NTRIPLES_TERMS << 10;
+
+    new_terms = RAPTOR_REALLOC(raptor_term**, range->terms,
+                               new_size * sizeof(raptor_term*));
+    if(!new_terms)
+      return 1;
+
+    range->terms = new_terms;
+    range->terms_size = new_size;
+  }
 
-#define MAX_NTRIPLES_TERMS 4
+  memcpy(range->terms + range->terms_count, terms,
+         MAX_NTRIPLES_TERMS * sizeof(raptor_term*));
+  range->terms_count += MAX_NTRIPLES_TERMS;
 
+  return 0;
+}
+
+
+/*
+ * raptor_ntriples_parse_line:
+ * @rdf_parser: parser
+ * @locator: locator to update as the line is parsed
+ * @buffer: line; NUL terminated and edited in place
+ * @len: length of line
+ * @range: worker range to store the statement terms in or NULL
+ *
+ * Parse one N-Triples / N-Quads line.
+ *
+ * Without @range, any statement is passed to the statement handler.
+ * With @range, this is running on a worker thread: the terms are
+ * kept in @range and nothing is reported; anything that would have
+ * been reported makes the parse fail instead.
+ *
+ * Return value: non-0 on a fatal error, or with @range, if the line
+ * must be parsed again on the calling thread
+ */
 static int
 raptor_ntriples_parse_line(raptor_parser* rdf_parser,
+                           raptor_locator* locator,
                            unsigned char *buffer, size_t len,
-                           int max_terms)
+                           raptor_ntriples_range* range)
 {
   raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
   int i;
   unsigned char *p;
   raptor_term* terms[MAX_NTRIPLES_TERMS+1] = {NULL, NULL, NULL, NULL, NULL};
   int rc = 0;
-  
+  int quiet = (range != NULL);
+
   /* ASSERTION:
    * p always points to first char we are considering
    * p[len-1] always points to last char
    */
-  
+
   /* Handle empty  lines */
   if(!len)
     return 0;
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-  RAPTOR_DEBUG3("handling line '%s' (%d bytes)\n", buffer, (unsigned int)len);
+  if(!quiet)
+    RAPTOR_DEBUG3("handling line '%s' (%d bytes)\n", buffer, (unsigned int)len);
 #endif
-  
+
   p = buffer;
 
   while(len > 0 && isspace((int)*p)) {
     p++;
-    rdf_parser->locator.column++;
-    rdf_parser->locator.byte++;
+    locator->column++;
+    locator->byte++;
     len--;
   }
 
   /* Handle empty - all whitespace lines */
   if(!len)
     return 0;
-  
+
   /* Handle comment lines */
   if(*p == '#')
     return 0;
-  
+
   /* Remove trailing spaces */
   while(len > 0 && isspace((int)p[len-1])) {
     p[len-1] = '\0';
@@ -210,7 +419,7 @@ raptor_ntriples_parse_line(raptor_parser* rdf_parser,
   }
 
   /* can't be empty now - that would have been caught above */
-  
+
   /* Must be triple/quad */
 
   for(i = 0; i < MAX_NTRIPLES_TERMS + 1; i++) {
@@ -225,40 +434,47 @@ raptor_ntriples_parse_line(raptor_parser* rdf_parser,
         if(i == 3)
           break;
       }
-      raptor_parser_error(rdf_parser, "Unexpected end of line");
-      goto cleanup;
+      if(!quiet)
+        raptor_parser_error(rdf_parser, "Unexpected end of line");
+      goto fail;
     }
-    
+
 
     if(i == 3) {
       /* graph term (3): blank node or <URI> */
       if(*p != '<' && *p != '_') {
-        raptor_parser_error(rdf_parser, "Saw '%c', expected Graph term <URIref>, _:bnodeID", *p);
-        goto cleanup;
+        if(!quiet)
+          raptor_parser_error(rdf_parser, "Saw '%c', expected Graph term <URIref>, _:bnodeID", *p);
+        goto fail;
       }
     } else if(i == 2) {
       /* object term (2): expect either <URI> or _:name or literal */
       if(*p != '<' && *p != '_' && *p != '"') {
-        raptor_parser_error(rdf_parser, "Saw '%c', expected object term <URIref>, _:bnodeID or \"literal\"", *p);
-        goto cleanup;
+        if(!quiet)
+          raptor_parser_error(rdf_parser, "Saw '%c', expected object term <URIref>, _:bnodeID or \"literal\"", *p);
+        goto fail;
       }
     } else if(i == 1) {
       /* predicate term (1): expect URI only */
       if(*p != '<') {
-        raptor_parser_error(rdf_parser, "Saw '%c', expected predict term <URIref>", *p);
-        goto cleanup;
+        if(!quiet)
+          raptor_parser_error(rdf_parser, "Saw '%c', expected predict term <URIref>", *p);
+        goto fail;
       }
     } else {
       /* subject (0) or graph (3) terms: expect <URI> or _:name */
       if(*p != '<' && *p != '_') {
-        raptor_parser_error(rdf_parser, "Saw '%c', expected subject term <URIref> or _:bnodeID", *p);
-        goto cleanup;
+        if(!quiet)
+          raptor_parser_error(rdf_parser, "Saw '%c', expected subject term <URIref> or _:bnodeID", *p);
+        goto fail;
       }
     }
 
 
-    term_len = raptor_ntriples_parse_term(rdf_parser->world, &rdf_parser->locator,
-                                          p, &len, &terms[i], 0);
+    term_len = raptor_ntriples_parse_term(rdf_parser->world, locator,
+                                          p, &len, &terms[i],
+                                          quiet ? RAPTOR_NTRIPLES_TERM_QUIET : 0,
+                                          range ? range->arena : ntriples_parser->arena);
     if(!term_len) {
       rc = 1;
       goto cleanup;
@@ -273,8 +489,9 @@ raptor_ntriples_parse_line(raptor_parser* rdf_parser,
       /* Check for absolute URI */
       uri_string = raptor_uri_as_string(terms[i]->value.uri);
       if(!raptor_uri_uri_string_is_absolute(uri_string)) {
-        raptor_parser_error(rdf_parser, "URI %s is not absolute", uri_string);
-        goto cleanup;
+        if(!quiet)
+          raptor_parser_error(rdf_parser, "URI %s is not absolute", uri_string);
+        goto fail;
       }
     }
 
@@ -282,45 +499,47 @@ raptor_ntriples_parse_line(raptor_parser* rdf_parser,
     while(len > 0 && isspace((int)*p)) {
       p++;
       len--;
-      rdf_parser->locator.column++;
-      rdf_parser->locator.byte++;
+      locator->column++;
+      locator->byte++;
     }
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-    if(terms[i]) {
+    if(terms[i] && !quiet) {
       unsigned char* c = raptor_term_to_string(terms[i]);
       fprintf(stderr, "item %d: term '%s' type %d\n",
               i, c, terms[i]->type);
       raptor_free_memory(c);
-    } else
+    } else if(!quiet)
       fprintf(stderr, "item %d: NULL term\n", i);
 #endif
 
     /* Look for terminating '.' after 3rd (ntriples) or 3rd/4th (nquads) term */
     if(i == (ntriples_parser->is_nquads ? 4 : 3) && *p != '.') {
-      raptor_parser_error(rdf_parser, "Missing terminating \".\"");
-      return 0;
+      if(!quiet)
+        raptor_parser_error(rdf_parser, "Missing terminating \".\"");
+      goto fail;
     }
 
     /* Still may be optional so check again */
     if(*p == '.') {
       p++;
       len--;
-      rdf_parser->locator.column++;
-      rdf_parser->locator.byte++;
+      locator->column++;
+      locator->byte++;
 
       /* Skip whitespace after '.' */
       while(len > 0 && isspace((int)*p)) {
         p++;
         len--;
-        rdf_parser->locator.column++;
-        rdf_parser->locator.byte++;
+        locator->column++;
+        locator->byte++;
       }
 
       /* Only a comment is allowed here */
       if(*p && *p != '#') {
-        raptor_parser_error(rdf_parser, "Junk after terminating \".\"");
-        return 0;
+        if(!quiet)
+          raptor_parser_error(rdf_parser, "Junk after terminating \".\"");
+        goto fail;
       }
 
       p += len; len = 0;
@@ -331,104 +550,88 @@ raptor_ntriples_parse_line(raptor_parser* rdf_parser,
   if(ntriples_parser->is_nquads) {
     /* Check N-Quads has 3 or 4 terms */
     if(terms[4]) {
-      raptor_free_term(terms[4]);
-      terms[4] = NULL;
-      raptor_parser_error(rdf_parser, "N-Quads only allows 3 or 4 terms");
-      goto cleanup;
+      if(!quiet)
+        raptor_parser_error(rdf_parser, "N-Quads only allows 3 or 4 terms");
+      goto fail;
     }
   } else {
     /* Check N-Triples has only 3 terms */
     if(terms[3] || terms[4]) {
-      if(terms[4]) {
-        raptor_free_term(terms[4]);
-        terms[4] = NULL;
-      }
-      if(terms[3]) {
-        raptor_free_term(terms[3]);
-        terms[3] = NULL;
-      }
-      raptor_parser_error(rdf_parser, "N-Triples only allows 3 terms");
-      goto cleanup;
+      if(!quiet)
+        raptor_parser_error(rdf_parser, "N-Triples only allows 3 terms");
+      goto fail;
     }
   }
 
   if(terms[3] && terms[3]->type == RAPTOR_TERM_TYPE_LITERAL) {
-    if(!ntriples_parser->literal_graph_warning++)
+    if(range) {
+      /* warned about when the range is delivered */
+      if(!range->literal_graph++)
+        range->literal_graph_locator = *locator;
+    } else if(!ntriples_parser->literal_graph_warning++)
       raptor_parser_warning(rdf_parser, "Ignoring N-Quad literal contexts");
 
     raptor_free_term(terms[3]);
     terms[3] = NULL;
   }
 
-  raptor_ntriples_generate_statement(rdf_parser, 
-                                     terms[0], terms[1], terms[2], terms[3]);
+  if(range) {
+    if(raptor_ntriples_range_add_terms(range, terms))
+      goto fail;
+  } else {
+    raptor_ntriples_generate_statement(rdf_parser,
+                                       terms[0], terms[1], terms[2], terms[3]);
+    if(ntriples_parser->arena)
+      raptor_arena_reset(ntriples_parser->arena);
+
+    locator->byte += RAPTOR_BAD_CAST(int, len);
+  }
 
-  rdf_parser->locator.byte += RAPTOR_BAD_CAST(int, len);
+  /* the terms are now owned by the statement or range */
+  return 0;
+
+ fail:
+  /* a worker leaves the line for the calling thread to report */
+  rc = quiet;
 
  cleanup:
+  for(i = 0; i < MAX_NTRIPLES_TERMS + 1; i++) {
+    if(terms[i])
+      raptor_free_term(terms[i]);
+  }
+  if(!range && ntriples_parser->arena)
+    raptor_arena_reset(ntriples_parser->arena);
 
   return rc;
 }
 
 
-static int
-raptor_ntriples_parse_chunk(raptor_parser* rdf_parser, 
-                            const unsigned char *s, size_t len,
+/*
+ * raptor_ntriples_parse_lines:
+ * @rdf_parser: parser
+ * @ptr: start of lines in the input window
+ * @end_ptr: end of input in the window
+ * @is_end: non-0 if the input ends at @end_ptr
+ *
+ * Parse lines on the calling thread until the end of the input or
+ * until an unterminated line when @is_end is 0.
+ *
+ * Return value: where parsing stopped or NULL on a fatal error
+ */
+static unsigned char*
+raptor_ntriples_parse_lines(raptor_parser* rdf_parser,
+                            unsigned char *ptr, unsigned char *end_ptr,
                             int is_end)
 {
-  unsigned char *buffer;
-  unsigned char *ptr;
-  unsigned char *start;
   raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
-  int max_terms = ntriples_parser->is_nquads ? 4 : 3;
-  unsigned char* end_ptr;
-
-#if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-  RAPTOR_DEBUG2("adding %d bytes to buffer\n", (unsigned int)len);
-#endif
-
-  if(len) {
-    buffer = RAPTOR_MALLOC(unsigned char*, ntriples_parser->line_length + len + 1);
-    if(!buffer) {
-      raptor_parser_fatal_error(rdf_parser, "Out of memory");
-      return 1;
-    }
-
-    if(ntriples_parser->line_length) {
-      memcpy(buffer, ntriples_parser->line, ntriples_parser->line_length);
-      RAPTOR_FREE(char*, ntriples_parser->line);
-    }
-
-    ntriples_parser->line = buffer;
-
-    /* move pointer to end of cdata buffer */
-    ptr = buffer + ntriples_parser->line_length;
-
-    /* adjust stored length */
-    ntriples_parser->line_length += len;
-
-    /* now write new stuff at end of cdata buffer */
-    memcpy(ptr, s, len);
-    ptr += len;
-    *ptr = '\0';
-  } else
-    buffer = ntriples_parser->line;
-
-
-#if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-  RAPTOR_DEBUG2("buffer now %ld bytes\n", ntriples_parser->line_length);
-#endif
-
-  if(!ntriples_parser->line_length)
-    return 0;
+  unsigned char *start;
 
-  ptr = buffer + ntriples_parser->offset;
-  end_ptr = buffer + ntriples_parser->line_length;
   while((start = ptr) < end_ptr) {
     unsigned char *line_start = ptr;
+    size_t len;
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-  RAPTOR_DEBUG3("line buffer now '%s' (offset %ld)\n", ptr, ptr-(buffer+ntriples_parser->offset));
+  RAPTOR_DEBUG2("line buffer now '%s'\n", ptr);
 #endif
 
     /* skip \n when just seen \r - i.e. \r\n or CR LF */
@@ -442,37 +645,8 @@ raptor_ntriples_parse_chunk(raptor_parser* rdf_parser,
       start = line_start = ptr;
     }
 
-    if(1) {
-      int quote = '\0';
-      int in_uri = '\0';
-      int bq = 0;
-      while(ptr < end_ptr) {
-        if(!bq) {
-          if(*ptr == '\\') {
-            bq = 1;
-            ptr++;
-            continue;
-          }
-
-          if(*ptr == '<')
-            in_uri = 1;
-          else if (in_uri && *ptr == '>')
-            in_uri = 0;
-
-          if(!quote) {
-            if((!in_uri && *ptr == '\'') || *ptr == '"')
-              quote = *ptr;
-            if(*ptr == '\n' || *ptr == '\r')
-              break;
-          } else {
-            if(*ptr == quote)
-              quote = 0;
-          }
-        }
-        ptr++;
-        bq = 0;
-      }
-    }
+    /* find the end of line - newlines inside literals do not count */
+    ptr = ntriples_parser->scan_line(ptr, end_ptr);
 
     if(ptr == end_ptr) {
       if(!is_end)
@@ -485,7 +659,7 @@ raptor_ntriples_parse_chunk(raptor_parser* rdf_parser,
 #endif
       ntriples_parser->last_char = *ptr;
     }
-    
+
     len = ptr - line_start;
     rdf_parser->locator.column = 0;
 
@@ -495,9 +669,10 @@ raptor_ntriples_parse_chunk(raptor_parser* rdf_parser,
     fputs("<<<\n", stderr);
 #endif
     *ptr = '\0';
-    if(raptor_ntriples_parse_line(rdf_parser, line_start, len, max_terms))
-      return 1;
-    
+    if(raptor_ntriples_parse_line(rdf_parser, &rdf_parser->locator,
+                                  line_start, len, NULL))
+      return NULL;
+
     rdf_parser->locator.line++;
 
     /* go past newline */
@@ -508,43 +683,407 @@ raptor_ntriples_parse_chunk(raptor_parser* rdf_parser,
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
     /* Do not peek if too far */
-    if(RAPTOR_BAD_CAST(size_t, ptr - buffer) < ntriples_parser->line_length)
+    if(ptr < end_ptr)
       RAPTOR_DEBUG2("next char is \\x%02x\n", *ptr);
     else
       RAPTOR_DEBUG1("next char unknown - end of buffer\n");
 #endif
   }
 
+  return start;
+}
+
+
+/*
+ * raptor_ntriples_parse_range:
+ * @user_data: #raptor_ntriples_range
+ *
+ * Worker thread: parse the lines of a range, keeping the terms.
+ * Stops at the first line that needs reporting.
+ */
+static void
+raptor_ntriples_parse_range(void* user_data)
+{
+  raptor_ntriples_range* range = (raptor_ntriples_range*)user_data;
+  raptor_parser* rdf_parser = range->rdf_parser;
+  raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
+  raptor_locator locator = range->locator;
+  unsigned char *ptr = range->start;
+  char last_char = range->last_char;
+  int start_byte = locator.byte;
+
+  range->terms_count = 0;
+  range->stop = NULL;
+  range->literal_graph = 0;
+
+  while(ptr < range->end) {
+    unsigned char *top = ptr;
+    unsigned char *line_start;
+    size_t len;
+
+    /* skip \n when just seen \r - i.e. \r\n or CR LF */
+    if(last_char == '\r' && *ptr == '\n')
+      ptr++;
+    line_start = ptr;
+
+    ptr = ntriples_parser->scan_line(ptr, range->end);
+    len = ptr - line_start;
+
+    if(len >= range->scratch_size) {
+      size_t new_size = range->scratch_size ? range->scratch_size : 1024;
+      unsigned char *scratch;
+
+      while(new_size <= len)
+        new_size <<= 1;
+
+      scratch = RAPTOR_REALLOC(unsigned char*, range->scratch, new_size);
+      if(!scratch)
+        goto stop;
+      range->scratch = scratch;
+      range->scratch_size = new_size;
+    }
+
+    memcpy(range->scratch, line_start, len);
+    range->scratch[len] = '\0';
+
+    locator.column = 0;
+    locator.byte = start_byte + RAPTOR_BAD_CAST(int, line_start - range->start);
+    if(raptor_ntriples_parse_line(rdf_parser, &locator, range->scratch, len,
+                                  range)) {
+      ptr = top;
+      goto stop;
+    }
+
+    locator.line++;
+
+    /* go past newline */
+    if(ptr < range->end) {
+      last_char = *ptr;
+      ptr++;
+    }
+    continue;
+
+    stop:
+    range->stop = top;
+    range->stop_last_char = last_char;
+    range->stop_line = locator.line;
+    range->stop_byte = start_byte + RAPTOR_BAD_CAST(int, top - range->start);
+    break;
+  }
+}
+
+
+/*
+ * raptor_ntriples_split_range:
+ * @rdf_parser: parser
+ * @splitter: where the next range starts
+ * @range: range to fill
+ *
+ * Take about RAPTOR_NTRIPLES_RANGE_SIZE bytes of complete lines from
+ * the input window for a worker.
+ *
+ * Lines are found with the same scanner as the parser uses so
+ * newlines inside literals do not split a range.
+ *
+ * Return value: non-0 if a range was made
+ */
+static int
+raptor_ntriples_split_range(raptor_parser* rdf_parser,
+                            raptor_ntriples_splitter* splitter,
+                            raptor_ntriples_range* range)
+{
+  raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
+  unsigned char *ptr = splitter->ptr;
+  unsigned char *target;
+
+  if(ptr >= splitter->end)
+    return 0;
+
+  range->start = ptr;
+  range->last_char = splitter->last_char;
+  range->locator = rdf_parser->locator;
+  range->locator.line = splitter->line;
+  range->locator.column = 0;
+  range->locator.byte = splitter->byte;
+
+  if(RAPTOR_BAD_CAST(size_t, splitter->end - ptr) > RAPTOR_NTRIPLES_RANGE_SIZE)
+    target = ptr + RAPTOR_NTRIPLES_RANGE_SIZE;
+  else
+    target = splitter->end;
+
+  while(ptr < target) {
+    unsigned char *line_start = ptr;
+
+    if(splitter->last_char == '\r' && *line_start == '\n')
+      line_start++;
+
+    /* a \n left at the end is for the calling thread */
+    if(line_start == splitter->end)
+      break;
+
+    line_start = ntriples_parser->scan_line(line_start, splitter->end);
+    if(line_start == splitter->end) {
+      if(!splitter->is_end)
+        /* middle of line */
+        break;
+      ptr = line_start;
+    } else {
+      splitter->last_char = *line_start;
+      ptr = line_start + 1;
+    }
+
+    splitter->line++;
+  }
+
+  if(ptr == range->start)
+    return 0;
+
+  range->end = ptr;
+  splitter->byte += RAPTOR_BAD_CAST(int, ptr - range->start);
+  splitter->ptr = ptr;
+
+  return 1;
+}
+
+
+/*
+ * raptor_ntriples_deliver_range:
+ * @rdf_parser: parser
+ * @range: range finished by a worker
+ *
+ * Send the statements parsed by a worker to the statement handler
+ * then parse any lines the worker left on this thread.
+ *
+ * Return value: non-0 on a fatal error
+ */
+static int
+raptor_ntriples_deliver_range(raptor_parser* rdf_parser,
+                              raptor_ntriples_range* range)
+{
+  raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
+  raptor_term** terms = range->terms;
+  size_t i;
+
+  if(range->literal_graph && !ntriples_parser->literal_graph_warning++) {
+    rdf_parser->locator = range->literal_graph_locator;
+    raptor_parser_warning(rdf_parser, "Ignoring N-Quad literal contexts");
+  }
+
+  rdf_parser->locator.line = range->locator.line;
+  rdf_parser->locator.column = 0;
+
+  for(i = 0; i < range->terms_count; i += MAX_NTRIPLES_TERMS)
+    raptor_ntriples_generate_statement(rdf_parser, terms[i], terms[i + 1],
+                                       terms[i + 2], terms[i + 3]);
+  range->terms_count = 0;
+  if(range->arena)
+    raptor_arena_reset(range->arena);
+
+  if(range->stop) {
+    rdf_parser->locator.line = range->stop_line;
+    rdf_parser->locator.byte = range->stop_byte;
+    ntriples_parser->last_char = range->stop_last_char;
+
+    if(!raptor_ntriples_parse_lines(rdf_parser, range->stop, range->end, 1))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * raptor_ntriples_parse_ranges:
+ * @rdf_parser: parser
+ * @ptr: start of lines in the input window
+ * @end_ptr: end of input in the window
+ * @is_end: non-0 if the input ends at @end_ptr
+ *
+ * Parse all complete lines with the worker threads.
+ *
+ * Statements are delivered on the calling thread, in input order
+ * or, with RAPTOR_OPTION_PARSE_UNORDERED, as ranges finish.  Blank
+ * node labels are used as written so they remain scoped to the
+ * document whichever worker sees them.
+ *
+ * Return value: where parsing stopped or NULL on a fatal error
+ */
+static unsigned char*
+raptor_ntriples_parse_ranges(raptor_parser* rdf_parser,
+                             unsigned char *ptr, unsigned char *end_ptr,
+                             int is_end)
+{
+  raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
+  raptor_ntriples_splitter splitter;
+  int head = 0;
+  int running = 0;
+  int rc = 0;
+
+  splitter.ptr = ptr;
+  splitter.end = end_ptr;
+  splitter.is_end = is_end;
+  splitter.last_char = ntriples_parser->last_char;
+  splitter.line = rdf_parser->locator.line;
+  splitter.byte = rdf_parser->locator.byte;
+
+  for(running = 0; running < ntriples_parser->ranges_count; running++) {
+    raptor_ntriples_range* range = &ntriples_parser->ranges[running];
+
+    if(!raptor_ntriples_split_range(rdf_parser, &splitter, range))
+      break;
+    raptor_thread_pool_submit(ntriples_parser->pool, &range->task);
+  }
+
+  while(running) {
+    raptor_ntriples_range* range;
+
+    if(ntriples_parser->unordered) {
+      raptor_thread_task* task;
+
+      task = raptor_thread_pool_wait_any(ntriples_parser->pool);
+      range = (raptor_ntriples_range*)task->user_data;
+    } else {
+      /* ranges are reused in turn so the oldest is always next */
+      range = &ntriples_parser->ranges[head];
+      raptor_thread_pool_wait(ntriples_parser->pool, &range->task);
+      head = (head + 1) % ntriples_parser->ranges_count;
+    }
+    running--;
+
+    if(rc) {
+      /* after a fatal error just wait for the workers */
+      raptor_ntriples_range_free_terms(range);
+      continue;
+    }
+
+    rc = raptor_ntriples_deliver_range(rdf_parser, range);
+
+    if(!rc && raptor_ntriples_split_range(rdf_parser, &splitter, range)) {
+      raptor_thread_pool_submit(ntriples_parser->pool, &range->task);
+      running++;
+    }
+  }
+
+  if(rc)
+    return NULL;
+
+  ntriples_parser->last_char = splitter.last_char;
+  rdf_parser->locator.line = splitter.line;
+  rdf_parser->locator.column = 0;
+  rdf_parser->locator.byte = splitter.byte;
+
+  return splitter.ptr;
+}
+
+
+/* end the default graph started by the first statement, if any */
+static void
+raptor_ntriples_parse_end_graph(raptor_parser* rdf_parser)
+{
+  if(rdf_parser->emitted_default_graph) {
+    raptor_parser_end_graph(rdf_parser, NULL, 0);
+    rdf_parser->emitted_default_graph--;
+  }
+}
+
+
+static int
+raptor_ntriples_parse_chunk(raptor_parser* rdf_parser,
+                            const unsigned char *s, size_t len,
+                            int is_end)
+{
+  unsigned char *buffer;
+  unsigned char *ptr;
+  unsigned char *start;
+  raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
+  unsigned char* end_ptr;
+
+#if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
+  RAPTOR_DEBUG2("adding %d bytes to buffer\n", (unsigned int)len);
+#endif
+
+  if(len) {
+    size_t needed = ntriples_parser->line_length + len + 1;
+
+    if(needed > ntriples_parser->line_size) {
+      /* grow the window; only happens for lines longer than any
+       * seen so far so the size is bounded by the longest line */
+      size_t new_size = ntriples_parser->line_size << 1;
+      if(new_size < needed)
+        new_size = needed;
+      if(new_size < RAPTOR_NTRIPLES_WINDOW_MIN_SIZE)
+        new_size = RAPTOR_NTRIPLES_WINDOW_MIN_SIZE;
+
+      buffer = RAPTOR_REALLOC(unsigned char*, ntriples_parser->line, new_size);
+      if(!buffer) {
+        raptor_parser_fatal_error(rdf_parser, "Out of memory");
+        return 1;
+      }
+
+      ntriples_parser->line = buffer;
+      ntriples_parser->line_size = new_size;
+    } else
+      buffer = ntriples_parser->line;
+
+    /* now write new stuff after the carried over partial line */
+    memcpy(buffer + ntriples_parser->line_length, s, len);
+    ntriples_parser->line_length += len;
+    buffer[ntriples_parser->line_length] = '\0';
+  } else
+    buffer = ntriples_parser->line;
+
+
+#if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
+  RAPTOR_DEBUG2("buffer now %ld bytes\n", ntriples_parser->line_length);
+#endif
+
+  /* all input so far was complete lines; the end of input still has
+   * to close the graph */
+  if(!ntriples_parser->line_length) {
+    if(is_end)
+      raptor_ntriples_parse_end_graph(rdf_parser);
+    return 0;
+  }
+
+  ptr = buffer + ntriples_parser->offset;
+  end_ptr = buffer + ntriples_parser->line_length;
+
+  if(ntriples_parser->pool) {
+    /* collect enough input to keep the workers busy */
+    if(!is_end &&
+       RAPTOR_BAD_CAST(size_t, end_ptr - ptr) < ntriples_parser->batch_size)
+      return 0;
+
+    ptr = raptor_ntriples_parse_ranges(rdf_parser, ptr, end_ptr, is_end);
+    if(!ptr)
+      return 1;
+  }
+
+  /* any partial line left is handled the same with or without workers */
+  start = raptor_ntriples_parse_lines(rdf_parser, ptr, end_ptr, is_end);
+  if(!start)
+    return 1;
+
   ntriples_parser->offset = start - buffer;
 
   len = ntriples_parser->line_length - ntriples_parser->offset;
-    
-  if(len && ntriples_parser->line_length != len) {
-    /* collapse buffer */
+
+  if(ntriples_parser->offset) {
+    /* compact in place: keep only the partial trailing line */
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
     RAPTOR_DEBUG3("collapsing buffer from %ld to %ld bytes\n", ntriples_parser->line_length, len);
 #endif
-    buffer = RAPTOR_MALLOC(unsigned char*, len + 1);
-    if(!buffer) {
-      raptor_parser_fatal_error(rdf_parser, "Out of memory");
-      return 1;
-    }
-
-    memcpy(buffer, 
-           ntriples_parser->line + ntriples_parser->line_length - len,
-           len);
+    if(len)
+      memmove(buffer, buffer + ntriples_parser->offset, len);
     buffer[len] = '\0';
 
-    RAPTOR_FREE(char*, ntriples_parser->line);
-
-    ntriples_parser->line = buffer;
-    ntriples_parser->line_length -= ntriples_parser->offset;
+    ntriples_parser->line_length = len;
     ntriples_parser->offset = 0;
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
     RAPTOR_DEBUG3("buffer now '%s' (%ld bytes)\n", ntriples_parser->line, ntriples_parser->line_length);
-#endif    
+#endif
   }
 
   /* exit now, no more input */
@@ -553,21 +1092,123 @@ raptor_ntriples_parse_chunk(raptor_parser* rdf_parser,
        raptor_parser_error(rdf_parser, "Junk at end of input.");
        return 1;
     }
-    
-    if(rdf_parser->emitted_default_graph) {
-      raptor_parser_end_graph(rdf_parser, NULL, 0);
-      rdf_parser->emitted_default_graph--;
-    }
 
-    return 0;
+    raptor_ntriples_parse_end_graph(rdf_parser);
   }
-    
+
   return 0;
 }
 
 
+/*
+ * raptor_ntriples_parse_set_threads:
+ * @rdf_parser: parser
+ * @threads: number of worker threads
+ *
+ * Set up the worker threads for RAPTOR_OPTION_PARSE_THREADS.  If
+ * they cannot be started, parsing stays on the calling thread.
+ */
+static void
+raptor_ntriples_parse_set_threads(raptor_parser* rdf_parser, int threads)
+{
+  raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
+  int i;
+
+  if(threads < 2)
+    threads = 0;
+
+  if(threads == ntriples_parser->threads)
+    return;
+
+  raptor_ntriples_free_threads(ntriples_parser);
+
+  if(!threads)
+    return;
+
+  /* workers create and free URIs */
+  if(raptor_uri_init_locking(rdf_parser->world))
+    return;
+
+  ntriples_parser->pool = raptor_new_thread_pool(threads);
+  if(!ntriples_parser->pool)
+    return;
+
+  /* not worth it if tasks would run on this thread */
+  if(!raptor_thread_pool_get_threads_count(ntriples_parser->pool))
+    goto failed;
+
+  ntriples_parser->ranges_count = threads << 1;
+  ntriples_parser->ranges = RAPTOR_CALLOC(raptor_ntriples_range*,
+                                          (size_t)ntriples_parser->ranges_count,
+                                          sizeof(raptor_ntriples_range));
+  if(!ntriples_parser->ranges)
+    goto failed;
+
+  for(i = 0; i < ntriples_parser->ranges_count; i++) {
+    raptor_ntriples_range* range = &ntriples_parser->ranges[i];
+
+    range->task.handler = raptor_ntriples_parse_range;
+    range->task.user_data = range;
+    range->rdf_parser = rdf_parser;
+  }
+
+  ntriples_parser->threads = threads;
+  ntriples_parser->batch_size = (size_t)threads *
+    RAPTOR_NTRIPLES_RANGES_PER_THREAD * RAPTOR_NTRIPLES_RANGE_SIZE;
+  if(ntriples_parser->batch_size > RAPTOR_NTRIPLES_BATCH_MAX_SIZE)
+    ntriples_parser->batch_size = RAPTOR_NTRIPLES_BATCH_MAX_SIZE;
+  return;
+
+  failed:
+  raptor_ntriples_free_threads(ntriples_parser);
+}
+
+
+/*
+ * raptor_ntriples_parse_set_arena:
+ * @rdf_parser: parser
+ * @use_arena: non-0 to make terms in arenas
+ *
+ * Set up the arenas for RAPTOR_OPTION_PARSE_ARENA; one for the
+ * calling thread and one for each worker range.  If one cannot be
+ * made, those terms are allocated on their own as usual.
+ */
+static void
+raptor_ntriples_parse_set_arena(raptor_parser* rdf_parser, int use_arena)
+{
+  raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
+  int i;
+
+  if(!use_arena) {
+    if(ntriples_parser->arena) {
+      raptor_free_arena(ntriples_parser->arena);
+      ntriples_parser->arena = NULL;
+    }
+    for(i = 0; i < ntriples_parser->ranges_count; i++) {
+      raptor_ntriples_range* range = &ntriples_parser->ranges[i];
+
+      if(range->arena) {
+        raptor_free_arena(range->arena);
+        range->arena = NULL;
+      }
+    }
+    return;
+  }
+
+  if(!ntriples_parser->arena)
+    ntriples_parser->arena = raptor_new_arena(0);
+
+  for(i = 0; i < ntriples_parser->ranges_count; i++) {
+    raptor_ntriples_range* range = &ntriples_parser->ranges[i];
+
+    if(!range->arena)
+      range->arena = raptor_new_arena(RAPTOR_NTRIPLES_RANGE_SIZE);
+  }
+}
+
+
 static int
-raptor_ntriples_parse_start(raptor_parser* rdf_parser) 
+raptor_ntriples_parse_start(raptor_parser* rdf_parser)
 {
   raptor_locator *locator = &rdf_parser->locator;
   raptor_ntriples_parser_context *ntriples_parser = (raptor_ntriples_parser_context*)rdf_parser->context;
@@ -578,6 +1219,17 @@ raptor_ntriples_parse_start(raptor_parser* rdf_parser)
 
   ntriples_parser->last_char = '\0';
 
+  /* forget any input left over from a previous parse but keep the
+   * window allocated for reuse */
+  ntriples_parser->line_length = 0;
+  ntriples_parser->offset = 0;
+
+  raptor_ntriples_parse_set_threads(rdf_parser,
+                                    RAPTOR_OPTIONS_GET_NUMERIC(rdf_parser, RAPTOR_OPTION_PARSE_THREADS));
+  ntriples_parser->unordered = RAPTOR_OPTIONS_GET_NUMERIC(rdf_parser, RAPTOR_OPTION_PARSE_UNORDERED);
+  raptor_ntriples_parse_set_arena(rdf_parser,
+                                  RAPTOR_OPTIONS_GET_NUMERIC(rdf_parser, RAPTOR_OPTION_PARSE_ARENA));
+
   return 0;
 }
 
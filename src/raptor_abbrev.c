@@ -38,6 +38,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SERIALIZER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -141,43 +143,341 @@ raptor_abbrev_node_equals(raptor_abbrev_node* node1, raptor_abbrev_node* node2)
 }
 
 
-/**
- * raptor_abbrev_node_lookup:
- * @nodes: Tree of nodes to search
- * @node: Node value to search for
+/*
+ * raptor_abbrev_table implementation
+ *
+ * Open addressing hash table with linear probing of nodes or subjects
+ * keyed by their term.  Each slot keeps the term hash next to the
+ * key so probing only compares terms when the hashes match.  Entries
+ * are deleted by shifting later entries of the probe sequence back so
+ * no tombstones are needed.  The table does not keep any order; use
+ * raptor_abbrev_subjects_sort() to get subjects in term order.
+ */
+typedef struct {
+  unsigned int hash;
+  /* key; owned by @item.  NULL if empty */
+  raptor_term* term;
+  /* node or subject */
+  void* item;
+} raptor_abbrev_table_slot;
+
+struct raptor_abbrev_table_s {
+  raptor_world* world;
+  /* table; size is a power of 2 */
+  raptor_abbrev_table_slot* slots;
+  int size;
+  int count;
+  /* handler to free items */
+  raptor_data_free_handler free_handler;
+};
+
+/* Initial table size */
+#define RAPTOR_ABBREV_TABLE_MIN_SIZE 64
+
+
+/* hash a counted string (FNV-1a) */
+static unsigned int
+raptor_abbrev_hash_string(unsigned int hash, const unsigned char *string,
+                          size_t length)
+{
+  while(length--) {
+    hash ^= *string++;
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+
+/*
+ * raptor_abbrev_term_hash:
+ * @term: term
  *
- * INTERNAL - Look in an avltree of nodes for a node described by parameters
- *   and if present create it, add it and return it
+ * INTERNAL - Hash a term consistently with raptor_term_equals()
  *
- * Return value: the node found/created or NULL on failure
+ * Return value: hash
  */
-raptor_abbrev_node* 
-raptor_abbrev_node_lookup(raptor_avltree* nodes, raptor_term* term)
+static unsigned int
+raptor_abbrev_term_hash(raptor_term* term)
 {
-  raptor_abbrev_node *lookup_node;
-  raptor_abbrev_node *rv_node;
+  unsigned int hash = 2166136261U;
 
-  /* Create a temporary node for search comparison. */
-  lookup_node = raptor_new_abbrev_node(term->world, term);
-  
-  if(!lookup_node)
+  switch(term->type) {
+    case RAPTOR_TERM_TYPE_URI:
+      hash = raptor_uri_get_hash(term->value.uri);
+      break;
+
+    case RAPTOR_TERM_TYPE_BLANK:
+      hash = raptor_abbrev_hash_string(hash, term->value.blank.string,
+                                       term->value.blank.string_len);
+      break;
+
+    case RAPTOR_TERM_TYPE_LITERAL:
+      hash = raptor_abbrev_hash_string(hash, term->value.literal.string,
+                                       term->value.literal.string_len);
+      if(term->value.literal.language)
+        hash = raptor_abbrev_hash_string(hash ^ 1,
+                                         term->value.literal.language,
+                                         term->value.literal.language_len);
+      if(term->value.literal.datatype)
+        hash ^= raptor_uri_get_hash(term->value.literal.datatype) * 31U;
+      break;
+
+    case RAPTOR_TERM_TYPE_UNKNOWN:
+    default:
+      break;
+  }
+
+  /* the table uses the low bits so mix in all of them */
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+
+  return hash;
+}
+
+
+/**
+ * raptor_new_abbrev_table:
+ * @world: raptor world
+ * @free_handler: handler to free items or NULL
+ *
+ * INTERNAL - Constructor for raptor_abbrev_table
+ *
+ * Return value: new table or NULL on failure
+ **/
+raptor_abbrev_table*
+raptor_new_abbrev_table(raptor_world* world,
+                        raptor_data_free_handler free_handler)
+{
+  raptor_abbrev_table* table;
+
+  table = RAPTOR_CALLOC(raptor_abbrev_table*, 1, sizeof(*table));
+  if(!table)
     return NULL;
 
-  rv_node = (raptor_abbrev_node*)raptor_avltree_search(nodes, lookup_node);
-  
-  /* If not found, insert/return a new one */
-  if(!rv_node) {
-    
-    if(raptor_avltree_add(nodes, lookup_node))
-      return NULL;
-    else
-      return lookup_node;
+  table->slots = RAPTOR_CALLOC(raptor_abbrev_table_slot*,
+                               RAPTOR_ABBREV_TABLE_MIN_SIZE,
+                               sizeof(raptor_abbrev_table_slot));
+  if(!table->slots) {
+    RAPTOR_FREE(raptor_abbrev_table, table);
+    return NULL;
+  }
+  table->world = world;
+  table->size = RAPTOR_ABBREV_TABLE_MIN_SIZE;
+  table->free_handler = free_handler;
+
+  return table;
+}
 
-  /* Found */
-  } else {
-    raptor_free_abbrev_node(lookup_node);
-    return rv_node;
+
+/**
+ * raptor_free_abbrev_table:
+ * @table: table
+ *
+ * INTERNAL - Destructor for raptor_abbrev_table; frees all items
+ **/
+void
+raptor_free_abbrev_table(raptor_abbrev_table* table)
+{
+  int i;
+
+  RAPTOR_ASSERT_OBJECT_POINTER_RETURN(table, raptor_abbrev_table);
+
+  if(table->free_handler) {
+    for(i = 0; i < table->size; i++) {
+      if(table->slots[i].term)
+        table->free_handler(table->slots[i].item);
+    }
+  }
+
+  RAPTOR_FREE(raptor_abbrev_table_slot*, table->slots);
+  RAPTOR_FREE(raptor_abbrev_table, table);
+}
+
+
+/**
+ * raptor_abbrev_table_size:
+ * @table: table
+ *
+ * INTERNAL - Get the number of items in a table
+ *
+ * Return value: number of items
+ **/
+int
+raptor_abbrev_table_size(raptor_abbrev_table* table)
+{
+  return table->count;
+}
+
+
+/* the slot index of @term or <0 if not in the table */
+static int
+raptor_abbrev_table_find(raptor_abbrev_table* table, raptor_term* term,
+                         unsigned int hash)
+{
+  raptor_abbrev_table_slot* slots = table->slots;
+  int mask = table->size - 1;
+  int i;
+
+  for(i = (int)(hash & (unsigned int)mask); slots[i].term;
+      i = (i + 1) & mask) {
+    if(slots[i].hash == hash && raptor_term_equals(slots[i].term, term))
+      return i;
   }
+
+  return -1;
+}
+
+
+/* add a term known not to be in the table to @slots */
+static void
+raptor_abbrev_table_put(raptor_abbrev_table* table, raptor_term* term,
+                        unsigned int hash, void* item)
+{
+  int mask = table->size - 1;
+  int i;
+
+  for(i = (int)(hash & (unsigned int)mask); table->slots[i].term;
+      i = (i + 1) & mask)
+    ;
+  table->slots[i].hash = hash;
+  table->slots[i].term = term;
+  table->slots[i].item = item;
+  table->count++;
+}
+
+
+/*
+ * raptor_abbrev_table_add:
+ * @table: table
+ * @term: key term not already in the table; owned by @item
+ * @hash: hash of @term
+ * @item: item
+ *
+ * INTERNAL - Add an item to a table
+ *
+ * The item becomes owned by the table.  On failure it is freed.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_abbrev_table_add(raptor_abbrev_table* table, raptor_term* term,
+                        unsigned int hash, void* item)
+{
+  if((table->count + 1) * 2 > table->size) {
+    raptor_abbrev_table_slot* old_slots = table->slots;
+    int old_size = table->size;
+    int i;
+
+    table->slots = RAPTOR_CALLOC(raptor_abbrev_table_slot*, old_size * 2,
+                                 sizeof(raptor_abbrev_table_slot));
+    if(!table->slots) {
+      table->slots = old_slots;
+      if(table->free_handler)
+        table->free_handler(item);
+      return 1;
+    }
+    table->size = old_size * 2;
+    table->count = 0;
+
+    for(i = 0; i < old_size; i++) {
+      if(old_slots[i].term)
+        raptor_abbrev_table_put(table, old_slots[i].term, old_slots[i].hash,
+                                old_slots[i].item);
+    }
+    RAPTOR_FREE(raptor_abbrev_table_slot*, old_slots);
+  }
+
+  raptor_abbrev_table_put(table, term, hash, item);
+
+  return 0;
+}
+
+
+/**
+ * raptor_abbrev_table_delete:
+ * @table: table
+ * @term: key term
+ *
+ * INTERNAL - Remove the item for a term from a table and free it
+ *
+ * Return value: non-0 if the term was not in the table
+ **/
+int
+raptor_abbrev_table_delete(raptor_abbrev_table* table, raptor_term* term)
+{
+  raptor_abbrev_table_slot* slots = table->slots;
+  int mask = table->size - 1;
+  void* item;
+  int i;
+  int j;
+
+  i = raptor_abbrev_table_find(table, term, raptor_abbrev_term_hash(term));
+  if(i < 0)
+    return 1;
+
+  item = slots[i].item;
+
+  /* shift back later entries whose probe sequence passes slot i */
+  for(j = (i + 1) & mask; slots[j].term; j = (j + 1) & mask) {
+    int home = (int)(slots[j].hash & (unsigned int)mask);
+
+    if(((j - home) & mask) >= ((j - i) & mask)) {
+      slots[i] = slots[j];
+      i = j;
+    }
+  }
+  slots[i].term = NULL;
+  slots[i].item = NULL;
+  table->count--;
+
+  if(table->free_handler)
+    table->free_handler(item);
+
+  return 0;
+}
+
+
+/* find or add the node for @term with hash @hash */
+static raptor_abbrev_node*
+raptor_abbrev_node_lookup_hash(raptor_abbrev_table* nodes, raptor_term* term,
+                               unsigned int hash)
+{
+  raptor_abbrev_node *node;
+  int i;
+
+  i = raptor_abbrev_table_find(nodes, term, hash);
+  if(i >= 0)
+    return (raptor_abbrev_node*)nodes->slots[i].item;
+
+  /* If not found, insert/return a new one */
+  node = raptor_new_abbrev_node(term->world, term);
+  if(!node)
+    return NULL;
+
+  if(raptor_abbrev_table_add(nodes, node->term, hash, node))
+    return NULL;
+
+  return node;
+}
+
+
+/**
+ * raptor_abbrev_node_lookup:
+ * @nodes: Table of nodes to search
+ * @node: Node value to search for
+ *
+ * INTERNAL - Look in a table of nodes for a node described by parameters
+ *   and if not present create it and add it
+ *
+ * Return value: the node found/created or NULL on failure
+ */
+raptor_abbrev_node* 
+raptor_abbrev_node_lookup(raptor_abbrev_table* nodes, raptor_term* term)
+{
+  return raptor_abbrev_node_lookup_hash(nodes, term,
+                                        raptor_abbrev_term_hash(term));
 }
 
 
@@ -363,21 +663,17 @@ raptor_abbrev_subject_add_property(raptor_abbrev_subject* subject,
   predicate->ref_count++;
   object->ref_count++;
 
-  if(raptor_avltree_search(subject->properties, nodes)) {
-    /* Already present - do not add a duplicate triple (s->[p o]) */
-    raptor_free_abbrev_po(nodes);
-    return 1;
-  }
-  
 #if 0
   fprintf(stderr, "Adding P,O ");
   raptor_print_abbrev_po(stderr, nodes);
 
   raptor_avltree_dump(subject->properties, stderr);
 #endif
+  /* Already present pairs are freed by the tree so that a duplicate
+   * triple (s->[p o]) is not added */
   err = raptor_avltree_add(subject->properties, nodes);
   if(err)
-    return -1;
+    return (err > 0) ? 1 : -1;
 #if 0
   fprintf(stderr, "Result ");
   raptor_avltree_print(subject->properties, stderr);
@@ -403,78 +699,110 @@ raptor_abbrev_subject_compare(raptor_abbrev_subject* subject1,
 
 /**
  * raptor_abbrev_subject_find:
- * @subjects: AVL-Tree of subject nodes
+ * @subjects: Table of subject nodes
  * @term: node to find
  *
- * INTERNAL - Find a subject node in an AVL-Tree of subject nodes
+ * INTERNAL - Find a subject node in a table of subject nodes
  *
- * Return value: node or NULL if not found or failure
+ * Return value: node or NULL if not found
  */
 raptor_abbrev_subject*
-raptor_abbrev_subject_find(raptor_avltree *subjects, raptor_term* node)
+raptor_abbrev_subject_find(raptor_abbrev_table *subjects, raptor_term* node)
 {
-  raptor_abbrev_subject* rv_subject = NULL;
-  raptor_abbrev_node* lookup_node = NULL;
-  raptor_abbrev_subject* lookup = NULL;
-
-  /* datatype and language are both NULL for a subject node */
-  
-  lookup_node = raptor_new_abbrev_node(node->world, node);
-  if(!lookup_node)
-    return NULL;
-  
-  lookup = raptor_new_abbrev_subject(lookup_node);
-  if(!lookup) {
-    raptor_free_abbrev_node(lookup_node);
-    return NULL;
-  }
-
-  rv_subject = (raptor_abbrev_subject*) raptor_avltree_search(subjects, lookup);
+  int i;
 
-  raptor_free_abbrev_subject(lookup);
-  raptor_free_abbrev_node(lookup_node);
+  i = raptor_abbrev_table_find(subjects, node, raptor_abbrev_term_hash(node));
 
-  return rv_subject;
+  return (i < 0) ? NULL : (raptor_abbrev_subject*)subjects->slots[i].item;
 }
 
 
 /**
  * raptor_abbrev_subject_lookup:
- * @nodes: AVL-Tree of subject nodes
- * @subjects: AVL-Tree of URI-subject nodes
- * @blanks: AVL-Tree of blank-subject nodes
+ * @nodes: Table of nodes
+ * @subjects: Table of URI-subject nodes
+ * @blanks: Table of blank-subject nodes
  * @term: node to find
  *
- * INTERNAL - Find a subject node in the appropriate uri/blank AVL-Tree of subject nodes or add it
+ * INTERNAL - Find a subject node in the appropriate uri/blank table of subject nodes or add it
  *
  * Return value: node or NULL on failure
  */
 raptor_abbrev_subject* 
-raptor_abbrev_subject_lookup(raptor_avltree* nodes,
-                             raptor_avltree* subjects, raptor_avltree* blanks,
+raptor_abbrev_subject_lookup(raptor_abbrev_table* nodes,
+                             raptor_abbrev_table* subjects,
+                             raptor_abbrev_table* blanks,
                              raptor_term* term)
 {
-  raptor_avltree *tree;
+  raptor_abbrev_table *table;
   raptor_abbrev_subject* rv_subject;
+  raptor_abbrev_node* node;
+  unsigned int hash;
+  int i;
 
   /* Search for specified resource. */
-  tree = (term->type == RAPTOR_TERM_TYPE_BLANK) ? blanks : subjects;
-  rv_subject = raptor_abbrev_subject_find(tree, term);
+  table = (term->type == RAPTOR_TERM_TYPE_BLANK) ? blanks : subjects;
+  hash = raptor_abbrev_term_hash(term);
+  i = raptor_abbrev_table_find(table, term, hash);
+  if(i >= 0)
+    return (raptor_abbrev_subject*)table->slots[i].item;
 
   /* If not found, create one and insert it */
-  if(!rv_subject) {
-    raptor_abbrev_node* node = raptor_abbrev_node_lookup(nodes, term);
-    if(node) {      
-      rv_subject = raptor_new_abbrev_subject(node);
-      if(rv_subject) {
-        if(raptor_avltree_add(tree, rv_subject)) {
-          rv_subject = NULL;
-        }
-      }
+  node = raptor_abbrev_node_lookup_hash(nodes, term, hash);
+  if(!node)
+    return NULL;
+
+  rv_subject = raptor_new_abbrev_subject(node);
+  if(!rv_subject)
+    return NULL;
+
+  if(raptor_abbrev_table_add(table, rv_subject->node->term, hash, rv_subject))
+    return NULL;
+
+  return rv_subject;
+}
+
+
+static int
+raptor_abbrev_subject_compare_p(const void* a, const void* b)
+{
+  return raptor_abbrev_subject_compare(*(raptor_abbrev_subject**)a,
+                                       *(raptor_abbrev_subject**)b);
+}
+
+
+/**
+ * raptor_abbrev_subjects_sort:
+ * @subjects: Table of subject nodes
+ *
+ * INTERNAL - Get the subjects of a table in term order
+ *
+ * The returned sequence does not own the subjects, which stay owned by
+ * @subjects and must not be added or removed while it is used.
+ *
+ * Return value: new sequence or NULL on failure
+ */
+raptor_sequence*
+raptor_abbrev_subjects_sort(raptor_abbrev_table* subjects)
+{
+  raptor_sequence* seq;
+  int i;
+
+  seq = raptor_new_sequence(NULL, NULL);
+  if(!seq)
+    return NULL;
+
+  for(i = 0; i < subjects->size; i++) {
+    if(subjects->slots[i].term &&
+       raptor_sequence_push(seq, subjects->slots[i].item)) {
+      raptor_free_sequence(seq);
+      return NULL;
     }
   }
 
-  return rv_subject;
+  raptor_sequence_sort(seq, raptor_abbrev_subject_compare_p);
+
+  return seq;
 }
 
 
@@ -0,0 +1,686 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * raptor_arena.c - Raptor arena allocator for short lived terms
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <raptor_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_TERM
+
+/* Raptor includes */
+#include "raptor2.h"
+#include "raptor_internal.h"
+
+
+/*
+ * An arena hands out memory from a chain of blocks by moving a
+ * pointer along the current block.  Nothing is freed on its own;
+ * raptor_arena_reset() empties every block at once and keeps them for
+ * the next round so a parser that resets after each statement stops
+ * calling malloc once the blocks are big enough.
+ *
+ * Terms made in an arena have a usage count of -1, like a static
+ * #raptor_statement: raptor_free_term() leaves them alone and
+ * raptor_term_copy() returns a heap copy that outlives the arena.
+ */
+
+#define RAPTOR_ARENA_DEFAULT_BLOCK_SIZE 16384
+
+/* all allocations are rounded up to keep pointers aligned */
+#define RAPTOR_ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+typedef struct raptor_arena_block_s {
+  struct raptor_arena_block_s* next;
+  size_t size;
+  size_t used;
+} raptor_arena_block;
+
+/* the block data follows the header */
+#define RAPTOR_ARENA_BLOCK_DATA(block) \
+  ((unsigned char*)(block) + RAPTOR_ARENA_ALIGN(sizeof(raptor_arena_block)))
+
+/* an arena term and the next one holding URIs to release on reset */
+typedef struct raptor_arena_term_s {
+  raptor_term term;
+  struct raptor_arena_term_s* next;
+} raptor_arena_term;
+
+struct raptor_arena_s {
+  size_t block_size;
+
+  raptor_arena_block* blocks;
+  /* block being allocated from; the blocks after it are empty */
+  raptor_arena_block* current;
+
+  /* terms with URI references */
+  raptor_arena_term* uri_terms;
+};
+
+
+/**
+ * raptor_new_arena:
+ * @block_size: size of each block or 0 for a default
+ *
+ * INTERNAL - Constructor - create an arena
+ *
+ * Return value: new arena or NULL on failure
+ */
+raptor_arena*
+raptor_new_arena(size_t block_size)
+{
+  raptor_arena* arena;
+
+  arena = RAPTOR_CALLOC(raptor_arena*, 1, sizeof(*arena));
+  if(!arena)
+    return NULL;
+
+  arena->block_size = block_size ? block_size : RAPTOR_ARENA_DEFAULT_BLOCK_SIZE;
+
+  return arena;
+}
+
+
+/**
+ * raptor_free_arena:
+ * @arena: arena
+ *
+ * INTERNAL - Destructor - destroy an arena and everything in it
+ */
+void
+raptor_free_arena(raptor_arena* arena)
+{
+  raptor_arena_block* block;
+
+  if(!arena)
+    return;
+
+  raptor_arena_reset(arena);
+
+  block = arena->blocks;
+  while(block) {
+    raptor_arena_block* next = block->next;
+
+    RAPTOR_FREE(raptor_arena_block, block);
+    block = next;
+  }
+
+  RAPTOR_FREE(raptor_arena, arena);
+}
+
+
+/**
+ * raptor_arena_alloc:
+ * @arena: arena
+ * @size: bytes wanted
+ *
+ * INTERNAL - Allocate memory that lasts until the arena is reset
+ *
+ * Return value: pointer to @size bytes, 8 byte aligned, or NULL on failure
+ */
+void*
+raptor_arena_alloc(raptor_arena* arena, size_t size)
+{
+  raptor_arena_block* block = arena->current;
+  void* ptr;
+
+  size = RAPTOR_ARENA_ALIGN(size);
+
+  if(!block || block->size - block->used < size) {
+    /* the block after the current one is empty; use it if big enough */
+    if(block && block->next && block->next->size >= size)
+      block = block->next;
+    else if(!block && arena->blocks && arena->blocks->size >= size)
+      block = arena->blocks;
+    else {
+      raptor_arena_block* new_block;
+      size_t block_size = arena->block_size;
+
+      if(block_size < size)
+        block_size = size;
+
+      new_block = (raptor_arena_block*)RAPTOR_MALLOC(unsigned char*,
+          RAPTOR_ARENA_ALIGN(sizeof(raptor_arena_block)) + block_size);
+      if(!new_block)
+        return NULL;
+
+      new_block->size = block_size;
+      new_block->used = 0;
+      if(block) {
+        new_block->next = block->next;
+        block->next = new_block;
+      } else {
+        new_block->next = arena->blocks;
+        arena->blocks = new_block;
+      }
+      block = new_block;
+    }
+    arena->current = block;
+  }
+
+  ptr = RAPTOR_ARENA_BLOCK_DATA(block) + block->used;
+  block->used += size;
+
+  return ptr;
+}
+
+
+/**
+ * raptor_arena_reset:
+ * @arena: arena
+ *
+ * INTERNAL - Release everything allocated from the arena
+ *
+ * Any terms made in the arena are no longer valid afterwards.  The
+ * blocks are kept for reuse.
+ */
+void
+raptor_arena_reset(raptor_arena* arena)
+{
+  raptor_arena_term* at;
+  raptor_arena_block* block;
+
+  for(at = arena->uri_terms; at; at = at->next) {
+    raptor_term* term = &at->term;
+
+    if(term->type == RAPTOR_TERM_TYPE_URI)
+      raptor_free_uri(term->value.uri);
+    else if(term->type == RAPTOR_TERM_TYPE_LITERAL)
+      raptor_free_uri(term->value.literal.datatype);
+  }
+  arena->uri_terms = NULL;
+
+  for(block = arena->blocks; block; block = block->next)
+    block->used = 0;
+
+  arena->current = arena->blocks;
+}
+
+
+static unsigned char*
+raptor_arena_strndup(raptor_arena* arena, const unsigned char* string,
+                     size_t length)
+{
+  unsigned char* copy;
+
+  copy = (unsigned char*)raptor_arena_alloc(arena, length + 1);
+  if(!copy)
+    return NULL;
+
+  if(length)
+    memcpy(copy, string, length);
+  copy[length] = '\0';
+
+  return copy;
+}
+
+
+static raptor_arena_term*
+raptor_arena_new_term(raptor_arena* arena, raptor_world* world,
+                      raptor_term_type type)
+{
+  raptor_arena_term* at;
+
+  at = (raptor_arena_term*)raptor_arena_alloc(arena, sizeof(*at));
+  if(!at)
+    return NULL;
+
+  memset(at, '\0', sizeof(*at));
+  /* owned by the arena - not usage counted */
+  at->term.usage = -1;
+  at->term.world = world;
+  at->term.type = type;
+
+  return at;
+}
+
+
+/**
+ * raptor_arena_new_term_from_uri:
+ * @arena: arena or NULL
+ * @world: raptor world
+ * @uri: uri
+ *
+ * INTERNAL - Constructor - raptor_new_term_from_uri() in an arena
+ *
+ * With a NULL @arena this is raptor_new_term_from_uri().
+ *
+ * Return value: new term or NULL on failure
+ */
+raptor_term*
+raptor_arena_new_term_from_uri(raptor_arena* arena, raptor_world* world,
+                               raptor_uri* uri)
+{
+  raptor_arena_term* at;
+
+  if(!arena)
+    return raptor_new_term_from_uri(world, uri);
+
+  if(!uri)
+    return NULL;
+
+  at = raptor_arena_new_term(arena, world, RAPTOR_TERM_TYPE_URI);
+  if(!at)
+    return NULL;
+
+  at->term.value.uri = raptor_uri_copy(uri);
+  at->next = arena->uri_terms;
+  arena->uri_terms = at;
+
+  return &at->term;
+}
+
+
+/**
+ * raptor_arena_new_term_from_literal:
+ * @arena: arena or NULL
+ * @world: raptor world
+ * @literal: UTF-8 encoded literal string (or NULL for empty literal)
+ * @datatype: literal datatype URI (or NULL)
+ * @language: literal language (or NULL for no language)
+ *
+ * INTERNAL - Constructor - raptor_new_term_from_literal() in an arena
+ *
+ * With a NULL @arena this is raptor_new_term_from_literal().
+ *
+ * Return value: new term or NULL on failure
+ */
+raptor_term*
+raptor_arena_new_term_from_literal(raptor_arena* arena, raptor_world* world,
+                                   const unsigned char* literal,
+                                   raptor_uri* datatype,
+                                   const unsigned char* language)
+{
+  raptor_arena_term* at;
+  unsigned char* new_literal;
+  unsigned char* new_language = NULL;
+  size_t literal_len = 0;
+  size_t language_len = 0;
+
+  if(!arena)
+    return raptor_new_term_from_literal(world, literal, datatype, language);
+
+  if(language && !*language)
+    language = NULL;
+
+  if(language && datatype)
+    return NULL;
+
+  if(literal)
+    literal_len = strlen((const char*)literal);
+
+  new_literal = raptor_arena_strndup(arena, literal, literal_len);
+  if(!new_literal)
+    return NULL;
+
+  if(language) {
+    unsigned char* l;
+
+    language_len = strlen((const char*)language);
+    new_language = raptor_arena_strndup(arena, language, language_len);
+    if(!new_language)
+      return NULL;
+
+    for(l = new_language; *l; l++) {
+      if(*l == '_')
+        *l = '-';
+    }
+  }
+
+  at = raptor_arena_new_term(arena, world, RAPTOR_TERM_TYPE_LITERAL);
+  if(!at)
+    return NULL;
+
+  at->term.value.literal.string = new_literal;
+  at->term.value.literal.string_len = RAPTOR_LANG_LEN_FROM_INT(literal_len);
+  at->term.value.literal.language = new_language;
+  at->term.value.literal.language_len = RAPTOR_GOOD_CAST(unsigned char, language_len);
+
+  if(datatype) {
+    at->term.value.literal.datatype = raptor_uri_copy(datatype);
+    at->next = arena->uri_terms;
+    arena->uri_terms = at;
+  }
+
+  return &at->term;
+}
+
+
+/**
+ * raptor_arena_new_term_from_blank:
+ * @arena: arena or NULL
+ * @world: raptor world
+ * @blank: UTF-8 encoded blank node identifier (or NULL)
+ *
+ * INTERNAL - Constructor - raptor_new_term_from_blank() in an arena
+ *
+ * With a NULL @arena this is raptor_new_term_from_blank().
+ *
+ * Return value: new term or NULL on failure
+ */
+raptor_term*
+raptor_arena_new_term_from_blank(raptor_arena* arena, raptor_world* world,
+                                 const unsigned char* blank)
+{
+  raptor_arena_term* at;
+  unsigned char* new_id;
+  size_t length;
+
+  if(!arena)
+    return raptor_new_term_from_blank(world, blank);
+
+  if(blank && *blank) {
+    length = strlen((const char*)blank);
+    new_id = raptor_arena_strndup(arena, blank, length);
+  } else {
+    unsigned char* id = raptor_world_generate_bnodeid(world);
+
+    if(!id)
+      return NULL;
+    length = strlen((const char*)id);
+    new_id = raptor_arena_strndup(arena, id, length);
+    RAPTOR_FREE(char*, id);
+  }
+  if(!new_id)
+    return NULL;
+
+  at = raptor_arena_new_term(arena, world, RAPTOR_TERM_TYPE_BLANK);
+  if(!at)
+    return NULL;
+
+  at->term.value.blank.string = new_id;
+  at->term.value.blank.string_len = RAPTOR_BAD_CAST(int, length);
+
+  return &at->term;
+}
+
+
+/*
+ * A free list keeps released objects of one size for the next
+ * allocation instead of returning them to malloc.  Each object is
+ * still a separate allocation so one that escapes the free list can
+ * be given to RAPTOR_FREE() or the destructor of its type as usual.
+ *
+ * Released objects are chained through their first pointer and handed
+ * out again most recently released first, which for a stack of parser
+ * elements means the object freed at one depth is the next one made
+ * at that depth.
+ */
+struct raptor_freelist_s {
+  size_t object_size;
+
+  /* frees what a released object owns before the object is freed */
+  raptor_data_free_handler clear_handler;
+
+  /* released objects */
+  void* head;
+};
+
+
+/**
+ * raptor_new_freelist:
+ * @object_size: size of each object
+ * @clear_handler: function to free what a released object still owns
+ *   when the free list is destroyed, or NULL
+ *
+ * INTERNAL - Constructor - create a free list of objects
+ *
+ * Return value: new free list or NULL on failure
+ */
+raptor_freelist*
+raptor_new_freelist(size_t object_size,
+                    raptor_data_free_handler clear_handler)
+{
+  raptor_freelist* freelist;
+
+  freelist = RAPTOR_CALLOC(raptor_freelist*, 1, sizeof(*freelist));
+  if(!freelist)
+    return NULL;
+
+  if(object_size < sizeof(void*))
+    object_size = sizeof(void*);
+  freelist->object_size = object_size;
+  freelist->clear_handler = clear_handler;
+
+  return freelist;
+}
+
+
+/**
+ * raptor_free_freelist:
+ * @freelist: free list
+ *
+ * INTERNAL - Destructor - destroy a free list and the objects released to it
+ */
+void
+raptor_free_freelist(raptor_freelist* freelist)
+{
+  void* object;
+
+  if(!freelist)
+    return;
+
+  object = freelist->head;
+  while(object) {
+    void* next = *(void**)object;
+
+    if(freelist->clear_handler)
+      freelist->clear_handler(object);
+    RAPTOR_FREE(void*, object);
+    object = next;
+  }
+
+  RAPTOR_FREE(raptor_freelist, freelist);
+}
+
+
+/**
+ * raptor_freelist_alloc:
+ * @freelist: free list
+ *
+ * INTERNAL - Get an object from a free list
+ *
+ * A new object is zeroed.  A reused object keeps the contents it was
+ * released with except for the first pointer sized field.
+ *
+ * Return value: object or NULL on failure
+ */
+void*
+raptor_freelist_alloc(raptor_freelist* freelist)
+{
+  void* object = freelist->head;
+
+  if(object) {
+    freelist->head = *(void**)object;
+    return object;
+  }
+
+  return RAPTOR_CALLOC(void*, 1, freelist->object_size);
+}
+
+
+/**
+ * raptor_freelist_release:
+ * @freelist: free list
+ * @object: object from raptor_freelist_alloc() or NULL
+ *
+ * INTERNAL - Give an object back to a free list for reuse
+ */
+void
+raptor_freelist_release(raptor_freelist* freelist, void* object)
+{
+  if(!object)
+    return;
+
+  *(void**)object = freelist->head;
+  freelist->head = object;
+}
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = raptor_basename(argv[0]);
+  raptor_world *world;
+  raptor_arena* arena;
+  raptor_freelist* freelist;
+  void* objects[3];
+  raptor_uri* uri;
+  raptor_term* terms[3];
+  raptor_term* copy;
+  unsigned char* p;
+  unsigned char* big;
+  int failures = 0;
+  int round;
+  int i;
+
+  world = raptor_new_world();
+  if(!world || raptor_world_open(world))
+    exit(1);
+
+  uri = raptor_new_uri(world, (const unsigned char*)"http://example.org/a");
+
+  /* small block so that the arena has to grow */
+  arena = raptor_new_arena(64);
+  if(!arena) {
+    fprintf(stderr, "%s: raptor_new_arena() failed\n", program);
+    exit(1);
+  }
+
+  for(round = 0; round < 3; round++) {
+    for(i = 0; i < 100; i++) {
+      p = (unsigned char*)raptor_arena_alloc(arena, (size_t)i + 1);
+      if(!p || ((size_t)p & 7)) {
+        fprintf(stderr, "%s: raptor_arena_alloc(%d) returned bad pointer %p\n",
+                program, i + 1, (void*)p);
+        failures++;
+        break;
+      }
+      memset(p, 'x', (size_t)i + 1);
+    }
+
+    /* bigger than a block */
+    big = (unsigned char*)raptor_arena_alloc(arena, 1000);
+    if(!big) {
+      fprintf(stderr, "%s: raptor_arena_alloc(1000) failed\n", program);
+      failures++;
+    } else
+      memset(big, 'y', 1000);
+
+    terms[0] = raptor_arena_new_term_from_uri(arena, world, uri);
+    terms[1] = raptor_arena_new_term_from_literal(arena, world,
+                                                  (const unsigned char*)"hello",
+                                                  NULL,
+                                                  (const unsigned char*)"en_GB");
+    terms[2] = raptor_arena_new_term_from_blank(arena, world,
+                                                (const unsigned char*)"b1");
+    if(!terms[0] || !terms[1] || !terms[2]) {
+      fprintf(stderr, "%s: arena term constructor failed\n", program);
+      failures++;
+      break;
+    }
+
+    if(strcmp((const char*)terms[1]->value.literal.language, "en-GB") ||
+       terms[1]->value.literal.string_len != 5) {
+      fprintf(stderr, "%s: arena literal has language '%s' length %u\n",
+              program, terms[1]->value.literal.language,
+              terms[1]->value.literal.string_len);
+      failures++;
+    }
+
+    for(i = 0; i < 3; i++) {
+      /* does nothing to an arena term */
+      raptor_free_term(terms[i]);
+
+      copy = raptor_term_copy(terms[i]);
+      if(!copy || copy == terms[i] || copy->usage != 1 ||
+         !raptor_term_equals(copy, terms[i])) {
+        fprintf(stderr, "%s: raptor_term_copy() of arena term %d failed\n",
+                program, i);
+        failures++;
+      }
+      raptor_free_term(copy);
+    }
+
+    raptor_arena_reset(arena);
+  }
+
+  raptor_free_arena(arena);
+
+  /* without an arena the public constructors are used */
+  copy = raptor_arena_new_term_from_uri(NULL, world, uri);
+  if(!copy || copy->usage != 1) {
+    fprintf(stderr, "%s: raptor_arena_new_term_from_uri(NULL) failed\n",
+            program);
+    failures++;
+  }
+  raptor_free_term(copy);
+
+  /* free list hands back the most recently released object first */
+  freelist = raptor_new_freelist(sizeof(raptor_term), NULL);
+  if(!freelist) {
+    fprintf(stderr, "%s: raptor_new_freelist() failed\n", program);
+    exit(1);
+  }
+
+  for(i = 0; i < 3; i++) {
+    objects[i] = raptor_freelist_alloc(freelist);
+    if(!objects[i] || ((raptor_term*)objects[i])->usage) {
+      fprintf(stderr, "%s: raptor_freelist_alloc() returned %p not zeroed\n",
+              program, objects[i]);
+      failures++;
+    }
+  }
+  ((raptor_term*)objects[1])->usage = 42;
+
+  raptor_freelist_release(freelist, objects[2]);
+  raptor_freelist_release(freelist, objects[1]);
+  if(raptor_freelist_alloc(freelist) != objects[1] ||
+     ((raptor_term*)objects[1])->usage != 42) {
+    fprintf(stderr, "%s: raptor_freelist_alloc() did not reuse last object\n",
+            program);
+    failures++;
+  }
+
+  /* an object that escapes is freed as usual */
+  RAPTOR_FREE(void*, objects[0]);
+  raptor_freelist_release(freelist, objects[1]);
+  raptor_free_freelist(freelist);
+
+  raptor_free_uri(uri);
+  raptor_free_world(world);
+
+  return failures;
+}
+
+#endif
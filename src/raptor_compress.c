@@ -0,0 +1,1838 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * raptor_compress.c - Raptor compressing and decompressing iostreams
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <raptor_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_BZLIB
+#include <bzlib.h>
+#endif
+
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_IOSTREAM
+
+/* Raptor includes */
+#include "raptor2.h"
+#include "raptor_internal.h"
+
+
+/*
+ * A compressing iostream collects the bytes written into blocks and
+ * compresses each block on its own, on the threads of a thread pool
+ * when asked for.  Compressed blocks are written to the output
+ * iostream in order.
+ *
+ * gzip writes a single gzip member.  Each block is compressed as raw
+ * deflate data using the last 32K of the previous block as a preset
+ * dictionary and ends with a sync flush so that the blocks join up
+ * into one deflate stream; the last block finishes the stream.  The
+ * CRC-32 of each block is combined into the trailer.
+ *
+ * zstd and bzip2 write each block as a separate frame or stream.
+ * Concatenated frames and streams decompress as one.
+ */
+
+#define RAPTOR_COMPRESS_BLOCK_SIZE (128 * 1024)
+#define RAPTOR_COMPRESS_DICTIONARY_SIZE (32 * 1024)
+
+
+typedef struct raptor_compress_context_s raptor_compress_context;
+
+typedef struct {
+  raptor_thread_task task;
+
+  raptor_compress_context* compressor;
+
+  unsigned char* input;
+  size_t input_length;
+
+  /* gzip: end of the previous block's input */
+  unsigned char* dictionary;
+  size_t dictionary_length;
+
+  /* non-0 for the last block */
+  int last;
+
+  unsigned char* output;
+  size_t output_size;
+  size_t output_length;
+
+  /* gzip: CRC-32 of the input */
+  unsigned long crc;
+
+  /* non-0 on failure */
+  int rc;
+} raptor_compress_block;
+
+
+struct raptor_compress_context_s {
+  raptor_world* world;
+
+  raptor_compression_type type;
+  int level;
+
+  /* output iostream and non-0 if owned */
+  raptor_iostream* iostr;
+  int free_iostr;
+
+  raptor_thread_pool* pool;
+
+  /* ring of blocks; @running blocks from @head are submitted */
+  raptor_compress_block* blocks;
+  int blocks_count;
+  int head;
+  int running;
+  int submitted;
+
+  /* block being filled */
+  raptor_compress_block* current;
+
+  /* gzip: CRC-32 and length modulo 2^32 of the input collected */
+  unsigned long crc;
+  unsigned long length;
+
+  int ended;
+  int failed;
+};
+
+
+static const unsigned char raptor_gzip_header[10] = {
+  0x1f, 0x8b, /* magic */
+  8,          /* deflate */
+  0,          /* no flags */
+  0, 0, 0, 0, /* no modification time */
+  0,          /* no extra flags */
+  255         /* unknown OS */
+};
+
+
+static int
+raptor_compress_block_grow_output(raptor_compress_block* block, size_t size)
+{
+  unsigned char* output;
+
+  if(block->output_size >= size)
+    return 0;
+
+  output = RAPTOR_REALLOC(unsigned char*, block->output, size);
+  if(!output)
+    return 1;
+
+  block->output = output;
+  block->output_size = size;
+  return 0;
+}
+
+
+#ifdef HAVE_ZLIB
+static int
+raptor_compress_block_gzip(raptor_compress_block* block, int level)
+{
+  z_stream strm;
+  int flush = block->last ? Z_FINISH : Z_SYNC_FLUSH;
+  int rc = 1;
+
+  memset(&strm, 0, sizeof(strm));
+  if(deflateInit2(&strm, level, Z_DEFLATED, -MAX_WBITS, 8,
+                  Z_DEFAULT_STRATEGY) != Z_OK)
+    return 1;
+
+  if(block->dictionary_length &&
+     deflateSetDictionary(&strm, block->dictionary,
+                          (uInt)block->dictionary_length) != Z_OK)
+    goto tidy;
+
+  /* deflateBound() does not count the sync flush marker */
+  if(raptor_compress_block_grow_output(block,
+                                       deflateBound(&strm, (uLong)block->input_length) + 16))
+    goto tidy;
+
+  strm.next_in = block->input;
+  strm.avail_in = (uInt)block->input_length;
+  block->output_length = 0;
+
+  while(1) {
+    int zrc;
+
+    strm.next_out = block->output + block->output_length;
+    strm.avail_out = (uInt)(block->output_size - block->output_length);
+
+    zrc = deflate(&strm, flush);
+    block->output_length = block->output_size - strm.avail_out;
+
+    if(zrc == Z_STREAM_ERROR)
+      goto tidy;
+
+    if(block->last ? (zrc == Z_STREAM_END) : (strm.avail_out > 0))
+      break;
+
+    if(raptor_compress_block_grow_output(block, block->output_size << 1))
+      goto tidy;
+  }
+
+  block->crc = crc32(0L, block->input, (uInt)block->input_length);
+  rc = 0;
+
+  tidy:
+  deflateEnd(&strm);
+  return rc;
+}
+#endif
+
+
+#ifdef HAVE_BZLIB
+static int
+raptor_compress_block_bzip2(raptor_compress_block* block, int level)
+{
+  unsigned int length;
+
+  /* bound from the libbz2 documentation */
+  if(raptor_compress_block_grow_output(block, block->input_length +
+                                       (block->input_length / 100) + 600))
+    return 1;
+
+  length = (unsigned int)block->output_size;
+  if(BZ2_bzBuffToBuffCompress((char*)block->output, &length,
+                              (char*)block->input,
+                              (unsigned int)block->input_length,
+                              level, 0, 0) != BZ_OK)
+    return 1;
+
+  block->output_length = length;
+  return 0;
+}
+#endif
+
+
+#ifdef HAVE_ZSTD
+static int
+raptor_compress_block_zstd(raptor_compress_block* block, int level)
+{
+  size_t length;
+
+  if(raptor_compress_block_grow_output(block,
+                                       ZSTD_compressBound(block->input_length)))
+    return 1;
+
+  length = ZSTD_compress(block->output, block->output_size,
+                         block->input, block->input_length, level);
+  if(ZSTD_isError(length))
+    return 1;
+
+  block->output_length = length;
+  return 0;
+}
+#endif
+
+
+/* thread pool task handler */
+static void
+raptor_compress_block_run(void* user_data)
+{
+  raptor_compress_block* block = (raptor_compress_block*)user_data;
+  raptor_compress_context* compressor = block->compressor;
+
+  block->rc = 1;
+  switch(compressor->type) {
+#ifdef HAVE_ZLIB
+    case RAPTOR_COMPRESSION_GZIP:
+      block->rc = raptor_compress_block_gzip(block, compressor->level);
+      break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case RAPTOR_COMPRESSION_ZSTD:
+      block->rc = raptor_compress_block_zstd(block, compressor->level);
+      break;
+#endif
+
+#ifdef HAVE_BZLIB
+    case RAPTOR_COMPRESSION_BZIP2:
+      block->rc = raptor_compress_block_bzip2(block, compressor->level);
+      break;
+#endif
+
+    default:
+      break;
+  }
+}
+
+
+/*
+ * raptor_compress_collect:
+ * @compressor: compressor
+ *
+ * Wait for the oldest submitted block and write its output
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_compress_collect(raptor_compress_context* compressor)
+{
+  raptor_compress_block* block = &compressor->blocks[compressor->head];
+  size_t length;
+
+  raptor_thread_pool_wait(compressor->pool, &block->task);
+  compressor->head = (compressor->head + 1) % compressor->blocks_count;
+  compressor->running--;
+
+  if(compressor->failed)
+    return 1;
+
+  if(block->rc) {
+    raptor_log_error(compressor->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                     "Compressing iostream block failed");
+    compressor->failed = 1;
+    return 1;
+  }
+
+#ifdef HAVE_ZLIB
+  if(compressor->type == RAPTOR_COMPRESSION_GZIP) {
+    compressor->crc = crc32_combine(compressor->crc, block->crc,
+                                    (z_off_t)block->input_length);
+    compressor->length += (unsigned long)block->input_length;
+  }
+#endif
+
+  length = block->output_length;
+  if(length &&
+     raptor_iostream_write_bytes(block->output, 1, length,
+                                 compressor->iostr) != (int)length) {
+    compressor->failed = 1;
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * raptor_compress_submit:
+ * @compressor: compressor
+ * @last: non-0 if this is the last block
+ *
+ * Submit the current block for compressing and start the next one,
+ * collecting the oldest block first if the ring is full
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_compress_submit(raptor_compress_context* compressor, int last)
+{
+  raptor_compress_block* block = compressor->current;
+  raptor_compress_block* next;
+  int index;
+
+  block->last = last;
+  raptor_thread_pool_submit(compressor->pool, &block->task);
+  compressor->running++;
+  compressor->submitted++;
+
+  if(last)
+    return 0;
+
+  if(compressor->running == compressor->blocks_count &&
+     raptor_compress_collect(compressor))
+    return 1;
+
+  index = (compressor->head + compressor->running) % compressor->blocks_count;
+  next = &compressor->blocks[index];
+
+  if(compressor->type == RAPTOR_COMPRESSION_GZIP) {
+    size_t length = block->input_length;
+
+    if(length > RAPTOR_COMPRESS_DICTIONARY_SIZE)
+      length = RAPTOR_COMPRESS_DICTIONARY_SIZE;
+    memcpy(next->dictionary, block->input + block->input_length - length,
+           length);
+    next->dictionary_length = length;
+  }
+
+  next->input_length = 0;
+  compressor->current = next;
+  return 0;
+}
+
+
+/*
+ * raptor_compress_end:
+ * @compressor: compressor
+ *
+ * Compress the last block, write everything out and the gzip trailer
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_compress_end(raptor_compress_context* compressor)
+{
+  if(compressor->ended)
+    return compressor->failed;
+  compressor->ended = 1;
+
+  /* gzip always needs the end of the deflate stream; zstd and bzip2
+   * write an empty frame or stream only when there was no data */
+  if(!compressor->failed &&
+     (compressor->current->input_length ||
+      compressor->type == RAPTOR_COMPRESSION_GZIP ||
+      !compressor->submitted))
+    raptor_compress_submit(compressor, 1);
+
+  while(compressor->running)
+    raptor_compress_collect(compressor);
+
+  if(compressor->failed)
+    return 1;
+
+  if(compressor->type == RAPTOR_COMPRESSION_GZIP) {
+    unsigned char trailer[8];
+    int i;
+
+    for(i = 0; i < 4; i++) {
+      trailer[i] = (unsigned char)((compressor->crc >> (i << 3)) & 0xff);
+      trailer[i + 4] = (unsigned char)((compressor->length >> (i << 3)) & 0xff);
+    }
+    if(raptor_iostream_write_bytes(trailer, 1, 8, compressor->iostr) != 8)
+      compressor->failed = 1;
+  }
+
+  if(!compressor->failed && raptor_iostream_flush(compressor->iostr))
+    compressor->failed = 1;
+
+  return compressor->failed;
+}
+
+
+static void
+raptor_free_compress_context(raptor_compress_context* compressor)
+{
+  if(compressor->blocks) {
+    int i;
+
+    for(i = 0; i < compressor->blocks_count; i++) {
+      raptor_compress_block* block = &compressor->blocks[i];
+
+      if(block->input)
+        RAPTOR_FREE(char*, block->input);
+      if(block->dictionary)
+        RAPTOR_FREE(char*, block->dictionary);
+      if(block->output)
+        RAPTOR_FREE(char*, block->output);
+    }
+    RAPTOR_FREE(raptor_compress_block*, compressor->blocks);
+  }
+
+  if(compressor->pool)
+    raptor_free_thread_pool(compressor->pool);
+
+  if(compressor->free_iostr && compressor->iostr)
+    raptor_free_iostream(compressor->iostr);
+
+  RAPTOR_FREE(raptor_compress_context, compressor);
+}
+
+
+/**
+ * raptor_compression_is_supported:
+ * @type: compression format
+ *
+ * Check if a compression format is supported by this raptor build
+ *
+ * Supported formats can be used with the compressing writers such as
+ * raptor_new_iostream_to_compressed_iostream() and are recognised
+ * when reading with raptor_new_iostream_from_compressed_iostream().
+ *
+ * Return value: non-0 if @type is supported
+ **/
+int
+raptor_compression_is_supported(raptor_compression_type type)
+{
+  switch(type) {
+#ifdef HAVE_ZLIB
+    case RAPTOR_COMPRESSION_GZIP:
+      return 1;
+#endif
+#ifdef HAVE_ZSTD
+    case RAPTOR_COMPRESSION_ZSTD:
+      return 1;
+#endif
+#ifdef HAVE_BZLIB
+    case RAPTOR_COMPRESSION_BZIP2:
+      return 1;
+#endif
+    default:
+      return 0;
+  }
+}
+
+
+static raptor_compress_context*
+raptor_new_compress_context(raptor_world* world, raptor_iostream* iostr,
+                            raptor_compression_type type, int level,
+                            int threads)
+{
+  raptor_compress_context* compressor;
+  int min_level = -1;
+  int max_level = 0;
+  int i;
+
+  switch(type) {
+#ifdef HAVE_ZLIB
+    case RAPTOR_COMPRESSION_GZIP:
+      max_level = 9;
+      break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case RAPTOR_COMPRESSION_ZSTD:
+      max_level = ZSTD_maxCLevel();
+      /* 0 is the zstd default level */
+      if(level < 0)
+        level = 0;
+      break;
+#endif
+
+#ifdef HAVE_BZLIB
+    case RAPTOR_COMPRESSION_BZIP2:
+      min_level = 1;
+      max_level = 9;
+      if(level < 0)
+        level = 9;
+      break;
+#endif
+
+    default:
+      raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                                 "Compression type %d is not supported",
+                                 (int)type);
+      return NULL;
+  }
+
+  if(level < min_level || level > max_level) {
+    raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                               "Compression level %d is out of range",
+                               level);
+    return NULL;
+  }
+
+  compressor = RAPTOR_CALLOC(raptor_compress_context*, 1,
+                             sizeof(*compressor));
+  if(!compressor)
+    return NULL;
+
+  compressor->world = world;
+  compressor->type = type;
+  compressor->level = level;
+
+  compressor->pool = raptor_new_thread_pool(threads > 1 ? threads : 0);
+  if(!compressor->pool)
+    goto failed;
+
+  /* enough blocks to keep every thread busy while the oldest is written */
+  threads = raptor_thread_pool_get_threads_count(compressor->pool);
+  compressor->blocks_count = threads ? (threads << 1) : 1;
+
+  compressor->blocks = RAPTOR_CALLOC(raptor_compress_block*,
+                                     RAPTOR_GOOD_CAST(size_t, compressor->blocks_count),
+                                     sizeof(raptor_compress_block));
+  if(!compressor->blocks)
+    goto failed;
+
+  for(i = 0; i < compressor->blocks_count; i++) {
+    raptor_compress_block* block = &compressor->blocks[i];
+
+    block->task.handler = raptor_compress_block_run;
+    block->task.user_data = block;
+    block->compressor = compressor;
+
+    block->input = RAPTOR_MALLOC(unsigned char*, RAPTOR_COMPRESS_BLOCK_SIZE);
+    if(!block->input)
+      goto failed;
+
+    if(type == RAPTOR_COMPRESSION_GZIP) {
+      block->dictionary = RAPTOR_MALLOC(unsigned char*,
+                                        RAPTOR_COMPRESS_DICTIONARY_SIZE);
+      if(!block->dictionary)
+        goto failed;
+    }
+  }
+  compressor->current = &compressor->blocks[0];
+
+  if(type == RAPTOR_COMPRESSION_GZIP &&
+     raptor_iostream_write_bytes(raptor_gzip_header, 1, 10, iostr) != 10)
+    goto failed;
+
+  /* owned only once everything else has succeeded */
+  compressor->iostr = iostr;
+  return compressor;
+
+  failed:
+  raptor_free_compress_context(compressor);
+  return NULL;
+}
+
+
+/* iostream handler methods */
+
+static void
+raptor_compress_iostream_finish(void *user_data)
+{
+  raptor_compress_context* compressor = (raptor_compress_context*)user_data;
+
+  raptor_compress_end(compressor);
+  raptor_free_compress_context(compressor);
+}
+
+
+static int
+raptor_compress_iostream_write_bytes(void *user_data,
+                                     const void *ptr, size_t size,
+                                     size_t nmemb)
+{
+  raptor_compress_context* compressor = (raptor_compress_context*)user_data;
+  const unsigned char* p = (const unsigned char*)ptr;
+  size_t length = size * nmemb;
+
+  if(compressor->failed || compressor->ended)
+    return 0;
+
+  while(length) {
+    raptor_compress_block* block = compressor->current;
+    size_t n = RAPTOR_COMPRESS_BLOCK_SIZE - block->input_length;
+
+    if(n > length)
+      n = length;
+
+    memcpy(block->input + block->input_length, p, n);
+    block->input_length += n;
+    p += n;
+    length -= n;
+
+    if(block->input_length == RAPTOR_COMPRESS_BLOCK_SIZE &&
+       raptor_compress_submit(compressor, 0))
+      return 0;
+  }
+
+  return RAPTOR_BAD_CAST(int, nmemb);
+}
+
+
+static int
+raptor_compress_iostream_write_byte(void *user_data, const int byte)
+{
+  unsigned char c = RAPTOR_GOOD_CAST(unsigned char, byte);
+
+  return (raptor_compress_iostream_write_bytes(user_data, &c, 1, 1) != 1);
+}
+
+
+static int
+raptor_compress_iostream_write_end(void *user_data)
+{
+  raptor_compress_context* compressor = (raptor_compress_context*)user_data;
+
+  return raptor_compress_end(compressor);
+}
+
+
+static const raptor_iostream_handler raptor_compress_iostream_handler = {
+  /* .version     = */ 2,
+  /* .init        = */ NULL,
+  /* .finish      = */ raptor_compress_iostream_finish,
+  /* .write_byte  = */ raptor_compress_iostream_write_byte,
+  /* .write_bytes = */ raptor_compress_iostream_write_bytes,
+  /* .write_end   = */ raptor_compress_iostream_write_end,
+  /* .read_bytes  = */ NULL,
+  /* .read_eof    = */ NULL
+};
+
+
+/**
+ * raptor_new_iostream_to_compressed_iostream:
+ * @world: raptor world
+ * @iostr: output iostream
+ * @type: compression format
+ * @level: compression level or -1 for the format's default
+ * @threads: number of threads to compress with; 0 or 1 to compress on the calling thread
+ *
+ * Constructor - create a new iostream compressing what is written to it into another iostream.
+ *
+ * The output is written in blocks as they are compressed and ends
+ * when raptor_iostream_write_end() is called or the iostream is
+ * destroyed.  @iostr is not owned and must not be destroyed before
+ * the new iostream.
+ *
+ * Using several threads splits the data into independently
+ * compressed blocks so the output is a little larger than compressing
+ * on one thread with gzip(1) or zstd(1).
+ *
+ * Return value: new #raptor_iostream object or NULL on failure or
+ * if the @type is not supported
+ **/
+raptor_iostream*
+raptor_new_iostream_to_compressed_iostream(raptor_world* world,
+                                           raptor_iostream* iostr,
+                                           raptor_compression_type type,
+                                           int level, int threads)
+{
+  raptor_compress_context* compressor;
+  raptor_iostream* ciostr;
+
+  RAPTOR_CHECK_CONSTRUCTOR_WORLD(world);
+  RAPTOR_ASSERT_OBJECT_POINTER_RETURN_VALUE(iostr, raptor_iostream, NULL);
+
+  raptor_world_open(world);
+
+  compressor = raptor_new_compress_context(world, iostr, type, level,
+                                           threads);
+  if(!compressor)
+    return NULL;
+
+  ciostr = raptor_new_iostream_from_handler(world, compressor,
+                                            &raptor_compress_iostream_handler);
+  if(!ciostr)
+    raptor_free_compress_context(compressor);
+
+  return ciostr;
+}
+
+
+/**
+ * raptor_new_iostream_to_compressed_filename:
+ * @world: raptor world
+ * @filename: Output filename to open and write to
+ * @type: compression format
+ * @level: compression level or -1 for the format's default
+ * @threads: number of threads to compress with; 0 or 1 to compress on the calling thread
+ *
+ * Constructor - create a new iostream writing compressed data to a filename.
+ *
+ * See raptor_new_iostream_to_compressed_iostream() for details.
+ *
+ * Return value: new #raptor_iostream object or NULL on failure or
+ * if the @type is not supported
+ **/
+raptor_iostream*
+raptor_new_iostream_to_compressed_filename(raptor_world* world,
+                                           const char *filename,
+                                           raptor_compression_type type,
+                                           int level, int threads)
+{
+  raptor_iostream* iostr;
+  raptor_compress_context* compressor;
+  raptor_iostream* ciostr;
+
+  RAPTOR_CHECK_CONSTRUCTOR_WORLD(world);
+
+  raptor_world_open(world);
+
+  iostr = raptor_new_iostream_to_filename(world, filename);
+  if(!iostr)
+    return NULL;
+
+  compressor = raptor_new_compress_context(world, iostr, type, level,
+                                           threads);
+  if(!compressor) {
+    raptor_free_iostream(iostr);
+    return NULL;
+  }
+  compressor->free_iostr = 1;
+
+  ciostr = raptor_new_iostream_from_handler(world, compressor,
+                                            &raptor_compress_iostream_handler);
+  if(!ciostr)
+    raptor_free_compress_context(compressor);
+
+  return ciostr;
+}
+
+
+/*
+ * A decompressing iostream reads compressed data from another
+ * iostream.  The format is picked from the magic bytes at the start
+ * and data without known magic bytes is passed through unchanged.
+ * Concatenated gzip members, zstd frames and bzip2 streams are read
+ * as one.
+ *
+ * Decompressing is done by a thread pool task that fills one of two
+ * buffers while the reader takes bytes from the other, so with
+ * threads decompressing overlaps parsing.  Only one task is queued at
+ * a time so the decoder and the input iostream are only used by one
+ * thread at a time.
+ */
+
+#define RAPTOR_DECOMPRESS_BUFFER_SIZE (256 * 1024)
+#define RAPTOR_DECOMPRESS_INPUT_SIZE (64 * 1024)
+
+
+typedef struct raptor_decompress_context_s raptor_decompress_context;
+
+typedef struct {
+  raptor_thread_task task;
+
+  raptor_decompress_context* decompressor;
+
+  unsigned char* data;
+  size_t length;
+
+  /* non-0 if this is the end of the data */
+  int eof;
+
+  /* error message on failure; logged by the reader */
+  const char* error;
+} raptor_decompress_buffer;
+
+
+struct raptor_decompress_context_s {
+  raptor_world* world;
+
+  /* input iostream and non-0 if owned */
+  raptor_iostream* iostr;
+  int free_iostr;
+
+  raptor_thread_pool* pool;
+
+  /* fields from here to @buffers are only used by the task */
+  raptor_compression_type type;
+  int started;
+
+  unsigned char* input;
+  size_t input_offset;
+  size_t input_length;
+  int input_eof;
+
+  /* non-0 between members, frames or streams */
+  int stream_end;
+
+#ifdef HAVE_ZLIB
+  z_stream zstream;
+  int zstream_init;
+#endif
+#ifdef HAVE_ZSTD
+  ZSTD_DStream* zstd;
+#endif
+#ifdef HAVE_BZLIB
+  bz_stream bzstream;
+  int bzstream_init;
+#endif
+
+  raptor_decompress_buffer buffers[2];
+
+  /* buffer being read and the offset into it */
+  int current;
+  size_t offset;
+
+  /* non-0 if the other buffer has been submitted */
+  int pending;
+
+  int failed;
+};
+
+
+/**
+ * raptor_compression_guess:
+ * @buffer: bytes from the start of the data
+ * @length: length of @buffer
+ *
+ * INTERNAL - Guess the compression format from magic bytes
+ *
+ * Four bytes are enough to recognise every format.
+ *
+ * Return value: compression type or RAPTOR_COMPRESSION_NONE if not recognised
+ */
+raptor_compression_type
+raptor_compression_guess(const unsigned char* buffer, size_t length)
+{
+  if(length >= 2 && buffer[0] == 0x1f && buffer[1] == 0x8b)
+    return RAPTOR_COMPRESSION_GZIP;
+
+  if(length >= 4 && buffer[0] == 0x28 && buffer[1] == 0xb5 &&
+     buffer[2] == 0x2f && buffer[3] == 0xfd)
+    return RAPTOR_COMPRESSION_ZSTD;
+
+  if(length >= 4 && buffer[0] == 'B' && buffer[1] == 'Z' &&
+     buffer[2] == 'h' && buffer[3] >= '1' && buffer[3] <= '9')
+    return RAPTOR_COMPRESSION_BZIP2;
+
+  return RAPTOR_COMPRESSION_NONE;
+}
+
+
+static int
+raptor_decompress_read_input(raptor_decompress_context* decompressor)
+{
+  size_t length = decompressor->input_length - decompressor->input_offset;
+  int n;
+
+  if(decompressor->input_offset) {
+    memmove(decompressor->input,
+            decompressor->input + decompressor->input_offset, length);
+    decompressor->input_offset = 0;
+    decompressor->input_length = length;
+  }
+
+  n = raptor_iostream_read_bytes(decompressor->input + length, 1,
+                                 RAPTOR_DECOMPRESS_INPUT_SIZE - length,
+                                 decompressor->iostr);
+  if(n < 0)
+    return 1;
+
+  if(!n)
+    decompressor->input_eof = 1;
+  else
+    decompressor->input_length += RAPTOR_GOOD_CAST(size_t, n);
+
+  return 0;
+}
+
+
+/* Read the magic bytes and set up the decoder */
+static const char*
+raptor_decompress_start(raptor_decompress_context* decompressor)
+{
+  while(decompressor->input_length < 4 && !decompressor->input_eof) {
+    if(raptor_decompress_read_input(decompressor))
+      return "Reading compressed input failed";
+  }
+
+  decompressor->type = raptor_compression_guess(decompressor->input,
+                                                decompressor->input_length);
+  switch(decompressor->type) {
+    case RAPTOR_COMPRESSION_NONE:
+      decompressor->stream_end = 1;
+      break;
+
+#ifdef HAVE_ZLIB
+    case RAPTOR_COMPRESSION_GZIP:
+      /* 16 selects gzip decoding */
+      if(inflateInit2(&decompressor->zstream, 16 + MAX_WBITS) != Z_OK)
+        return "Failed to start gzip decompression";
+      decompressor->zstream_init = 1;
+      break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case RAPTOR_COMPRESSION_ZSTD:
+      decompressor->zstd = ZSTD_createDStream();
+      if(!decompressor->zstd || ZSTD_isError(ZSTD_initDStream(decompressor->zstd)))
+        return "Failed to start zstd decompression";
+      break;
+#endif
+
+#ifdef HAVE_BZLIB
+    case RAPTOR_COMPRESSION_BZIP2:
+      if(BZ2_bzDecompressInit(&decompressor->bzstream, 0, 0) != BZ_OK)
+        return "Failed to start bzip2 decompression";
+      decompressor->bzstream_init = 1;
+      break;
+#endif
+
+#ifndef HAVE_ZLIB
+    case RAPTOR_COMPRESSION_GZIP:
+      return "gzip compressed input is not supported";
+#endif
+
+#ifndef HAVE_ZSTD
+    case RAPTOR_COMPRESSION_ZSTD:
+      return "zstd compressed input is not supported";
+#endif
+
+#ifndef HAVE_BZLIB
+    case RAPTOR_COMPRESSION_BZIP2:
+      return "bzip2 compressed input is not supported";
+#endif
+  }
+
+  decompressor->started = 1;
+  return NULL;
+}
+
+
+/*
+ * raptor_decompress_step:
+ * @decompressor: decompressor with input available
+ * @buffer: buffer with space
+ *
+ * Decode some input into the buffer
+ *
+ * Return value: error message or NULL on success
+ */
+static const char*
+raptor_decompress_step(raptor_decompress_context* decompressor,
+                       raptor_decompress_buffer* buffer)
+{
+  unsigned char* in = decompressor->input + decompressor->input_offset;
+  size_t in_length = decompressor->input_length - decompressor->input_offset;
+  unsigned char* out = buffer->data + buffer->length;
+  size_t out_length = RAPTOR_DECOMPRESS_BUFFER_SIZE - buffer->length;
+
+  switch(decompressor->type) {
+#ifdef HAVE_ZLIB
+    case RAPTOR_COMPRESSION_GZIP:
+    {
+      z_stream* strm = &decompressor->zstream;
+      int zrc;
+
+      if(decompressor->stream_end) {
+        /* another gzip member follows */
+        inflateReset(strm);
+        decompressor->stream_end = 0;
+      }
+
+      strm->next_in = in;
+      strm->avail_in = (uInt)in_length;
+      strm->next_out = out;
+      strm->avail_out = (uInt)out_length;
+      zrc = inflate(strm, Z_NO_FLUSH);
+      in_length = strm->avail_in;
+      out_length = strm->avail_out;
+
+      if(zrc == Z_STREAM_END)
+        decompressor->stream_end = 1;
+      else if(zrc != Z_OK && zrc != Z_BUF_ERROR)
+        return "gzip compressed input is corrupt";
+      break;
+    }
+#endif
+
+#ifdef HAVE_ZSTD
+    case RAPTOR_COMPRESSION_ZSTD:
+    {
+      ZSTD_inBuffer zin;
+      ZSTD_outBuffer zout;
+      size_t zrc;
+
+      zin.src = in;
+      zin.size = in_length;
+      zin.pos = 0;
+      zout.dst = out;
+      zout.size = out_length;
+      zout.pos = 0;
+      zrc = ZSTD_decompressStream(decompressor->zstd, &zout, &zin);
+      in_length -= zin.pos;
+      out_length -= zout.pos;
+
+      if(ZSTD_isError(zrc))
+        return "zstd compressed input is corrupt";
+      /* 0 when a frame is complete and flushed */
+      decompressor->stream_end = !zrc;
+      break;
+    }
+#endif
+
+#ifdef HAVE_BZLIB
+    case RAPTOR_COMPRESSION_BZIP2:
+    {
+      bz_stream* strm = &decompressor->bzstream;
+      int bzrc;
+
+      if(decompressor->stream_end) {
+        /* another bzip2 stream follows */
+        BZ2_bzDecompressEnd(strm);
+        memset(strm, 0, sizeof(*strm));
+        decompressor->bzstream_init = 0;
+        if(BZ2_bzDecompressInit(strm, 0, 0) != BZ_OK)
+          return "Failed to start bzip2 decompression";
+        decompressor->bzstream_init = 1;
+        decompressor->stream_end = 0;
+      }
+
+      strm->next_in = (char*)in;
+      strm->avail_in = (unsigned int)in_length;
+      strm->next_out = (char*)out;
+      strm->avail_out = (unsigned int)out_length;
+      bzrc = BZ2_bzDecompress(strm);
+      in_length = strm->avail_in;
+      out_length = strm->avail_out;
+
+      if(bzrc == BZ_STREAM_END)
+        decompressor->stream_end = 1;
+      else if(bzrc != BZ_OK)
+        return "bzip2 compressed input is corrupt";
+      break;
+    }
+#endif
+
+    default:
+    {
+      /* not compressed */
+      size_t n = (out_length < in_length) ? out_length : in_length;
+
+      memcpy(out, in, n);
+      in_length -= n;
+      out_length -= n;
+      break;
+    }
+  }
+
+  decompressor->input_offset = decompressor->input_length - in_length;
+  buffer->length = RAPTOR_DECOMPRESS_BUFFER_SIZE - out_length;
+
+  return NULL;
+}
+
+
+/* thread pool task handler: fill a buffer */
+static void
+raptor_decompress_buffer_fill(void* user_data)
+{
+  raptor_decompress_buffer* buffer = (raptor_decompress_buffer*)user_data;
+  raptor_decompress_context* decompressor = buffer->decompressor;
+
+  buffer->length = 0;
+  buffer->eof = 0;
+  buffer->error = NULL;
+
+  if(!decompressor->started) {
+    buffer->error = raptor_decompress_start(decompressor);
+    if(buffer->error)
+      return;
+  }
+
+  while(buffer->length < RAPTOR_DECOMPRESS_BUFFER_SIZE) {
+    size_t input_offset;
+    size_t length;
+
+    if(decompressor->input_offset == decompressor->input_length) {
+      if(decompressor->input_eof) {
+        if(!decompressor->stream_end)
+          buffer->error = "Compressed input is truncated";
+        else
+          buffer->eof = 1;
+        return;
+      }
+
+      if(raptor_decompress_read_input(decompressor)) {
+        buffer->error = "Reading compressed input failed";
+        return;
+      }
+      continue;
+    }
+
+    input_offset = decompressor->input_offset;
+    length = buffer->length;
+
+    buffer->error = raptor_decompress_step(decompressor, buffer);
+    if(buffer->error)
+      return;
+
+    /* a decoder that can neither read nor write is stuck */
+    if(decompressor->input_offset == input_offset &&
+       buffer->length == length) {
+      buffer->error = "Compressed input is corrupt";
+      return;
+    }
+  }
+}
+
+
+/*
+ * raptor_decompress_next:
+ * @decompressor: decompressor
+ *
+ * Switch to the other buffer when it is filled and start refilling
+ * the one just read
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_decompress_next(raptor_decompress_context* decompressor)
+{
+  int next = 1 - decompressor->current;
+  raptor_decompress_buffer* buffer = &decompressor->buffers[next];
+
+  if(!decompressor->pending)
+    raptor_thread_pool_submit(decompressor->pool, &buffer->task);
+  raptor_thread_pool_wait(decompressor->pool, &buffer->task);
+  decompressor->pending = 0;
+
+  if(buffer->error) {
+    raptor_log_error(decompressor->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                     buffer->error);
+    decompressor->failed = 1;
+    return 1;
+  }
+
+  decompressor->current = next;
+  decompressor->offset = 0;
+
+  if(!buffer->eof) {
+    raptor_thread_pool_submit(decompressor->pool,
+                              &decompressor->buffers[1 - next].task);
+    decompressor->pending = 1;
+  }
+
+  return 0;
+}
+
+
+static void
+raptor_free_decompress_context(raptor_decompress_context* decompressor)
+{
+  int i;
+
+  if(decompressor->pending)
+    raptor_thread_pool_wait(decompressor->pool,
+                            &decompressor->buffers[1 - decompressor->current].task);
+
+  if(decompressor->pool)
+    raptor_free_thread_pool(decompressor->pool);
+
+#ifdef HAVE_ZLIB
+  if(decompressor->zstream_init)
+    inflateEnd(&decompressor->zstream);
+#endif
+#ifdef HAVE_ZSTD
+  if(decompressor->zstd)
+    ZSTD_freeDStream(decompressor->zstd);
+#endif
+#ifdef HAVE_BZLIB
+  if(decompressor->bzstream_init)
+    BZ2_bzDecompressEnd(&decompressor->bzstream);
+#endif
+
+  for(i = 0; i < 2; i++) {
+    if(decompressor->buffers[i].data)
+      RAPTOR_FREE(char*, decompressor->buffers[i].data);
+  }
+
+  if(decompressor->input)
+    RAPTOR_FREE(char*, decompressor->input);
+
+  if(decompressor->free_iostr && decompressor->iostr)
+    raptor_free_iostream(decompressor->iostr);
+
+  RAPTOR_FREE(raptor_decompress_context, decompressor);
+}
+
+
+static raptor_decompress_context*
+raptor_new_decompress_context(raptor_world* world, raptor_iostream* iostr)
+{
+  raptor_decompress_context* decompressor;
+  int i;
+
+  decompressor = RAPTOR_CALLOC(raptor_decompress_context*, 1,
+                               sizeof(*decompressor));
+  if(!decompressor)
+    return NULL;
+
+  decompressor->world = world;
+
+  /* one thread is enough to keep ahead of a parser */
+  decompressor->pool = raptor_new_thread_pool(1);
+  if(!decompressor->pool)
+    goto failed;
+
+  decompressor->input = RAPTOR_MALLOC(unsigned char*,
+                                      RAPTOR_DECOMPRESS_INPUT_SIZE);
+  if(!decompressor->input)
+    goto failed;
+
+  for(i = 0; i < 2; i++) {
+    raptor_decompress_buffer* buffer = &decompressor->buffers[i];
+
+    buffer->task.handler = raptor_decompress_buffer_fill;
+    buffer->task.user_data = buffer;
+    buffer->decompressor = decompressor;
+
+    buffer->data = RAPTOR_MALLOC(unsigned char*,
+                                 RAPTOR_DECOMPRESS_BUFFER_SIZE);
+    if(!buffer->data)
+      goto failed;
+  }
+
+  decompressor->iostr = iostr;
+  return decompressor;
+
+  failed:
+  raptor_free_decompress_context(decompressor);
+  return NULL;
+}
+
+
+/* iostream handler methods */
+
+static void
+raptor_decompress_iostream_finish(void *user_data)
+{
+  raptor_decompress_context* decompressor;
+
+  decompressor = (raptor_decompress_context*)user_data;
+  raptor_free_decompress_context(decompressor);
+}
+
+
+static int
+raptor_decompress_iostream_read_bytes(void *user_data,
+                                      void *ptr, size_t size, size_t nmemb)
+{
+  raptor_decompress_context* decompressor;
+  unsigned char* p = (unsigned char*)ptr;
+  size_t total;
+  size_t length = 0;
+
+  if(!ptr || size <= 0 || !nmemb)
+    return -1;
+
+  decompressor = (raptor_decompress_context*)user_data;
+  if(decompressor->failed)
+    return -1;
+
+  total = size * nmemb;
+  while(length < total) {
+    raptor_decompress_buffer* buffer;
+    size_t n;
+
+    buffer = &decompressor->buffers[decompressor->current];
+    if(decompressor->offset == buffer->length) {
+      if(buffer->eof)
+        break;
+      if(raptor_decompress_next(decompressor))
+        return -1;
+      continue;
+    }
+
+    n = buffer->length - decompressor->offset;
+    if(n > total - length)
+      n = total - length;
+    memcpy(p + length, buffer->data + decompressor->offset, n);
+    decompressor->offset += n;
+    length += n;
+  }
+
+  return RAPTOR_BAD_CAST(int, length / size);
+}
+
+
+static int
+raptor_decompress_iostream_read_eof(void *user_data)
+{
+  raptor_decompress_context* decompressor;
+  raptor_decompress_buffer* buffer;
+
+  decompressor = (raptor_decompress_context*)user_data;
+  buffer = &decompressor->buffers[decompressor->current];
+
+  return decompressor->failed ||
+         (buffer->eof && decompressor->offset == buffer->length);
+}
+
+
+static const raptor_iostream_handler raptor_decompress_iostream_handler = {
+  /* .version     = */ 2,
+  /* .init        = */ NULL,
+  /* .finish      = */ raptor_decompress_iostream_finish,
+  /* .write_byte  = */ NULL,
+  /* .write_bytes = */ NULL,
+  /* .write_end   = */ NULL,
+  /* .read_bytes  = */ raptor_decompress_iostream_read_bytes,
+  /* .read_eof    = */ raptor_decompress_iostream_read_eof
+};
+
+
+/**
+ * raptor_new_iostream_from_compressed_iostream:
+ * @world: raptor world
+ * @iostr: input iostream
+ *
+ * Constructor - create a new iostream decompressing what is read from another iostream.
+ *
+ * The compression format is recognised from the first bytes read
+ * from @iostr: gzip, zstd or bzip2 where raptor was built with
+ * support for them.  Data that is not compressed is read unchanged.
+ * Reading fails with an error for formats that are not supported.
+ *
+ * Where threads are available, @iostr is read and decompressed on
+ * another thread ahead of the reader.  @iostr is not owned and must
+ * not be used or destroyed before the new iostream is destroyed.
+ *
+ * The new iostream can be passed to raptor_parser_parse_iostream().
+ *
+ * Return value: new #raptor_iostream object or NULL on failure
+ **/
+raptor_iostream*
+raptor_new_iostream_from_compressed_iostream(raptor_world* world,
+                                             raptor_iostream* iostr)
+{
+  raptor_decompress_context* decompressor;
+  raptor_iostream* diostr;
+
+  RAPTOR_CHECK_CONSTRUCTOR_WORLD(world);
+  RAPTOR_ASSERT_OBJECT_POINTER_RETURN_VALUE(iostr, raptor_iostream, NULL);
+
+  raptor_world_open(world);
+
+  decompressor = raptor_new_decompress_context(world, iostr);
+  if(!decompressor)
+    return NULL;
+
+  diostr = raptor_new_iostream_from_handler(world, decompressor,
+                                            &raptor_decompress_iostream_handler);
+  if(!diostr)
+    raptor_free_decompress_context(decompressor);
+
+  return diostr;
+}
+
+
+/**
+ * raptor_new_iostream_from_compressed_filename:
+ * @world: raptor world
+ * @filename: Input filename to open and read from
+ *
+ * Constructor - create a new iostream decompressing a file.
+ *
+ * See raptor_new_iostream_from_compressed_iostream() for details.
+ *
+ * Return value: new #raptor_iostream object or NULL on failure
+ **/
+raptor_iostream*
+raptor_new_iostream_from_compressed_filename(raptor_world* world,
+                                             const char *filename)
+{
+  raptor_iostream* iostr;
+  raptor_decompress_context* decompressor;
+  raptor_iostream* diostr;
+
+  RAPTOR_CHECK_CONSTRUCTOR_WORLD(world);
+
+  raptor_world_open(world);
+
+  iostr = raptor_new_iostream_from_filename(world, filename);
+  if(!iostr)
+    return NULL;
+
+  decompressor = raptor_new_decompress_context(world, iostr);
+  if(!decompressor) {
+    raptor_free_iostream(iostr);
+    return NULL;
+  }
+  decompressor->free_iostr = 1;
+
+  diostr = raptor_new_iostream_from_handler(world, decompressor,
+                                            &raptor_decompress_iostream_handler);
+  if(!diostr)
+    raptor_free_decompress_context(decompressor);
+
+  return diostr;
+}
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+#define TEST_DATA_SIZE (1024 * 1024 + 12345)
+
+#ifdef HAVE_ZLIB
+static int
+test_gunzip(const unsigned char* data, size_t length,
+            unsigned char* output, size_t output_size, size_t* output_length)
+{
+  z_stream strm;
+  int zrc;
+
+  memset(&strm, 0, sizeof(strm));
+  /* 16 selects gzip decoding */
+  if(inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK)
+    return 1;
+
+  strm.next_in = (Bytef*)data;
+  strm.avail_in = (uInt)length;
+  strm.next_out = output;
+  strm.avail_out = (uInt)output_size;
+  zrc = inflate(&strm, Z_FINISH);
+  *output_length = output_size - strm.avail_out;
+  inflateEnd(&strm);
+
+  return (zrc != Z_STREAM_END || strm.avail_in);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int
+test_unzstd(const unsigned char* data, size_t length,
+            unsigned char* output, size_t output_size, size_t* output_length)
+{
+  size_t n;
+
+  n = ZSTD_decompress(output, output_size, data, length);
+  if(ZSTD_isError(n))
+    return 1;
+
+  *output_length = n;
+  return 0;
+}
+#endif
+
+
+/* Read all of a decompressing iostream over @data; returns <0 on failure */
+static int
+test_read(raptor_world* world, unsigned char* data, size_t length,
+          unsigned char* output, size_t output_size, size_t* output_length)
+{
+  raptor_iostream* iostr;
+  raptor_iostream* diostr;
+  int rc = 0;
+
+  *output_length = 0;
+
+  iostr = raptor_new_iostream_from_string(world, data, length);
+  if(!iostr)
+    return -1;
+
+  diostr = raptor_new_iostream_from_compressed_iostream(world, iostr);
+  if(!diostr) {
+    raptor_free_iostream(iostr);
+    return -1;
+  }
+
+  /* read in uneven pieces */
+  while(!raptor_iostream_read_eof(diostr)) {
+    size_t n = 1 + (*output_length * 31) % 70000;
+    int ilen;
+
+    if(n > output_size - *output_length)
+      n = output_size - *output_length;
+    if(!n)
+      break;
+
+    ilen = raptor_iostream_read_bytes(output + *output_length, 1, n, diostr);
+    if(ilen < 0) {
+      rc = -1;
+      break;
+    }
+    *output_length += RAPTOR_GOOD_CAST(size_t, ilen);
+  }
+
+  raptor_free_iostream(diostr);
+  raptor_free_iostream(iostr);
+
+  return rc;
+}
+
+
+static int
+test_compare(const char* program, const char* label,
+             raptor_compression_type type, int threads,
+             const unsigned char* data, size_t data_length,
+             const unsigned char* output, size_t output_length)
+{
+  if(output_length != data_length || memcmp(output, data, data_length)) {
+    fprintf(stderr,
+            "%s: Type %d threads %d %s to %d bytes, expected %d\n",
+            program, (int)type, threads, label, (int)output_length,
+            (int)data_length);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+test_compress(raptor_world* world, const char* program,
+              raptor_compression_type type, int threads,
+              const unsigned char* data, size_t data_length)
+{
+  raptor_iostream* iostr;
+  raptor_iostream* ciostr;
+  unsigned char* string = NULL;
+  size_t string_length = 0;
+  unsigned char* output;
+  size_t output_size = (data_length << 1) + 1;
+  size_t output_length = 0;
+  unsigned char* twice = NULL;
+  size_t offset;
+  int rc = 0;
+
+  iostr = raptor_new_iostream_to_string(world, (void**)&string,
+                                        &string_length, NULL);
+  if(!iostr)
+    return 1;
+
+  ciostr = raptor_new_iostream_to_compressed_iostream(world, iostr, type,
+                                                      -1, threads);
+  if(!ciostr) {
+    fprintf(stderr, "%s: Failed to create compressed iostream type %d\n",
+            program, (int)type);
+    raptor_free_iostream(iostr);
+    return 1;
+  }
+
+  /* write in uneven pieces */
+  for(offset = 0; offset < data_length; ) {
+    size_t n = 1 + (offset * 31) % 7000;
+
+    if(n > data_length - offset)
+      n = data_length - offset;
+    raptor_iostream_write_bytes(data + offset, 1, n, ciostr);
+    offset += n;
+  }
+
+  raptor_free_iostream(ciostr);
+  raptor_free_iostream(iostr);
+
+  output = (unsigned char*)malloc(output_size);
+  if(!output) {
+    rc = 1;
+    goto tidy;
+  }
+
+  /* check with the library's own decoder where it has a simple one */
+  switch(type) {
+#ifdef HAVE_ZLIB
+    case RAPTOR_COMPRESSION_GZIP:
+      if(test_gunzip(string, string_length, output, output_size,
+                     &output_length))
+        rc = 1;
+      else
+        rc = test_compare(program, "gunzipped", type, threads,
+                          data, data_length, output, output_length);
+      break;
+#endif
+#ifdef HAVE_ZSTD
+    case RAPTOR_COMPRESSION_ZSTD:
+      if(test_unzstd(string, string_length, output, output_size,
+                     &output_length))
+        rc = 1;
+      else
+        rc = test_compare(program, "unzstded", type, threads,
+                          data, data_length, output, output_length);
+      break;
+#endif
+    default:
+      break;
+  }
+
+  if(test_read(world, string, string_length, output, output_size,
+               &output_length)) {
+    fprintf(stderr, "%s: Failed to read type %d threads %d\n",
+            program, (int)type, threads);
+    rc = 1;
+  } else
+    rc += test_compare(program, "read", type, threads,
+                       data, data_length, output, output_length);
+
+  /* concatenated members, frames or streams read as one */
+  twice = (unsigned char*)malloc((string_length << 1) + 1);
+  if(twice) {
+    unsigned char* data2 = (unsigned char*)malloc((data_length << 1) + 1);
+
+    memcpy(twice, string, string_length);
+    memcpy(twice + string_length, string, string_length);
+
+    if(data2) {
+      memcpy(data2, data, data_length);
+      memcpy(data2 + data_length, data, data_length);
+      if(test_read(world, twice, string_length << 1, output, output_size,
+                   &output_length)) {
+        fprintf(stderr, "%s: Failed to read twice type %d threads %d\n",
+                program, (int)type, threads);
+        rc = 1;
+      } else
+        rc += test_compare(program, "read twice", type, threads,
+                           data2, data_length << 1, output, output_length);
+      free(data2);
+    }
+
+    /* truncated data must fail */
+    if(string_length > 20 &&
+       !test_read(world, string, string_length - 5, output, output_size,
+                  &output_length)) {
+      fprintf(stderr, "%s: Reading truncated type %d threads %d succeeded\n",
+              program, (int)type, threads);
+      rc = 1;
+    }
+
+    free(twice);
+  }
+
+  free(output);
+
+  tidy:
+  if(string)
+    raptor_free_memory(string);
+
+  return rc;
+}
+
+
+#ifdef HAVE_BZLIB
+static const char test_bzip2_data[] =
+  "<http://example.org/s> <http://example.org/p> \"o\" .\n";
+
+/* test_bzip2_data compressed by bzip2 */
+static const unsigned char test_bzip2_stream[] = {
+  0x42, 0x5a, 0x68, 0x39, 0x31, 0x41, 0x59, 0x26, 0x53, 0x59, 0x3f, 0x8f,
+  0x86, 0xf4, 0x00, 0x00, 0x09, 0x59, 0x80, 0x00, 0x10, 0x50, 0x01, 0x80,
+  0x15, 0x22, 0xc6, 0xdc, 0x40, 0x20, 0x00, 0x40, 0x95, 0x27, 0x94, 0xf4,
+  0xd2, 0x68, 0x3c, 0x8d, 0x42, 0x98, 0x4d, 0x34, 0x06, 0x98, 0x8a, 0xfc,
+  0xf1, 0xf3, 0x19, 0x30, 0x60, 0xec, 0x81, 0xb2, 0x9a, 0xa2, 0x47, 0x36,
+  0x41, 0x72, 0x48, 0x92, 0x87, 0xa3, 0x42, 0x29, 0x46, 0xcf, 0xc5, 0xdc,
+  0x91, 0x4e, 0x14, 0x24, 0x0f, 0xe3, 0xe1, 0xbd, 0x00
+};
+
+static int
+test_read_bzip2(raptor_world* world, const char* program)
+{
+  size_t stream_length = sizeof(test_bzip2_stream);
+  size_t data_length = sizeof(test_bzip2_data) - 1;
+  unsigned char input[sizeof(test_bzip2_stream) * 2];
+  unsigned char data[(sizeof(test_bzip2_data) - 1) * 2];
+  unsigned char output[sizeof(data) + 1];
+  size_t output_length;
+  int rc = 0;
+
+  memcpy(input, test_bzip2_stream, stream_length);
+  memcpy(input + stream_length, test_bzip2_stream, stream_length);
+  memcpy(data, test_bzip2_data, data_length);
+  memcpy(data + data_length, test_bzip2_data, data_length);
+
+  if(test_read(world, input, stream_length, output, sizeof(output),
+               &output_length))
+    rc = 1;
+  else
+    rc += test_compare(program, "read", RAPTOR_COMPRESSION_BZIP2, 0,
+                       data, data_length, output, output_length);
+
+  /* concatenated streams read as one */
+  if(test_read(world, input, stream_length << 1, output, sizeof(output),
+               &output_length))
+    rc = 1;
+  else
+    rc += test_compare(program, "read twice", RAPTOR_COMPRESSION_BZIP2, 0,
+                       data, data_length << 1, output, output_length);
+
+  /* truncated data must fail */
+  if(!test_read(world, input, stream_length - 5, output, sizeof(output),
+                &output_length))
+    rc = 1;
+
+  if(rc)
+    fprintf(stderr, "%s: Failed to read bzip2 data\n", program);
+
+  return rc;
+}
+#endif
+
+
+static void
+test_log_handler(void *user_data, raptor_log_message *message)
+{
+  /* expected errors from truncated data */
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = raptor_basename(argv[0]);
+  raptor_world *world;
+  unsigned char* data;
+  unsigned char* output;
+  size_t output_length;
+  size_t i;
+  int failures = 0;
+  raptor_compression_type type;
+
+  world = raptor_new_world();
+  if(!world || raptor_world_open(world))
+    exit(1);
+
+  raptor_world_set_log_handler(world, NULL, test_log_handler);
+
+  data = (unsigned char*)malloc(TEST_DATA_SIZE);
+  output = (unsigned char*)malloc(TEST_DATA_SIZE + 1);
+  if(!data || !output)
+    exit(1);
+
+  /* compressible text with some variety */
+  for(i = 0; i < TEST_DATA_SIZE; i++)
+    data[i] = (unsigned char)("<http://example.org/s> .\n"[i % 25] +
+                              ((i * 7919) % 97 == 0));
+
+  for(type = RAPTOR_COMPRESSION_GZIP; type <= RAPTOR_COMPRESSION_LAST;
+      type = (raptor_compression_type)(type + 1)) {
+    int threads;
+
+    if(!raptor_compression_is_supported(type)) {
+      /* an unsupported type must fail */
+      raptor_iostream* iostr = raptor_new_iostream_to_sink(world);
+      raptor_iostream* ciostr;
+
+      ciostr = raptor_new_iostream_to_compressed_iostream(world, iostr, type,
+                                                          -1, 0);
+      if(ciostr) {
+        fprintf(stderr, "%s: Unsupported type %d was accepted\n",
+                program, (int)type);
+        raptor_free_iostream(ciostr);
+        failures++;
+      }
+      raptor_free_iostream(iostr);
+      continue;
+    }
+
+    for(threads = 0; threads <= 3; threads += 3) {
+      failures += test_compress(world, program, type, threads,
+                                data, TEST_DATA_SIZE);
+      failures += test_compress(world, program, type, threads, data, 0);
+      failures += test_compress(world, program, type, threads, data, 100);
+    }
+  }
+
+#ifdef HAVE_BZLIB
+  failures += test_read_bzip2(world, program);
+#endif
+
+  /* data that is not compressed is read unchanged */
+  if(test_read(world, data, TEST_DATA_SIZE, output, TEST_DATA_SIZE + 1,
+               &output_length) ||
+     test_compare(program, "read", RAPTOR_COMPRESSION_NONE, 0,
+                  data, TEST_DATA_SIZE, output, output_length))
+    failures++;
+  if(test_read(world, data, 3, output, TEST_DATA_SIZE + 1, &output_length) ||
+     test_compare(program, "read", RAPTOR_COMPRESSION_NONE, 0,
+                  data, 3, output, output_length))
+    failures++;
+
+  free(output);
+  free(data);
+  raptor_free_world(world);
+
+  return failures;
+}
+
+#endif /* STANDALONE */
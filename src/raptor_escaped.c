@@ -28,12 +28,227 @@
 
 #include <stdio.h>
 #include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RAPTOR_ESCAPED_SCAN_SSE2 1
+#endif
+
+#if defined(RAPTOR_ESCAPED_SCAN_SSE2) && defined(HAVE_AVX2_TARGET_ATTRIBUTE)
+#include <immintrin.h>
+#define RAPTOR_ESCAPED_SCAN_AVX2 1
+#endif
 
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
 
 
+/* Byte classes for raptor_string_escaped_write(): a byte is written
+ * as-is unless it has a class in the mask made from the flags, or
+ * is the delimiter.
+ */
+#define RAPTOR_ESCAPED_CLASS_ALWAYS 1 /* NUL, \\ and not ASCII */
+#define RAPTOR_ESCAPED_CLASS_SPARQL 2 /* #x00-#x20<>\"{}|^` */
+#define RAPTOR_ESCAPED_CLASS_TNRU   4 /* controls */
+#define RAPTOR_ESCAPED_CLASS_BF     8 /* \b \f */
+
+static const unsigned char raptor_escaped_byte_classes[256] = {
+   7,  6,  6,  6,  6,  6,  6,  6, 14,  6,  6, 14,  6,  6,  6,  6, /* 00 */
+   6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6, /* 10 */
+   2,  0,  2,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 20 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  2,  0, /* 30 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 40 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  2,  0, /* 50 */
+   2,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 60 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  2,  2,  0,  1, /* 70 */
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, /* 80 */
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, /* 90 */
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, /* A0 */
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, /* B0 */
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, /* C0 */
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, /* D0 */
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, /* E0 */
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1 /* F0 */
+};
+
+
+/* Skip bytes from @p that are written as-is; return the first byte
+ * that needs escaping, the delimiter or the NUL at the end.
+ */
+static RAPTOR_INLINE const unsigned char*
+raptor_escaped_skip_plain_scalar(const unsigned char *p,
+                                 const unsigned char *end,
+                                 unsigned char mask, unsigned char delim)
+{
+  while(!(raptor_escaped_byte_classes[*p] & mask) && *p != delim)
+    p++;
+  return p;
+}
+
+
+/*
+ * The vector variants below read whole blocks only before @end and
+ * flag every byte that may need escaping: controls, DEL and non-ASCII
+ * (a signed compare below 0x20), backslash, the delimiter and with
+ * SPARQL URI escapes the other SPARQL characters.  The table decides
+ * for each flagged byte, the scalar code finishes the tail.
+ */
+#ifdef RAPTOR_ESCAPED_SCAN_SSE2
+static RAPTOR_INLINE const unsigned char*
+raptor_escaped_skip_plain_sse2(const unsigned char *p,
+                               const unsigned char *end,
+                               unsigned char mask, unsigned char delim)
+{
+  const __m128i space = _mm_set1_epi8((mask & RAPTOR_ESCAPED_CLASS_SPARQL) ?
+                                      0x21 : 0x20);
+  const __m128i del = _mm_set1_epi8(0x7f);
+  const __m128i bs = _mm_set1_epi8('\\');
+  const __m128i dl = _mm_set1_epi8(RAPTOR_GOOD_CAST(char, delim));
+  const int sparql = (mask & RAPTOR_ESCAPED_CLASS_SPARQL);
+
+  while(end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i m;
+    unsigned int bits;
+
+    /* signed: also true for the non-ASCII bytes */
+    m = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, bs));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, dl));
+    if(sparql) {
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('{')));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('^')));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('`')));
+    }
+
+    for(bits = (unsigned int)_mm_movemask_epi8(m); bits; bits &= bits - 1) {
+      const unsigned char *q = p + __builtin_ctz(bits);
+      if((raptor_escaped_byte_classes[*q] & mask) || *q == delim)
+        return q;
+    }
+    p += 16;
+  }
+
+  return raptor_escaped_skip_plain_scalar(p, end, mask, delim);
+}
+#endif
+
+
+#ifdef RAPTOR_ESCAPED_SCAN_AVX2
+__attribute__((target("avx2")))
+static const unsigned char*
+raptor_escaped_skip_plain_avx2(const unsigned char *p,
+                               const unsigned char *end,
+                               unsigned char mask, unsigned char delim)
+{
+  const __m256i space = _mm256_set1_epi8((mask & RAPTOR_ESCAPED_CLASS_SPARQL) ?
+                                         0x21 : 0x20);
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  const __m256i bs = _mm256_set1_epi8('\\');
+  const __m256i dl = _mm256_set1_epi8(RAPTOR_GOOD_CAST(char, delim));
+  const int sparql = (mask & RAPTOR_ESCAPED_CLASS_SPARQL);
+
+  while(end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i m;
+    unsigned int bits;
+
+    /* signed: also true for the non-ASCII bytes */
+    m = _mm256_or_si256(_mm256_cmpgt_epi8(space, v),
+                        _mm256_cmpeq_epi8(v, del));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, bs));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, dl));
+    if(sparql) {
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}')));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('^')));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('`')));
+    }
+
+    for(bits = (unsigned int)_mm256_movemask_epi8(m); bits; bits &= bits - 1) {
+      const unsigned char *q = p + __builtin_ctz(bits);
+      if((raptor_escaped_byte_classes[*q] & mask) || *q == delim)
+        return q;
+    }
+    p += 32;
+  }
+
+  return raptor_escaped_skip_plain_sse2(p, end, mask, delim);
+}
+#endif
+
+
+typedef const unsigned char* (*raptor_escaped_skipper)(const unsigned char *p, const unsigned char *end, unsigned char mask, unsigned char delim);
+
+/* Skipper picked for the running CPU or NULL before the first use.
+ * Threads racing to set it all store the same value.
+ */
+static raptor_escaped_skipper raptor_escaped_best_skipper = NULL;
+
+/* Pick the fastest skipper the running CPU supports, once */
+static raptor_escaped_skipper
+raptor_escaped_get_skipper(void)
+{
+  raptor_escaped_skipper skipper;
+
+#ifdef HAVE_ATOMIC_BUILTINS
+  skipper = RAPTOR_ATOMIC_LOAD(&raptor_escaped_best_skipper);
+#else
+  skipper = raptor_escaped_best_skipper;
+#endif
+
+  if(skipper)
+    return skipper;
+
+#ifdef RAPTOR_ESCAPED_SCAN_SSE2
+  skipper = raptor_escaped_skip_plain_sse2;
+#else
+  skipper = raptor_escaped_skip_plain_scalar;
+#endif
+#ifdef RAPTOR_ESCAPED_SCAN_AVX2
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    skipper = raptor_escaped_skip_plain_avx2;
+#endif
+
+#ifdef HAVE_ATOMIC_BUILTINS
+  RAPTOR_ATOMIC_STORE(&raptor_escaped_best_skipper, skipper);
+#else
+  raptor_escaped_best_skipper = skipper;
+#endif
+  return skipper;
+}
+
+
+/* Write \u or \U and @width hex digits of @value as one write */
+static void
+raptor_escaped_write_unicode(unsigned long value, int width,
+                             raptor_iostream *iostr)
+{
+  char buf[11]; /* \U + 8 hex digits + NUL */
+
+  buf[0] = '\\';
+  buf[1] = (width == 4) ? 'u' : 'U';
+  (void)raptor_format_integer(buf + 2, width + 1,
+                              RAPTOR_GOOD_CAST(int, value), /* base */ 16,
+                              width, '0');
+  raptor_iostream_write_bytes(buf, 1, width + 2, iostr);
+}
+
+
 /**
  * raptor_string_escaped_write:
  * @string: UTF-8 string to write
@@ -59,21 +274,59 @@ raptor_string_escaped_write(const unsigned char *string,
   unsigned char c;
   int unichar_len;
   raptor_unichar unichar;
+  unsigned char mask = RAPTOR_ESCAPED_CLASS_ALWAYS;
+  const unsigned char *end;
+  raptor_escaped_skipper skip_plain;
 
   if(!string)
     return 1;
+
+  /* vector reads stay before here; the scan itself stops at the NUL */
+  end = string + len;
+  /* too short for a single vector block */
+  if(len < 16)
+    skip_plain = raptor_escaped_skip_plain_scalar;
+  else
+    skip_plain = raptor_escaped_get_skipper();
+
+  if(flags & RAPTOR_ESCAPED_WRITE_BITFLAG_SPARQL_URI_ESCAPES)
+    mask |= RAPTOR_ESCAPED_CLASS_SPARQL;
+  else {
+    if(flags & RAPTOR_ESCAPED_WRITE_BITFLAG_BS_ESCAPES_TNRU)
+      mask |= RAPTOR_ESCAPED_CLASS_TNRU;
+    if(flags & RAPTOR_ESCAPED_WRITE_BITFLAG_BS_ESCAPES_BF)
+      mask |= RAPTOR_ESCAPED_CLASS_BF;
+  }
   
   for(; (c=*string); string++, len--) {
+    if(!(raptor_escaped_byte_classes[c] & mask) && c != delim) {
+      /* Write the run of bytes that need no escaping in one go */
+      const unsigned char *run = string;
+      size_t run_len;
+
+      string = skip_plain(string + 1, end, mask,
+                          RAPTOR_GOOD_CAST(unsigned char, delim));
+      c = *string;
+
+      run_len = RAPTOR_GOOD_CAST(size_t, string - run);
+      raptor_iostream_write_bytes(run, 1, run_len, iostr);
+      len -= run_len;
+      if(!c)
+        break;
+    }
+
     if((delim && c == delim && (delim == '\'' || delim == '"')) ||
        c == '\\') {
-      raptor_iostream_write_byte('\\', iostr);
-      raptor_iostream_write_byte(c, iostr);
+      char buf[2];
+
+      buf[0] = '\\';
+      buf[1] = RAPTOR_GOOD_CAST(char, c);
+      raptor_iostream_write_bytes(buf, 1, 2, iostr);
       continue;
     }
 
     if(delim && c == delim) {
-      raptor_iostream_counted_string_write("\\u", 2, iostr);
-      raptor_iostream_hexadecimal_write(c, 4, iostr);
+      raptor_escaped_write_unicode(c, 4, iostr);
       continue;
     }
     
@@ -82,8 +335,7 @@ raptor_string_escaped_write(const unsigned char *string,
       if(c <= 0x20 ||
          c == '<' || c == '>' || c == '\\' || c == '"' || 
          c == '{' || c == '}' || c == '|' || c == '^' || c == '`') {
-        raptor_iostream_counted_string_write("\\u", 2, iostr);
-        raptor_iostream_hexadecimal_write(c, 4, iostr);
+        raptor_escaped_write_unicode(c, 4, iostr);
         continue;
       } else if(c < 0x7f) {
         raptor_iostream_write_byte(c, iostr);
@@ -102,8 +354,7 @@ raptor_string_escaped_write(const unsigned char *string,
         raptor_iostream_counted_string_write("\\r", 2, iostr);
         continue;
       } else if(c < 0x20 || c == 0x7f) {
-        raptor_iostream_counted_string_write("\\u", 2, iostr);
-        raptor_iostream_hexadecimal_write(c, 4, iostr);
+        raptor_escaped_write_unicode(c, 4, iostr);
         continue;
       }
     }
@@ -136,13 +387,10 @@ raptor_string_escaped_write(const unsigned char *string,
       /* UTF-8 is allowed so no need to escape */
       raptor_iostream_counted_string_write(string, unichar_len, iostr);
     } else {
-      if(unichar < 0x10000) {
-        raptor_iostream_counted_string_write("\\u", 2, iostr);
-        raptor_iostream_hexadecimal_write(RAPTOR_GOOD_CAST(unsigned int, unichar), 4, iostr);
-      } else {
-        raptor_iostream_counted_string_write("\\U", 2, iostr);
-        raptor_iostream_hexadecimal_write(RAPTOR_GOOD_CAST(unsigned int, unichar), 8, iostr);
-      }
+      if(unichar < 0x10000)
+        raptor_escaped_write_unicode(unichar, 4, iostr);
+      else
+        raptor_escaped_write_unicode(unichar, 8, iostr);
     }
     
     unichar_len--; /* since loop does len-- */
@@ -287,3 +535,134 @@ raptor_term_escaped_write(const raptor_term *term,
 
   return 0;
 }
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+#define TEST_MAX_REPEAT 9
+
+
+struct escaped_test {
+  const char *string;
+  char delim;
+  unsigned int flags;
+  const char *expected;
+};
+
+static const struct escaped_test escaped_tests[] = {
+  { "plain text", '"', RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL, "plain text" },
+  { "a\"b\\c", '"', RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL, "a\\\"b\\\\c" },
+  { "t\tn\nr\rb\bf\013", '"', RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL,
+    "t\\tn\\nr\\rb\\u0008f\\u000B" },
+  { "b\bf\013", '"', RAPTOR_ESCAPED_WRITE_BITFLAG_BS_ESCAPES_BF, "b\\bf\\f" },
+  { "x\001y\177", '"', RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL,
+    "x\\u0001y\\u007F" },
+  { "caf\xc3\xa9 \xf0\x9f\x98\x80", '"', RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL,
+    "caf\\u00E9 \\U0001F600" },
+  { "caf\xc3\xa9", '"', RAPTOR_ESCAPED_WRITE_TURTLE_LITERAL, "caf\xc3\xa9" },
+  { "http://ex.org/a b<c>{d}|^`", '>', RAPTOR_ESCAPED_WRITE_NTRIPLES_URI,
+    "http://ex.org/a\\u0020b\\u003Cc\\u003E\\u007Bd\\u007D\\u007C\\u005E\\u0060" },
+  { "a>b", '>', 0, "a\\u003Eb" },
+  { "it's", '\'', 0, "it\\'s" },
+  { "raw\tcontrol", '\0', 0, "raw\tcontrol" },
+  { "a run of plain text longer than one vector block \"", '"',
+    RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL,
+    "a run of plain text longer than one vector block \\\"" },
+  { NULL, '\0', 0, NULL }
+};
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = raptor_basename(argv[0]);
+  raptor_world *world;
+  raptor_iostream *sink;
+  int failures = 0;
+  int i;
+
+  world = raptor_new_world();
+  if(!world || raptor_world_open(world))
+    exit(1);
+
+  /* Escaping is per character so a string repeated N times escapes
+   * to the expected string repeated N times; the longer strings go
+   * through the vector scans.
+   */
+  for(i = 0; escaped_tests[i].string; i++) {
+    const struct escaped_test *t = &escaped_tests[i];
+    size_t t_len = strlen(t->string);
+    size_t e_len = strlen(t->expected);
+    int repeat;
+
+    for(repeat = 1; repeat <= TEST_MAX_REPEAT; repeat++) {
+      raptor_iostream *iostr;
+      unsigned char *input;
+      char *expected;
+      void *string = NULL;
+      size_t string_len = 0;
+      int rc;
+      int j;
+
+      input = RAPTOR_MALLOC(unsigned char*, t_len * repeat + 1);
+      expected = RAPTOR_MALLOC(char*, e_len * repeat + 1);
+      if(!input || !expected) {
+        fprintf(stderr, "%s: Out of memory\n", program);
+        failures++;
+        break;
+      }
+      for(j = 0; j < repeat; j++) {
+        memcpy(input + t_len * j, t->string, t_len);
+        memcpy(expected + e_len * j, t->expected, e_len);
+      }
+      input[t_len * repeat] = '\0';
+      expected[e_len * repeat] = '\0';
+
+      iostr = raptor_new_iostream_to_string(world, &string, &string_len,
+                                            NULL);
+      if(!iostr) {
+        fprintf(stderr, "%s: Failed to create iostream to string\n",
+                program);
+        failures++;
+        break;
+      }
+
+      rc = raptor_string_escaped_write(input, t_len * repeat, t->delim,
+                                       t->flags, iostr);
+      raptor_free_iostream(iostr);
+
+      if(rc || !string || strcmp((const char*)string, expected)) {
+        fprintf(stderr,
+                "%s: Test %d escaping '%s' x%d with flags %u returned %d '%s', expected '%s'\n",
+                program, i, t->string, repeat, t->flags, rc,
+                string ? (const char*)string : "(null)", expected);
+        failures++;
+      }
+
+      if(string)
+        raptor_free_memory(string);
+      RAPTOR_FREE(char*, input);
+      RAPTOR_FREE(char*, expected);
+    }
+  }
+
+  /* UTF-8 that ends part way through a character is an error */
+  sink = raptor_new_iostream_to_sink(world);
+  if(!raptor_string_escaped_write((const unsigned char*)"ab\xc3", 3, '"',
+                                  RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL,
+                                  sink)) {
+    fprintf(stderr, "%s: Truncated UTF-8 was not an error\n", program);
+    failures++;
+  }
+  raptor_free_iostream(sink);
+
+  raptor_free_world(world);
+
+  return failures;
+}
+
+#endif /* STANDALONE */
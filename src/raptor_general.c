@@ -100,6 +100,25 @@ const unsigned int raptor_version_release = RAPTOR_VERSION_RELEASE;
 const unsigned int raptor_version_decimal = RAPTOR_VERSION_DECIMAL;
 
 
+/*
+ * Memory handlers set by raptor_world_set_allocator().  Internal code
+ * allocates without a world at hand, so they are library wide; they
+ * may only be changed while no world is open.
+ */
+static raptor_allocator raptor_memory_allocator;
+static int raptor_memory_allocator_set = 0;
+
+/* number of open worlds */
+static int raptor_worlds_opened = 0;
+
+/* number of open worlds with RAPTOR_WORLD_FLAG_MEMORY_COUNTERS */
+static int raptor_memory_counting = 0;
+static raptor_memory_counters raptor_memory_domain_counters[RAPTOR_DOMAIN_LAST + 1];
+
+/* non-0 if either of the above is in use */
+int raptor_memory_hooked = 0;
+
+
 /**
  * raptor_new_world:
  * @version_decimal: raptor version as a decimal integer as defined by the macro #RAPTOR_VERSION and static int #raptor_version_decimal
@@ -131,7 +150,9 @@ raptor_new_world_internal(unsigned int version_decimal)
     return NULL;
   }
   
-  world = RAPTOR_CALLOC(raptor_world*, 1, sizeof(*world));
+  /* not from the raptor_world_set_allocator() handlers since the
+   * world is made before they are set */
+  world = (raptor_world*)calloc(1, sizeof(*world));
   if(world) {
     world->magic = RAPTOR2_WORLD_MAGIC;
     
@@ -178,6 +199,17 @@ raptor_world_open(raptor_world* world)
     return 0; /* not an error */
 
   world->opened = 1;
+  raptor_worlds_opened++;
+  if(world->memory_counters) {
+    raptor_memory_counting++;
+    raptor_memory_hooked = 1;
+  }
+
+  if(world->thread_safe) {
+    world->mutex = raptor_new_mutex();
+    if(!world->mutex)
+      return 1;
+  }
 
   rc = raptor_uri_init(world);
   if(rc)
@@ -246,7 +278,17 @@ raptor_free_world(raptor_world* world)
 
   raptor_uri_finish(world);
 
-  RAPTOR_FREE(raptor_world, world);
+  if(world->mutex)
+    raptor_free_mutex(world->mutex);
+
+  if(world->opened) {
+    raptor_worlds_opened--;
+    if(world->memory_counters)
+      raptor_memory_counting--;
+    raptor_memory_hooked = (raptor_memory_allocator_set || raptor_memory_counting);
+  }
+
+  free(world);
 }
 
 
@@ -293,7 +335,12 @@ raptor_world_default_generate_bnodeid_handler(void *user_data,
   if(user_bnodeid)
     return user_bnodeid;
 
-  id = ++world->default_generate_bnodeid_handler_base;
+#ifdef RAPTOR_THREAD_SAFE_WORLD
+  if(world->thread_safe)
+    id = RAPTOR_ATOMIC_INCREMENT(&world->default_generate_bnodeid_handler_base);
+  else
+#endif
+    id = ++world->default_generate_bnodeid_handler_base;
 
   id_length = raptor_format_integer(NULL, 0, id, /* base */ 10, -1, '\0');
 
@@ -476,6 +523,19 @@ raptor_world_set_flag(raptor_world *world, raptor_world_flag flag, int value)
     case RAPTOR_WORLD_FLAG_WWW_SKIP_INIT_FINISH:
       world->www_skip_www_init_finish = value;
       break;
+
+    case RAPTOR_WORLD_FLAG_THREAD_SAFE:
+#ifdef RAPTOR_THREAD_SAFE_WORLD
+      world->thread_safe = value;
+#else
+      if(value)
+        rc = -2;
+#endif
+      break;
+
+    case RAPTOR_WORLD_FLAG_MEMORY_COUNTERS:
+      world->memory_counters = value;
+      break;
   }
 
   return rc;
@@ -677,39 +737,258 @@ raptor_calloc_memory(size_t nmemb, size_t size)
 }
 
 
+/**
+ * raptor_world_set_allocator:
+ * @world: #raptor_world object
+ * @allocator: memory handlers or NULL to use the C library
+ *
+ * Set the functions raptor allocates and frees memory with.
+ *
+ * All memory raptor allocates, including that returned to the
+ * application to free with raptor_free_memory(), comes from these
+ * handlers.  Since internal code does not always have a world to
+ * hand, the handlers are used by every world and can only be set
+ * before @world is opened and while no other world is open.  The
+ * handlers in @allocator are copied.
+ *
+ * Memory allocated by other libraries raptor uses, such as libxml2
+ * and libcurl, does not go through these handlers.
+ *
+ * Return value: non-0 on failure
+ */
+int
+raptor_world_set_allocator(raptor_world* world,
+                           const raptor_allocator* allocator)
+{
+  RAPTOR_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, raptor_world, -1);
+
+  if(world->opened || raptor_worlds_opened)
+    return 1;
+
+  if(!allocator) {
+    raptor_memory_allocator_set = 0;
+    raptor_memory_hooked = 0;
+    return 0;
+  }
+
+  if(!allocator->malloc_handler || !allocator->realloc_handler ||
+     !allocator->free_handler)
+    return 1;
+
+  raptor_memory_allocator = *allocator;
+  raptor_memory_allocator_set = 1;
+  raptor_memory_hooked = 1;
+
+  return 0;
+}
+
+
+/**
+ * raptor_world_get_memory_counters:
+ * @world: #raptor_world object
+ * @domain: domain to get counters for
+ * @counters: pointer to counters to fill in
+ *
+ * Get the memory allocated in a domain.
+ *
+ * Memory is counted while any world with
+ * #RAPTOR_WORLD_FLAG_MEMORY_COUNTERS set is open and the counts are
+ * cumulative across all worlds.  Frees are counted against the
+ * domain that frees the memory which may differ from the one that
+ * allocated it.  Allocations outside the listed domains are counted
+ * against #RAPTOR_DOMAIN_NONE.
+ *
+ * Return value: non-0 on failure
+ */
+int
+raptor_world_get_memory_counters(raptor_world* world, raptor_domain domain,
+                                 raptor_memory_counters* counters)
+{
+  raptor_memory_counters* c;
+
+  RAPTOR_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, raptor_world, -1);
+
+  if(domain > RAPTOR_DOMAIN_LAST || !counters)
+    return 1;
+
+  c = &raptor_memory_domain_counters[domain];
+#ifdef HAVE_ATOMIC_BUILTINS
+  counters->allocations = RAPTOR_ATOMIC_LOAD(&c->allocations);
+  counters->frees = RAPTOR_ATOMIC_LOAD(&c->frees);
+  counters->bytes = RAPTOR_ATOMIC_LOAD(&c->bytes);
+#else
+  *counters = *c;
+#endif
+
+  return 0;
+}
+
+
+/* count an allocation of @size bytes against @domain */
+static void
+raptor_memory_count(raptor_domain domain, size_t size)
+{
+  raptor_memory_counters* c = &raptor_memory_domain_counters[domain];
+
+  /* parser worker threads allocate concurrently */
+#ifdef HAVE_ATOMIC_BUILTINS
+  __atomic_add_fetch(&c->allocations, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&c->bytes, size, __ATOMIC_RELAXED);
+#else
+  c->allocations++;
+  c->bytes += size;
+#endif
+}
+
+
+/*
+ * raptor_memory_malloc:
+ * @domain: domain to count the memory against
+ * @size: size of memory to allocate
+ *
+ * INTERNAL - Allocate memory; used by RAPTOR_MALLOC()
+ *
+ * Return value: the address of the allocated memory or NULL on failure
+ */
+void*
+raptor_memory_malloc(raptor_domain domain, size_t size)
+{
+  void* ptr;
+
+  if(raptor_memory_allocator_set)
+    ptr = raptor_memory_allocator.malloc_handler(raptor_memory_allocator.user_data, size);
+  else
+    ptr = malloc(size);
+
+  if(ptr && raptor_memory_counting)
+    raptor_memory_count(domain, size);
+
+  return ptr;
+}
+
+
+/*
+ * raptor_memory_calloc:
+ * @domain: domain to count the memory against
+ * @nmemb: number of members
+ * @size: size of item
+ *
+ * INTERNAL - Allocate zeroed memory; used by RAPTOR_CALLOC()
+ *
+ * Return value: the address of the allocated memory or NULL on failure
+ */
+void*
+raptor_memory_calloc(raptor_domain domain, size_t nmemb, size_t size)
+{
+  void* ptr;
+
+  if(!raptor_memory_allocator_set)
+    ptr = calloc(nmemb, size);
+  else if(raptor_memory_allocator.calloc_handler)
+    ptr = raptor_memory_allocator.calloc_handler(raptor_memory_allocator.user_data, nmemb, size);
+  else {
+    if(size && nmemb > ((size_t)-1) / size)
+      return NULL;
+
+    ptr = raptor_memory_allocator.malloc_handler(raptor_memory_allocator.user_data, nmemb * size);
+    if(ptr)
+      memset(ptr, '\0', nmemb * size);
+  }
+
+  if(ptr && raptor_memory_counting)
+    raptor_memory_count(domain, nmemb * size);
+
+  return ptr;
+}
+
+
+/*
+ * raptor_memory_realloc:
+ * @domain: domain to count the memory against
+ * @ptr: memory to resize or NULL
+ * @size: new size
+ *
+ * INTERNAL - Resize memory; used by RAPTOR_REALLOC()
+ *
+ * Return value: the address of the resized memory or NULL on failure
+ */
+void*
+raptor_memory_realloc(raptor_domain domain, void *ptr, size_t size)
+{
+  if(raptor_memory_allocator_set)
+    ptr = raptor_memory_allocator.realloc_handler(raptor_memory_allocator.user_data, ptr, size);
+  else
+    ptr = realloc(ptr, size);
+
+  if(ptr && raptor_memory_counting)
+    raptor_memory_count(domain, size);
+
+  return ptr;
+}
+
+
+/*
+ * raptor_memory_free:
+ * @domain: domain to count the free against
+ * @ptr: memory to free or NULL
+ *
+ * INTERNAL - Free memory; used by RAPTOR_FREE()
+ */
+void
+raptor_memory_free(raptor_domain domain, void *ptr)
+{
+  if(!ptr)
+    return;
+
+  if(raptor_memory_counting) {
+#ifdef HAVE_ATOMIC_BUILTINS
+    __atomic_add_fetch(&raptor_memory_domain_counters[domain].frees, 1,
+                       __ATOMIC_RELAXED);
+#else
+    raptor_memory_domain_counters[domain].frees++;
+#endif
+  }
+
+  if(raptor_memory_allocator_set)
+    raptor_memory_allocator.free_handler(raptor_memory_allocator.user_data, ptr);
+  else
+    free(ptr);
+}
+
+
 #if defined (RAPTOR_DEBUG) && defined(RAPTOR_MEMORY_SIGN)
 void*
-raptor_sign_malloc(size_t size)
+raptor_sign_malloc(raptor_domain domain, size_t size)
 {
   int *p;
   
   size += sizeof(int);
   
-  p = (int*)malloc(size);
+  p = (int*)raptor_memory_malloc(domain, size);
   *p++ = RAPTOR_SIGN_KEY;
   return p;
 }
 
 void*
-raptor_sign_calloc(size_t nmemb, size_t size)
+raptor_sign_calloc(raptor_domain domain, size_t nmemb, size_t size)
 {
   int *p;
   
   /* turn into bytes */
   size = nmemb*size + sizeof(int);
   
-  p = (int*)calloc(1, size);
+  p = (int*)raptor_memory_calloc(domain, 1, size);
   *p++ = RAPTOR_SIGN_KEY;
   return p;
 }
 
 void*
-raptor_sign_realloc(void *ptr, size_t size)
+raptor_sign_realloc(raptor_domain domain, void *ptr, size_t size)
 {
   int *p;
 
   if(!ptr)
-    return raptor_sign_malloc(size);
+    return raptor_sign_malloc(domain, size);
   
   p = (int*)ptr;
   p--;
@@ -719,13 +998,13 @@ raptor_sign_realloc(void *ptr, size_t size)
 
   size += sizeof(int);
   
-  p = (int*)realloc(p, size);
+  p = (int*)raptor_memory_realloc(domain, p, size);
   *p++= RAPTOR_SIGN_KEY;
   return p;
 }
 
 void
-raptor_sign_free(void *ptr)
+raptor_sign_free(raptor_domain domain, void *ptr)
 {
   int *p;
 
@@ -738,7 +1017,7 @@ raptor_sign_free(void *ptr)
   if(*p != RAPTOR_SIGN_KEY)
     RAPTOR_FATAL3("memory signature %08X != %08X", *p, RAPTOR_SIGN_KEY);
 
-  free(p);
+  raptor_memory_free(domain, p);
 }
 #endif
 
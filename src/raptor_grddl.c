@@ -46,6 +46,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_PARSER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -1428,16 +1430,36 @@ raptor_grddl_parse_chunk(raptor_parser* rdf_parser,
     if(loop == 0) { 
       int libxml_options = 0;
 
-      RAPTOR_DEBUG2("Parser %p: Creating an XML parser\n", rdf_parser);
+#ifdef RAPTOR_XML_LIBXML
+      /* reuse the XML parser context of the previous document */
+      if(grddl_parser->xml_ctxt &&
+         raptor_libxml_reset(grddl_parser->xml_ctxt,
+                             (const char*)buffer,
+                             RAPTOR_BAD_CAST(int, buffer_len),
+                             (const char*)uri_string)) {
+        xmlFreeParserCtxt(grddl_parser->xml_ctxt);
+        grddl_parser->xml_ctxt = NULL;
+      }
+#else
+      /* raptor_libxml_reset() is only built for the libxml XML parser */
+      if(grddl_parser->xml_ctxt) {
+        xmlFreeParserCtxt(grddl_parser->xml_ctxt);
+        grddl_parser->xml_ctxt = NULL;
+      }
+#endif
 
-      /* try to create an XML parser context */
-      grddl_parser->xml_ctxt = xmlCreatePushParserCtxt(NULL, NULL,
-                                                       (const char*)buffer,
-                                                       RAPTOR_BAD_CAST(int, buffer_len),
-                                                       (const char*)uri_string);
       if(!grddl_parser->xml_ctxt) {
-        RAPTOR_DEBUG2("Parser %p: Creating an XML parser failed\n", rdf_parser);
-        continue;
+        RAPTOR_DEBUG2("Parser %p: Creating an XML parser\n", rdf_parser);
+
+        /* try to create an XML parser context */
+        grddl_parser->xml_ctxt = xmlCreatePushParserCtxt(NULL, NULL,
+                                                         (const char*)buffer,
+                                                         RAPTOR_BAD_CAST(int, buffer_len),
+                                                         (const char*)uri_string);
+        if(!grddl_parser->xml_ctxt) {
+          RAPTOR_DEBUG2("Parser %p: Creating an XML parser failed\n", rdf_parser);
+          continue;
+        }
       }
 
 #ifdef RAPTOR_LIBXML_XML_PARSE_NONET
@@ -1888,13 +1910,10 @@ raptor_grddl_parse_chunk(raptor_parser* rdf_parser,
     grddl_parser->sb = NULL;
   }
 
-  if(grddl_parser->xml_ctxt) {
-    if(grddl_parser->xml_ctxt->myDoc) {
-      xmlFreeDoc(grddl_parser->xml_ctxt->myDoc);
-      grddl_parser->xml_ctxt->myDoc = NULL;
-    }
-    xmlFreeParserCtxt(grddl_parser->xml_ctxt);
-    grddl_parser->xml_ctxt = NULL;
+  /* the XML parser context is kept for the next document */
+  if(grddl_parser->xml_ctxt && grddl_parser->xml_ctxt->myDoc) {
+    xmlFreeDoc(grddl_parser->xml_ctxt->myDoc);
+    grddl_parser->xml_ctxt->myDoc = NULL;
   }
   if(grddl_parser->html_ctxt) {
     if(grddl_parser->html_ctxt->myDoc) {
@@ -56,23 +56,39 @@ extern "C" {
 #define RAPTOR_DEBUG 1
 #endif
 
+/* Memory is counted against this #raptor_domain; a source file may
+ * define it before including this header */
+#ifndef RAPTOR_MEMORY_DOMAIN
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_NONE
+#endif
+
+/* raptor_general.c - allocate with the raptor_world_set_allocator()
+ * handlers and count allocations; only called when
+ * raptor_memory_hooked is non-0 so the C library is used directly
+ * otherwise */
+RAPTOR_INTERNAL_API extern int raptor_memory_hooked;
+RAPTOR_INTERNAL_API void* raptor_memory_malloc(raptor_domain domain, size_t size);
+RAPTOR_INTERNAL_API void* raptor_memory_calloc(raptor_domain domain, size_t nmemb, size_t size);
+RAPTOR_INTERNAL_API void* raptor_memory_realloc(raptor_domain domain, void *ptr, size_t size);
+RAPTOR_INTERNAL_API void raptor_memory_free(raptor_domain domain, void *ptr);
+
 #if defined(RAPTOR_MEMORY_SIGN)
 #define RAPTOR_SIGN_KEY 0x08A61080
-void* raptor_sign_malloc(size_t size);
-void* raptor_sign_calloc(size_t nmemb, size_t size);
-void* raptor_sign_realloc(void *ptr, size_t size);
-void raptor_sign_free(void *ptr);
+void* raptor_sign_malloc(raptor_domain domain, size_t size);
+void* raptor_sign_calloc(raptor_domain domain, size_t nmemb, size_t size);
+void* raptor_sign_realloc(raptor_domain domain, void *ptr, size_t size);
+void raptor_sign_free(raptor_domain domain, void *ptr);
   
-#define RAPTOR_MALLOC(type, size)   (type)raptor_sign_malloc(size)
-#define RAPTOR_CALLOC(type, nmemb, size) (type)raptor_sign_calloc(nmemb, size)
-#define RAPTOR_REALLOC(type, ptr, size) (type)raptor_sign_realloc(ptr, size)
-#define RAPTOR_FREE(type, ptr)   raptor_sign_free((void*)ptr)
+#define RAPTOR_MALLOC(type, size)   (type)raptor_sign_malloc(RAPTOR_MEMORY_DOMAIN, size)
+#define RAPTOR_CALLOC(type, nmemb, size) (type)raptor_sign_calloc(RAPTOR_MEMORY_DOMAIN, nmemb, size)
+#define RAPTOR_REALLOC(type, ptr, size) (type)raptor_sign_realloc(RAPTOR_MEMORY_DOMAIN, ptr, size)
+#define RAPTOR_FREE(type, ptr)   raptor_sign_free(RAPTOR_MEMORY_DOMAIN, (void*)ptr)
 
 #else
-#define RAPTOR_MALLOC(type, size) (type)malloc(size)
-#define RAPTOR_CALLOC(type, nmemb, size) (type)calloc(nmemb, size)
-#define RAPTOR_REALLOC(type, ptr, size) (type)realloc(ptr, size)
-#define RAPTOR_FREE(type, ptr)   free((void*)ptr)
+#define RAPTOR_MALLOC(type, size) (type)(raptor_memory_hooked ? raptor_memory_malloc(RAPTOR_MEMORY_DOMAIN, size) : malloc(size))
+#define RAPTOR_CALLOC(type, nmemb, size) (type)(raptor_memory_hooked ? raptor_memory_calloc(RAPTOR_MEMORY_DOMAIN, nmemb, size) : calloc(nmemb, size))
+#define RAPTOR_REALLOC(type, ptr, size) (type)(raptor_memory_hooked ? raptor_memory_realloc(RAPTOR_MEMORY_DOMAIN, ptr, size) : realloc(ptr, size))
+#define RAPTOR_FREE(type, ptr)   (raptor_memory_hooked ? raptor_memory_free(RAPTOR_MEMORY_DOMAIN, (void*)ptr) : free((void*)ptr))
 
 #endif
 
@@ -213,6 +229,7 @@ extern void raptor_libxml_finish(raptor_world* world);
 extern void raptor_libxml_validation_error(void *context, const char *msg, ...) RAPTOR_PRINTF_FORMAT(2, 3);
 extern void raptor_libxml_validation_warning(void *context, const char *msg, ...) RAPTOR_PRINTF_FORMAT(2, 3);
 void raptor_libxml_free(xmlParserCtxtPtr xc);
+int raptor_libxml_reset(xmlParserCtxtPtr xc, const char *chunk, int size, const char *filename);
 
 /* raptor_parse.c - exported to libxml part */
 extern void raptor_libxml_update_document_locator(raptor_sax2* sax2, raptor_locator* locator);
@@ -425,6 +442,9 @@ raptor_world* raptor_iostream_get_world(raptor_iostream *iostr);
 
 
 /* Raptor Namespace Stack node */
+/* Index of namespace URIs; see raptor_namespace.c */
+typedef struct raptor_namespace_index_s raptor_namespace_index;
+
 struct raptor_namespace_stack_s {
   raptor_world* world;
   int size;
@@ -432,9 +452,14 @@ struct raptor_namespace_stack_s {
   int table_size;
   raptor_namespace** table;
   raptor_namespace* def_namespace;
+  /* no namespace on the stack is deeper than this; -1 if empty */
+  int max_depth;
 
   raptor_uri *rdf_ms_uri;
   raptor_uri *rdf_schema_uri;
+
+  /* namespaces by URI or NULL if none were started yet */
+  raptor_namespace_index* uri_index;
 };
 
 
@@ -465,6 +490,8 @@ struct raptor_namespace_s {
   int is_rdf_ms;
   /* Non 0 if is RDF Schema Namespace */
   int is_rdf_schema;
+  /* next started namespace with the same URI in the stack's URI index */
+  struct raptor_namespace_s* uri_next;
 };
 
 raptor_namespace** raptor_namespace_stack_to_array(raptor_namespace_stack *nstack, size_t *size_p);
@@ -710,8 +737,103 @@ void raptor_stats_print(raptor_parser *rdf_parser, FILE *stream);
 RAPTOR_INTERNAL_API const char* raptor_basename(const char *name);
 int raptor_term_print_as_ntriples(const raptor_term *term, FILE* stream);
 
+/* raptor_arena.c */
+typedef struct raptor_arena_s raptor_arena;
+
+RAPTOR_INTERNAL_API raptor_arena* raptor_new_arena(size_t block_size);
+RAPTOR_INTERNAL_API void raptor_free_arena(raptor_arena* arena);
+RAPTOR_INTERNAL_API void* raptor_arena_alloc(raptor_arena* arena, size_t size);
+RAPTOR_INTERNAL_API void raptor_arena_reset(raptor_arena* arena);
+raptor_term* raptor_arena_new_term_from_uri(raptor_arena* arena, raptor_world* world, raptor_uri* uri);
+raptor_term* raptor_arena_new_term_from_literal(raptor_arena* arena, raptor_world* world, const unsigned char* literal, raptor_uri* datatype, const unsigned char* language);
+raptor_term* raptor_arena_new_term_from_blank(raptor_arena* arena, raptor_world* world, const unsigned char* blank);
+
+typedef struct raptor_freelist_s raptor_freelist;
+
+RAPTOR_INTERNAL_API raptor_freelist* raptor_new_freelist(size_t object_size, raptor_data_free_handler clear_handler);
+RAPTOR_INTERNAL_API void raptor_free_freelist(raptor_freelist* freelist);
+RAPTOR_INTERNAL_API void* raptor_freelist_alloc(raptor_freelist* freelist);
+RAPTOR_INTERNAL_API void raptor_freelist_release(raptor_freelist* freelist, void* object);
+
+/* raptor_statement_sorter.c */
+typedef struct raptor_statement_sorter_s raptor_statement_sorter;
+
+RAPTOR_INTERNAL_API raptor_statement_sorter* raptor_new_statement_sorter(raptor_world* world, size_t memory_limit);
+RAPTOR_INTERNAL_API void raptor_free_statement_sorter(raptor_statement_sorter* sorter);
+RAPTOR_INTERNAL_API int raptor_statement_sorter_add(raptor_statement_sorter* sorter, raptor_statement* statement);
+RAPTOR_INTERNAL_API raptor_statement* raptor_statement_sorter_next(raptor_statement_sorter* sorter);
+RAPTOR_INTERNAL_API int raptor_statement_sorter_failed(raptor_statement_sorter* sorter);
+
+/* raptor_compress.c */
+RAPTOR_INTERNAL_API raptor_compression_type raptor_compression_guess(const unsigned char* buffer, size_t length);
+
 /* raptor_ntriples.c */
-size_t raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator, unsigned char *string, size_t *len_p, raptor_term** term_p, int allow_turtle);
+/* Allow Turtle forms such as integers, boolean */
+#define RAPTOR_NTRIPLES_TERM_ALLOW_TURTLE 1
+/* Do not report errors; fail on anything that would have been reported */
+#define RAPTOR_NTRIPLES_TERM_QUIET 2
+size_t raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator, unsigned char *string, size_t *len_p, raptor_term** term_p, int flags, raptor_arena* arena);
+
+/* raptor_ntriples_scan.c */
+typedef enum {
+  RAPTOR_NTRIPLES_SCANNER_BEST,
+  RAPTOR_NTRIPLES_SCANNER_SCALAR,
+  RAPTOR_NTRIPLES_SCANNER_SSE2,
+  RAPTOR_NTRIPLES_SCANNER_AVX2
+} raptor_ntriples_scanner_type;
+
+typedef unsigned char* (*raptor_ntriples_line_scanner)(unsigned char* ptr, unsigned char* end);
+
+RAPTOR_INTERNAL_API raptor_ntriples_line_scanner raptor_ntriples_get_line_scanner(raptor_ntriples_scanner_type type);
+
+/* raptor_thread.c */
+typedef struct raptor_mutex_s raptor_mutex;
+typedef struct raptor_thread_pool_s raptor_thread_pool;
+
+typedef void (*raptor_thread_task_handler)(void* user_data);
+
+typedef enum {
+  RAPTOR_THREAD_TASK_IDLE,
+  RAPTOR_THREAD_TASK_QUEUED,
+  RAPTOR_THREAD_TASK_DONE
+} raptor_thread_task_state;
+
+/* A unit of work for a thread pool; owned and usually embedded by the caller */
+typedef struct raptor_thread_task_s {
+  raptor_thread_task_handler handler;
+  void* user_data;
+
+  /* fields below are owned by the thread pool */
+  raptor_thread_task_state state;
+  struct raptor_thread_task_s* next;
+} raptor_thread_task;
+
+RAPTOR_INTERNAL_API raptor_mutex* raptor_new_mutex(void);
+RAPTOR_INTERNAL_API void raptor_free_mutex(raptor_mutex* mutex);
+RAPTOR_INTERNAL_API void raptor_mutex_lock(raptor_mutex* mutex);
+RAPTOR_INTERNAL_API void raptor_mutex_unlock(raptor_mutex* mutex);
+RAPTOR_INTERNAL_API raptor_thread_pool* raptor_new_thread_pool(int threads);
+RAPTOR_INTERNAL_API void raptor_free_thread_pool(raptor_thread_pool* pool);
+RAPTOR_INTERNAL_API int raptor_thread_pool_get_threads_count(raptor_thread_pool* pool);
+RAPTOR_INTERNAL_API void raptor_thread_pool_submit(raptor_thread_pool* pool, raptor_thread_task* task);
+RAPTOR_INTERNAL_API void raptor_thread_pool_wait(raptor_thread_pool* pool, raptor_thread_task* task);
+RAPTOR_INTERNAL_API raptor_thread_task* raptor_thread_pool_wait_any(raptor_thread_pool* pool);
+
+/* Atomic updates of counters shared between threads */
+#ifdef HAVE_ATOMIC_BUILTINS
+#define RAPTOR_ATOMIC_INCREMENT(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define RAPTOR_ATOMIC_DECREMENT(p) __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+#define RAPTOR_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define RAPTOR_ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+/* updates *@expected with the current value on failure */
+#define RAPTOR_ATOMIC_COMPARE_AND_SWAP(p, expected, desired) \
+  __atomic_compare_exchange_n((p), (expected), (desired), 0, \
+                              __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#ifdef HAVE_PTHREAD_H
+/* RAPTOR_WORLD_FLAG_THREAD_SAFE is supported */
+#define RAPTOR_THREAD_SAFE_WORLD 1
+#endif
+#endif
 
 /* raptor_parse.c */
 raptor_parser_factory* raptor_world_get_parser_factory(raptor_world* world, const char *name);  
@@ -805,6 +927,8 @@ struct raptor_qname_s {
 
 
 /* raptor_qname.c */
+raptor_qname* raptor_new_qname_from_freelist(raptor_freelist* freelist, raptor_namespace_stack *nstack, const unsigned char *name, const unsigned char *value);
+void raptor_qname_release(raptor_freelist* freelist, raptor_qname* name);
 #ifdef RAPTOR_DEBUG
 void raptor_qname_print(FILE *stream, raptor_qname* name);
 #endif
@@ -812,10 +936,16 @@ void raptor_qname_print(FILE *stream, raptor_qname* name);
 
 /* raptor_uri.c */
 
+/* URI intern table shard; see raptor_uri.c */
+typedef struct raptor_uri_shard_s raptor_uri_shard;
+
 int raptor_uri_init(raptor_world* world);
 void raptor_uri_finish(raptor_world* world);
+int raptor_uri_init_locking(raptor_world* world);
 raptor_uri* raptor_new_uri_from_rdf_ordinal(raptor_world* world, int ordinal);
 size_t raptor_uri_normalize_path(unsigned char* path_buffer, size_t path_len);
+unsigned int raptor_uri_get_hash(raptor_uri *uri);
+raptor_uri* raptor_new_uri_relative_to_base_detail(raptor_world* world, raptor_uri *base_uri, raptor_uri_detail *base_detail, const unsigned char *uri_string, size_t uri_len);
 
 /* parsers */
 int raptor_init_parser_rdfxml(raptor_world* world);
@@ -922,6 +1052,7 @@ extern const unsigned char * const raptor_atom_namespace_uri;
 RAPTOR_INTERNAL_API raptor_uri_detail* raptor_new_uri_detail(const unsigned char *uri_string);
 RAPTOR_INTERNAL_API void raptor_free_uri_detail(raptor_uri_detail* uri_detail);
 unsigned char* raptor_uri_detail_to_string(raptor_uri_detail *ud, size_t* len_p);
+size_t raptor_uri_resolve_uri_reference_detail(const unsigned char *base_uri, raptor_uri_detail *base_detail, const unsigned char *reference_uri, unsigned char *buffer, size_t length);
 
 /* serializers */
 /* raptor_serializer.c */
@@ -1052,7 +1183,7 @@ void raptor_www_libfetch_free(raptor_www *www);
 int raptor_www_libfetch_fetch(raptor_www *www);
 
 /* raptor_set.c */
-RAPTOR_INTERNAL_API raptor_id_set* raptor_new_id_set(raptor_world* world);
+RAPTOR_INTERNAL_API raptor_id_set* raptor_new_id_set(raptor_world* world, int exact);
 RAPTOR_INTERNAL_API void raptor_free_id_set(raptor_id_set* set);
 RAPTOR_INTERNAL_API int raptor_id_set_add(raptor_id_set* set, raptor_uri* base_uri, const unsigned char *item, size_t item_len);
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
@@ -1069,12 +1200,22 @@ struct raptor_xml_element_s {
   raptor_qname *name;
   raptor_qname **attributes;
   unsigned int attribute_count;
+  /* allocated length of attributes array */
+  unsigned int attributes_size;
 
   /* value of xml:lang attribute on this element or NULL */
   const unsigned char *xml_language;
 
   /* URI of xml:base attribute value on this element or NULL */
   raptor_uri *base_uri;
+  /* base_uri split into components or NULL */
+  raptor_uri_detail *base_uri_detail;
+
+  /* xml:lang and base URI in scope at this element, shared with the
+   * element or ancestor declaring them; set by raptor_xml_element_push() */
+  const unsigned char *inscope_xml_language;
+  raptor_uri *inscope_base_uri;
+  raptor_uri_detail *inscope_base_uri_detail;
 
   /* CDATA content of element and checks for mixed content */
   raptor_stringbuffer* content_cdata_sb;
@@ -1102,6 +1243,9 @@ struct raptor_sax2_s {
   xmlSAXHandler sax;
   /* parser context */
   xmlParserCtxtPtr xc;
+  /* non-0 when xc is from a previous document and is reset by the
+   * first chunk of the next one */
+  int xc_reset;
   /* pointer to SAX document locator */
   xmlSAXLocatorPtr loc;
 
@@ -1146,6 +1290,7 @@ struct raptor_sax2_s {
 
   /* base URI for resolving relative URIs or xml:base URIs */
   raptor_uri* base_uri;
+  raptor_uri_detail* base_uri_detail;
 
   /* sax2 init failed - do not try to do anything with it */
   int failed;
@@ -1155,6 +1300,15 @@ struct raptor_sax2_s {
 
   void* uri_filter_user_data;
   raptor_uri_filter_func uri_filter;
+
+  /* per-element objects given back at end tags for the next start tag */
+  raptor_freelist* element_freelist;
+  raptor_freelist* qname_freelist;
+  raptor_freelist* attributes_freelist;
+
+  /* copy of the XML attribute pointers passed to start element */
+  const unsigned char** atts_copy;
+  size_t atts_copy_size;
 };
 
 int raptor_sax2_init(raptor_world* world);
@@ -1168,6 +1322,7 @@ void raptor_sax2_inc_depth(raptor_sax2* sax2);
 void raptor_sax2_dec_depth(raptor_sax2* sax2);
 void raptor_sax2_update_document_locator(raptor_sax2* sax2, raptor_locator* locator);
 int raptor_sax2_set_option(raptor_sax2 *sax2, raptor_option option, char* string, int integer);
+raptor_uri* raptor_sax2_new_uri_relative_to_inscope_base(raptor_sax2 *sax2, const unsigned char *uri_string);
   
 #ifdef RAPTOR_DEBUG
 void raptor_print_xml_element(raptor_xml_element *element, FILE* stream);
@@ -1252,6 +1407,9 @@ RAPTOR_INTERNAL_API int raptor_stringbuffer_append_turtle_string(raptor_stringbu
 
 /* raptor_abbrev.c */
 
+/* Hash table of nodes or subjects keyed by term; see raptor_abbrev.c */
+typedef struct raptor_abbrev_table_s raptor_abbrev_table;
+
 typedef struct {
   raptor_world* world;
   int ref_count;         /* count of references to this node */
@@ -1293,15 +1451,21 @@ raptor_abbrev_node* raptor_new_abbrev_node(raptor_world* world, raptor_term* ter
 void raptor_free_abbrev_node(raptor_abbrev_node* node);
 int raptor_abbrev_node_compare(raptor_abbrev_node* node1, raptor_abbrev_node* node2);
 int raptor_abbrev_node_equals(raptor_abbrev_node* node1, raptor_abbrev_node* node2);
-raptor_abbrev_node* raptor_abbrev_node_lookup(raptor_avltree* nodes, raptor_term* term);
+raptor_abbrev_node* raptor_abbrev_node_lookup(raptor_abbrev_table* nodes, raptor_term* term);
 
 void raptor_free_abbrev_subject(raptor_abbrev_subject* subject);
 int raptor_abbrev_subject_add_property(raptor_abbrev_subject* subject, raptor_abbrev_node* predicate, raptor_abbrev_node* object);
 int raptor_abbrev_subject_compare(raptor_abbrev_subject* subject1, raptor_abbrev_subject* subject2);
-raptor_abbrev_subject* raptor_abbrev_subject_find(raptor_avltree *subjects, raptor_term* node);
-raptor_abbrev_subject* raptor_abbrev_subject_lookup(raptor_avltree* nodes, raptor_avltree* subjects, raptor_avltree* blanks, raptor_term* term);
+raptor_abbrev_subject* raptor_abbrev_subject_find(raptor_abbrev_table *subjects, raptor_term* node);
+raptor_abbrev_subject* raptor_abbrev_subject_lookup(raptor_abbrev_table* nodes, raptor_abbrev_table* subjects, raptor_abbrev_table* blanks, raptor_term* term);
 int raptor_abbrev_subject_valid(raptor_abbrev_subject *subject);
 int raptor_abbrev_subject_invalidate(raptor_abbrev_subject *subject);
+raptor_sequence* raptor_abbrev_subjects_sort(raptor_abbrev_table* subjects);
+
+raptor_abbrev_table* raptor_new_abbrev_table(raptor_world* world, raptor_data_free_handler free_handler);
+void raptor_free_abbrev_table(raptor_abbrev_table* table);
+int raptor_abbrev_table_size(raptor_abbrev_table* table);
+int raptor_abbrev_table_delete(raptor_abbrev_table* table, raptor_term* term);
 
 
 /* avltree */
@@ -1465,7 +1629,29 @@ struct raptor_world_s {
   xmlGenericErrorFunc libxml_saved_generic_error_handler;
 #endif  
 
-  raptor_avltree *uris_tree;
+  /* Interned URIs, split by hash into shards with a table and lock
+   * each; see raptor_uri.c.  There is one shard unless the world is
+   * thread safe.
+   */
+  raptor_uri_shard *uri_shards;
+  unsigned int uri_shards_count;
+
+  /* Non-0 if URIs are constructed, copied and destroyed from several
+   * threads such as for parallel parsing or a thread safe world; see
+   * raptor_uri_init_locking()
+   */
+  int uris_locking;
+
+  /* Non-0 if RAPTOR_WORLD_FLAG_THREAD_SAFE is set */
+  int thread_safe;
+
+  /* Non-0 if RAPTOR_WORLD_FLAG_MEMORY_COUNTERS is set */
+  int memory_counters;
+
+  /* Lock for lazily initialised shared data in a thread safe world
+   * or NULL
+   */
+  raptor_mutex *mutex;
 
   raptor_uri* concepts[RDF_NS_LAST + 1];
 
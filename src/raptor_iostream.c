@@ -31,6 +31,8 @@
 #include <ctype.h>
 #include <stdarg.h>
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_IOSTREAM
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -44,6 +46,9 @@
 #define RAPTOR_IOSTREAM_FLAGS_EOF           1
 #define RAPTOR_IOSTREAM_FLAGS_FREE_HANDLER  2
 
+/* default size of the write buffer */
+#define RAPTOR_IOSTREAM_WRITE_BUFFER_SIZE 8192
+
 struct raptor_iostream_s
 {
   raptor_world *world;
@@ -53,6 +58,12 @@ struct raptor_iostream_s
   size_t offset;
   unsigned int mode;
   int flags;
+
+  /* writes not yet passed to the handler; allocated on first use */
+  unsigned char *buffer;
+  size_t buffer_length;
+  /* size of @buffer or 0 if writes are not buffered */
+  size_t buffer_size;
 };
 
 
@@ -130,6 +141,8 @@ raptor_new_iostream_from_handler(raptor_world *world,
   iostr->handler = handler;
   iostr->user_data = (void*)user_data;
   iostr->mode = raptor_iostream_calculate_modes(handler);
+  if(iostr->mode & RAPTOR_IOSTREAM_MODE_WRITE)
+    iostr->buffer_size = RAPTOR_IOSTREAM_WRITE_BUFFER_SIZE;
   
   if(iostr->handler->init && 
      iostr->handler->init(iostr->user_data)) {
@@ -195,12 +208,19 @@ static const raptor_iostream_handler raptor_iostream_sink_handler = {
 raptor_iostream*
 raptor_new_iostream_to_sink(raptor_world *world)
 {
+  raptor_iostream* iostr;
+
   RAPTOR_CHECK_CONSTRUCTOR_WORLD(world);
 
   raptor_world_open(world);
   
-  return raptor_new_iostream_from_handler(world,
-                                          NULL, &raptor_iostream_sink_handler);
+  iostr = raptor_new_iostream_from_handler(world,
+                                           NULL, &raptor_iostream_sink_handler);
+  /* nothing to gain from buffering writes that are discarded */
+  if(iostr)
+    iostr->buffer_size = 0;
+
+  return iostr;
 }
 
 
@@ -304,6 +324,7 @@ raptor_new_iostream_to_filename(raptor_world *world, const char *filename)
   iostr->handler = handler;
   iostr->user_data = (void*)handle;
   iostr->mode = mode;
+  iostr->buffer_size = RAPTOR_IOSTREAM_WRITE_BUFFER_SIZE;
 
   if(iostr->handler->init && 
      iostr->handler->init(iostr->user_data)) {
@@ -336,6 +357,9 @@ static const raptor_iostream_handler raptor_iostream_write_file_handler = {
  * The @handle must already be open for writing.
  * NOTE: This does not fclose the @handle when it is finished.
  *
+ * Writes are buffered; call raptor_iostream_flush() before writing
+ * to @handle directly.
+ *
  * Return value: new #raptor_iostream object or NULL on failure
  **/
 raptor_iostream*
@@ -364,6 +388,7 @@ raptor_new_iostream_to_file_handle(raptor_world *world, FILE *handle)
   iostr->handler = handler;
   iostr->user_data = (void*)handle;
   iostr->mode = mode;
+  iostr->buffer_size = RAPTOR_IOSTREAM_WRITE_BUFFER_SIZE;
 
   if(iostr->handler->init && iostr->handler->init(iostr->user_data)) {
     RAPTOR_FREE(raptor_iostream, iostr);
@@ -522,6 +547,7 @@ raptor_new_iostream_to_string(raptor_world *world,
   iostr->handler = handler;
   iostr->user_data = (void*)con;
   iostr->mode = mode;
+  iostr->buffer_size = RAPTOR_IOSTREAM_WRITE_BUFFER_SIZE;
 
   if(iostr->handler->init && iostr->handler->init(iostr->user_data)) {
     raptor_free_iostream(iostr);
@@ -693,6 +719,8 @@ raptor_free_iostream(raptor_iostream *iostr)
   
   if(iostr->flags & RAPTOR_IOSTREAM_FLAGS_EOF)
     raptor_iostream_write_end(iostr);
+  else
+    raptor_iostream_flush(iostr);
 
   if(iostr->handler->finish)
     iostr->handler->finish(iostr->user_data);
@@ -700,10 +728,115 @@ raptor_free_iostream(raptor_iostream *iostr)
   if((iostr->flags & RAPTOR_IOSTREAM_FLAGS_FREE_HANDLER))
     RAPTOR_FREE(raptor_iostream_handler, iostr->handler);
 
+  if(iostr->buffer)
+    RAPTOR_FREE(cdata, iostr->buffer);
+
   RAPTOR_FREE(raptor_iostream, iostr);
 }
 
 
+/*
+ * raptor_iostream_write_through:
+ * @iostr: raptor iostream
+ * @ptr: bytes to write
+ * @len: number of bytes
+ *
+ * Pass bytes to the handler, a byte at a time if it has no write_bytes
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_iostream_write_through(raptor_iostream *iostr,
+                              const unsigned char *ptr, size_t len)
+{
+  if(iostr->handler->write_bytes) {
+    int nobj = iostr->handler->write_bytes(iostr->user_data, ptr, 1, len);
+    return (nobj < 0 || RAPTOR_BAD_CAST(size_t, nobj) != len);
+  }
+
+  while(len--) {
+    if(iostr->handler->write_byte(iostr->user_data, *ptr++))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * raptor_iostream_flush:
+ * @iostr: raptor iostream
+ *
+ * Pass any buffered writes to the iostream handler.
+ *
+ * This happens when the buffer fills, at raptor_iostream_write_end(),
+ * when the iostream is destroyed, and at the end of serializing
+ * or a raptor_serializer_flush() for the serializer iostream.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+raptor_iostream_flush(raptor_iostream *iostr)
+{
+  size_t len = iostr->buffer_length;
+
+  if(!len)
+    return 0;
+
+  iostr->buffer_length = 0;
+  return raptor_iostream_write_through(iostr, iostr->buffer, len);
+}
+
+
+/**
+ * raptor_iostream_set_write_buffer_size:
+ * @iostr: raptor iostream
+ * @size: buffer size in bytes or 0 to pass each write to the handler
+ *
+ * Set the size of the write buffer.
+ *
+ * Iostreams collect writes in a buffer and pass them to the
+ * handler in large blocks.  Any buffered writes are flushed first.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+raptor_iostream_set_write_buffer_size(raptor_iostream *iostr, size_t size)
+{
+  int rc;
+
+  if(!(iostr->mode & RAPTOR_IOSTREAM_MODE_WRITE))
+    return 1;
+
+  rc = raptor_iostream_flush(iostr);
+
+  if(iostr->buffer) {
+    RAPTOR_FREE(cdata, iostr->buffer);
+    iostr->buffer = NULL;
+  }
+  iostr->buffer_size = size;
+
+  return rc;
+}
+
+
+/* Get the write buffer, making it if needed; NULL if writes are not
+ * buffered
+ */
+static unsigned char*
+raptor_iostream_get_write_buffer(raptor_iostream *iostr)
+{
+  if(!iostr->buffer && iostr->buffer_size) {
+    iostr->buffer = RAPTOR_MALLOC(unsigned char*, iostr->buffer_size);
+    /* write unbuffered if there is no memory for it */
+    if(!iostr->buffer)
+      iostr->buffer_size = 0;
+  }
+
+  return iostr->buffer;
+}
+
+
 
 /**
  * raptor_iostream_write_byte:
@@ -721,10 +854,19 @@ raptor_iostream_write_byte(const int byte, raptor_iostream *iostr)
 
   if(iostr->flags & RAPTOR_IOSTREAM_FLAGS_EOF)
     return 1;
-  if(!iostr->handler->write_byte)
-    return 1;
   if(!(iostr->mode & RAPTOR_IOSTREAM_MODE_WRITE))
     return 1;
+
+  if(raptor_iostream_get_write_buffer(iostr)) {
+    if(iostr->buffer_length == iostr->buffer_size &&
+       raptor_iostream_flush(iostr))
+      return 1;
+    iostr->buffer[iostr->buffer_length++] = RAPTOR_GOOD_CAST(unsigned char, byte);
+    return 0;
+  }
+
+  if(!iostr->handler->write_byte)
+    return 1;
   return iostr->handler->write_byte(iostr->user_data, byte);
 }
 
@@ -748,11 +890,34 @@ raptor_iostream_write_bytes(const void *ptr, size_t size, size_t nmemb,
   
   if(iostr->flags & RAPTOR_IOSTREAM_FLAGS_EOF)
     return -1;
-  if(!iostr->handler->write_bytes)
-    return -1;
   if(!(iostr->mode & RAPTOR_IOSTREAM_MODE_WRITE))
     return -1;
 
+  if(raptor_iostream_get_write_buffer(iostr)) {
+    size_t len = size * nmemb;
+
+    if(len > iostr->buffer_size - iostr->buffer_length) {
+      if(raptor_iostream_flush(iostr))
+        return -1;
+
+      /* too big to be worth buffering */
+      if(len >= iostr->buffer_size) {
+        if(raptor_iostream_write_through(iostr, (const unsigned char*)ptr, len))
+          return -1;
+        iostr->offset += len;
+        return RAPTOR_BAD_CAST(int, nmemb);
+      }
+    }
+
+    memcpy(iostr->buffer + iostr->buffer_length, ptr, len);
+    iostr->buffer_length += len;
+    iostr->offset += len;
+    return RAPTOR_BAD_CAST(int, nmemb);
+  }
+
+  if(!iostr->handler->write_bytes)
+    return -1;
+
   nobj = iostr->handler->write_bytes(iostr->user_data, ptr, size, nmemb);
   if(nobj > 0)
     iostr->offset += (size * nobj);
@@ -828,12 +993,13 @@ raptor_uri_write(raptor_uri* uri, raptor_iostream* iostr)
 int
 raptor_iostream_write_end(raptor_iostream *iostr)
 {
-  int rc = 0;
+  int rc;
   
   if(iostr->flags & RAPTOR_IOSTREAM_FLAGS_EOF)
     return 1;
-  if(iostr->handler->write_end)
-    rc = iostr->handler->write_end(iostr->user_data);
+  rc = raptor_iostream_flush(iostr);
+  if(iostr->handler->write_end && iostr->handler->write_end(iostr->user_data))
+    rc = 1;
   iostr->flags |= RAPTOR_IOSTREAM_FLAGS_EOF;
 
   return rc;
@@ -1577,6 +1743,108 @@ test_read_from_sink(raptor_world *world, size_t read_len, size_t expected_len)
 }
 
 
+struct counting_writer {
+  char out[READ_BUFFER_SIZE];
+  size_t out_len;
+  int calls;
+};
+
+static int
+counting_writer_write_bytes(void *context, const void *ptr,
+                            size_t size, size_t nmemb)
+{
+  struct counting_writer* cw = (struct counting_writer*)context;
+  size_t len = size * nmemb;
+
+  if(cw->out_len + len > READ_BUFFER_SIZE)
+    return 0;
+  memcpy(cw->out + cw->out_len, ptr, len);
+  cw->out_len += len;
+  cw->calls++;
+  return RAPTOR_BAD_CAST(int, nmemb);
+}
+
+static int
+counting_writer_write_byte(void *context, const int byte)
+{
+  char b = RAPTOR_GOOD_CAST(char, byte);
+
+  return (counting_writer_write_bytes(context, &b, 1, 1) != 1);
+}
+
+static const raptor_iostream_handler counting_writer_handler = {
+  /* .version     = */ 2,
+  /* .init        = */ NULL,
+  /* .finish      = */ NULL,
+  /* .write_byte  = */ counting_writer_write_byte,
+  /* .write_bytes = */ counting_writer_write_bytes,
+  /* .write_end   = */ NULL,
+  /* .read_bytes  = */ NULL,
+  /* .read_eof    = */ NULL
+};
+
+
+static int
+test_write_buffering(raptor_world *world, size_t buffer_size,
+                     const char* test_string, size_t test_string_len,
+                     const int expected_calls)
+{
+  raptor_iostream *iostr = NULL;
+  struct counting_writer cw;
+  size_t i;
+  int rc = 0;
+  const char* const label="write iostream with buffering";
+
+#if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
+  fprintf(stderr, "%s: Testing %s size %d\n", program, label,
+          (int)buffer_size);
+#endif
+
+  memset(&cw, '\0', sizeof(cw));
+  iostr = raptor_new_iostream_from_handler(world, &cw,
+                                           &counting_writer_handler);
+  if(!iostr || raptor_iostream_set_write_buffer_size(iostr, buffer_size)) {
+    fprintf(stderr, "%s: Failed to create %s\n", program, label);
+    rc = 1;
+    goto tidy;
+  }
+
+  /* a byte at a time, then the whole string at once */
+  for(i = 0; i < test_string_len; i++)
+    raptor_iostream_write_byte(test_string[i], iostr);
+  raptor_iostream_write_bytes(test_string, 1, test_string_len, iostr);
+
+  if(raptor_iostream_flush(iostr)) {
+    fprintf(stderr, "%s: %s flush failed\n", program, label);
+    rc = 1;
+    goto tidy;
+  }
+
+  if(cw.out_len != 2 * test_string_len ||
+     strncmp(cw.out, test_string, test_string_len) ||
+     strncmp(cw.out + test_string_len, test_string, test_string_len)) {
+    fprintf(stderr, "%s: %s wrote '%.*s'\n", program, label,
+            (int)cw.out_len, cw.out);
+    rc = 1;
+  }
+
+  if(cw.calls != expected_calls) {
+    fprintf(stderr, "%s: %s size %d made %d handler calls, expected %d\n",
+            program, label, (int)buffer_size, cw.calls, expected_calls);
+    rc = 1;
+  }
+
+  tidy:
+  if(iostr)
+    raptor_free_iostream(iostr);
+
+  if(rc)
+    fprintf(stderr, "%s: FAILED Testing %s\n", program, label);
+
+  return rc;
+}
+
+
 #define OUT_FILENAME "out.bin"
 #define OUT_BYTES_COUNT 14
 #define TEST_STRING "Hello, world!"
@@ -1619,6 +1887,16 @@ main(int argc, char *argv[])
   failures+= test_write_to_sink(world,
                                 TEST_STRING,
                                 TEST_STRING_LEN, (int)OUT_BYTES_COUNT);
+  /* one flush for everything */
+  failures+= test_write_buffering(world, 64,
+                                  TEST_STRING, TEST_STRING_LEN, 1);
+  /* full buffer flushed after the bytes; string is too big to buffer */
+  failures+= test_write_buffering(world, TEST_STRING_LEN,
+                                  TEST_STRING, TEST_STRING_LEN, 2);
+  /* unbuffered: one call per byte and one for the string */
+  failures+= test_write_buffering(world, 0,
+                                  TEST_STRING, TEST_STRING_LEN,
+                                  TEST_STRING_LEN + 1);
 
   remove(OUT_FILENAME);
 
@@ -42,6 +42,8 @@
 
 #include <yajl/yajl_parse.h>
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_PARSER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -75,6 +77,29 @@ typedef enum {
   RAPTOR_JSON_ATTRIB_DATATYPE
 } raptor_json_term_attrib;
 
+/* Map keys with a meaning in RDF/JSON */
+typedef enum {
+  RAPTOR_JSON_KEY_UNKNOWN,
+  RAPTOR_JSON_KEY_TRIPLES,
+  RAPTOR_JSON_KEY_SUBJECT,
+  RAPTOR_JSON_KEY_PREDICATE,
+  RAPTOR_JSON_KEY_OBJECT,
+  RAPTOR_JSON_KEY_VALUE,
+  RAPTOR_JSON_KEY_TYPE,
+  RAPTOR_JSON_KEY_DATATYPE,
+  RAPTOR_JSON_KEY_LANG
+} raptor_json_key;
+
+/* Growable string kept between terms */
+typedef struct {
+  unsigned char* string;
+  size_t length;
+  size_t size;
+} raptor_json_buffer;
+
+/* Most datatype URIs remembered by a parser */
+#define RAPTOR_JSON_DATATYPES_SIZE 16
+
 
 /* When YAJL V1 support is dropped, this can be removed */
 #ifdef HAVE_YAJL2
@@ -99,10 +124,15 @@ struct raptor_json_parser_context_s {
   raptor_json_term_attrib attrib;
 
   /* Temporary storage, while creating terms */
-  raptor_term_type term_type;
-  unsigned char*   term_value;
-  unsigned char*   term_datatype;
-  unsigned char*   term_lang;
+  raptor_term_type   term_type;
+  raptor_json_buffer term_value;
+  int                term_has_value;
+  raptor_json_buffer term_lang;
+  raptor_uri*        term_datatype;
+
+  /* Datatype URIs seen, each made once; replaced in turn when full */
+  raptor_uri* datatypes[RAPTOR_JSON_DATATYPES_SIZE];
+  int datatypes_next;
 
   /* Temporary storage, while creating statements */
   raptor_statement statement;
@@ -114,35 +144,200 @@ typedef struct raptor_json_parser_context_s raptor_json_parser_context;
 static void
 raptor_json_reset_term(raptor_json_parser_context *context)
 {
-  if(context->term_value)
-    RAPTOR_FREE(char*, context->term_value);
-  if(context->term_lang)
-    RAPTOR_FREE(char*, context->term_lang);
-  if(context->term_datatype)
-    RAPTOR_FREE(char*, context->term_datatype);
-
-  context->term_value = NULL;
-  context->term_lang = NULL;
-  context->term_datatype = NULL;
+  if(context->term_datatype) {
+    raptor_free_uri(context->term_datatype);
+    context->term_datatype = NULL;
+  }
+
+  context->term_has_value = 0;
+  context->term_value.length = 0;
+  context->term_lang.length = 0;
   context->term_type = RAPTOR_TERM_TYPE_UNKNOWN;
   context->attrib = RAPTOR_JSON_ATTRIB_UNKNOWN;
 }
 
-static unsigned char*
-raptor_json_cstring_from_counted_string(raptor_parser *rdf_parser, const unsigned char* str, RAPTOR_YAJL_LEN_TYPE len)
+
+/*
+ * raptor_json_buffer_set:
+ * @rdf_parser: parser
+ * @buffer: buffer
+ * @str: counted string from YAJL
+ * @len: length of @str
+ *
+ * INTERNAL - Copy a YAJL string into a buffer, growing it if needed.
+ * The buffer is NUL terminated.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_json_buffer_set(raptor_parser *rdf_parser, raptor_json_buffer* buffer,
+                       const unsigned char* str, size_t len)
 {
-  unsigned char *cstr = RAPTOR_MALLOC(unsigned char*, len + 1);
-  if(!cstr) {
-    raptor_parser_fatal_error(rdf_parser, "Out of memory");
-    return NULL;
+  if(len + 1 > buffer->size) {
+    size_t new_size = buffer->size ? buffer->size : 64;
+    unsigned char* new_string;
+
+    while(new_size < len + 1)
+      new_size <<= 1;
+
+    new_string = RAPTOR_MALLOC(unsigned char*, new_size);
+    if(!new_string) {
+      raptor_parser_fatal_error(rdf_parser, "Out of memory");
+      return 1;
+    }
+    if(buffer->string)
+      RAPTOR_FREE(char*, buffer->string);
+    buffer->string = new_string;
+    buffer->size = new_size;
+  }
+
+  memcpy(buffer->string, str, len);
+  buffer->string[len] = '\0';
+  buffer->length = len;
+
+  return 0;
+}
+
+
+/*
+ * raptor_json_key_lookup:
+ * @str: map key string
+ * @len: length of @str
+ *
+ * INTERNAL - Identify an RDF/JSON map key by its length then bytes
+ *
+ * Return value: key or RAPTOR_JSON_KEY_UNKNOWN
+ */
+static raptor_json_key
+raptor_json_key_lookup(const unsigned char* str, size_t len)
+{
+  switch(len) {
+    case 4:
+      if(str[0] == 't' && !memcmp(str + 1, "ype", 3))
+        return RAPTOR_JSON_KEY_TYPE;
+      if(str[0] == 'l' && !memcmp(str + 1, "ang", 3))
+        return RAPTOR_JSON_KEY_LANG;
+      break;
+
+    case 5:
+      if(str[0] == 'v' && !memcmp(str + 1, "alue", 4))
+        return RAPTOR_JSON_KEY_VALUE;
+      break;
+
+    case 6:
+      if(str[0] == 'o' && !memcmp(str + 1, "bject", 5))
+        return RAPTOR_JSON_KEY_OBJECT;
+      break;
+
+    case 7:
+      if(str[0] == 't' && !memcmp(str + 1, "riples", 6))
+        return RAPTOR_JSON_KEY_TRIPLES;
+      if(str[0] == 's' && !memcmp(str + 1, "ubject", 6))
+        return RAPTOR_JSON_KEY_SUBJECT;
+      break;
+
+    case 8:
+      if(str[0] == 'd' && !memcmp(str + 1, "atatype", 7))
+        return RAPTOR_JSON_KEY_DATATYPE;
+      break;
+
+    case 9:
+      if(str[0] == 'p' && !memcmp(str + 1, "redicate", 8))
+        return RAPTOR_JSON_KEY_PREDICATE;
+      break;
+
+    default:
+      break;
+  }
+
+  return RAPTOR_JSON_KEY_UNKNOWN;
+}
+
+
+/*
+ * raptor_json_term_type_lookup:
+ * @str: term "type" value
+ * @len: length of @str
+ *
+ * INTERNAL - Identify a term type name by its length then bytes
+ *
+ * Return value: term type or RAPTOR_TERM_TYPE_UNKNOWN
+ */
+static raptor_term_type
+raptor_json_term_type_lookup(const unsigned char* str, size_t len)
+{
+  switch(len) {
+    case 3:
+      if(!memcmp(str, "uri", 3))
+        return RAPTOR_TERM_TYPE_URI;
+      break;
+
+    case 5:
+      if(!memcmp(str, "bnode", 5))
+        return RAPTOR_TERM_TYPE_BLANK;
+      break;
+
+    case 7:
+      if(!memcmp(str, "literal", 7))
+        return RAPTOR_TERM_TYPE_LITERAL;
+      break;
+
+    default:
+      break;
+  }
+
+  return RAPTOR_TERM_TYPE_UNKNOWN;
+}
+
+
+/*
+ * raptor_json_get_datatype_uri:
+ * @rdf_parser: parser
+ * @str: datatype URI string
+ * @len: length of @str
+ *
+ * INTERNAL - Get a datatype URI, making each distinct one once
+ *
+ * Return value: new reference to the URI or NULL on failure
+ */
+static raptor_uri*
+raptor_json_get_datatype_uri(raptor_parser *rdf_parser,
+                             const unsigned char* str, size_t len)
+{
+  raptor_json_parser_context *context;
+  raptor_uri* uri;
+  int i;
+
+  context = (raptor_json_parser_context*)rdf_parser->context;
+
+  for(i = 0; i < RAPTOR_JSON_DATATYPES_SIZE; i++) {
+    const unsigned char* uri_string;
+    size_t uri_len;
+
+    uri = context->datatypes[i];
+    if(!uri)
+      break;
+
+    uri_string = raptor_uri_as_counted_string(uri, &uri_len);
+    if(uri_len == len && !memcmp(uri_string, str, len))
+      return raptor_uri_copy(uri);
   }
 
-  memcpy(cstr, str, len);
-  cstr[len] = '\0';
+  uri = raptor_new_uri_from_counted_string(rdf_parser->world, str, len);
+  if(!uri)
+    return NULL;
+
+  if(i == RAPTOR_JSON_DATATYPES_SIZE) {
+    i = context->datatypes_next;
+    context->datatypes_next = (i + 1) % RAPTOR_JSON_DATATYPES_SIZE;
+    raptor_free_uri(context->datatypes[i]);
+  }
+  context->datatypes[i] = raptor_uri_copy(uri);
 
-  return cstr;
+  return uri;
 }
 
+
 static raptor_term*
 raptor_json_new_term_from_counted_string(raptor_parser *rdf_parser, const unsigned char* str, size_t len)
 {
@@ -153,16 +348,12 @@ raptor_json_new_term_from_counted_string(raptor_parser *rdf_parser, const unsign
     term = raptor_new_term_from_counted_blank(rdf_parser->world, node_id, len - 2);
 
   } else {
-    raptor_uri *uri = raptor_new_uri_from_counted_string(rdf_parser->world, str, len);
-    if(!uri) {
-      unsigned char* cstr = raptor_json_cstring_from_counted_string(rdf_parser, str, RAPTOR_BAD_CAST(int, len));
-      raptor_parser_error(rdf_parser, "Could not create uri from '%s'", cstr);
-      RAPTOR_FREE(char*, cstr);
+    term = raptor_new_term_from_counted_uri_string(rdf_parser->world, str, len);
+    if(!term) {
+      raptor_parser_error(rdf_parser, "Could not create uri from '%.*s'",
+                          RAPTOR_BAD_CAST(int, len), (const char*)str);
       return NULL;
     }
-
-    term = raptor_new_term_from_uri(rdf_parser->world, uri);
-    raptor_free_uri(uri);
   }
 
   return term;
@@ -174,39 +365,44 @@ raptor_json_generate_term(raptor_parser *rdf_parser)
 {
   raptor_json_parser_context *context = (raptor_json_parser_context*)rdf_parser->context;
   raptor_term *term = NULL;
+  raptor_json_buffer *value = &context->term_value;
 
-  if(!context->term_value) {
+  if(!context->term_has_value) {
     raptor_parser_error(rdf_parser, "No value for term defined");
     return NULL;
   }
 
   switch(context->term_type) {
-    case RAPTOR_TERM_TYPE_URI: {
-      raptor_uri *uri = raptor_new_uri(rdf_parser->world, context->term_value);
-      if(!uri) {
-        raptor_parser_error(rdf_parser, "Could not create uri from '%s'", context->term_value);
+    case RAPTOR_TERM_TYPE_URI:
+      term = raptor_new_term_from_counted_uri_string(rdf_parser->world,
+                                                     value->string,
+                                                     value->length);
+      if(!term) {
+        raptor_parser_error(rdf_parser, "Could not create uri from '%s'", value->string);
         return NULL;
       }
-      term = raptor_new_term_from_uri(rdf_parser->world, uri);
-      raptor_free_uri(uri);
       break;
-    }
+
     case RAPTOR_TERM_TYPE_LITERAL: {
-      raptor_uri *datatype_uri = NULL;
-      if(context->term_datatype) {
-        datatype_uri = raptor_new_uri(rdf_parser->world, context->term_datatype);
-      }
-      term = raptor_new_term_from_literal(rdf_parser->world, context->term_value, datatype_uri, context->term_lang);
-      if(datatype_uri)
-        raptor_free_uri(datatype_uri);
+      raptor_json_buffer *lang = &context->term_lang;
+      term = raptor_new_term_from_counted_literal(rdf_parser->world,
+                                                  value->string, value->length,
+                                                  context->term_datatype,
+                                                  lang->length ? lang->string : NULL,
+                                                  RAPTOR_BAD_CAST(unsigned char, lang->length));
       break;
     }
     case RAPTOR_TERM_TYPE_BLANK: {
-      unsigned char *node_id = context->term_value;
-      if(strlen((const char*)node_id) > 2 && node_id[0] == '_' && node_id[1] == ':') {
-          node_id = &node_id[2];
+      const unsigned char *node_id = value->string;
+      size_t node_id_len = value->length;
+      if(node_id_len > 2 && node_id[0] == '_' && node_id[1] == ':') {
+        node_id += 2;
+        node_id_len -= 2;
       }
-      term = raptor_new_term_from_blank(rdf_parser->world, node_id);
+      /* an empty ID makes a new blank node */
+      term = raptor_new_term_from_counted_blank(rdf_parser->world,
+                                                node_id_len ? node_id : NULL,
+                                                node_id_len);
       break;
     }
     case RAPTOR_TERM_TYPE_UNKNOWN:
@@ -263,27 +459,24 @@ static int raptor_json_yajl_string(void * ctx, const unsigned char * str,
       context->state == RAPTOR_JSON_STATE_RESOURCES_OBJECT) {
     switch(context->attrib) {
       case RAPTOR_JSON_ATTRIB_VALUE:
-        context->term_value = raptor_json_cstring_from_counted_string(rdf_parser, str, len);
+        if(raptor_json_buffer_set(rdf_parser, &context->term_value, str, len))
+          return 0;
+        context->term_has_value = 1;
       break;
       case RAPTOR_JSON_ATTRIB_LANG:
-        context->term_lang = raptor_json_cstring_from_counted_string(rdf_parser, str, len);
+        if(raptor_json_buffer_set(rdf_parser, &context->term_lang, str, len))
+          return 0;
       break;
       case RAPTOR_JSON_ATTRIB_TYPE:
-        if(!strncmp((const char*)str, "uri", len)) {
-          context->term_type = RAPTOR_TERM_TYPE_URI;
-        } else if(!strncmp((const char*)str, "literal", len)) {
-          context->term_type = RAPTOR_TERM_TYPE_LITERAL;
-        } else if(!strncmp((const char*)str, "bnode", len)) {
-          context->term_type = RAPTOR_TERM_TYPE_BLANK;
-        } else {
-          unsigned char * cstr = raptor_json_cstring_from_counted_string(rdf_parser, str, len);
-          context->term_type = RAPTOR_TERM_TYPE_UNKNOWN;
-          raptor_parser_error(rdf_parser, "Unknown term type: %s", cstr);
-          RAPTOR_FREE(char*, cstr);
-        }
+        context->term_type = raptor_json_term_type_lookup(str, len);
+        if(context->term_type == RAPTOR_TERM_TYPE_UNKNOWN)
+          raptor_parser_error(rdf_parser, "Unknown term type: %.*s",
+                              RAPTOR_BAD_CAST(int, len), (const char*)str);
       break;
       case RAPTOR_JSON_ATTRIB_DATATYPE:
-        context->term_datatype = raptor_json_cstring_from_counted_string(rdf_parser, str, len);
+        if(context->term_datatype)
+          raptor_free_uri(context->term_datatype);
+        context->term_datatype = raptor_json_get_datatype_uri(rdf_parser, str, len);
       break;
       case RAPTOR_JSON_ATTRIB_UNKNOWN:
       default:
@@ -302,10 +495,11 @@ static int raptor_json_yajl_map_key(void * ctx, const unsigned char * str,
 {
   raptor_parser* rdf_parser = (raptor_parser*)ctx;
   raptor_json_parser_context *context;
+  raptor_json_key key;
   context = (raptor_json_parser_context*)rdf_parser->context;
 
   if(context->state == RAPTOR_JSON_STATE_MAP_ROOT) {
-    if(!strncmp((const char*)str, "triples", len)) {
+    if(raptor_json_key_lookup(str, len) == RAPTOR_JSON_KEY_TRIPLES) {
       context->state = RAPTOR_JSON_STATE_TRIPLES_KEY;
       return 1;
     } else {
@@ -325,13 +519,14 @@ static int raptor_json_yajl_map_key(void * ctx, const unsigned char * str,
       return 0;
     return 1;
   } else if(context->state == RAPTOR_JSON_STATE_TRIPLES_TRIPLE) {
-    if(!strncmp((const char*)str, "subject", len)) {
+    key = raptor_json_key_lookup(str, len);
+    if(key == RAPTOR_JSON_KEY_SUBJECT) {
       context->term = RAPTOR_JSON_TERM_SUBJECT;
       return 1;
-    } else if(!strncmp((const char*)str, "predicate", len)) {
+    } else if(key == RAPTOR_JSON_KEY_PREDICATE) {
       context->term = RAPTOR_JSON_TERM_PREDICATE;
       return 1;
-    } else if(!strncmp((const char*)str, "object", len)) {
+    } else if(key == RAPTOR_JSON_KEY_OBJECT) {
       context->term = RAPTOR_JSON_TERM_OBJECT;
       return 1;
     } else {
@@ -340,16 +535,17 @@ static int raptor_json_yajl_map_key(void * ctx, const unsigned char * str,
     }
   } else if(context->state == RAPTOR_JSON_STATE_TRIPLES_TERM ||
              context->state == RAPTOR_JSON_STATE_RESOURCES_OBJECT) {
-    if(!strncmp((const char*)str, "value", len)) {
+    key = raptor_json_key_lookup(str, len);
+    if(key == RAPTOR_JSON_KEY_VALUE) {
       context->attrib = RAPTOR_JSON_ATTRIB_VALUE;
       return 1;
-    } else if(!strncmp((const char*)str, "type", len)) {
+    } else if(key == RAPTOR_JSON_KEY_TYPE) {
       context->attrib = RAPTOR_JSON_ATTRIB_TYPE;
       return 1;
-    } else if(!strncmp((const char*)str, "datatype", len)) {
+    } else if(key == RAPTOR_JSON_KEY_DATATYPE) {
       context->attrib = RAPTOR_JSON_ATTRIB_DATATYPE;
       return 1;
-    } else if(!strncmp((const char*)str, "lang", len)) {
+    } else if(key == RAPTOR_JSON_KEY_LANG) {
       context->attrib = RAPTOR_JSON_ATTRIB_LANG;
       return 1;
     } else {
@@ -592,6 +788,8 @@ static void
 raptor_json_parse_terminate(raptor_parser* rdf_parser)
 {
   raptor_json_parser_context *context;
+  int i;
+
   context = (raptor_json_parser_context*)rdf_parser->context;
 
   if(context->handle)
@@ -599,6 +797,16 @@ raptor_json_parse_terminate(raptor_parser* rdf_parser)
 
   raptor_json_reset_term(context);
   raptor_statement_clear(&context->statement);
+
+  if(context->term_value.string)
+    RAPTOR_FREE(char*, context->term_value.string);
+  if(context->term_lang.string)
+    RAPTOR_FREE(char*, context->term_lang.string);
+
+  for(i = 0; i < RAPTOR_JSON_DATATYPES_SIZE; i++) {
+    if(context->datatypes[i])
+      raptor_free_uri(context->datatypes[i]);
+  }
 }
 
 
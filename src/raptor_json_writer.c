@@ -41,6 +41,8 @@
 #endif
 
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SERIALIZER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -37,6 +37,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_PARSER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
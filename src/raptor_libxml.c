@@ -38,6 +38,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SAX2
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -619,6 +621,45 @@ raptor_libxml_free(xmlParserCtxtPtr xc) {
 }
 
 
+/* Most names a reused context's dictionary may hold */
+#define RAPTOR_LIBXML_DICT_MAX_SIZE 100000
+
+/*
+ * raptor_libxml_reset:
+ * @xc: libxml push parser context
+ * @chunk: first bytes of the next document
+ * @size: length of @chunk
+ * @filename: file name or URI of the next document (or NULL)
+ *
+ * INTERNAL - Reset a push parser context for another document
+ *
+ * The context keeps its name dictionary so names seen in earlier
+ * documents are not interned again.  A context whose dictionary has
+ * grown past RAPTOR_LIBXML_DICT_MAX_SIZE names is not reused, which
+ * bounds the memory of long running parsers.
+ *
+ * Return value: non-0 if the context cannot be reused and must be freed
+ */
+int
+raptor_libxml_reset(xmlParserCtxtPtr xc, const char *chunk, int size,
+                    const char *filename)
+{
+#ifdef HAVE_XMLCTXTRESETPUSH
+  if(xc->dict && xmlDictSize(xc->dict) > RAPTOR_LIBXML_DICT_MAX_SIZE)
+    return 1;
+
+  if(xc->myDoc) {
+    xmlFreeDoc(xc->myDoc);
+    xc->myDoc = NULL;
+  }
+
+  return xmlCtxtResetPush(xc, chunk, size, filename, NULL) != 0;
+#else
+  return 1;
+#endif
+}
+
+
 int
 raptor_libxml_init(raptor_world* world)
 {
@@ -38,6 +38,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_NAMESPACE
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -111,6 +113,330 @@ raptor_hash_ns_string(const unsigned char *str, int length)
 }
 
 
+/*
+ * Namespace URI index
+ *
+ * A radix tree over the URIs of the started namespaces of a stack so
+ * that the namespace with the longest URI that is a prefix of a given
+ * URI is found in one walk down the URI.  Namespaces with the same URI
+ * hang off the same node, most recently started first.
+ *
+ * In front of it is a small cache of qname lookups keyed by URI
+ * object, for the URIs that serializers write over and over.  Every
+ * namespace start or end bumps the generation which makes all cached
+ * results stale.
+ */
+typedef struct raptor_namespace_index_node_s raptor_namespace_index_node;
+
+struct raptor_namespace_index_node_s {
+  raptor_namespace_index_node* parent;
+  /* first child and next sibling; children differ in first label byte */
+  raptor_namespace_index_node* children;
+  raptor_namespace_index_node* next;
+  /* URI bytes on the edge from the parent */
+  unsigned char* label;
+  size_t label_len;
+  /* length of the URI prefix ending at this node */
+  size_t depth;
+  /* namespaces with exactly this URI, linked by uri_next */
+  raptor_namespace* namespaces;
+};
+
+typedef struct {
+  /* URI or NULL if empty; a reference is held */
+  raptor_uri* uri;
+  int xml_version;
+  unsigned int generation;
+  /* namespace to make a qname with or NULL if there is none */
+  raptor_namespace* ns;
+} raptor_namespace_index_cache_entry;
+
+/* Cached qname lookups; a power of 2 */
+#define RAPTOR_NAMESPACE_INDEX_CACHE_SIZE 256
+
+struct raptor_namespace_index_s {
+  raptor_namespace_index_node root;
+  unsigned int generation;
+  /* NULL until the first qname lookup */
+  raptor_namespace_index_cache_entry* cache;
+};
+
+
+static void
+raptor_free_namespace_index_node(raptor_namespace_index_node* node)
+{
+  while(node->children) {
+    raptor_namespace_index_node* child = node->children;
+    node->children = child->next;
+    raptor_free_namespace_index_node(child);
+  }
+
+  if(node->label)
+    RAPTOR_FREE(char*, node->label);
+  RAPTOR_FREE(raptor_namespace_index_node, node);
+}
+
+
+static void
+raptor_free_namespace_index(raptor_namespace_index* index)
+{
+  while(index->root.children) {
+    raptor_namespace_index_node* child = index->root.children;
+    index->root.children = child->next;
+    raptor_free_namespace_index_node(child);
+  }
+
+  if(index->cache) {
+    int i;
+
+    for(i = 0; i < RAPTOR_NAMESPACE_INDEX_CACHE_SIZE; i++) {
+      if(index->cache[i].uri)
+        raptor_free_uri(index->cache[i].uri);
+    }
+    RAPTOR_FREE(raptor_namespace_index_cache_entry*, index->cache);
+  }
+
+  RAPTOR_FREE(raptor_namespace_index, index);
+}
+
+
+static raptor_namespace_index_node*
+raptor_new_namespace_index_node(raptor_namespace_index_node* parent,
+                                const unsigned char* label, size_t label_len)
+{
+  raptor_namespace_index_node* node;
+
+  node = RAPTOR_CALLOC(raptor_namespace_index_node*, 1, sizeof(*node));
+  if(!node)
+    return NULL;
+
+  node->label = RAPTOR_MALLOC(unsigned char*, label_len + 1);
+  if(!node->label) {
+    RAPTOR_FREE(raptor_namespace_index_node, node);
+    return NULL;
+  }
+  memcpy(node->label, label, label_len);
+  node->label[label_len] = '\0';
+  node->label_len = label_len;
+  node->parent = parent;
+  node->depth = parent->depth + label_len;
+
+  return node;
+}
+
+
+/* the child of @node with an edge starting with @c or NULL */
+static raptor_namespace_index_node*
+raptor_namespace_index_child(raptor_namespace_index_node* node,
+                             unsigned char c)
+{
+  raptor_namespace_index_node* child;
+
+  for(child = node->children; child; child = child->next) {
+    if(child->label[0] == c)
+      break;
+  }
+
+  return child;
+}
+
+
+/*
+ * raptor_namespace_index_add:
+ * @nstack: namespace stack
+ * @nspace: started namespace with a URI
+ *
+ * INTERNAL - Add a namespace to the URI index of a stack
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_namespace_index_add(raptor_namespace_stack* nstack,
+                           raptor_namespace* nspace)
+{
+  raptor_namespace_index_node* node;
+  const unsigned char* uri_string;
+  size_t uri_len;
+  size_t pos = 0;
+
+  if(!nstack->uri_index) {
+    nstack->uri_index = RAPTOR_CALLOC(raptor_namespace_index*, 1,
+                                      sizeof(raptor_namespace_index));
+    if(!nstack->uri_index)
+      return 1;
+  }
+  nstack->uri_index->generation++;
+
+  uri_string = raptor_uri_as_counted_string(nspace->uri, &uri_len);
+
+  node = &nstack->uri_index->root;
+  while(pos < uri_len) {
+    raptor_namespace_index_node* child;
+    size_t common = 0;
+
+    child = raptor_namespace_index_child(node, uri_string[pos]);
+    if(!child) {
+      child = raptor_new_namespace_index_node(node, uri_string + pos,
+                                              uri_len - pos);
+      if(!child)
+        return 1;
+      child->next = node->children;
+      node->children = child;
+      node = child;
+      break;
+    }
+
+    while(common < child->label_len && pos + common < uri_len &&
+          child->label[common] == uri_string[pos + common])
+      common++;
+
+    if(common < child->label_len) {
+      /* split the edge to child at the end of the common part */
+      raptor_namespace_index_node* mid;
+      raptor_namespace_index_node** p;
+      unsigned char* rest;
+
+      mid = raptor_new_namespace_index_node(node, child->label, common);
+      if(!mid)
+        return 1;
+      rest = RAPTOR_MALLOC(unsigned char*, child->label_len - common + 1);
+      if(!rest) {
+        raptor_free_namespace_index_node(mid);
+        return 1;
+      }
+      memcpy(rest, child->label + common, child->label_len - common + 1);
+      RAPTOR_FREE(char*, child->label);
+      child->label = rest;
+      child->label_len -= common;
+
+      for(p = &node->children; *p != child; p = &(*p)->next)
+        ;
+      *p = mid;
+      mid->next = child->next;
+      child->next = NULL;
+      child->parent = mid;
+      mid->children = child;
+
+      child = mid;
+    }
+
+    node = child;
+    pos += common;
+  }
+
+  nspace->uri_next = node->namespaces;
+  node->namespaces = nspace;
+
+  return 0;
+}
+
+
+/*
+ * raptor_namespace_index_remove:
+ * @nstack: namespace stack
+ * @nspace: started namespace
+ *
+ * INTERNAL - Remove a namespace from the URI index of a stack if present
+ */
+static void
+raptor_namespace_index_remove(raptor_namespace_stack* nstack,
+                              raptor_namespace* nspace)
+{
+  raptor_namespace_index_node* node;
+  raptor_namespace** p;
+  const unsigned char* uri_string;
+  size_t uri_len;
+  size_t pos = 0;
+
+  if(!nstack->uri_index || !nspace->uri)
+    return;
+  nstack->uri_index->generation++;
+
+  uri_string = raptor_uri_as_counted_string(nspace->uri, &uri_len);
+
+  node = &nstack->uri_index->root;
+  while(pos < uri_len) {
+    node = raptor_namespace_index_child(node, uri_string[pos]);
+    if(!node || node->label_len > uri_len - pos ||
+       memcmp(node->label, uri_string + pos, node->label_len))
+      return;
+    pos += node->label_len;
+  }
+
+  for(p = &node->namespaces; *p; p = &(*p)->uri_next) {
+    if(*p == nspace) {
+      *p = nspace->uri_next;
+      nspace->uri_next = NULL;
+      break;
+    }
+  }
+
+  /* prune leaves that no longer end any namespace URI */
+  while(node->parent && !node->namespaces && !node->children) {
+    raptor_namespace_index_node* parent = node->parent;
+    raptor_namespace_index_node** np;
+
+    for(np = &parent->children; *np != node; np = &(*np)->next)
+      ;
+    *np = node->next;
+    raptor_free_namespace_index_node(node);
+    node = parent;
+  }
+}
+
+
+/*
+ * raptor_namespace_index_find:
+ * @nstack: namespace stack
+ * @uri_string: URI string
+ * @uri_len: length of @uri_string
+ * @xml_version: XML version for checking the local name or 0 for none
+ *
+ * INTERNAL - Find the namespace with the longest URI that is a prefix of a URI
+ *
+ * With @xml_version, the rest of the URI after the namespace URI
+ * must be a legal XML name and must not be empty.  Otherwise the
+ * namespace URI must be all of @uri_string.
+ *
+ * Return value: namespace or NULL if none matches
+ */
+static raptor_namespace*
+raptor_namespace_index_find(raptor_namespace_stack* nstack,
+                            const unsigned char* uri_string, size_t uri_len,
+                            int xml_version)
+{
+  raptor_namespace_index_node* node;
+  size_t pos = 0;
+
+  if(!nstack->uri_index)
+    return NULL;
+
+  node = &nstack->uri_index->root;
+  while(pos < uri_len) {
+    raptor_namespace_index_node* child;
+
+    child = raptor_namespace_index_child(node, uri_string[pos]);
+    if(!child || child->label_len > uri_len - pos ||
+       memcmp(child->label, uri_string + pos, child->label_len))
+      break;
+    node = child;
+    pos += child->label_len;
+  }
+
+  if(!xml_version)
+    return (pos == uri_len) ? node->namespaces : NULL;
+
+  for(; node; node = node->parent) {
+    if(node->namespaces && node->depth < uri_len &&
+       raptor_xml_name_check(uri_string + node->depth,
+                             uri_len - node->depth, xml_version))
+      return node->namespaces;
+  }
+
+  return NULL;
+}
+
+
 #define RAPTOR_NAMESPACES_HASHTABLE_SIZE 1024
 /**
  * raptor_namespaces_init:
@@ -146,6 +472,9 @@ raptor_namespaces_init(raptor_world* world,
     return -1;
 
   nstack->def_namespace = NULL;
+  nstack->max_depth = -1;
+
+  nstack->uri_index = NULL;
 
   nstack->rdf_ms_uri = raptor_new_uri_from_counted_string(nstack->world,
                                                           (const unsigned char*)raptor_rdf_namespace_uri,
@@ -239,9 +568,17 @@ raptor_namespaces_start_namespace(raptor_namespace_stack *nstack,
     nspace->next = nstack->table[bucket];
   nstack->table[bucket] = nspace;
 
+  if(nspace->depth > nstack->max_depth)
+    nstack->max_depth = nspace->depth;
+
   if(!nstack->def_namespace)
     nstack->def_namespace = nspace;
 
+  /* On failure the namespace is not found by URI; qnames using it
+   * are not made */
+  if(nspace->uri)
+    (void)raptor_namespace_index_add(nstack, nspace);
+
 #ifndef STANDALONE
 #ifdef RAPTOR_DEBUG_VERBOSE
     RAPTOR_DEBUG3("start namespace prefix %s depth %d\n", nspace->prefix ? (char*)nspace->prefix : "(default)", nspace->depth);
@@ -311,6 +648,11 @@ raptor_namespaces_clear(raptor_namespace_stack *nstack)
     nstack->table_size = 0;
   }
 
+  if(nstack->uri_index) {
+    raptor_free_namespace_index(nstack->uri_index);
+    nstack->uri_index = NULL;
+  }
+
   if(nstack->world) {
     if(nstack->rdf_ms_uri) {
       raptor_free_uri(nstack->rdf_ms_uri);
@@ -323,6 +665,7 @@ raptor_namespaces_clear(raptor_namespace_stack *nstack)
   }
 
   nstack->size = 0;
+  nstack->max_depth = -1;
 
   nstack->world = NULL;
 }
@@ -357,11 +700,21 @@ void
 raptor_namespaces_end_for_depth(raptor_namespace_stack *nstack, int depth)
 {
   int bucket;
+  int max_depth = -1;
+
+  /* Most elements declare no namespaces; skip scanning the table */
+  if(depth > nstack->max_depth)
+    return;
+
   for(bucket = 0; bucket < nstack->table_size; bucket++) {
+    raptor_namespace* ns;
+
     while(nstack->table[bucket] &&
           nstack->table[bucket]->depth == depth) {
-      raptor_namespace* ns = nstack->table[bucket];
-      raptor_namespace* next_ns = ns->next;
+      raptor_namespace* next_ns;
+
+      ns = nstack->table[bucket];
+      next_ns = ns->next;
 
 #ifndef STANDALONE
 #ifdef RAPTOR_DEBUG_VERBOSE
@@ -369,12 +722,20 @@ raptor_namespaces_end_for_depth(raptor_namespace_stack *nstack, int depth)
                     ns->prefix ? (char*)ns->prefix : "(default)", depth);
 #endif
 #endif
+      raptor_namespace_index_remove(nstack, ns);
       raptor_free_namespace(ns);
       nstack->size--;
 
       nstack->table[bucket] = next_ns;
     }
+
+    for(ns = nstack->table[bucket]; ns; ns = ns->next) {
+      if(ns->depth > max_depth)
+        max_depth = ns->depth;
+    }
   }
+
+  nstack->max_depth = max_depth;
 }
 
 
@@ -446,6 +807,9 @@ raptor_namespaces_find_namespace(raptor_namespace_stack *nstack,
  * @ns_uri: namespace URI to find
  * 
  * Find a namespace in a namespace stack by namespace URI.
+ *
+ * If several namespaces have the URI, the most recently started one
+ * is returned.
  * 
  * Return value: #raptor_namespace for the URI or NULL on failure
  **/
@@ -453,19 +817,15 @@ raptor_namespace*
 raptor_namespaces_find_namespace_by_uri(raptor_namespace_stack *nstack, 
                                         raptor_uri *ns_uri)
 {
-  int bucket;
+  const unsigned char* uri_string;
+  size_t uri_len;
 
   if(!ns_uri)
     return NULL;
   
-  for(bucket = 0; bucket < nstack->table_size; bucket++) {
-    raptor_namespace* ns;
-    for(ns = nstack->table[bucket]; ns ; ns = ns->next)
-      if(raptor_uri_equals(ns->uri, ns_uri))
-        return ns;
-   }
-  
-  return NULL;
+  uri_string = raptor_uri_as_counted_string(ns_uri, &uri_len);
+
+  return raptor_namespace_index_find(nstack, uri_string, uri_len, 0);
 }
 
 
@@ -484,10 +844,14 @@ raptor_namespaces_namespace_in_scope(raptor_namespace_stack *nstack,
 {
   raptor_namespace* ns;
   int bucket;
+
+  if(nspace->uri)
+    return raptor_namespaces_find_namespace_by_uri(nstack, nspace->uri) != NULL;
   
+  /* namespaces without a URI are not in the URI index */
   for(bucket = 0; bucket < nstack->table_size; bucket++) {
     for(ns = nstack->table[bucket]; ns ; ns = ns->next)
-      if(raptor_uri_equals(ns->uri, nspace->uri))
+      if(!ns->uri)
         return 1;
   }
   return 0;
@@ -963,7 +1327,8 @@ raptor_xml_namespace_string_parse(const unsigned char *string,
  * Make an appropriate XML Qname from the namespaces on a namespace stack
  * 
  * Makes a qname from the in-scope namespaces in a stack if the URI matches
- * the prefix and the rest is a legal XML name.
+ * the prefix and the rest is a legal XML name.  The namespace with the
+ * longest such URI is used.
  *
  * Return value: #raptor_qname for the URI or NULL on failure
  **/
@@ -971,50 +1336,55 @@ raptor_qname*
 raptor_new_qname_from_namespace_uri(raptor_namespace_stack *nstack, 
                                     raptor_uri *uri, int xml_version)
 {
+  raptor_namespace_index* index = nstack->uri_index;
+  raptor_namespace_index_cache_entry* entry = NULL;
   unsigned char *uri_string;
   size_t uri_len;
-  raptor_namespace* ns = NULL;
-  unsigned char *ns_uri_string;
+  raptor_namespace* ns;
   size_t ns_uri_len;
-  unsigned char *name = NULL;
-  int bucket;
 
-  if(!uri)
+  if(!uri || !index)
     return NULL;
   
   uri_string = raptor_uri_as_counted_string(uri, &uri_len);
 
-  for(bucket = 0; bucket < nstack->table_size; bucket++) {
-    for(ns = nstack->table[bucket]; ns ; ns = ns->next) {
-      if(!ns->uri)
-        continue;
-      
-      ns_uri_string = raptor_uri_as_counted_string(ns->uri,
-                                                      &ns_uri_len);
-      if(ns_uri_len >= uri_len)
-        continue;
-      if(strncmp((const char*)uri_string, (const char*)ns_uri_string,
-                 ns_uri_len))
-        continue;
-      
-      /* uri_string is a prefix of ns_uri_string */
-      name = uri_string + ns_uri_len;
-      if(!raptor_xml_name_check(name, uri_len-ns_uri_len, xml_version))
-        name = NULL;
-      
-      /* If name is set, we've found a prefix with a legal XML name value */
-      if(name)
-        break;
+  if(!index->cache)
+    index->cache = RAPTOR_CALLOC(raptor_namespace_index_cache_entry*,
+                                 RAPTOR_NAMESPACE_INDEX_CACHE_SIZE,
+                                 sizeof(raptor_namespace_index_cache_entry));
+  if(index->cache) {
+    entry = &index->cache[raptor_uri_get_hash(uri) &
+                          (RAPTOR_NAMESPACE_INDEX_CACHE_SIZE - 1)];
+    if(entry->uri == uri && entry->xml_version == xml_version &&
+       entry->generation == index->generation) {
+      ns = entry->ns;
+      goto found;
     }
-    if(name)
-      break;
   }
-  
+
+  ns = raptor_namespace_index_find(nstack, uri_string, uri_len, xml_version);
+
+  if(entry) {
+    if(entry->uri != uri) {
+      if(entry->uri)
+        raptor_free_uri(entry->uri);
+      entry->uri = raptor_uri_copy(uri);
+    }
+    entry->xml_version = xml_version;
+    entry->generation = index->generation;
+    entry->ns = ns;
+  }
+
+  found:
   if(!ns)
     return NULL;
 
+  /* the rest of the URI is the local name */
+  raptor_uri_as_counted_string(ns->uri, &ns_uri_len);
+
   return raptor_new_qname_from_namespace_local_name(nstack->world, ns,
-                                                    name,  NULL);
+                                                    uri_string + ns_uri_len,
+                                                    NULL);
 }
 
 
@@ -1084,6 +1454,52 @@ raptor_namespace_stack_to_array(raptor_namespace_stack *nstack,
 int main(int argc, char *argv[]);
 
 
+/* check the qname made for @uri_string; @local_name NULL for none */
+static int
+test_qname(const char *program, raptor_namespace_stack *nstack,
+           const char *uri_string, const char *prefix,
+           const char *local_name)
+{
+  raptor_uri *uri;
+  raptor_qname *qname;
+  int rc = 0;
+
+  uri = raptor_new_uri(nstack->world, (const unsigned char*)uri_string);
+  if(!uri)
+    return 1;
+
+  /* twice for the cached result */
+  qname = raptor_new_qname_from_namespace_uri(nstack, uri, 10);
+  if(qname)
+    raptor_free_qname(qname);
+  qname = raptor_new_qname_from_namespace_uri(nstack, uri, 10);
+
+  if(!local_name) {
+    if(qname) {
+      fprintf(stderr, "%s: Got qname %s:%s for <%s> expected none\n",
+              program, qname->nspace->prefix, qname->local_name, uri_string);
+      rc = 1;
+    }
+  } else if(!qname) {
+    fprintf(stderr, "%s: Got no qname for <%s> expected %s:%s\n",
+            program, uri_string, prefix, local_name);
+    rc = 1;
+  } else if(strcmp((const char*)qname->nspace->prefix, prefix) ||
+            strcmp((const char*)qname->local_name, local_name)) {
+    fprintf(stderr, "%s: Got qname %s:%s for <%s> expected %s:%s\n",
+            program, qname->nspace->prefix, qname->local_name, uri_string,
+            prefix, local_name);
+    rc = 1;
+  }
+
+  if(qname)
+    raptor_free_qname(qname);
+  raptor_free_uri(uri);
+
+  return rc;
+}
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -1091,6 +1507,8 @@ main(int argc, char *argv[])
   const char *program = raptor_basename(argv[0]);
   raptor_namespace_stack namespaces; /* static */
   raptor_namespace* ns;
+  raptor_uri* uri;
+  int failures = 0;
 
   world = raptor_new_world();
   if(!world || raptor_world_open(world))
@@ -1133,10 +1551,44 @@ main(int argc, char *argv[])
     return(1);
   }
 
+  raptor_namespaces_start_namespace_full(&namespaces,
+                                         (const unsigned char*)"ex",
+                                         (const unsigned char*)"http://example.org/",
+                                         1);
+
+  /* longest namespace URI with a legal local name wins */
+  failures += test_qname(program, &namespaces,
+                         "http://example.org/ns1foo", "ex1", "foo");
+  failures += test_qname(program, &namespaces,
+                         "http://example.org/ns2bar", "ex2", "bar");
+  failures += test_qname(program, &namespaces,
+                         "http://example.org/thing", "ex", "thing");
+  failures += test_qname(program, &namespaces,
+                         "http://example.org/ns1/foo", NULL, NULL);
+  failures += test_qname(program, &namespaces,
+                         "http://example.org/", NULL, NULL);
+  failures += test_qname(program, &namespaces,
+                         "http://example.com/thing", NULL, NULL);
+
+  uri = raptor_new_uri(world, (const unsigned char*)"http://example.org/ns2");
+  ns = raptor_namespaces_find_namespace_by_uri(&namespaces, uri);
+  raptor_free_uri(uri);
+  if(!ns || strcmp((const char*)ns->prefix, "ex2")) {
+    fprintf(stderr, "%s: namespace ex2 not found by URI, returning error\n",
+            program);
+    failures++;
+  }
+
   raptor_namespaces_end_for_depth(&namespaces, 2);
 
   raptor_namespaces_end_for_depth(&namespaces, 1);
 
+  /* ex2 and ex have gone */
+  failures += test_qname(program, &namespaces,
+                         "http://example.org/ns2bar", NULL, NULL);
+  failures += test_qname(program, &namespaces,
+                         "http://example.org/ns1foo", "ex1", "foo");
+
   raptor_namespaces_end_for_depth(&namespaces, 0);
 
   raptor_namespaces_clear(&namespaces);
@@ -1144,7 +1596,7 @@ main(int argc, char *argv[])
   raptor_free_world(world);
 
   /* keep gcc -Wall happy */
-  return(0);
+  return(failures);
 }
 
 #endif
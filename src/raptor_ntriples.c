@@ -37,6 +37,8 @@
 #endif
 
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_PARSER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -138,7 +140,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
                                     unsigned char *dest,
                                     size_t *lenp, size_t *dest_lenp,
                                     char end_char,
-                                    raptor_ntriples_term_class term_class)
+                                    raptor_ntriples_term_class term_class,
+                                    int quiet)
 {
   const unsigned char *p = *start;
   unsigned char c = '\0';
@@ -161,9 +164,10 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
     }
 
     if(term_class == RAPTOR_TERM_CLASS_URI && c == ' ') {
-      raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator,
-                                 "URI error - illegal character %d (0x%02X) found.",
-                                 c, RAPTOR_GOOD_CAST(unsigned int, c));
+      if(!quiet)
+        raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator,
+                                   "URI error - illegal character %d (0x%02X) found.",
+                                   c, RAPTOR_GOOD_CAST(unsigned int, c));
       return 1;
     }
 
@@ -172,6 +176,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
       int unichar_len;
       unichar_len = raptor_unicode_utf8_string_get_char(p - 1, 1 + *lenp, NULL);
       if(unichar_len < 0 || RAPTOR_GOOD_CAST(size_t, unichar_len) > *lenp) {
+        if(quiet)
+          return 1;
         raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator,
                                    "UTF-8 encoding error at character %d (0x%02X) found.",
                                    c, RAPTOR_GOOD_CAST(unsigned int, c));
@@ -202,6 +208,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
       if(!raptor_ntriples_term_valid(c, position, term_class)) {
         if(end_char) {
           /* end char was expected, so finding an invalid thing is an error */
+          if(quiet)
+            return 1;
           raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Missing terminating '%c' (found '%c')", end_char, c);
           return 0;
         } else {
@@ -234,6 +242,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
     }
 
     if(!*lenp) {
+      if(quiet)
+        return 1;
       raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "\\ at end of input.");
       return 0;
     }
@@ -258,7 +268,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
       case 'r':
       case 't':
         if(term_class == RAPTOR_TERM_CLASS_URI) {
-          raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "URI error - illegal URI escape '\\%c'.", c);
+          if(!quiet)
+            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "URI error - illegal URI escape '\\%c'.", c);
           return 1;
         }
 
@@ -289,6 +300,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
         ulen = (c == 'u') ? 4 : 8;
 
         if(*lenp < ulen) {
+          if(quiet)
+            return 1;
           raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "%c over end of input.", c);
           return 0;
         }
@@ -300,6 +313,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
           for(ii = 0; ii < ulen; ii++) {
             char cc = p[ii];
             if(!isxdigit(RAPTOR_GOOD_CAST(char, cc))) {
+              if(quiet)
+                return 1;
               raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "N-Triples string error - illegal hex digit %c in Unicode escape '%c%s...'",
                             cc, c, p);
               n = 1;
@@ -312,6 +327,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
 
           n = sscanf((const char*)p, ((ulen == 4) ? "%04lx" : "%08lx"), &unichar);
           if(n != 1) {
+            if(quiet)
+              return 1;
             raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Illegal Uncode escape '%c%s...'", c, p);
             break;
           }
@@ -326,17 +343,23 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
 
         if(term_class == RAPTOR_TERM_CLASS_URI &&
            (unichar == 0x0020 || unichar == 0x003C || unichar == 0x003E)) {
+          if(quiet)
+            return 1;
           raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "URI error - illegal Unicode escape \\u%04lX in URI.", unichar);
           break;
         }
 
         if(unichar > raptor_unicode_max_codepoint) {
+          if(quiet)
+            return 1;
           raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Illegal Unicode character with code point #x%lX (max #x%lX).", unichar, raptor_unicode_max_codepoint);
           break;
         }
 
         unichar_width = raptor_unicode_utf8_string_put_char(unichar, dest, 4);
         if(unichar_width < 0) {
+          if(quiet)
+            return 1;
           raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Illegal Unicode character with code point #x%lX.", unichar);
           break;
         }
@@ -351,6 +374,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
         break;
 
       default:
+        if(quiet)
+          return 1;
         raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Illegal string escape \\%c in \"%s\"", c, (char*)start);
         return 0;
     }
@@ -360,7 +385,8 @@ raptor_ntriples_parse_term_internal(raptor_world* world,
 
 
   if(end_char && !end_char_seen) {
-    raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Missing terminating '%c' before end of input.", end_char);
+    if(!quiet)
+      raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Missing terminating '%c' before end of input.", end_char);
     return 1;
   }
 
@@ -445,7 +471,9 @@ raptor_parse_turtle_term_internal(raptor_world* world,
  * @string: string input (in)
  * @len_p: pointer to length of @string (in/out)
  * @term_p: pointer to store term (out)
- * @allow_turtle: non-0 to allow Turtle forms such as integers, boolean
+ * @flags: bitmask of RAPTOR_NTRIPLES_TERM_ALLOW_TURTLE to allow Turtle
+ *   forms such as integers, boolean and RAPTOR_NTRIPLES_TERM_QUIET
+ * @arena: arena to make the term in or NULL
  *
  * INTERNAL - Parse an N-Triples string into a #raptor_term
  *
@@ -453,16 +481,24 @@ raptor_parse_turtle_term_internal(raptor_world* world,
  * proceeds to be used in error messages.  The final value is written
  * into the #raptor_term pointed at by @term_p
  *
+ * With RAPTOR_NTRIPLES_TERM_QUIET nothing is reported and anything
+ * that would have been reported, including errors that parsing
+ * otherwise continues after, makes the parse fail.  Parser worker
+ * threads use this since they must not log; the line is then parsed
+ * again without the flag to get the messages.
+ *
  * Return value: number of bytes processed or 0 on failure
  */
 size_t
 raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
                            unsigned char *string, size_t *len_p,
-                           raptor_term** term_p, int allow_turtle)
+                           raptor_term** term_p, int flags,
+                           raptor_arena* arena)
 {
   unsigned char *p = string;
   unsigned char *dest;
   size_t term_length = 0;
+  int quiet = (flags & RAPTOR_NTRIPLES_TERM_QUIET);
 
   switch(*p) {
     case '<':
@@ -478,7 +514,7 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
       if(raptor_ntriples_parse_term_internal(world, locator,
                                              (const unsigned char**)&p,
                                              dest, len_p, &term_length,
-                                             '>', RAPTOR_TERM_CLASS_URI)) {
+                                             '>', RAPTOR_TERM_CLASS_URI, quiet)) {
         goto fail;
       }
 
@@ -489,21 +525,26 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
         if(!strncmp((const char*)dest,
                     "http://www.w3.org/1999/02/22-rdf-syntax-ns#_", 44)) {
           int ordinal = raptor_check_ordinal(dest + 44);
-          if(ordinal <= 0)
+          if(ordinal <= 0) {
+            if(quiet)
+              goto fail;
             raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Illegal ordinal value %d in property '%s'.", ordinal, dest);
+          }
         }
         if(raptor_uri_uri_string_is_absolute(dest) <= 0) {
-          raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "URI '%s' is not absolute.", dest);
+          if(!quiet)
+            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "URI '%s' is not absolute.", dest);
           goto fail;
         }
 
         uri = raptor_new_uri(world, dest);
         if(!uri) {
-          raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Could not create URI for '%s'", (const char *)dest);
+          if(!quiet)
+            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Could not create URI for '%s'", (const char *)dest);
           goto fail;
         }
 
-        *term_p = raptor_new_term_from_uri(world, uri);
+        *term_p = raptor_arena_new_term_from_uri(arena, world, uri);
         raptor_free_uri(uri);
       }
       break;
@@ -520,7 +561,7 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
     case '7':
     case '8':
     case '9':
-      if(allow_turtle) {
+      if(flags & RAPTOR_NTRIPLES_TERM_ALLOW_TURTLE) {
         raptor_uri* datatype_uri = NULL;
 
         dest = p;
@@ -532,10 +573,12 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
           goto fail;
         }
 
-        *term_p = raptor_new_term_from_literal(world,
-                                               dest,
-                                               datatype_uri,
-                                               NULL /* language */);
+        *term_p = raptor_arena_new_term_from_literal(arena, world,
+                                                      dest,
+                                                      datatype_uri,
+                                                      NULL /* language */);
+        /* the term holds its own reference */
+        raptor_free_uri(datatype_uri);
       } else
         goto fail;
       break;
@@ -553,7 +596,7 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
       if(raptor_ntriples_parse_term_internal(world, locator,
                                              (const unsigned char**)&p,
                                              dest, len_p, &term_length,
-                                             '"', RAPTOR_TERM_CLASS_STRING)) {
+                                             '"', RAPTOR_TERM_CLASS_STRING, quiet)) {
         goto fail;
       }
 
@@ -577,19 +620,21 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
           }
 
           if(!*len_p) {
-            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Missing language after \"string\"-");
+            if(!quiet)
+              raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Missing language after \"string\"-");
             goto fail;
           }
 
           if(raptor_ntriples_parse_term_internal(world, locator,
                                   (const unsigned char**)&p,
                                   object_literal_language, len_p, &lang_len,
-                                  '\0', RAPTOR_TERM_CLASS_LANGUAGE)) {
+                                  '\0', RAPTOR_TERM_CLASS_LANGUAGE, quiet)) {
             goto fail;
           }
 
           if(!lang_len) {
-            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Invalid language tag at @%s", p);
+            if(!quiet)
+              raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Invalid language tag at @%s", p);
             goto fail;
           }
 
@@ -619,7 +664,8 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
           }
 
           if(!*len_p || (*len_p && *p != '<')) {
-            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Missing datatype URI-ref in\"string\"^^<URI-ref> after ^^");
+            if(!quiet)
+              raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Missing datatype URI-ref in\"string\"^^<URI-ref> after ^^");
             goto fail;
           }
 
@@ -633,18 +679,21 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
           if(raptor_ntriples_parse_term_internal(world, locator,
                                   (const unsigned char**)&p,
                                   object_literal_datatype, len_p, NULL,
-                                  '>', RAPTOR_TERM_CLASS_URI)) {
+                                  '>', RAPTOR_TERM_CLASS_URI, quiet)) {
             goto fail;
           }
 
           if(raptor_uri_uri_string_is_absolute(object_literal_datatype) <= 0) {
-            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Datatype URI '%s' is not absolute.", object_literal_datatype);
+            if(!quiet)
+              raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Datatype URI '%s' is not absolute.", object_literal_datatype);
             goto fail;
           }
 
         }
 
         if(object_literal_datatype && object_literal_language) {
+          if(quiet)
+            goto fail;
           raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Typed literal used with a language - ignoring the language");
           object_literal_language = NULL;
         }
@@ -653,16 +702,19 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
           datatype_uri = raptor_new_uri(world,
                                         object_literal_datatype);
           if(!datatype_uri) {
-            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Could not create literal datatype uri '%s'", object_literal_datatype);
+            if(!quiet)
+              raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Could not create literal datatype uri '%s'", object_literal_datatype);
             goto fail;
           }
           object_literal_language = NULL;
         }
 
-        *term_p = raptor_new_term_from_literal(world,
-                                               dest,
-                                               datatype_uri,
-                                               object_literal_language);
+        *term_p = raptor_arena_new_term_from_literal(arena, world,
+                                                      dest,
+                                                      datatype_uri,
+                                                      object_literal_language);
+        if(datatype_uri)
+          raptor_free_uri(datatype_uri);
       }
 
       break;
@@ -680,7 +732,8 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
         }
 
         if(!*len_p || (*len_p > 0 && *p != ':')) {
-          raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Illegal bNodeID - _ not followed by :");
+          if(!quiet)
+            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Illegal bNodeID - _ not followed by :");
           goto fail;
         }
 
@@ -697,16 +750,18 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
                                                (const unsigned char**)&p,
                                                dest, len_p, &term_length,
                                                '\0',
-                                               RAPTOR_TERM_CLASS_BNODEID)) {
+                                               RAPTOR_TERM_CLASS_BNODEID,
+                                               quiet)) {
           goto fail;
         }
 
         if(!term_length) {
-          raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Bad or missing bNodeID after _:");
+          if(!quiet)
+            raptor_log_error_formatted(world, RAPTOR_LOG_LEVEL_ERROR, locator, "Bad or missing bNodeID after _:");
           goto fail;
         }
 
-        *term_p = raptor_new_term_from_blank(world, dest);
+        *term_p = raptor_arena_new_term_from_blank(arena, world, dest);
 
         break;
 
@@ -715,7 +770,14 @@ raptor_ntriples_parse_term(raptor_world* world, raptor_locator* locator,
         goto fail;
     }
 
+  if(quiet && !*term_p)
+    return 0;
+
+  return p - string;
+
   fail:
+  if(quiet)
+    return 0;
 
   return p - string;
 }
@@ -0,0 +1,479 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * raptor_ntriples_scan.c - N-Triples / N-Quads line end scanner
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <raptor_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RAPTOR_NTRIPLES_SCAN_SSE2 1
+#endif
+
+#if defined(RAPTOR_NTRIPLES_SCAN_SSE2) && defined(HAVE_AVX2_TARGET_ATTRIBUTE)
+#include <immintrin.h>
+#define RAPTOR_NTRIPLES_SCAN_AVX2 1
+#endif
+
+/* Raptor includes */
+#include "raptor2.h"
+#include "raptor_internal.h"
+
+
+/*
+ * The N-Triples line splitter only changes state on a few bytes:
+ * backslash, the two quote characters, '<' and '>' for URIs and the
+ * two line terminators.  Every other byte is skipped, so the
+ * vector variants below find the next one of these bytes many bytes
+ * at a time and then run the same state machine as the scalar code.
+ */
+
+static const unsigned char raptor_ntriples_scan_special[256] = {
+  /* 0x00 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0,
+  /* 0x10 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* 0x20 */ 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* 0x30 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0,
+  /* 0x40 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  /* 0x50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0
+  /* 0x60 - 0xff are all 0 */
+};
+
+
+static RAPTOR_INLINE unsigned char*
+raptor_ntriples_skip_plain_scalar(unsigned char* p, unsigned char* end)
+{
+  while(p < end && !raptor_ntriples_scan_special[*p])
+    p++;
+  return p;
+}
+
+
+#ifdef RAPTOR_NTRIPLES_SCAN_SSE2
+static RAPTOR_INLINE unsigned char*
+raptor_ntriples_skip_plain_sse2(unsigned char* p, unsigned char* end)
+{
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i dq = _mm_set1_epi8('"');
+  const __m128i sq = _mm_set1_epi8('\'');
+  const __m128i lt = _mm_set1_epi8('<');
+  const __m128i gt = _mm_set1_epi8('>');
+  const __m128i bs = _mm_set1_epi8('\\');
+
+  while(end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i m;
+    int mask;
+
+    m = _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, dq));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, sq));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, lt));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, gt));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, bs));
+    mask = _mm_movemask_epi8(m);
+    if(mask)
+      return p + __builtin_ctz((unsigned int)mask);
+    p += 16;
+  }
+
+  return raptor_ntriples_skip_plain_scalar(p, end);
+}
+#endif
+
+
+#ifdef RAPTOR_NTRIPLES_SCAN_AVX2
+__attribute__((target("avx2")))
+static RAPTOR_INLINE unsigned char*
+raptor_ntriples_skip_plain_avx2(unsigned char* p, unsigned char* end)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i dq = _mm256_set1_epi8('"');
+  const __m256i sq = _mm256_set1_epi8('\'');
+  const __m256i lt = _mm256_set1_epi8('<');
+  const __m256i gt = _mm256_set1_epi8('>');
+  const __m256i bs = _mm256_set1_epi8('\\');
+
+  while(end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i m;
+    unsigned int mask;
+
+    m = _mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, cr));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, dq));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, sq));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, lt));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, gt));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, bs));
+    mask = (unsigned int)_mm256_movemask_epi8(m);
+    if(mask)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+
+  return raptor_ntriples_skip_plain_sse2(p, end);
+}
+#endif
+
+
+/*
+ * The line state machine.  @skip is expanded inline by each variant
+ * so that it only costs a call per line, not per special byte.
+ */
+#define RAPTOR_NTRIPLES_FIND_LINE_END(skip, ptr, end)                   \
+  do {                                                                  \
+    int quote = '\0';                                                   \
+    int in_uri = 0;                                                     \
+    while(1) {                                                          \
+      int c;                                                            \
+      ptr = skip(ptr, end);                                             \
+      if(ptr >= end)                                                    \
+        break;                                                          \
+      c = *ptr;                                                         \
+      if(c == '\\') {                                                   \
+        /* skip backslash and the escaped byte */                       \
+        ptr++;                                                          \
+        if(ptr < end)                                                   \
+          ptr++;                                                        \
+        continue;                                                       \
+      }                                                                 \
+      if(c == '<')                                                      \
+        in_uri = 1;                                                     \
+      else if(in_uri && c == '>')                                       \
+        in_uri = 0;                                                     \
+      if(!quote) {                                                      \
+        if((!in_uri && c == '\'') || c == '"')                          \
+          quote = c;                                                    \
+        if(c == '\n' || c == '\r')                                      \
+          break;                                                        \
+      } else {                                                          \
+        if(c == quote)                                                  \
+          quote = 0;                                                    \
+      }                                                                 \
+      ptr++;                                                            \
+    }                                                                   \
+  } while(0)
+
+
+static unsigned char*
+raptor_ntriples_find_line_end_scalar(unsigned char* ptr, unsigned char* end)
+{
+  RAPTOR_NTRIPLES_FIND_LINE_END(raptor_ntriples_skip_plain_scalar, ptr, end);
+  return ptr;
+}
+
+
+#ifdef RAPTOR_NTRIPLES_SCAN_SSE2
+static unsigned char*
+raptor_ntriples_find_line_end_sse2(unsigned char* ptr, unsigned char* end)
+{
+  RAPTOR_NTRIPLES_FIND_LINE_END(raptor_ntriples_skip_plain_sse2, ptr, end);
+  return ptr;
+}
+#endif
+
+
+#ifdef RAPTOR_NTRIPLES_SCAN_AVX2
+__attribute__((target("avx2")))
+static unsigned char*
+raptor_ntriples_find_line_end_avx2(unsigned char* ptr, unsigned char* end)
+{
+  RAPTOR_NTRIPLES_FIND_LINE_END(raptor_ntriples_skip_plain_avx2, ptr, end);
+  return ptr;
+}
+#endif
+
+
+/**
+ * raptor_ntriples_get_line_scanner:
+ * @type: scanner implementation wanted
+ *
+ * INTERNAL - Get an N-Triples line end scanner
+ *
+ * With #RAPTOR_NTRIPLES_SCANNER_BEST the fastest implementation
+ * supported by the running CPU is returned.
+ *
+ * The returned function is given a buffer from @ptr to @end (which
+ * need not be NUL terminated) and returns a pointer to the '\n' or
+ * '\r' ending the first line, or @end if the line is not terminated.
+ * Newlines inside quoted literals and bytes escaped with a backslash
+ * do not end the line.
+ *
+ * Return value: scanner function or NULL if @type is not available
+ **/
+raptor_ntriples_line_scanner
+raptor_ntriples_get_line_scanner(raptor_ntriples_scanner_type type)
+{
+  switch(type) {
+    case RAPTOR_NTRIPLES_SCANNER_BEST:
+#ifdef RAPTOR_NTRIPLES_SCAN_AVX2
+      __builtin_cpu_init();
+      if(__builtin_cpu_supports("avx2"))
+        return raptor_ntriples_find_line_end_avx2;
+#endif
+#ifdef RAPTOR_NTRIPLES_SCAN_SSE2
+      return raptor_ntriples_find_line_end_sse2;
+#else
+      return raptor_ntriples_find_line_end_scalar;
+#endif
+
+    case RAPTOR_NTRIPLES_SCANNER_SCALAR:
+      return raptor_ntriples_find_line_end_scalar;
+
+    case RAPTOR_NTRIPLES_SCANNER_SSE2:
+#ifdef RAPTOR_NTRIPLES_SCAN_SSE2
+      return raptor_ntriples_find_line_end_sse2;
+#else
+      break;
+#endif
+
+    case RAPTOR_NTRIPLES_SCANNER_AVX2:
+#ifdef RAPTOR_NTRIPLES_SCAN_AVX2
+      __builtin_cpu_init();
+      if(__builtin_cpu_supports("avx2"))
+        return raptor_ntriples_find_line_end_avx2;
+#endif
+      break;
+  }
+
+  return NULL;
+}
+
+
+
+#ifdef STANDALONE
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+/* The byte at a time loop from raptor_ntriples_parse_chunk() */
+static unsigned char*
+reference_find_line_end(unsigned char* ptr, unsigned char* end_ptr)
+{
+  int quote = '\0';
+  int in_uri = '\0';
+  int bq = 0;
+  while(ptr < end_ptr) {
+    if(!bq) {
+      if(*ptr == '\\') {
+        bq = 1;
+        ptr++;
+        continue;
+      }
+
+      if(*ptr == '<')
+        in_uri = 1;
+      else if (in_uri && *ptr == '>')
+        in_uri = 0;
+
+      if(!quote) {
+        if((!in_uri && *ptr == '\'') || *ptr == '"')
+          quote = *ptr;
+        if(*ptr == '\n' || *ptr == '\r')
+          break;
+      } else {
+        if(*ptr == quote)
+          quote = 0;
+      }
+    }
+    ptr++;
+    bq = 0;
+  }
+  return ptr;
+}
+
+
+static const char * const scanner_names[4] = {
+  "best", "scalar", "sse2", "avx2"
+};
+
+/* Bytes that matter to the scanner, weighted towards the plain ones */
+static const char test_alphabet[] = "\n\r\"'<>\\abcdefghijklmnopqrstu :.#_";
+
+#define TEST_BUFFER_SIZE 4096
+#define TEST_ROUNDS 2000
+
+
+static int
+test_scanner(const char* program, raptor_ntriples_scanner_type type,
+             unsigned char* buffer)
+{
+  raptor_ntriples_line_scanner scanner;
+  int round;
+  int failures = 0;
+
+  scanner = raptor_ntriples_get_line_scanner(type);
+  if(!scanner) {
+    fprintf(stderr, "%s: scanner %s not available - skipping\n",
+            program, scanner_names[type]);
+    return 0;
+  }
+
+  for(round = 0; round < TEST_ROUNDS; round++) {
+    size_t len = (size_t)(rand() % TEST_BUFFER_SIZE);
+    int plain = (round & 1) ? 8 : 64;
+    unsigned char* end = buffer + len;
+    unsigned char* p;
+    size_t i;
+
+    /* odd rounds are dense with special bytes, even rounds sparse */
+    for(i = 0; i < len; i++) {
+      if(rand() % plain)
+        buffer[i] = (unsigned char)('a' + (rand() % 26));
+      else
+        buffer[i] = (unsigned char)test_alphabet[rand() % (sizeof(test_alphabet) - 1)];
+    }
+
+    /* Split the whole buffer into lines both ways */
+    p = buffer;
+    while(p < end) {
+      unsigned char* expected = reference_find_line_end(p, end);
+      unsigned char* got = scanner(p, end);
+
+      if(got != expected) {
+        fprintf(stderr,
+                "%s: scanner %s round %d: line at offset %d ended at %d expected %d\n",
+                program, scanner_names[type], round, (int)(p - buffer),
+                (int)(got - buffer), (int)(expected - buffer));
+        failures++;
+        break;
+      }
+      p = (expected < end) ? expected + 1 : end;
+    }
+  }
+
+  return failures;
+}
+
+
+#ifdef HAVE_GETTIMEOFDAY
+static void
+bench_scanner(const char* program, const char* name,
+              raptor_ntriples_line_scanner scanner,
+              unsigned char* buffer, size_t len, int loops)
+{
+  struct timeval tv_start, tv_end;
+  unsigned char* end = buffer + len;
+  long lines = 0;
+  double secs;
+  int i;
+
+  if(!scanner)
+    return;
+
+  gettimeofday(&tv_start, NULL);
+  for(i = 0; i < loops; i++) {
+    unsigned char* p = buffer;
+    while(p < end) {
+      p = scanner(p, end);
+      if(p < end) {
+        p++;
+        lines++;
+      }
+    }
+  }
+  gettimeofday(&tv_end, NULL);
+
+  secs = (double)(tv_end.tv_sec - tv_start.tv_sec) +
+    (double)(tv_end.tv_usec - tv_start.tv_usec) / 1000000.0;
+  fprintf(stdout, "%s: %-6s %ld lines in %.3fs  %.1f MB/s\n",
+          program, name, lines, secs,
+          secs > 0 ? ((double)len * loops / (1024.0 * 1024.0)) / secs : 0.0);
+}
+
+
+/* Build N-Quads shaped lines and time each scanner over them */
+static int
+bench_scanners(const char* program, size_t len)
+{
+  static const char line[] =
+    "<http://example.org/resource/subject/12345> "
+    "<http://www.w3.org/2000/01/rdf-schema#label> "
+    "\"A moderately long literal value with some words in it\"@en "
+    "<http://example.org/graph/1> .\n";
+  unsigned char* buffer;
+  size_t offset;
+  int type;
+
+  buffer = (unsigned char*)malloc(len);
+  if(!buffer)
+    return 1;
+
+  for(offset = 0; offset < len; offset++)
+    buffer[offset] = (unsigned char)line[offset % (sizeof(line) - 1)];
+
+  bench_scanner(program, "byte", reference_find_line_end, buffer, len, 10);
+  for(type = RAPTOR_NTRIPLES_SCANNER_SCALAR;
+      type <= RAPTOR_NTRIPLES_SCANNER_AVX2; type++)
+    bench_scanner(program, scanner_names[type],
+                  raptor_ntriples_get_line_scanner((raptor_ntriples_scanner_type)type),
+                  buffer, len, 10);
+
+  free(buffer);
+  return 0;
+}
+#endif
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = raptor_basename(argv[0]);
+  unsigned char* buffer;
+  int type;
+  int failures = 0;
+
+  buffer = (unsigned char*)malloc(TEST_BUFFER_SIZE);
+  if(!buffer)
+    return 1;
+
+  srand(1);
+
+  for(type = RAPTOR_NTRIPLES_SCANNER_BEST;
+      type <= RAPTOR_NTRIPLES_SCANNER_AVX2; type++)
+    failures += test_scanner(program, (raptor_ntriples_scanner_type)type,
+                             buffer);
+
+  free(buffer);
+
+#ifdef HAVE_GETTIMEOFDAY
+  /* Benchmark with: raptor_ntriples_scan_test SIZE-IN-MB */
+  if(!failures && argc > 1)
+    failures += bench_scanners(program, (size_t)atoi(argv[1]) * 1024 * 1024);
+#endif
+
+  return failures;
+}
+
+#endif /* STANDALONE */
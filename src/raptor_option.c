@@ -296,6 +296,48 @@ static const struct
     RAPTOR_OPTION_VALUE_TYPE_BOOL,
     "loadExternalEntities",
     "Parsers and SAX2 should load external entities."
+  },
+  { RAPTOR_OPTION_PARSE_THREADS,
+    RAPTOR_OPTION_AREA_PARSER,
+    RAPTOR_OPTION_VALUE_TYPE_INT,
+    "parseThreads",
+    "N-Triples/N-Quads parsers use this many worker threads"
+  },
+  { RAPTOR_OPTION_PARSE_UNORDERED,
+    RAPTOR_OPTION_AREA_PARSER,
+    RAPTOR_OPTION_VALUE_TYPE_BOOL,
+    "parseUnordered",
+    "Parallel parsers may return statements out of input order"
+  },
+  { RAPTOR_OPTION_PARSE_ARENA,
+    RAPTOR_OPTION_AREA_PARSER,
+    RAPTOR_OPTION_VALUE_TYPE_BOOL,
+    "parseArena",
+    "N-Triples/N-Quads parsers make terms in an arena reset after each statement"
+  },
+  { RAPTOR_OPTION_TURTLE_STREAMING,
+    RAPTOR_OPTION_AREA_SERIALIZER,
+    RAPTOR_OPTION_VALUE_TYPE_BOOL,
+    "turtleStreaming",
+    "Turtle serializer writes statements as they arrive"
+  },
+  { RAPTOR_OPTION_SORT_MEMORY_LIMIT,
+    RAPTOR_OPTION_AREA_SERIALIZER,
+    RAPTOR_OPTION_VALUE_TYPE_INT,
+    "sortMemoryLimit",
+    "Bytes of statements serializers sort in memory before using temporary files"
+  },
+  { RAPTOR_OPTION_SERIALIZE_THREADS,
+    RAPTOR_OPTION_AREA_SERIALIZER,
+    RAPTOR_OPTION_VALUE_TYPE_INT,
+    "serializeThreads",
+    "Turtle serializer formats subjects on this many worker threads"
+  },
+  { RAPTOR_OPTION_CHECK_RDF_ID_EXACT,
+    RAPTOR_OPTION_AREA_PARSER,
+    RAPTOR_OPTION_VALUE_TYPE_BOOL,
+    "checkRdfIDExact",
+    "RDF/XML parser keeps rdf:ID strings when checking for duplicates"
   }
 };
 
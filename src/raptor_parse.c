@@ -43,6 +43,11 @@
 #ifdef HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_PARSER
 
 /* Raptor includes */
 #include "raptor2.h"
@@ -517,6 +522,61 @@ raptor_free_parser(raptor_parser* rdf_parser)
 }
 
 
+/*
+ * raptor_parser_parse_file_stream_pushback:
+ * @rdf_parser: parser
+ * @stream: FILE* of RDF content
+ * @pushback: bytes already read from the start of @stream or NULL
+ * @pushback_len: length of @pushback
+ * @filename: filename of content or NULL if it has no name
+ * @base_uri: the base URI to use
+ *
+ * INTERNAL - Parse RDF content from a FILE* after some bytes that
+ * were already read from it
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+raptor_parser_parse_file_stream_pushback(raptor_parser* rdf_parser,
+                                         FILE *stream,
+                                         const unsigned char* pushback,
+                                         size_t pushback_len,
+                                         const char* filename,
+                                         raptor_uri *base_uri)
+{
+  int rc = 0;
+  raptor_locator *locator = &rdf_parser->locator;
+  size_t len = pushback_len;
+
+  if(!stream || !base_uri)
+    return 1;
+
+  locator->line= locator->column = -1;
+  locator->file= filename;
+
+  if(raptor_parser_parse_start(rdf_parser, base_uri))
+    return 1;
+
+  if(len)
+    memcpy(rdf_parser->buffer, pushback, len);
+
+  while(1) {
+    int is_end;
+
+    len += fread(rdf_parser->buffer + len, 1, RAPTOR_READ_BUFFER_SIZE - len,
+                 stream);
+    is_end = (len < RAPTOR_READ_BUFFER_SIZE);
+    rdf_parser->buffer[len] = '\0';
+    rc = raptor_parser_parse_chunk(rdf_parser, rdf_parser->buffer, len, is_end);
+    if(rc || is_end)
+      break;
+    len = 0;
+  }
+
+  return (rc != 0);
+}
+
+
 /**
  * raptor_parser_parse_file_stream:
  * @rdf_parser: parser
@@ -535,29 +595,236 @@ raptor_parser_parse_file_stream(raptor_parser* rdf_parser,
                                 FILE *stream, const char* filename,
                                 raptor_uri *base_uri)
 {
-  int rc = 0;
+  return raptor_parser_parse_file_stream_pushback(rdf_parser, stream,
+                                                  NULL, 0,
+                                                  filename, base_uri);
+}
+
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_SYS_STAT_H)
+#define RAPTOR_PARSE_FILE_MMAP 1
+
+/* Bytes of a mapped file passed to the parser in one chunk */
+#define RAPTOR_MMAP_CHUNK_SIZE (1 << 20)
+
+/*
+ * raptor_parser_parse_file_mmap:
+ * @rdf_parser: parser
+ * @stream: FILE* of RDF content positioned at the start of the file
+ * @filename: filename of content
+ * @base_uri: the base URI to use
+ *
+ * INTERNAL - Parse a regular file by mapping it into memory
+ *
+ * The mapping is passed to the parser in large chunks, avoiding a
+ * read() call and a copy into the parser buffer for every
+ * RAPTOR_READ_BUFFER_SIZE bytes.
+ *
+ * Return value: non 0 on failure or <0 if the file cannot be mapped
+ * and must be read as a stream
+ **/
+static int
+raptor_parser_parse_file_mmap(raptor_parser* rdf_parser,
+                              FILE *stream, const char* filename,
+                              raptor_uri *base_uri)
+{
   raptor_locator *locator = &rdf_parser->locator;
+  struct stat buf;
+  unsigned char *map;
+  size_t size;
+  size_t offset;
+  int rc = 0;
 
-  if(!stream || !base_uri)
-    return 1;
+  /* pipes, devices and empty files are read as a stream */
+  if(fstat(fileno(stream), &buf) || !S_ISREG(buf.st_mode) || buf.st_size <= 0)
+    return -1;
+
+  size = RAPTOR_GOOD_CAST(size_t, buf.st_size);
+  if(RAPTOR_GOOD_CAST(off_t, size) != buf.st_size)
+    return -1;
+
+  map = (unsigned char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+                             fileno(stream), 0);
+  if(map == (unsigned char*)MAP_FAILED)
+    return -1;
+
+#if defined(HAVE_MADVISE) && defined(MADV_SEQUENTIAL)
+  madvise(map, size, MADV_SEQUENTIAL);
+#endif
 
   locator->line= locator->column = -1;
   locator->file= filename;
 
-  if(raptor_parser_parse_start(rdf_parser, base_uri))
-    return 1;
-  
-  while(!feof(stream)) {
-    size_t len = fread(rdf_parser->buffer, 1, RAPTOR_READ_BUFFER_SIZE, stream);
-    int is_end = (len < RAPTOR_READ_BUFFER_SIZE);
-    rdf_parser->buffer[len] = '\0';
-    rc = raptor_parser_parse_chunk(rdf_parser, rdf_parser->buffer, len, is_end);
-    if(rc || is_end)
+  if(raptor_parser_parse_start(rdf_parser, base_uri)) {
+    rc = 1;
+    goto unmap;
+  }
+
+  for(offset = 0; offset < size; ) {
+    size_t len = size - offset;
+    int is_end;
+
+    if(len > RAPTOR_MMAP_CHUNK_SIZE)
+      len = RAPTOR_MMAP_CHUNK_SIZE;
+    is_end = (offset + len == size);
+
+    rc = raptor_parser_parse_chunk(rdf_parser, map + offset, len, is_end);
+    if(rc)
       break;
+
+    offset += len;
   }
 
+  unmap:
+  munmap(map, size);
+
   return (rc != 0);
 }
+#endif
+
+
+#if defined(HAVE_SYS_STAT_H) && (defined(HAVE_ZLIB) || defined(HAVE_ZSTD) || defined(HAVE_BZLIB))
+#define RAPTOR_PARSE_FILE_COMPRESSED 1
+
+/* Bytes read from the start of a file to guess its compression */
+#define RAPTOR_COMPRESSION_MAGIC_SIZE 4
+
+/* Context for reading the magic bytes already taken from a stream
+ * that cannot be rewound, followed by the rest of the stream */
+typedef struct {
+  FILE* stream;
+  const unsigned char* pushback;
+  size_t pushback_len;
+  size_t offset;
+} raptor_parse_pushback_context;
+
+
+static int
+raptor_parse_pushback_iostream_read_bytes(void *user_data,
+                                          void *ptr, size_t size, size_t nmemb)
+{
+  raptor_parse_pushback_context* pbc;
+  unsigned char* p = (unsigned char*)ptr;
+  size_t total = size * nmemb;
+  size_t len = 0;
+
+  pbc = (raptor_parse_pushback_context*)user_data;
+
+  if(pbc->offset < pbc->pushback_len) {
+    len = pbc->pushback_len - pbc->offset;
+    if(len > total)
+      len = total;
+    memcpy(p, pbc->pushback + pbc->offset, len);
+    pbc->offset += len;
+  }
+
+  if(len < total)
+    len += fread(p + len, 1, total - len, pbc->stream);
+
+  return RAPTOR_BAD_CAST(int, len / size);
+}
+
+
+static int
+raptor_parse_pushback_iostream_read_eof(void *user_data)
+{
+  raptor_parse_pushback_context* pbc;
+
+  pbc = (raptor_parse_pushback_context*)user_data;
+  return (pbc->offset == pbc->pushback_len && feof(pbc->stream));
+}
+
+
+static const raptor_iostream_handler raptor_parse_pushback_iostream_handler = {
+  /* .version     = */ 2,
+  /* .init        = */ NULL,
+  /* .finish      = */ NULL,
+  /* .write_byte  = */ NULL,
+  /* .write_bytes = */ NULL,
+  /* .write_end   = */ NULL,
+  /* .read_bytes  = */ raptor_parse_pushback_iostream_read_bytes,
+  /* .read_eof    = */ raptor_parse_pushback_iostream_read_eof
+};
+
+
+/*
+ * raptor_parser_parse_file_compressed:
+ * @rdf_parser: parser
+ * @stream: FILE* of RDF content positioned at the start of the file
+ * @magic: buffer of RAPTOR_COMPRESSION_MAGIC_SIZE bytes
+ * @magic_len_p: pointer to store the number of bytes left in @magic
+ * @filename: filename of content or NULL if it has no name
+ * @base_uri: the base URI to use
+ *
+ * INTERNAL - Parse a file if it is compressed
+ *
+ * The content is read through a decompressing iostream.  Regular
+ * files are rewound after looking at the magic bytes; other streams
+ * such as pipes and standard input cannot be, so the magic bytes are
+ * read back before the rest of the stream and, if the stream is not
+ * compressed, left in @magic for the caller to parse first.
+ *
+ * Return value: non 0 on failure or <0 if the file is not compressed
+ * and must be read as usual
+ **/
+static int
+raptor_parser_parse_file_compressed(raptor_parser* rdf_parser,
+                                    FILE *stream,
+                                    unsigned char* magic, size_t* magic_len_p,
+                                    const char* filename,
+                                    raptor_uri *base_uri)
+{
+  raptor_world* world = rdf_parser->world;
+  struct stat buf;
+  int seekable;
+  size_t len;
+  raptor_parse_pushback_context pbc;
+  raptor_iostream* iostr;
+  raptor_iostream* diostr;
+  int rc;
+
+  *magic_len_p = 0;
+
+  seekable = (!fstat(fileno(stream), &buf) && S_ISREG(buf.st_mode));
+
+  len = fread(magic, 1, RAPTOR_COMPRESSION_MAGIC_SIZE, stream);
+  if(seekable) {
+    if(fseek(stream, 0L, SEEK_SET))
+      return 1;
+  } else
+    *magic_len_p = len;
+
+  if(raptor_compression_guess(magic, len) == RAPTOR_COMPRESSION_NONE)
+    return -1;
+
+  if(seekable)
+    iostr = raptor_new_iostream_from_file_handle(world, stream);
+  else {
+    pbc.stream = stream;
+    pbc.pushback = magic;
+    pbc.pushback_len = len;
+    pbc.offset = 0;
+    iostr = raptor_new_iostream_from_handler(world, &pbc,
+                                             &raptor_parse_pushback_iostream_handler);
+  }
+  if(!iostr)
+    return 1;
+
+  diostr = raptor_new_iostream_from_compressed_iostream(world, iostr);
+  if(!diostr) {
+    raptor_free_iostream(iostr);
+    return 1;
+  }
+
+  rdf_parser->locator.file = filename;
+  rc = raptor_parser_parse_iostream(rdf_parser, diostr, base_uri);
+
+  raptor_free_iostream(diostr);
+  raptor_free_iostream(iostr);
+
+  return (rc != 0);
+}
+#endif
 
 
 /**
@@ -569,6 +836,12 @@ raptor_parser_parse_file_stream(raptor_parser* rdf_parser,
  * Parse RDF content at a file URI.
  *
  * If @uri is NULL (source is stdin), then the @base_uri is required.
+ *
+ * Regular files are mapped into memory where supported; standard
+ * input and other files are read as a stream.  Content compressed
+ * with a format raptor was built to support, including on standard
+ * input, is decompressed as it is read - see
+ * raptor_new_iostream_from_compressed_iostream().
  * 
  * Return value: non 0 on failure
  **/
@@ -583,6 +856,12 @@ raptor_parser_parse_file(raptor_parser* rdf_parser, raptor_uri *uri,
 #if defined(HAVE_UNISTD_H) && defined(HAVE_SYS_STAT_H)
   struct stat buf;
 #endif
+#ifdef RAPTOR_PARSE_FILE_COMPRESSED
+  unsigned char magic[RAPTOR_COMPRESSION_MAGIC_SIZE];
+#else
+  unsigned char *magic = NULL;
+#endif
+  size_t magic_len = 0;
 
   if(uri) {
     filename = raptor_uri_uri_string_to_filename(raptor_uri_as_string(uri));
@@ -613,7 +892,25 @@ raptor_parser_parse_file(raptor_parser* rdf_parser, raptor_uri *uri,
     fh = stdin;
   }
 
-  rc = raptor_parser_parse_file_stream(rdf_parser, fh, filename, base_uri);
+#ifdef RAPTOR_PARSE_FILE_COMPRESSED
+  rc = raptor_parser_parse_file_compressed(rdf_parser, fh,
+                                           magic, &magic_len,
+                                           filename, base_uri);
+  if(rc >= 0)
+    goto cleanup;
+#endif
+
+#ifdef RAPTOR_PARSE_FILE_MMAP
+  if(uri) {
+    rc = raptor_parser_parse_file_mmap(rdf_parser, fh, filename, base_uri);
+    if(rc >= 0)
+      goto cleanup;
+  }
+#endif
+
+  rc = raptor_parser_parse_file_stream_pushback(rdf_parser, fh,
+                                                magic, magic_len,
+                                                filename, base_uri);
 
   cleanup:
   if(uri) {
@@ -1286,9 +1583,24 @@ raptor_world_guess_parser_name(raptor_world* world,
   raptor_parser_factory *factory;
   unsigned char *suffix = NULL;
   struct syntax_score* scores;
+  /* Only use first N bytes to avoid HTML documents that contain
+   * RDF/XML examples
+   */
+#define FIRSTN 1024
+  unsigned char firstn[FIRSTN + 1];
 
   RAPTOR_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, raptor_world, NULL);
 
+  /* The content may be read-only such as a mapped file so terminate a
+   * copy of the first N bytes rather than writing into it.
+   */
+  if(buffer && len > FIRSTN) {
+    memcpy(firstn, buffer, FIRSTN);
+    firstn[FIRSTN] = '\0';
+    buffer = firstn;
+    len = FIRSTN;
+  }
+
   raptor_world_open(world);
 
   scores = RAPTOR_CALLOC(struct syntax_score*,
@@ -1364,29 +1676,11 @@ raptor_world_guess_parser_name(raptor_world* world,
         break;
     }
     
-    if(factory->recognise_syntax) {
-      int c = -1;
-    
-      /* Only use first N bytes to avoid HTML documents that contain
-       * RDF/XML examples
-       */
-#define FIRSTN 1024
-#if FIRSTN > RAPTOR_READ_BUFFER_SIZE
-#error "RAPTOR_READ_BUFFER_SIZE is not large enough"
-#endif
-      if(buffer && len && len > FIRSTN) {
-        c = buffer[FIRSTN];
-        ((char*)buffer)[FIRSTN] = '\0';
-      }
-
+    if(factory->recognise_syntax)
       score += factory->recognise_syntax(factory, buffer, len, 
                                          identifier, suffix, 
                                          mime_type);
 
-      if(c >= 0)
-        ((char*)buffer)[FIRSTN] = RAPTOR_GOOD_CAST(char, c);
-    }
-
     scores[i].score = score < 10 ? score : 10; 
     scores[i].factory = factory;
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 2
@@ -1745,8 +2039,10 @@ raptor_parser_parse_iostream(raptor_parser* rdf_parser, raptor_iostream *iostr,
 
     ilen = raptor_iostream_read_bytes(rdf_parser->buffer, 1,
                                       RAPTOR_READ_BUFFER_SIZE, iostr);
-    if(ilen < 0)
+    if(ilen < 0) {
+      rc = 1;
       break;
+    }
     len = RAPTOR_GOOD_CAST(size_t, ilen);
     is_end = (len < RAPTOR_READ_BUFFER_SIZE);
 
@@ -1765,10 +2061,301 @@ raptor_parser_parse_iostream(raptor_parser* rdf_parser, raptor_iostream *iostr,
 
 #ifdef STANDALONE
 #include <stdio.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 int main(int argc, char *argv[]);
 
 
+#define GUESS_TRIPLES_COUNT 100
+
+static void
+test_guess_count_triples(void *user_data, raptor_statement *statement)
+{
+  (*(int*)user_data)++;
+}
+
+
+/*
+ * test_guess_open_file:
+ * @filename_p: pointer to store the new filename
+ *
+ * Create a file for writing test content in the temporary directory,
+ * or the current (build) directory without mkstemp().
+ *
+ * Return value: FILE* or NULL on failure
+ */
+static FILE*
+test_guess_open_file(char **filename_p)
+{
+  FILE *handle;
+  char *filename;
+#ifdef HAVE_MKSTEMP
+  static const char name_template[] = "/raptor_guess_XXXXXX";
+  const char *dir = getenv("TMPDIR");
+  size_t dir_len;
+  int fd;
+
+  if(!dir || !*dir)
+    dir = "/tmp";
+  dir_len = strlen(dir);
+
+  filename = RAPTOR_MALLOC(char*, dir_len + sizeof(name_template));
+  if(!filename)
+    return NULL;
+  memcpy(filename, dir, dir_len);
+  memcpy(filename + dir_len, name_template, sizeof(name_template));
+
+  fd = mkstemp(filename);
+  if(fd < 0) {
+    RAPTOR_FREE(char*, filename);
+    return NULL;
+  }
+  handle = fdopen(fd, "wb");
+#else
+  static const char name[] = "raptor_guess_test.nt";
+
+  filename = RAPTOR_MALLOC(char*, sizeof(name));
+  if(!filename)
+    return NULL;
+  memcpy(filename, name, sizeof(name));
+
+  handle = fopen(filename, "wb");
+#endif
+
+  if(!handle) {
+    remove(filename);
+    RAPTOR_FREE(char*, filename);
+    return NULL;
+  }
+
+  *filename_p = filename;
+  return handle;
+}
+
+
+/* Parse a file larger than the guess parser's sniff window with
+ * raptor_parser_parse_file() so it goes through the read-only file
+ * mapping
+ */
+static int
+test_guess_parse_file(raptor_world *world, const char *program)
+{
+  raptor_parser *parser;
+  unsigned char *uri_string;
+  raptor_uri *uri;
+  FILE *handle;
+  char *filename = NULL;
+  int count = 0;
+  int rc;
+  int i;
+
+  if(!raptor_world_is_parser_name(world, "guess") ||
+     !raptor_world_is_parser_name(world, "ntriples"))
+    return 0;
+
+  handle = test_guess_open_file(&filename);
+  if(!handle) {
+    fprintf(stderr, "%s: Failed to create a test file\n", program);
+    return 1;
+  }
+  for(i = 0; i < GUESS_TRIPLES_COUNT; i++)
+    fprintf(handle,
+            "<http://example.org/s%d> <http://example.org/p> \"o%d\" .\n",
+            i, i);
+  fclose(handle);
+
+  parser = raptor_new_parser(world, "guess");
+  uri_string = raptor_uri_filename_to_uri_string(filename);
+  uri = raptor_new_uri(world, uri_string);
+  raptor_parser_set_statement_handler(parser, &count,
+                                      test_guess_count_triples);
+
+  rc = raptor_parser_parse_file(parser, uri, NULL);
+
+  raptor_free_parser(parser);
+  raptor_free_uri(uri);
+  raptor_free_memory(uri_string);
+  remove(filename);
+
+  if(rc || count != GUESS_TRIPLES_COUNT) {
+    fprintf(stderr,
+            "%s: guess parser on %s returned %d with %d triples, expected %d\n",
+            program, filename, rc, count, GUESS_TRIPLES_COUNT);
+    rc = 1;
+  }
+
+  RAPTOR_FREE(char*, filename);
+
+  return rc;
+}
+
+
+#if defined(HAVE_UNISTD_H) && !defined(WIN32)
+#define TEST_PARSE_PIPE 1
+
+/* Parse N-Triples written to a pipe read as standard input, which
+ * cannot be rewound after guessing the compression, either plain or
+ * compressed with @type
+ */
+static int
+test_parse_pipe(raptor_world *world, const char *program,
+                raptor_compression_type type)
+{
+  raptor_parser *parser = NULL;
+  raptor_uri *base_uri = NULL;
+  raptor_iostream *iostr = NULL;
+  raptor_iostream *ciostr = NULL;
+  unsigned char *string = NULL;
+  size_t string_length = 0;
+  int fds[2];
+  int saved_stdin = -1;
+  int count = 0;
+  int rc = 1;
+  int i;
+
+  if(!raptor_world_is_parser_name(world, "ntriples"))
+    return 0;
+
+  iostr = raptor_new_iostream_to_string(world, (void**)&string,
+                                        &string_length, NULL);
+  if(!iostr)
+    goto tidy;
+  if(type != RAPTOR_COMPRESSION_NONE) {
+    ciostr = raptor_new_iostream_to_compressed_iostream(world, iostr, type,
+                                                        -1, 0);
+    if(!ciostr)
+      goto tidy;
+  }
+  for(i = 0; i < GUESS_TRIPLES_COUNT; i++) {
+    char line[80];
+
+    sprintf(line, "<http://example.org/s%d> <http://example.org/p> \"o%d\" .\n",
+            i, i);
+    raptor_iostream_string_write(line, ciostr ? ciostr : iostr);
+  }
+  if(ciostr) {
+    raptor_free_iostream(ciostr);
+    ciostr = NULL;
+  }
+  raptor_free_iostream(iostr);
+  iostr = NULL;
+  if(!string)
+    goto tidy;
+
+  /* the content is small enough to fit in the pipe buffer */
+  if(pipe(fds))
+    goto tidy;
+  if(write(fds[1], string, string_length) != (ssize_t)string_length) {
+    close(fds[0]);
+    close(fds[1]);
+    goto tidy;
+  }
+  close(fds[1]);
+
+  saved_stdin = dup(0);
+  dup2(fds[0], 0);
+  close(fds[0]);
+  clearerr(stdin);
+
+  parser = raptor_new_parser(world, "ntriples");
+  base_uri = raptor_new_uri(world, (const unsigned char*)"http://example.org/");
+  raptor_parser_set_statement_handler(parser, &count,
+                                      test_guess_count_triples);
+
+  rc = raptor_parser_parse_file(parser, NULL, base_uri);
+
+  dup2(saved_stdin, 0);
+  close(saved_stdin);
+  clearerr(stdin);
+
+  tidy:
+  if(parser)
+    raptor_free_parser(parser);
+  if(base_uri)
+    raptor_free_uri(base_uri);
+  if(ciostr)
+    raptor_free_iostream(ciostr);
+  if(iostr)
+    raptor_free_iostream(iostr);
+  if(string)
+    raptor_free_memory(string);
+
+  if(rc || count != GUESS_TRIPLES_COUNT) {
+    fprintf(stderr,
+            "%s: parsing compression type %d from a pipe returned %d with %d triples, expected %d\n",
+            program, (int)type, rc, count, GUESS_TRIPLES_COUNT);
+    rc = 1;
+  }
+
+  return rc;
+}
+#endif
+
+
+struct test_graph_marks {
+  int starts;
+  int ends;
+};
+
+static void
+test_graph_mark_count(void *user_data, raptor_uri *graph, int flags)
+{
+  struct test_graph_marks *marks = (struct test_graph_marks*)user_data;
+
+  if(flags & RAPTOR_GRAPH_MARK_START)
+    marks->starts++;
+  else
+    marks->ends++;
+}
+
+
+/* Parse line-terminated N-Triples twice with one parser; each parse
+ * must start and end the default graph once
+ */
+static int
+test_graph_marks_reuse(raptor_world *world, const char *program)
+{
+  static const char content[] =
+    "<http://example.org/s> <http://example.org/p> <http://example.org/o> .\n"
+    "<http://example.org/s> <http://example.org/p> \"o\" .\n";
+  raptor_parser *parser;
+  raptor_uri *base_uri;
+  struct test_graph_marks marks = { 0, 0 };
+  int rc = 0;
+  int i;
+
+  if(!raptor_world_is_parser_name(world, "ntriples"))
+    return 0;
+
+  parser = raptor_new_parser(world, "ntriples");
+  base_uri = raptor_new_uri(world, (const unsigned char*)"http://example.org/");
+  raptor_parser_set_graph_mark_handler(parser, &marks, test_graph_mark_count);
+
+  for(i = 0; i < 2 && !rc; i++) {
+    rc = raptor_parser_parse_start(parser, base_uri);
+    if(!rc)
+      rc = raptor_parser_parse_chunk(parser, (const unsigned char*)content,
+                                     sizeof(content) - 1, 0);
+    if(!rc)
+      rc = raptor_parser_parse_chunk(parser, NULL, 0, 1);
+  }
+
+  raptor_free_parser(parser);
+  raptor_free_uri(base_uri);
+
+  if(rc || marks.starts != 2 || marks.ends != 2) {
+    fprintf(stderr,
+            "%s: two parses returned %d with %d graph starts and %d ends, expected 2 and 2\n",
+            program, rc, marks.starts, marks.ends);
+    return 1;
+  }
+
+  return 0;
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -1820,6 +2407,27 @@ main(int argc, char *argv[])
   }
   RAPTOR_FREE(char*, s);
 
+  if(test_guess_parse_file(world, program))
+    return 1;
+
+  if(test_graph_marks_reuse(world, program))
+    return 1;
+
+#ifdef TEST_PARSE_PIPE
+  if(1) {
+    raptor_compression_type type;
+
+    for(type = RAPTOR_COMPRESSION_NONE; type <= RAPTOR_COMPRESSION_LAST;
+        type = (raptor_compression_type)(type + 1)) {
+      if(type != RAPTOR_COMPRESSION_NONE &&
+         !raptor_compression_is_supported(type))
+        continue;
+      if(test_parse_pipe(world, program, type))
+        return 1;
+    }
+  }
+#endif
+
   raptor_free_world(world);
   
   return 0;
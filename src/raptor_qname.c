@@ -38,6 +38,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_QNAME
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -76,27 +78,42 @@
  * --------------------------------------------------------------------
  */
 
-/**
- * raptor_new_qname:
+/* free the fields of a qname but not the structure */
+static void
+raptor_qname_clear(raptor_qname* name)
+{
+  if(name->local_name)
+    RAPTOR_FREE(char*, name->local_name);
+
+  if(name->uri && name->nspace)
+    raptor_free_uri(name->uri);
+
+  if(name->value)
+    RAPTOR_FREE(char*, name->value);
+}
+
+
+/*
+ * raptor_qname_init:
+ * @qname: zeroed qname to fill
  * @nstack: namespace stack to look up for namespaces
  * @name: element or attribute name
  * @value: attribute value (else is an element)
  *
- * Constructor - create a new XML qname.
- * 
- * Create a new qname from the local element/attribute name,
- * with optional (attribute) value.  The namespace stack is used
- * to look up the name and find the namespace and generate the
- * URI of the qname.
- * 
- * Return value: a new #raptor_qname object or NULL on failure
- **/
-raptor_qname*
-raptor_new_qname(raptor_namespace_stack *nstack, 
-                 const unsigned char *name,
-                 const unsigned char *value)
+ * INTERNAL - Fill in a qname for raptor_new_qname() and
+ * raptor_new_qname_from_freelist()
+ *
+ * On failure the fields set so far must be freed with
+ * raptor_qname_clear().
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_qname_init(raptor_qname* qname,
+                  raptor_namespace_stack *nstack, 
+                  const unsigned char *name,
+                  const unsigned char *value)
 {
-  raptor_qname* qname;
   const unsigned char *p;
   raptor_namespace* ns;
   unsigned char* new_name;
@@ -107,9 +124,6 @@ raptor_new_qname(raptor_namespace_stack *nstack,
   RAPTOR_DEBUG2("name %s\n", name);
 #endif  
 
-  qname = RAPTOR_CALLOC(raptor_qname*, 1, sizeof(*qname));
-  if(!qname)
-    return NULL;
   qname->world = nstack->world;
 
   if(value) {
@@ -117,10 +131,8 @@ raptor_new_qname(raptor_namespace_stack *nstack,
     unsigned char* new_value;
 
     new_value = RAPTOR_MALLOC(unsigned char*, value_length + 1);
-    if(!new_value) {
-      RAPTOR_FREE(raptor_qname, qname);
-      return NULL;
-    } 
+    if(!new_value)
+      return 1;
 
     memcpy(new_value, value, value_length + 1); /* copy NUL */
     qname->value = new_value;
@@ -138,10 +150,8 @@ raptor_new_qname(raptor_namespace_stack *nstack,
 
     /* No : in the name */
     new_name = RAPTOR_MALLOC(unsigned char*, local_name_length + 1);
-    if(!new_name) {
-      raptor_free_qname(qname);
-      return NULL;
-    }
+    if(!new_name)
+      return 1;
     memcpy(new_name, name, local_name_length); /* no NUL to copy */
     new_name[local_name_length] = '\0';
     qname->local_name = new_name;
@@ -172,10 +182,8 @@ raptor_new_qname(raptor_namespace_stack *nstack,
     /* p now is at start of local_name */
     local_name_length = (unsigned int)strlen((char*)p);
     new_name = RAPTOR_MALLOC(unsigned char*, local_name_length + 1);
-    if(!new_name) {
-      raptor_free_qname(qname);
-      return NULL;
-    }
+    if(!new_name)
+      return 1;
     memcpy(new_name, p, local_name_length); /* No NUL to copy */
     new_name[local_name_length] = '\0';
     qname->local_name = new_name;
@@ -210,6 +218,78 @@ raptor_new_qname(raptor_namespace_stack *nstack,
   }
 
 
+  return 0;
+}
+
+
+/**
+ * raptor_new_qname:
+ * @nstack: namespace stack to look up for namespaces
+ * @name: element or attribute name
+ * @value: attribute value (else is an element)
+ *
+ * Constructor - create a new XML qname.
+ * 
+ * Create a new qname from the local element/attribute name,
+ * with optional (attribute) value.  The namespace stack is used
+ * to look up the name and find the namespace and generate the
+ * URI of the qname.
+ * 
+ * Return value: a new #raptor_qname object or NULL on failure
+ **/
+raptor_qname*
+raptor_new_qname(raptor_namespace_stack *nstack, 
+                 const unsigned char *name,
+                 const unsigned char *value)
+{
+  raptor_qname* qname;
+
+  qname = RAPTOR_CALLOC(raptor_qname*, 1, sizeof(*qname));
+  if(!qname)
+    return NULL;
+
+  if(raptor_qname_init(qname, nstack, name, value)) {
+    raptor_free_qname(qname);
+    return NULL;
+  }
+
+  return qname;
+}
+
+
+/*
+ * raptor_new_qname_from_freelist:
+ * @freelist: free list of #raptor_qname objects
+ * @nstack: namespace stack to look up for namespaces
+ * @name: element or attribute name
+ * @value: attribute value (else is an element)
+ *
+ * INTERNAL - Constructor - raptor_new_qname() with the structure taken
+ * from a free list
+ *
+ * Give the qname back with raptor_qname_release(); raptor_free_qname()
+ * also works.
+ *
+ * Return value: a new #raptor_qname object or NULL on failure
+ */
+raptor_qname*
+raptor_new_qname_from_freelist(raptor_freelist* freelist,
+                               raptor_namespace_stack *nstack, 
+                               const unsigned char *name,
+                               const unsigned char *value)
+{
+  raptor_qname* qname;
+
+  qname = (raptor_qname*)raptor_freelist_alloc(freelist);
+  if(!qname)
+    return NULL;
+
+  memset(qname, 0, sizeof(*qname));
+  if(raptor_qname_init(qname, nstack, name, value)) {
+    raptor_qname_release(freelist, qname);
+    return NULL;
+  }
+
   return qname;
 }
 
@@ -374,15 +454,27 @@ raptor_free_qname(raptor_qname* name)
   if(!name)
     return;
 
-  if(name->local_name)
-    RAPTOR_FREE(char*, name->local_name);
+  raptor_qname_clear(name);
+  RAPTOR_FREE(raptor_qname, name);
+}
 
-  if(name->uri && name->nspace)
-    raptor_free_uri(name->uri);
 
-  if(name->value)
-    RAPTOR_FREE(char*, name->value);
-  RAPTOR_FREE(raptor_qname, name);
+/*
+ * raptor_qname_release:
+ * @freelist: free list of #raptor_qname objects
+ * @name: #raptor_qname object or NULL
+ *
+ * INTERNAL - Destructor - free the fields of a qname and give the
+ * structure back to a free list
+ */
+void
+raptor_qname_release(raptor_freelist* freelist, raptor_qname* name)
+{
+  if(!name)
+    return;
+
+  raptor_qname_clear(name);
+  raptor_freelist_release(freelist, name);
 }
 
 
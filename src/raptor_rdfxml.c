@@ -38,6 +38,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_PARSER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -408,6 +410,9 @@ struct raptor_rdfxml_parser_s {
 
   /* writer for building parseType="Literal" content */
   raptor_xml_writer* xml_writer;
+
+  /* elements given back at end tags for the next start tag */
+  raptor_freelist* element_freelist;
 };
 
 
@@ -450,6 +455,7 @@ static int raptor_rdfxml_parse_chunk(raptor_parser* rdf_parser, const unsigned c
 static void raptor_rdfxml_update_document_locator(raptor_parser *rdf_parser);
 
 static raptor_uri* raptor_rdfxml_inscope_base_uri(raptor_parser *rdf_parser);
+static raptor_uri* raptor_rdfxml_new_uri_relative_to_inscope_base(raptor_parser *rdf_parser, const unsigned char *uri_string);
 
 
 static raptor_rdfxml_element*
@@ -479,7 +485,8 @@ raptor_rdfxml_element_push(raptor_rdfxml_parser *rdf_xml_parser, raptor_rdfxml_e
 
 
 static void
-raptor_free_rdfxml_element(raptor_rdfxml_element *element)
+raptor_free_rdfxml_element(raptor_rdfxml_parser *rdf_xml_parser,
+                           raptor_rdfxml_element *element)
 {
   int i;
   
@@ -507,7 +514,7 @@ raptor_free_rdfxml_element(raptor_rdfxml_element *element)
   if(element->reified_id)
     RAPTOR_FREE(char*, (char*)element->reified_id);
 
-  RAPTOR_FREE(raptor_rdfxml_element, element);
+  raptor_freelist_release(rdf_xml_parser->element_freelist, element);
 }
 
 
@@ -571,12 +578,13 @@ raptor_rdfxml_start_element_handler(void *user_data,
   raptor_rdfxml_update_document_locator(rdf_parser);
 
   /* Create new element structure */
-  element = RAPTOR_CALLOC(raptor_rdfxml_element*, 1, sizeof(*element));
+  element = (raptor_rdfxml_element*)raptor_freelist_alloc(rdf_xml_parser->element_freelist);
   if(!element) {
     raptor_parser_fatal_error(rdf_parser, "Out of memory");
     rdf_parser->failed = 1;
     return;
   }
+  memset(element, 0, sizeof(*element));
   element->world = rdf_parser->world;
   element->xml_element = xml_element;
 
@@ -587,23 +595,12 @@ raptor_rdfxml_start_element_handler(void *user_data,
 
   /* RDF-specific processing of attributes */
   if(ns_attributes_count) {
-    raptor_qname** new_named_attrs;
     int offset = 0;
     raptor_rdfxml_element* parent_element;
 
     parent_element = element->parent;
 
-    /* Allocate new array to move namespaced-attributes to if
-     * rdf processing is performed
-     */
-    new_named_attrs = RAPTOR_CALLOC(raptor_qname**, ns_attributes_count, 
-                                    sizeof(raptor_qname*));
-    if(!new_named_attrs) {
-      raptor_parser_fatal_error(rdf_parser, "Out of memory");
-      rdf_parser->failed = 1;
-      return;
-    }
-
+    /* Attributes left after rdf processing are moved down in place */
     for(i = 0; i < ns_attributes_count; i++) {
       raptor_qname* attr = named_attrs[i];
 
@@ -639,7 +636,8 @@ raptor_rdfxml_start_element_handler(void *user_data,
 #endif
               /* make sure value isn't deleted from qname structure */
               attr->value = NULL;
-              raptor_free_qname(attr);
+              raptor_qname_release(rdf_xml_parser->sax2->qname_freelist,
+                                   attr);
               attr = NULL;
               break;
             }
@@ -667,7 +665,8 @@ raptor_rdfxml_start_element_handler(void *user_data,
               /* Delete it if it was stored elsewhere */
               /* make sure value isn't deleted from qname structure */
               attr->value = NULL;
-              raptor_free_qname(attr);
+              raptor_qname_release(rdf_xml_parser->sax2->qname_freelist,
+                                   attr);
               attr = NULL;
               break;
             }
@@ -679,19 +678,11 @@ raptor_rdfxml_start_element_handler(void *user_data,
       } /* end if leave literal XML alone */
 
       if(attr)
-        new_named_attrs[offset++] = attr;
+        named_attrs[offset++] = attr;
     }
 
     /* new attribute count is set from attributes that haven't been skipped */
     ns_attributes_count = offset;
-    if(!ns_attributes_count) {
-      /* all attributes were deleted so delete the new array */
-      RAPTOR_FREE(raptor_qname_array, new_named_attrs);
-      new_named_attrs = NULL;
-    }
-
-    RAPTOR_FREE(raptor_qname_array, named_attrs);
-    named_attrs = new_named_attrs;
     raptor_xml_element_set_attributes(xml_element, 
                                       named_attrs, ns_attributes_count);
   } /* end if ns_attributes_count */
@@ -865,7 +856,7 @@ raptor_rdfxml_end_element_handler(void *user_data,
         element->parent->child_state = element->state;
     }
   
-    raptor_free_rdfxml_element(element);
+    raptor_free_rdfxml_element(rdf_xml_parser, element);
   }
 }
 
@@ -943,6 +934,10 @@ raptor_rdfxml_parse_init(raptor_parser* rdf_parser, const char *name)
   if(!sax2)
     return 1;
 
+  rdf_xml_parser->element_freelist = raptor_new_freelist(sizeof(raptor_rdfxml_element), NULL);
+  if(!rdf_xml_parser->element_freelist)
+    return 1;
+
   /* Initialize sax2 element handlers */
   raptor_sax2_set_start_element_handler(sax2, raptor_rdfxml_start_element_handler);
   raptor_sax2_set_end_element_handler(sax2, raptor_rdfxml_end_element_handler);
@@ -1017,7 +1012,9 @@ raptor_rdfxml_parse_start(raptor_parser* rdf_parser)
   
   /* Create a new id_set if needed */
   if(RAPTOR_OPTIONS_GET_NUMERIC(rdf_parser, RAPTOR_OPTION_CHECK_RDF_ID)) {
-    rdf_xml_parser->id_set = raptor_new_id_set(rdf_parser->world);
+    int exact = RAPTOR_OPTIONS_GET_NUMERIC(rdf_parser,
+                                           RAPTOR_OPTION_CHECK_RDF_ID_EXACT);
+    rdf_xml_parser->id_set = raptor_new_id_set(rdf_parser->world, exact);
     if(!rdf_xml_parser->id_set)
       return 1;
   }
@@ -1041,7 +1038,12 @@ raptor_rdfxml_parse_terminate(raptor_parser *rdf_parser)
   }
   
   while( (element = raptor_rdfxml_element_pop(rdf_xml_parser)) )
-    raptor_free_rdfxml_element(element);
+    raptor_free_rdfxml_element(rdf_xml_parser, element);
+
+  if(rdf_xml_parser->element_freelist) {
+    raptor_free_freelist(rdf_xml_parser->element_freelist);
+    rdf_xml_parser->element_freelist = NULL;
+  }
 
 
   for(i = 0; i < RAPTOR_RDFXML_N_CONCEPTS; i++) {
@@ -1523,11 +1525,9 @@ raptor_rdfxml_process_property_attributes(raptor_parser *rdf_parser,
                                                  (unsigned char*)value,
                                                  NULL, NULL);
     } else {
-      raptor_uri *base_uri;
       raptor_uri *object_uri;
-      base_uri = raptor_rdfxml_inscope_base_uri(rdf_parser);
-      object_uri = raptor_new_uri_relative_to_base(rdf_parser->world, 
-                                                   base_uri, value);
+      object_uri = raptor_rdfxml_new_uri_relative_to_inscope_base(rdf_parser,
+                                                                  value);
       object_term = raptor_new_term_from_uri(rdf_parser->world, object_uri);
       raptor_free_uri(object_uri);
     }
@@ -1777,9 +1777,8 @@ raptor_rdfxml_start_element_grammar(raptor_parser *rdf_parser,
         } else if(element->rdf_attr[RDF_NS_about]) {
           raptor_uri* subject_uri;
 
-          subject_uri = raptor_new_uri_relative_to_base(rdf_parser->world,
-                                                        base_uri,
-                                                        (const unsigned char*)element->rdf_attr[RDF_NS_about]);
+          subject_uri = raptor_rdfxml_new_uri_relative_to_inscope_base(rdf_parser,
+                                                                       (const unsigned char*)element->rdf_attr[RDF_NS_about]);
           if(!subject_uri)
             goto oom;
           
@@ -2140,9 +2139,8 @@ raptor_rdfxml_start_element_grammar(raptor_parser *rdf_parser,
         if(element->rdf_attr[RDF_NS_datatype]) {
           raptor_uri *datatype_uri;
           
-          datatype_uri = raptor_new_uri_relative_to_base(rdf_parser->world, 
-                                                         base_uri,
-                                                         (const unsigned char*)element->rdf_attr[RDF_NS_datatype]);
+          datatype_uri = raptor_rdfxml_new_uri_relative_to_inscope_base(rdf_parser,
+                                                                        (const unsigned char*)element->rdf_attr[RDF_NS_datatype]);
           element->object_literal_datatype = datatype_uri;
           RAPTOR_FREE(char*, element->rdf_attr[RDF_NS_datatype]);
           element->rdf_attr[RDF_NS_datatype] = NULL; 
@@ -2610,9 +2608,8 @@ raptor_rdfxml_end_element_grammar(raptor_parser *rdf_parser,
             if(!element->object) {
               if(element->rdf_attr[RDF_NS_resource]) {
                 raptor_uri* resource_uri;
-                resource_uri = raptor_new_uri_relative_to_base(rdf_parser->world,
-                                                               raptor_rdfxml_inscope_base_uri(rdf_parser),
-                                                               (const unsigned char*)element->rdf_attr[RDF_NS_resource]);
+                resource_uri = raptor_rdfxml_new_uri_relative_to_inscope_base(rdf_parser,
+                                                                              (const unsigned char*)element->rdf_attr[RDF_NS_resource]);
                 if(!resource_uri)
                   goto oom;
                 
@@ -3104,6 +3101,32 @@ raptor_rdfxml_inscope_base_uri(raptor_parser *rdf_parser)
 }
 
 
+/*
+ * raptor_rdfxml_new_uri_relative_to_inscope_base:
+ * @rdf_parser: Raptor parser object
+ * @uri_string: relative URI string
+ *
+ * Resolve a URI against the in-scope base URI.
+ *
+ * Return value: new URI or NULL on failure
+ */
+static raptor_uri*
+raptor_rdfxml_new_uri_relative_to_inscope_base(raptor_parser *rdf_parser,
+                                               const unsigned char *uri_string)
+{
+  raptor_rdfxml_parser* rdf_xml_parser;
+
+  rdf_xml_parser = (raptor_rdfxml_parser*)rdf_parser->context;
+
+  if(raptor_sax2_inscope_base_uri(rdf_xml_parser->sax2))
+    return raptor_sax2_new_uri_relative_to_inscope_base(rdf_xml_parser->sax2,
+                                                        uri_string);
+
+  return raptor_new_uri_relative_to_base(rdf_parser->world,
+                                         rdf_parser->base_uri, uri_string);
+}
+
+
 /**
  * raptor_rdfxml_record_ID:
  * @rdf_parser: Raptor parser object
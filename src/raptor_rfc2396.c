@@ -35,6 +35,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_URI
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -436,11 +438,41 @@ size_t
 raptor_uri_resolve_uri_reference(const unsigned char *base_uri,
                                  const unsigned char *reference_uri,
                                  unsigned char *buffer, size_t length)
+{
+  return raptor_uri_resolve_uri_reference_detail(base_uri, NULL,
+                                                 reference_uri,
+                                                 buffer, length);
+}
+
+
+/*
+ * raptor_uri_resolve_uri_reference_detail:
+ * @base_uri: Base URI string
+ * @base_detail: @base_uri already split by raptor_new_uri_detail() or NULL
+ * @reference_uri: Reference URI string
+ * @buffer: Destination URI output buffer
+ * @length: Length of destination output buffer
+ *
+ * INTERNAL - raptor_uri_resolve_uri_reference() with the base URI
+ * components kept by the caller so that a base used for many
+ * references is split once.  @base_detail is not changed.
+ *
+ * Return value: length of resolved string or 0 on failure (such as @buffer too small)
+ */
+size_t
+raptor_uri_resolve_uri_reference_detail(const unsigned char *base_uri,
+                                        raptor_uri_detail *base_detail,
+                                        const unsigned char *reference_uri,
+                                        unsigned char *buffer, size_t length)
 {
   raptor_uri_detail *ref = NULL;
   raptor_uri_detail *base = NULL;
+  raptor_uri_detail *new_base = NULL;
   raptor_uri_detail result; /* static - pointers go to inside ref or base */
   unsigned char *path_buffer = NULL;
+  const unsigned char *base_path;
+  size_t base_path_len;
+  const unsigned char *bp;
   unsigned char *p;
   size_t result_len = 0;
   size_t l;
@@ -520,9 +552,12 @@ raptor_uri_resolve_uri_reference(const unsigned char *base_uri,
   
 
   /* now the reference URI must be schemeless, i.e. relative */
-  base = raptor_new_uri_detail(base_uri);
-  if(!base)
-    goto resolve_tidy;
+  base = base_detail;
+  if(!base) {
+    base = new_base = raptor_new_uri_detail(base_uri);
+    if(!base)
+      goto resolve_tidy;
+  }
 
   /* result URI must be of the base URI scheme */
   result.scheme = base->scheme;
@@ -566,17 +601,15 @@ raptor_uri_resolve_uri_reference(const unsigned char *base_uri,
   /* need to resolve relative path */
 
   /* Build the result path in path_buffer */
-  result.path_len = 0;
-
-  if(base->path)
-    result.path_len += base->path_len;
-  else {
-    /* Add a missing path - makes the base URI 1 character longer */
-    base->path = (unsigned char*)"/"; /* static, but copied and not free()d  */
-    base->path_len = 1;
-    base->uri_len++;
-    result.path_len++;
+  if(base->path) {
+    base_path = base->path;
+    base_path_len = base->path_len;
+  } else {
+    /* Use "/" for a missing base path */
+    base_path = (const unsigned char*)"/";
+    base_path_len = 1;
   }
+  result.path_len = base_path_len;
 
   if(ref->path)
     result.path_len += ref->path_len;
@@ -592,18 +625,18 @@ raptor_uri_resolve_uri_reference(const unsigned char *base_uri,
 
   if(!ref->path) {
     /* If there is no reference path, copy the full base over */
-    result.path_len = base->path_len;
-    memcpy(path_buffer, base->path, result.path_len);
+    result.path_len = base_path_len;
+    memcpy(path_buffer, base_path, result.path_len);
   } else {
     /** Otherwise copy base path up to previous / and append ref path */
-    for(p = base->path + base->path_len - 1; p > base->path && *p != '/'; p--)
+    for(bp = base_path + base_path_len - 1; bp > base_path && *bp != '/'; bp--)
       ;
 
-    if(p >= base->path) {
-      result.path_len = p-base->path + 1;
+    if(bp >= base_path) {
+      result.path_len = bp - base_path + 1;
 
       /* Found a /, copy everything before that to path_buffer */
-      memcpy(path_buffer, base->path, result.path_len);
+      memcpy(path_buffer, base_path, result.path_len);
       path_buffer[result.path_len] = '\0';
     }
 
@@ -683,8 +716,8 @@ raptor_uri_resolve_uri_reference(const unsigned char *base_uri,
   resolve_tidy:
   if(path_buffer)
     RAPTOR_FREE(char*, path_buffer);
-  if(base)
-    raptor_free_uri_detail(base);
+  if(new_base)
+    raptor_free_uri_detail(new_base);
   if(ref)
     raptor_free_uri_detail(ref);
 
@@ -35,6 +35,8 @@
 #endif
 
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_PARSER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -241,6 +243,16 @@ raptor_rss_parse_start(raptor_parser *rdf_parser)
   for(n = 0; n < RAPTOR_RSS_NAMESPACES_SIZE; n++)
     rss_parser->nspaces_seen[n] = 'N';
 
+  /* Forget the items of any previous document parsed */
+  raptor_rss_model_clear(&rss_parser->model);
+  raptor_rss_model_init(rdf_parser->world, &rss_parser->model);
+
+  rss_parser->prev_type = RAPTOR_RSS_NONE;
+  rss_parser->current_field = RAPTOR_RSS_FIELD_NONE;
+  rss_parser->current_type = RAPTOR_RSS_NONE;
+  rss_parser->current_block = NULL;
+  rss_parser->is_atom = 0;
+
   /* Optionally forbid internal network and file requests in the XML parser */
   raptor_sax2_set_option(rss_parser->sax2, 
                          RAPTOR_OPTION_NO_NET, NULL,
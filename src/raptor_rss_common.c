@@ -295,8 +295,8 @@ const unsigned char * const raptor_atom_namespace_uri = (const unsigned char *)"
 
 
 
-int
-raptor_rss_common_init(raptor_world* world) {
+static int
+raptor_rss_common_init_internal(raptor_world* world) {
   int i;
   raptor_uri *namespace_uri;
 
@@ -351,8 +351,25 @@ raptor_rss_common_init(raptor_world* world) {
 }
 
 
-void
-raptor_rss_common_terminate(raptor_world* world) {
+int
+raptor_rss_common_init(raptor_world* world) {
+  int rc;
+
+  /* parsers and serializers of a thread safe world share this */
+  if(world->mutex)
+    raptor_mutex_lock(world->mutex);
+
+  rc = raptor_rss_common_init_internal(world);
+
+  if(world->mutex)
+    raptor_mutex_unlock(world->mutex);
+
+  return rc;
+}
+
+
+static void
+raptor_rss_common_terminate_internal(raptor_world* world) {
   int i;
   if(--world->rss_common_initialised)
     return;
@@ -386,6 +403,18 @@ raptor_rss_common_terminate(raptor_world* world) {
 }
 
 
+void
+raptor_rss_common_terminate(raptor_world* world) {
+  if(world->mutex)
+    raptor_mutex_lock(world->mutex);
+
+  raptor_rss_common_terminate_internal(world);
+
+  if(world->mutex)
+    raptor_mutex_unlock(world->mutex);
+}
+
+
 void
 raptor_rss_model_init(raptor_world* world, raptor_rss_model* rss_model)
 {
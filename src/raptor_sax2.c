@@ -38,6 +38,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SAX2
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -46,6 +48,9 @@
 /* Define this for far too much output */
 #undef RAPTOR_DEBUG_CDATA
 
+/* attribute arrays up to this length are taken from a free list */
+#define RAPTOR_SAX2_POOL_ATTRIBUTES 8
+
 
 int
 raptor_sax2_init(raptor_world* world)
@@ -60,6 +65,17 @@ raptor_sax2_finish(raptor_world* world)
 }
 
 
+/* free the empty stringbuffer kept with a released element */
+static void
+raptor_sax2_clear_xml_element(void* object)
+{
+  raptor_xml_element* xml_element = (raptor_xml_element*)object;
+
+  if(xml_element->content_cdata_sb)
+    raptor_free_stringbuffer(xml_element->content_cdata_sb);
+}
+
+
 /**
  * raptor_new_sax2:
  * @world: raptor world
@@ -98,11 +114,117 @@ raptor_new_sax2(raptor_world *world, raptor_locator *locator,
   sax2->enabled = 1;
 
   raptor_object_options_init(&sax2->options, RAPTOR_OPTION_AREA_SAX2);
+
+  sax2->element_freelist = raptor_new_freelist(sizeof(raptor_xml_element),
+                                               raptor_sax2_clear_xml_element);
+  sax2->qname_freelist = raptor_new_freelist(sizeof(raptor_qname), NULL);
+  sax2->attributes_freelist = raptor_new_freelist(RAPTOR_SAX2_POOL_ATTRIBUTES *
+                                                  sizeof(raptor_qname*), NULL);
+  if(!sax2->element_freelist || !sax2->qname_freelist ||
+     !sax2->attributes_freelist) {
+    raptor_free_sax2(sax2);
+    return NULL;
+  }
   
   return sax2;
 }
 
 
+/*
+ * raptor_sax2_new_xml_element:
+ * @sax2: SAX2 object
+ * @name: element name; owned by the new element
+ * @xml_language: xml:lang value or NULL; owned by the new element
+ * @xml_base: xml:base URI or NULL; owned by the new element
+ *
+ * INTERNAL - raptor_new_xml_element() taking the structure and its
+ * empty content stringbuffer from the SAX2 free list.
+ *
+ * Return value: new element or NULL on failure
+ */
+static raptor_xml_element*
+raptor_sax2_new_xml_element(raptor_sax2* sax2, raptor_qname* name,
+                            const unsigned char* xml_language,
+                            raptor_uri* xml_base)
+{
+  raptor_xml_element* xml_element;
+  raptor_stringbuffer* sb;
+
+  xml_element = (raptor_xml_element*)raptor_freelist_alloc(sax2->element_freelist);
+  if(!xml_element)
+    return NULL;
+
+  sb = xml_element->content_cdata_sb;
+  memset(xml_element, 0, sizeof(*xml_element));
+
+  if(!sb) {
+    sb = raptor_new_stringbuffer();
+    if(!sb) {
+      raptor_freelist_release(sax2->element_freelist, xml_element);
+      return NULL;
+    }
+  }
+
+  xml_element->name = name;
+  xml_element->xml_language = xml_language;
+  xml_element->base_uri = xml_base;
+  xml_element->content_cdata_sb = sb;
+
+  return xml_element;
+}
+
+
+/*
+ * raptor_sax2_release_xml_element:
+ * @sax2: SAX2 object
+ * @element: element or NULL
+ *
+ * INTERNAL - raptor_free_xml_element() giving the structure, its
+ * qnames and a short attributes array back to the SAX2 free lists.
+ */
+static void
+raptor_sax2_release_xml_element(raptor_sax2* sax2, raptor_xml_element *element)
+{
+  unsigned int i;
+
+  if(!element)
+    return;
+
+  for(i = 0; i < element->attribute_count; i++)
+    raptor_qname_release(sax2->qname_freelist, element->attributes[i]);
+
+  if(element->attributes) {
+    if(element->attributes_size == RAPTOR_SAX2_POOL_ATTRIBUTES)
+      raptor_freelist_release(sax2->attributes_freelist, element->attributes);
+    else
+      RAPTOR_FREE(raptor_qname_array, element->attributes);
+  }
+
+  /* an empty stringbuffer holds no memory and is kept for reuse */
+  if(element->content_cdata_sb &&
+     raptor_stringbuffer_length(element->content_cdata_sb)) {
+    raptor_free_stringbuffer(element->content_cdata_sb);
+    element->content_cdata_sb = NULL;
+  }
+
+  if(element->base_uri)
+    raptor_free_uri(element->base_uri);
+
+  if(element->base_uri_detail)
+    raptor_free_uri_detail(element->base_uri_detail);
+
+  if(element->xml_language)
+    RAPTOR_FREE(char*, element->xml_language);
+
+  raptor_qname_release(sax2->qname_freelist, element->name);
+
+  if(element->declared_nspaces)
+    raptor_free_sequence(element->declared_nspaces);
+
+  raptor_freelist_release(sax2->element_freelist, element);
+}
+
+
 /**
  * raptor_free_sax2:
  * @sax2: SAX2 object
@@ -125,12 +247,24 @@ raptor_free_sax2(raptor_sax2 *sax2)
 #endif
 
   while( (xml_element = raptor_xml_element_pop(sax2)) )
-    raptor_free_xml_element(xml_element);
+    raptor_sax2_release_xml_element(sax2, xml_element);
 
   raptor_namespaces_clear(&sax2->namespaces);
 
   if(sax2->base_uri)
     raptor_free_uri(sax2->base_uri);
+  if(sax2->base_uri_detail)
+    raptor_free_uri_detail(sax2->base_uri_detail);
+
+  if(sax2->element_freelist)
+    raptor_free_freelist(sax2->element_freelist);
+  if(sax2->qname_freelist)
+    raptor_free_freelist(sax2->qname_freelist);
+  if(sax2->attributes_freelist)
+    raptor_free_freelist(sax2->attributes_freelist);
+
+  if(sax2->atts_copy)
+    RAPTOR_FREE(cstringpointer, sax2->atts_copy);
 
   raptor_object_options_clear(&sax2->options);
   
@@ -286,7 +420,31 @@ raptor_xml_element_pop(raptor_sax2 *sax2)
 void
 raptor_xml_element_push(raptor_sax2 *sax2, raptor_xml_element* element) 
 {
-  element->parent = sax2->current_element;
+  raptor_xml_element* parent = sax2->current_element;
+
+  element->parent = parent;
+
+  /* inherit the in-scope values unless this element declares them */
+  if(element->xml_language)
+    element->inscope_xml_language = element->xml_language;
+  else if(parent)
+    element->inscope_xml_language = parent->inscope_xml_language;
+  else
+    element->inscope_xml_language = NULL;
+
+  if(element->base_uri) {
+    if(!element->base_uri_detail)
+      element->base_uri_detail = raptor_new_uri_detail(raptor_uri_as_string(element->base_uri));
+    element->inscope_base_uri = element->base_uri;
+    element->inscope_base_uri_detail = element->base_uri_detail;
+  } else if(parent) {
+    element->inscope_base_uri = parent->inscope_base_uri;
+    element->inscope_base_uri_detail = parent->inscope_base_uri_detail;
+  } else {
+    element->inscope_base_uri = sax2->base_uri;
+    element->inscope_base_uri_detail = sax2->base_uri_detail;
+  }
+
   sax2->current_element = element;
   if(!sax2->root_element)
     sax2->root_element = element;
@@ -324,14 +482,8 @@ raptor_xml_element_is_empty(raptor_xml_element* xml_element)
 const unsigned char*
 raptor_sax2_inscope_xml_language(raptor_sax2 *sax2)
 {
-  raptor_xml_element* xml_element;
-  
-  for(xml_element = sax2->current_element;
-      xml_element; 
-      xml_element = xml_element->parent) {
-    if(xml_element->xml_language)
-      return xml_element->xml_language;
-  }
+  if(sax2->current_element)
+    return sax2->current_element->inscope_xml_language;
 
   return NULL;
 }
@@ -348,18 +500,43 @@ raptor_sax2_inscope_xml_language(raptor_sax2 *sax2)
 raptor_uri*
 raptor_sax2_inscope_base_uri(raptor_sax2 *sax2)
 {
-  raptor_xml_element *xml_element;
-  
-  for(xml_element = sax2->current_element; 
-      xml_element; 
-      xml_element = xml_element->parent)
-    if(xml_element->base_uri)
-      return xml_element->base_uri;
+  if(sax2->current_element)
+    return sax2->current_element->inscope_base_uri;
     
   return sax2->base_uri;
 }
 
 
+/*
+ * raptor_sax2_new_uri_relative_to_inscope_base:
+ * @sax2: SAX2 object
+ * @uri_string: relative URI string
+ *
+ * INTERNAL - Constructor - create a URI relative to the in-scope base URI
+ *
+ * Uses the components of the base URI split when the element
+ * declaring it was pushed.
+ *
+ * Return value: new URI or NULL on failure or if no base URI is in scope
+ */
+raptor_uri*
+raptor_sax2_new_uri_relative_to_inscope_base(raptor_sax2 *sax2,
+                                             const unsigned char *uri_string)
+{
+  raptor_uri* base_uri = sax2->base_uri;
+  raptor_uri_detail* base_uri_detail = sax2->base_uri_detail;
+
+  if(sax2->current_element) {
+    base_uri = sax2->current_element->inscope_base_uri;
+    base_uri_detail = sax2->current_element->inscope_base_uri_detail;
+  }
+
+  return raptor_new_uri_relative_to_base_detail(sax2->world, base_uri,
+                                                base_uri_detail,
+                                                uri_string, 0);
+}
+
+
 /**
  * raptor_sax2_set_uri_filter:
  * @sax2: SAX2 object
@@ -441,9 +618,14 @@ raptor_sax2_parse_start(raptor_sax2* sax2, raptor_uri *base_uri)
 
   if(sax2->base_uri)
     raptor_free_uri(sax2->base_uri);
-  if(base_uri)
+  if(sax2->base_uri_detail) {
+    raptor_free_uri_detail(sax2->base_uri_detail);
+    sax2->base_uri_detail = NULL;
+  }
+  if(base_uri) {
     sax2->base_uri = raptor_uri_copy(base_uri);
-  else
+    sax2->base_uri_detail = raptor_new_uri_detail(raptor_uri_as_string(base_uri));
+  } else
     sax2->base_uri = NULL;
 
 #ifdef RAPTOR_XML_LIBXML
@@ -453,10 +635,9 @@ raptor_sax2_parse_start(raptor_sax2* sax2, raptor_uri *base_uri)
   sax2->first_read = 1;
 #endif
 
-  if(sax2->xc) {
-    raptor_libxml_free(sax2->xc);
-    sax2->xc = NULL;
-  }
+  /* Keep any parser context and its name dictionary for this document */
+  if(sax2->xc)
+    sax2->xc_reset = 1;
 #endif
 
   raptor_namespaces_clear(&sax2->namespaces);
@@ -491,7 +672,7 @@ raptor_sax2_parse_chunk(raptor_sax2* sax2, const unsigned char *buffer,
   xmlParserCtxtPtr xc = sax2->xc;
   int rc;
   
-  if(!xc) {
+  if(!xc || sax2->xc_reset) {
     int libxml_options = 0;
 
     if(!len) {
@@ -502,11 +683,22 @@ raptor_sax2_parse_chunk(raptor_sax2* sax2, const unsigned char *buffer,
       return 1;
     }
 
-    xc = xmlCreatePushParserCtxt(&sax2->sax, sax2, /* user data */
-                                 (char*)buffer, RAPTOR_BAD_CAST(int, len),
-                                 NULL);
-    if(!xc)
-      goto handle_error;
+    if(xc) {
+      sax2->xc_reset = 0;
+      if(raptor_libxml_reset(xc, (char*)buffer, RAPTOR_BAD_CAST(int, len),
+                             NULL)) {
+        raptor_libxml_free(xc);
+        xc = sax2->xc = NULL;
+      }
+    }
+
+    if(!xc) {
+      xc = xmlCreatePushParserCtxt(&sax2->sax, sax2, /* user data */
+                                   (char*)buffer, RAPTOR_BAD_CAST(int, len),
+                                   NULL);
+      if(!xc)
+        goto handle_error;
+    }
 
 #ifdef RAPTOR_LIBXML_XML_PARSE_NONET
     if(RAPTOR_OPTIONS_GET_NUMERIC(sax2, RAPTOR_OPTION_NO_NET))
@@ -629,7 +821,7 @@ raptor_sax2_start_element(void* user_data, const unsigned char *name,
 {
   raptor_sax2* sax2 = (raptor_sax2*)user_data;
   raptor_qname* el_name;
-  unsigned char **xml_atts_copy = NULL;
+  const unsigned char **xml_atts_copy = NULL;
   size_t xml_atts_size = 0;
   int all_atts_count = 0;
   int ns_attributes_count = 0;
@@ -688,9 +880,17 @@ raptor_sax2_start_element(void* user_data, const unsigned char *name,
     for(i = 0; atts[i]; i++) ;
     xml_atts_size = sizeof(unsigned char*) * i;
     if(xml_atts_size) {
-      xml_atts_copy = RAPTOR_MALLOC(unsigned char**, xml_atts_size);
-      if(!xml_atts_copy)
-        goto fail;
+      if(xml_atts_size > sax2->atts_copy_size) {
+        const unsigned char** new_atts_copy;
+
+        new_atts_copy = RAPTOR_REALLOC(const unsigned char**, sax2->atts_copy,
+                                       xml_atts_size);
+        if(!new_atts_copy)
+          goto fail;
+        sax2->atts_copy = new_atts_copy;
+        sax2->atts_copy_size = xml_atts_size;
+      }
+      xml_atts_copy = sax2->atts_copy;
       memcpy(xml_atts_copy, atts, xml_atts_size);
     }
 
@@ -751,10 +951,8 @@ raptor_sax2_start_element(void* user_data, const unsigned char *name,
         } else
           memcpy(xml_language, atts[i+1], lang_len + 1); /* Copy NUL */
       } else if(!strcmp((char*)atts[i], "xml:base")) {
-        raptor_uri* base_uri;
         raptor_uri* xuri;
-        base_uri = raptor_sax2_inscope_base_uri(sax2);
-        xuri = raptor_new_uri_relative_to_base(sax2->world, base_uri, atts[i+1]);
+        xuri = raptor_sax2_new_uri_relative_to_inscope_base(sax2, atts[i+1]);
         xml_base = raptor_new_uri_for_xmlbase(xuri);
         raptor_free_uri(xuri);
       }
@@ -766,13 +964,15 @@ raptor_sax2_start_element(void* user_data, const unsigned char *name,
 
 
   /* Create new element structure */
-  el_name = raptor_new_qname(&sax2->namespaces, name, NULL);
+  el_name = raptor_new_qname_from_freelist(sax2->qname_freelist,
+                                           &sax2->namespaces, name, NULL);
   if(!el_name)
     goto fail;
 
-  xml_element = raptor_new_xml_element(el_name, xml_language, xml_base);
+  xml_element = raptor_sax2_new_xml_element(sax2, el_name, xml_language,
+                                            xml_base);
   if(!xml_element) {
-    raptor_free_qname(el_name);
+    raptor_qname_release(sax2->qname_freelist, el_name);
     goto fail;
   }
   /* xml_language,xml_base now owned by xml_element */
@@ -782,17 +982,27 @@ raptor_sax2_start_element(void* user_data, const unsigned char *name,
   /* Turn string attributes into namespaced-attributes */
   if(ns_attributes_count) {
     int i;
-    int offset = 0;
+    unsigned int named_attrs_size;
 
     /* Allocate new array to hold namespaced-attributes */
-    named_attrs = RAPTOR_CALLOC(raptor_qname**, ns_attributes_count, 
-                                sizeof(raptor_qname*));
+    if(ns_attributes_count <= RAPTOR_SAX2_POOL_ATTRIBUTES) {
+      named_attrs = (raptor_qname**)raptor_freelist_alloc(sax2->attributes_freelist);
+      named_attrs_size = RAPTOR_SAX2_POOL_ATTRIBUTES;
+    } else {
+      named_attrs = RAPTOR_CALLOC(raptor_qname**, ns_attributes_count, 
+                                  sizeof(raptor_qname*));
+      named_attrs_size = RAPTOR_BAD_CAST(unsigned int, ns_attributes_count);
+    }
     if(!named_attrs) {
       raptor_log_error(sax2->world, RAPTOR_LOG_LEVEL_FATAL,
                        sax2->locator, "Out of memory");
       goto fail;
     }
 
+    /* attributes are owned by xml_element as they are added */
+    xml_element->attributes = named_attrs;
+    xml_element->attributes_size = named_attrs_size;
+
     for(i = 0; i < all_atts_count; i++) {
       raptor_qname* attr;
 
@@ -801,47 +1011,36 @@ raptor_sax2_start_element(void* user_data, const unsigned char *name,
         continue;
 
       /* namespace-name[i] stored in named_attrs[i] */
-      attr = raptor_new_qname(&sax2->namespaces, atts[i<<1], atts[(i<<1)+1]);
-      if(!attr) { /* failed - tidy up and return */
-        int j;
-
-        for(j = 0; j < i; j++)
-          RAPTOR_FREE(raptor_qname, named_attrs[j]);
-        RAPTOR_FREE(raptor_qname_array, named_attrs);
+      attr = raptor_new_qname_from_freelist(sax2->qname_freelist,
+                                            &sax2->namespaces,
+                                            atts[i<<1], atts[(i<<1)+1]);
+      if(!attr) /* failed - xml_element tidies up */
         goto fail;
-      }
 
-      named_attrs[offset++] = attr;
+      named_attrs[xml_element->attribute_count++] = attr;
     }
   } /* end if ns_attributes_count */
 
 
-  if(named_attrs)
-    raptor_xml_element_set_attributes(xml_element,
-                                      named_attrs, ns_attributes_count);
-
   raptor_xml_element_push(sax2, xml_element);
 
   if(sax2->start_element_handler)
     sax2->start_element_handler(sax2->user_data, xml_element);
 
   if(xml_atts_copy) {
-    /* Restore passed in XML attributes, free the copy */
+    /* Restore passed in XML attributes */
     memcpy((void*)atts, xml_atts_copy, xml_atts_size);
-    RAPTOR_FREE(cstringpointer, xml_atts_copy);
   }
 
   return;
 
   fail:
-  if(xml_atts_copy)
-    RAPTOR_FREE(cstringpointer, xml_atts_copy);
   if(xml_base)
     raptor_free_uri(xml_base);
   if(xml_language)
     RAPTOR_FREE(char*, xml_language);
   if(xml_element)
-    raptor_free_xml_element(xml_element);
+    raptor_sax2_release_xml_element(sax2, xml_element);
 }
 
 
@@ -871,7 +1070,7 @@ raptor_sax2_end_element(void* user_data, const unsigned char *name)
                                   raptor_sax2_get_depth(sax2));
   xml_element = raptor_xml_element_pop(sax2);
   if(xml_element)
-    raptor_free_xml_element(xml_element);
+    raptor_sax2_release_xml_element(sax2, xml_element);
 
   raptor_sax2_dec_depth(sax2);
 }
@@ -37,6 +37,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SERIALIZER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -608,6 +610,8 @@ raptor_serializer_serialize_end(raptor_serializer *rdf_serializer)
   if(rdf_serializer->iostream) {
     if(rdf_serializer->free_iostream_on_end)
       raptor_free_iostream(rdf_serializer->iostream);
+    else if(raptor_iostream_flush(rdf_serializer->iostream))
+      rc = 1;
     rdf_serializer->iostream = NULL;
   }
   return rc;
@@ -787,5 +791,8 @@ raptor_serializer_flush(raptor_serializer *rdf_serializer)
   else
     rc = 0;
 
+  if(rdf_serializer->iostream && raptor_iostream_flush(rdf_serializer->iostream))
+    rc = 1;
+
   return rc;
 }
@@ -32,6 +32,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SERIALIZER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -49,10 +51,10 @@ typedef struct {
   /* JSON writer object */
   raptor_json_writer* json_writer;
 
-  /* Ordered sequence of triples if is_resource */
-  raptor_avltree* avltree;
+  /* Sorter of triples if is_resource */
+  raptor_statement_sorter* sorter;
 
-  /* Last statement generated if is_resource (shared pointer) */
+  /* Last statement generated if is_resource */
   raptor_statement* last_statement;
 
   int need_object_comma;
@@ -101,9 +103,14 @@ raptor_json_serialize_terminate(raptor_serializer* serializer)
     context->json_writer = NULL;
   }
 
-  if(context->avltree) {
-    raptor_free_avltree(context->avltree);
-    context->avltree = NULL;
+  if(context->sorter) {
+    raptor_free_statement_sorter(context->sorter);
+    context->sorter = NULL;
+  }
+
+  if(context->last_statement) {
+    raptor_free_statement(context->last_statement);
+    context->last_statement = NULL;
   }
 }
 
@@ -125,10 +132,18 @@ raptor_json_serialize_start(raptor_serializer* serializer)
     return 1;
 
   if(context->is_resource) {
-    context->avltree = raptor_new_avltree((raptor_data_compare_handler)raptor_statement_compare,
-                                          (raptor_data_free_handler)raptor_free_statement,
-                                          0);
-    if(!context->avltree) {
+    int memory_limit;
+
+    memory_limit = RAPTOR_OPTIONS_GET_NUMERIC(serializer,
+                                              RAPTOR_OPTION_SORT_MEMORY_LIMIT);
+    if(memory_limit < 0)
+      memory_limit = 0;
+
+    if(context->sorter)
+      raptor_free_statement_sorter(context->sorter);
+    context->sorter = raptor_new_statement_sorter(serializer->world,
+                                                  (size_t)memory_limit);
+    if(!context->sorter) {
       raptor_free_json_writer(context->json_writer);
       context->json_writer = NULL;
       return 1;
@@ -164,12 +179,8 @@ raptor_json_serialize_statement(raptor_serializer* serializer,
 {
   raptor_json_context* context = (raptor_json_context*)serializer->context;
 
-  if(context->is_resource) {
-    raptor_statement* s = raptor_statement_copy(statement);
-    if(!s)
-      return 1;
-    return raptor_avltree_add(context->avltree, s);
-  }
+  if(context->is_resource)
+    return raptor_statement_sorter_add(context->sorter, statement);
 
   if(context->need_subject_comma) {
     raptor_iostream_write_byte(',', serializer->iostream);
@@ -208,14 +219,12 @@ raptor_json_serialize_statement(raptor_serializer* serializer,
 }
 
 
-/* return 0 to abort visit */
-static int
-raptor_json_serialize_avltree_visit(int depth, void* data, void *user_data)
+static void
+raptor_json_serialize_resource_statement(raptor_serializer* serializer,
+                                         raptor_statement* statement)
 {
-  raptor_serializer* serializer = (raptor_serializer*)user_data;
   raptor_json_context* context = (raptor_json_context*)serializer->context;
 
-  raptor_statement* statement = (raptor_statement*)data;
   raptor_statement* s1 = statement;
   raptor_statement* s2 = context->last_statement;
   int new_subject = 0;
@@ -326,9 +335,9 @@ raptor_json_serialize_avltree_visit(int depth, void* data, void *user_data)
   /* end triple */
 
   context->need_object_comma = 1;
-  context->last_statement = statement;
-
-  return 1;
+  if(context->last_statement)
+    raptor_free_statement(context->last_statement);
+  context->last_statement = raptor_statement_copy(statement);
 }
 
 
@@ -337,17 +346,23 @@ raptor_json_serialize_end(raptor_serializer* serializer)
 {
   raptor_json_context* context = (raptor_json_context*)serializer->context;
   char* value;
+  int rc = 0;
   
   raptor_json_writer_newline(context->json_writer);
 
   if(context->is_resource) {
+    raptor_statement* statement;
+
     /* start outer object */
     raptor_json_writer_start_block(context->json_writer, '{');
     raptor_json_writer_newline(context->json_writer);
     
-    raptor_avltree_visit(context->avltree,
-                         raptor_json_serialize_avltree_visit,
-                         serializer);
+    while((statement = raptor_statement_sorter_next(context->sorter)))
+      raptor_json_serialize_resource_statement(serializer, statement);
+
+    rc = raptor_statement_sorter_failed(context->sorter);
+    raptor_free_statement_sorter(context->sorter);
+    context->sorter = NULL;
 
     /* end last triples block */
     if(context->last_statement) {
@@ -357,6 +372,9 @@ raptor_json_serialize_end(raptor_serializer* serializer)
       
       raptor_json_writer_end_block(context->json_writer, '}');
       raptor_json_writer_newline(context->json_writer);
+
+      raptor_free_statement(context->last_statement);
+      context->last_statement = NULL;
     }
   } else {
     /* end triples array */
@@ -383,7 +401,7 @@ raptor_json_serialize_end(raptor_serializer* serializer)
     raptor_iostream_counted_string_write((const unsigned char*)");", 2,
                                          serializer->iostream);
 
-  return 0;
+  return rc;
 }
 
 
@@ -36,16 +36,47 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SERIALIZER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
 
 
+/* Number of URIs whose written form is cached; a power of 2 */
+#define RAPTOR_NTRIPLES_URI_CACHE_SIZE 4096
+
+/* Cached N-Triples form of a URI term */
+typedef struct {
+  /* URI, held with a reference so its pointer cannot be reused */
+  raptor_uri* uri;
+  /* "<...>" as written by raptor_term_escaped_write() */
+  unsigned char* string;
+  size_t string_len;
+  /* index of the next entry in the same bucket or -1 */
+  int next;
+  /* set when used; cleared as the clock hand passes */
+  int referenced;
+} raptor_ntriples_uri_cache_entry;
+
+
 /*
  * Raptor N-Triples serializer object
  */
 typedef struct {
   int is_nquads;
+
+  /* URI cache: entries, hash buckets of entry indexes and the
+   * URIs seen once, which are cached if seen again.  Allocated on
+   * first use.
+   */
+  raptor_ntriples_uri_cache_entry* cache;
+  int* cache_buckets;
+  raptor_uri** cache_seen;
+  /* number of entries used */
+  int cache_count;
+  /* next entry to consider for eviction */
+  int cache_hand;
 } raptor_ntriples_serializer_context;
 
 
@@ -63,11 +94,43 @@ raptor_ntriples_serialize_init(raptor_serializer* serializer, const char *name)
 }
   
 
+/* free the URI cache */
+static void
+raptor_ntriples_serialize_terminate_cache(raptor_ntriples_serializer_context* ntriples_serializer)
+{
+  int i;
+
+  if(ntriples_serializer->cache) {
+    for(i = 0; i < ntriples_serializer->cache_count; i++) {
+      raptor_ntriples_uri_cache_entry* entry = &ntriples_serializer->cache[i];
+
+      raptor_free_uri(entry->uri);
+      raptor_free_memory(entry->string);
+    }
+    RAPTOR_FREE(raptor_ntriples_uri_cache_entry*, ntriples_serializer->cache);
+  }
+  if(ntriples_serializer->cache_buckets)
+    RAPTOR_FREE(int*, ntriples_serializer->cache_buckets);
+  if(ntriples_serializer->cache_seen)
+    RAPTOR_FREE(raptor_uri**, ntriples_serializer->cache_seen);
+
+  ntriples_serializer->cache = NULL;
+  ntriples_serializer->cache_buckets = NULL;
+  ntriples_serializer->cache_seen = NULL;
+  ntriples_serializer->cache_count = 0;
+  ntriples_serializer->cache_hand = 0;
+}
+
+
 /* destroy a serializer */
 static void
 raptor_ntriples_serialize_terminate(raptor_serializer* serializer)
 {
+  raptor_ntriples_serializer_context* ntriples_serializer;
+
+  ntriples_serializer = (raptor_ntriples_serializer_context*)serializer->context;
 
+  raptor_ntriples_serialize_terminate_cache(ntriples_serializer);
 }
   
 
@@ -213,18 +276,186 @@ raptor_statement_ntriples_write(const raptor_statement *statement,
 }
 
 
+static unsigned int
+raptor_ntriples_uri_cache_hash(raptor_uri* uri)
+{
+  size_t h = RAPTOR_GOOD_CAST(size_t, uri) >> 4;
+
+  h ^= h >> 13;
+  return RAPTOR_BAD_CAST(unsigned int, h & (RAPTOR_NTRIPLES_URI_CACHE_SIZE - 1));
+}
+
+
+/* Get a free cache entry, evicting an unreferenced one if full */
+static raptor_ntriples_uri_cache_entry*
+raptor_ntriples_uri_cache_get_entry(raptor_ntriples_serializer_context* ntriples_serializer)
+{
+  raptor_ntriples_uri_cache_entry* entry;
+  int index;
+  int* link;
+
+  if(ntriples_serializer->cache_count < RAPTOR_NTRIPLES_URI_CACHE_SIZE)
+    return &ntriples_serializer->cache[ntriples_serializer->cache_count++];
+
+  /* CLOCK: pass over recently used entries, clearing their mark */
+  while(1) {
+    index = ntriples_serializer->cache_hand;
+    ntriples_serializer->cache_hand = (index + 1) & (RAPTOR_NTRIPLES_URI_CACHE_SIZE - 1);
+    entry = &ntriples_serializer->cache[index];
+    if(!entry->referenced)
+      break;
+    entry->referenced = 0;
+  }
+
+  link = &ntriples_serializer->cache_buckets[raptor_ntriples_uri_cache_hash(entry->uri)];
+  while(*link != index)
+    link = &ntriples_serializer->cache[*link].next;
+  *link = entry->next;
+
+  raptor_free_uri(entry->uri);
+  raptor_free_memory(entry->string);
+
+  return entry;
+}
+
+
+/*
+ * raptor_ntriples_serialize_uri_term:
+ * @ntriples_serializer: serializer context
+ * @term: URI term
+ * @iostr: iostream to write to
+ *
+ * Write a URI term as N-Triples using the cache of written URIs.
+ *
+ * URIs are cached the second time they are seen so that ones used
+ * once do not displace hot ones.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_ntriples_serialize_uri_term(raptor_ntriples_serializer_context* ntriples_serializer,
+                                   raptor_term* term, raptor_iostream* iostr)
+{
+  raptor_uri* uri = term->value.uri;
+  raptor_ntriples_uri_cache_entry* entry;
+  raptor_iostream* string_iostr;
+  unsigned int h;
+  int index;
+  void* string = NULL;
+  size_t string_len = 0;
+
+  if(!ntriples_serializer->cache) {
+    ntriples_serializer->cache = RAPTOR_CALLOC(raptor_ntriples_uri_cache_entry*,
+                                               RAPTOR_NTRIPLES_URI_CACHE_SIZE,
+                                               sizeof(*entry));
+    ntriples_serializer->cache_buckets = RAPTOR_MALLOC(int*,
+                                                       RAPTOR_NTRIPLES_URI_CACHE_SIZE * sizeof(int));
+    ntriples_serializer->cache_seen = RAPTOR_CALLOC(raptor_uri**,
+                                                    RAPTOR_NTRIPLES_URI_CACHE_SIZE,
+                                                    sizeof(raptor_uri*));
+    if(!ntriples_serializer->cache || !ntriples_serializer->cache_buckets ||
+       !ntriples_serializer->cache_seen) {
+      raptor_ntriples_serialize_terminate_cache(ntriples_serializer);
+      goto nocache;
+    }
+    memset(ntriples_serializer->cache_buckets, -1,
+           RAPTOR_NTRIPLES_URI_CACHE_SIZE * sizeof(int));
+  }
+
+  h = raptor_ntriples_uri_cache_hash(uri);
+  for(index = ntriples_serializer->cache_buckets[h]; index >= 0;
+      index = entry->next) {
+    entry = &ntriples_serializer->cache[index];
+    if(entry->uri == uri) {
+      entry->referenced = 1;
+      raptor_iostream_write_bytes(entry->string, 1, entry->string_len, iostr);
+      return 0;
+    }
+  }
+
+  /* The seen URIs are only compared, never dereferenced */
+  if(ntriples_serializer->cache_seen[h] != uri) {
+    ntriples_serializer->cache_seen[h] = uri;
+    goto nocache;
+  }
+
+  string_iostr = raptor_new_iostream_to_string(term->world,
+                                               &string, &string_len, NULL);
+  if(!string_iostr)
+    goto nocache;
+  raptor_iostream_set_write_buffer_size(string_iostr, 0);
+  raptor_term_escaped_write(term, RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL,
+                            string_iostr);
+  raptor_free_iostream(string_iostr);
+  if(!string)
+    goto nocache;
+
+  entry = raptor_ntriples_uri_cache_get_entry(ntriples_serializer);
+  entry->uri = raptor_uri_copy(uri);
+  entry->string = (unsigned char*)string;
+  entry->string_len = string_len;
+  entry->referenced = 0;
+  index = RAPTOR_BAD_CAST(int, entry - ntriples_serializer->cache);
+  entry->next = ntriples_serializer->cache_buckets[h];
+  ntriples_serializer->cache_buckets[h] = index;
+  ntriples_serializer->cache_seen[h] = NULL;
+
+  raptor_iostream_write_bytes(entry->string, 1, entry->string_len, iostr);
+  return 0;
+
+  nocache:
+  return raptor_term_escaped_write(term, RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL,
+                                   iostr);
+}
+
+
+/* write a predicate or graph term, which are usually few and repeated */
+static int
+raptor_ntriples_serialize_term(raptor_ntriples_serializer_context* ntriples_serializer,
+                               raptor_term* term, raptor_iostream* iostr)
+{
+  if(term->type == RAPTOR_TERM_TYPE_URI)
+    return raptor_ntriples_serialize_uri_term(ntriples_serializer, term, iostr);
+
+  return raptor_term_escaped_write(term, RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL,
+                                   iostr);
+}
+
+
 /* serialize a statement */
 static int
 raptor_ntriples_serialize_statement(raptor_serializer* serializer, 
                                     raptor_statement *statement)
 {
   raptor_ntriples_serializer_context* ntriples_serializer;
+  raptor_iostream* iostr = serializer->iostream;
 
   ntriples_serializer = (raptor_ntriples_serializer_context*)serializer->context;
 
-  raptor_statement_ntriples_write(statement,
-                                  serializer->iostream,
-                                  ntriples_serializer->is_nquads);
+  /* same output as raptor_statement_ntriples_write() */
+  if(raptor_term_escaped_write(statement->subject,
+                               RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL, iostr))
+    return 0;
+
+  raptor_iostream_write_byte(' ', iostr);
+  if(raptor_ntriples_serialize_term(ntriples_serializer, statement->predicate,
+                                    iostr))
+    return 0;
+
+  raptor_iostream_write_byte(' ', iostr);
+  if(raptor_term_escaped_write(statement->object,
+                               RAPTOR_ESCAPED_WRITE_NTRIPLES_LITERAL, iostr))
+    return 0;
+
+  if(statement->graph && ntriples_serializer->is_nquads) {
+    raptor_iostream_write_byte(' ', iostr);
+    if(raptor_ntriples_serialize_term(ntriples_serializer, statement->graph,
+                                      iostr))
+      return 0;
+  }
+
+  raptor_iostream_counted_string_write(" .\n", 3, iostr);
+
   return 0;
 }
 
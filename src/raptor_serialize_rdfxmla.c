@@ -37,6 +37,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SERIALIZER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -52,9 +54,9 @@ typedef struct {
   raptor_xml_element* rdf_RDF_element;  /* the rdf:RDF element */
   raptor_xml_writer *xml_writer;        /* where the xml is being written */
   raptor_sequence *namespaces;          /* User declared namespaces */
-  raptor_avltree *subjects;             /* subject items */
-  raptor_avltree *blanks;               /* blank subject items */
-  raptor_avltree *nodes;                /* nodes */
+  raptor_abbrev_table *subjects;        /* subject items */
+  raptor_abbrev_table *blanks;          /* blank subject items */
+  raptor_abbrev_table *nodes;           /* nodes */
   raptor_abbrev_node *rdf_type;         /* rdf:type uri */
 
   /* non-zero if is Adobe XMP abbreviated form */
@@ -779,33 +781,28 @@ raptor_rdfxmla_emit(raptor_serializer *serializer)
   raptor_rdfxmla_context* context = (raptor_rdfxmla_context*)serializer->context;
   raptor_abbrev_subject* subject;
   raptor_abbrev_subject* blank;
-  raptor_avltree_iterator* iter = NULL;
+  raptor_sequence* seq;
+  int i;
 
-  iter = raptor_new_avltree_iterator(context->subjects, NULL, NULL, 1);
-  while(iter) {
-    subject = (raptor_abbrev_subject*)raptor_avltree_iterator_get(iter);
-    if(subject) {
-      raptor_rdfxmla_emit_subject(serializer, subject, context->starting_depth);
-    }
-    if(raptor_avltree_iterator_next(iter))
-      break;
-  }
-  if(iter) 
-    raptor_free_avltree_iterator(iter);
+  seq = raptor_abbrev_subjects_sort(context->subjects);
+  if(!seq)
+    return 1;
+  for(i = 0;
+      (subject = (raptor_abbrev_subject*)raptor_sequence_get_at(seq, i));
+      i++)
+    raptor_rdfxmla_emit_subject(serializer, subject, context->starting_depth);
+  raptor_free_sequence(seq);
   
   if(!context->single_node) {
     /* Emit any remaining blank nodes */
-    iter = raptor_new_avltree_iterator(context->blanks, NULL, NULL, 1);
-    while(iter) {
-      blank = (raptor_abbrev_subject*)raptor_avltree_iterator_get(iter);
-      if(blank) {
-	raptor_rdfxmla_emit_subject(serializer, blank, context->starting_depth);
-      }
-      if(raptor_avltree_iterator_next(iter))
-	break;
-    }
-    if(iter) 
-      raptor_free_avltree_iterator(iter);
+    seq = raptor_abbrev_subjects_sort(context->blanks);
+    if(!seq)
+      return 1;
+    for(i = 0;
+        (blank = (raptor_abbrev_subject*)raptor_sequence_get_at(seq, i));
+        i++)
+      raptor_rdfxmla_emit_subject(serializer, blank, context->starting_depth);
+    raptor_free_sequence(seq);
   }
     
   return 0;
@@ -854,16 +851,16 @@ raptor_rdfxmla_serialize_init(raptor_serializer* serializer, const char *name)
   context->namespaces = raptor_new_sequence(NULL, NULL);
 
   context->subjects =
-    raptor_new_avltree((raptor_data_compare_handler)raptor_abbrev_subject_compare,
-                       (raptor_data_free_handler)raptor_free_abbrev_subject, 0);
+    raptor_new_abbrev_table(serializer->world,
+                            (raptor_data_free_handler)raptor_free_abbrev_subject);
 
   context->blanks =
-    raptor_new_avltree((raptor_data_compare_handler)raptor_abbrev_subject_compare,
-                       (raptor_data_free_handler)raptor_free_abbrev_subject, 0);
+    raptor_new_abbrev_table(serializer->world,
+                            (raptor_data_free_handler)raptor_free_abbrev_subject);
   
   context->nodes =
-    raptor_new_avltree((raptor_data_compare_handler)raptor_abbrev_node_compare,
-                       (raptor_data_free_handler)raptor_free_abbrev_node, 0);
+    raptor_new_abbrev_table(serializer->world,
+                            (raptor_data_free_handler)raptor_free_abbrev_node);
 
   type_term = RAPTOR_RDF_type_term(serializer->world);
   context->rdf_type = raptor_new_abbrev_node(serializer->world, type_term);
@@ -938,17 +935,17 @@ raptor_rdfxmla_serialize_terminate(raptor_serializer* serializer)
   }
 
   if(context->subjects) {
-    raptor_free_avltree(context->subjects);
+    raptor_free_abbrev_table(context->subjects);
     context->subjects = NULL;
   }
   
   if(context->blanks) {
-    raptor_free_avltree(context->blanks);
+    raptor_free_abbrev_table(context->blanks);
     context->blanks = NULL;
   }
   
   if(context->nodes) {
-    raptor_free_avltree(context->nodes);
+    raptor_free_abbrev_table(context->nodes);
     context->nodes = NULL;
   }
   
@@ -1371,10 +1368,7 @@ raptor_rdfxmla_serialize_statement(raptor_serializer* serializer,
               /* look for any generated blank node associated with this
                * statement and free it
                */
-              raptor_abbrev_subject *blank = 
-                raptor_abbrev_subject_find(context->blanks,
-                                           statement->object);
-              if(subject) raptor_avltree_delete(context->blanks, blank);
+              raptor_abbrev_table_delete(context->blanks, statement->object);
             }
             break;
           }
@@ -38,6 +38,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SERIALIZER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -45,6 +47,11 @@
 
 #define MAX_ASCII_INT_SIZE 13
 
+/* Subjects formatted by a worker per task (RAPTOR_OPTION_SERIALIZE_THREADS) */
+#define RAPTOR_TURTLE_RANGE_SUBJECTS 256
+
+typedef struct raptor_turtle_range_s raptor_turtle_range;
+
 
 /*
  * Raptor turtle serializer object
@@ -54,9 +61,9 @@ typedef struct {
   raptor_namespace *rdf_nspace;         /* the rdf: namespace */
   raptor_turtle_writer *turtle_writer;  /* where the xml is being written */
   raptor_sequence *namespaces;          /* User declared namespaces */
-  raptor_avltree *subjects;             /* subject items */
-  raptor_avltree *blanks;               /* blank subject items */
-  raptor_avltree *nodes;                /* nodes */
+  raptor_abbrev_table *subjects;        /* subject items */
+  raptor_abbrev_table *blanks;          /* blank subject items */
+  raptor_abbrev_table *nodes;           /* nodes */
   raptor_abbrev_node *rdf_type;         /* rdf:type uri */
 
   /* URI of rdf:XMLLiteral */
@@ -102,14 +109,69 @@ typedef struct {
   int mkr_rs_ntuple;
   int mkr_rs_nvalue;
   int mkr_rs_processing_value;
+
+  /* Non 0 to write statements as they arrive (Turtle only) */
+  int streaming;
+
+  /* streaming: last statement written; subject is NULL at the start
+   * and after the subject block is ended
+   */
+  raptor_statement last_statement;
+
+  /* streaming: sorter grouping statements by subject when
+   * RAPTOR_OPTION_SORT_MEMORY_LIMIT is set, or NULL
+   */
+  raptor_statement_sorter* sorter;
+
+  /* worker threads for RAPTOR_OPTION_SERIALIZE_THREADS or NULL */
+  raptor_thread_pool* pool;
+  int threads;
+
+  /* ranges of subjects being formatted by the workers */
+  raptor_turtle_range* ranges;
+  int ranges_count;
 } raptor_turtle_context;
 
 
+/*
+ * A range of top-level subjects formatted by a worker thread
+ *
+ * The worker emits through its own copy of the serializer and
+ * context.  These share the graph with the serializer, which is only
+ * read while emitting, but have their own Turtle writer writing to a
+ * string and their own namespace stack since qname lookups update
+ * the stack's cache.
+ */
+struct raptor_turtle_range_s {
+  raptor_thread_task task;
+
+  raptor_serializer serializer;
+  raptor_turtle_context context;
+
+  /* copy of the serializer namespace stack */
+  raptor_namespace_stack* nstack;
+
+  /* subjects from @start up to but not including @end */
+  raptor_sequence* subjects;
+  int start;
+  int end;
+
+  /* formatted Turtle */
+  unsigned char* string;
+  size_t length;
+
+  /* non-0 on failure */
+  int rc;
+};
+
+
 /* prototypes for functions */
 
 static int raptor_turtle_emit_resource(raptor_serializer *serializer,
                                        raptor_abbrev_node* node,
                                        int depth);
+static void raptor_turtle_emit_uri(raptor_serializer *serializer,
+                                   raptor_uri* uri);
 
 static int raptor_turtle_emit_literal(raptor_serializer *serializer,
                                       raptor_abbrev_node* node,
@@ -192,6 +254,29 @@ static int
 raptor_turtle_emit_resource(raptor_serializer *serializer,
                             raptor_abbrev_node* node,
                             int depth)
+{
+  RAPTOR_DEBUG_ABBREV_NODE("Emitting resource node", node);
+
+  if(node->term->type != RAPTOR_TERM_TYPE_URI)
+    return 1;
+
+  raptor_turtle_emit_uri(serializer, node->term->value.uri);
+
+  RAPTOR_DEBUG_ABBREV_NODE("Emitted", node);
+
+  return 0;
+}
+
+
+/*
+ * raptor_turtle_emit_uri:
+ * @serializer: #raptor_serializer object
+ * @uri: URI
+ *
+ * Emit a URI as a qname, ( ) for rdf:nil or a <URI> reference.
+ **/
+static void
+raptor_turtle_emit_uri(raptor_serializer *serializer, raptor_uri* uri)
 {
   raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
   int emit_mkr = context->emit_mkr;
@@ -199,21 +284,15 @@ raptor_turtle_emit_resource(raptor_serializer *serializer,
 
   raptor_qname* qname = NULL;
 
-  RAPTOR_DEBUG_ABBREV_NODE("Emitting resource node", node);
-
-  if(node->term->type != RAPTOR_TERM_TYPE_URI)
-    return 1;
-
-  if(raptor_uri_equals(node->term->value.uri, context->rdf_nil_uri)) {
+  if(raptor_uri_equals(uri, context->rdf_nil_uri)) {
     if(emit_mkr)
       raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)" ", 1);
     else
       raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)"( )", 3);
-    return 0;
+    return;
   }
 
-  qname = raptor_new_qname_from_namespace_uri(context->nstack,
-                                              node->term->value.uri, 10);
+  qname = raptor_new_qname_from_namespace_uri(context->nstack, uri, 10);
 
   /* XML Names allow leading '_' and '.' anywhere but Turtle does not */
   if(qname && !raptor_turtle_is_legal_turtle_qname(qname)) {
@@ -221,24 +300,12 @@ raptor_turtle_emit_resource(raptor_serializer *serializer,
     qname = NULL;
   }
 
-  if(raptor_uri_equals(node->term->value.uri, context->rdf_nil_uri)) {
-    if(emit_mkr)
-      raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)" ", 1);
-    else
-      raptor_turtle_writer_raw_counted(turtle_writer ,(const unsigned char*)"( )", 3);
-    return 0;
-  }
-
   if(qname) {
     raptor_turtle_writer_qname(turtle_writer, qname);
     raptor_free_qname(qname);
   } else {
-    raptor_turtle_writer_reference(turtle_writer, node->term->value.uri);
+    raptor_turtle_writer_reference(turtle_writer, uri);
   }
-
-  RAPTOR_DEBUG_ABBREV_NODE("Emitted", node);
-
-  return 0;
 }
 
 
@@ -526,6 +593,40 @@ raptor_turtle_emit_subject_collection_items(raptor_serializer* serializer,
 
 
 
+/*
+ * raptor_turtle_emit_predicate:
+ * @serializer: #raptor_serializer object
+ * @predicate: predicate term
+ *
+ * Emit a predicate as a, a qname or a <URI> reference.
+ **/
+static void
+raptor_turtle_emit_predicate(raptor_serializer* serializer,
+                             raptor_term* predicate)
+{
+  raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
+  raptor_turtle_writer *turtle_writer = context->turtle_writer;
+  raptor_qname *qname;
+
+  if(raptor_term_equals(predicate, context->rdf_type->term)) {
+    if(context->emit_mkr)
+      raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)"rdf:type", 8);
+    else
+      raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)"a", 1);
+    return;
+  }
+
+  qname = raptor_new_qname_from_namespace_uri(context->nstack,
+                                              predicate->value.uri, 10);
+  if(qname) {
+    raptor_turtle_writer_qname(turtle_writer, qname);
+    raptor_free_qname(qname);
+  } else {
+    raptor_turtle_writer_reference(turtle_writer, predicate->value.uri);
+  }
+}
+
+
 /*
  * raptor_turtle_emit_subject_properties:
  * @serializer: #raptor_serializer object
@@ -562,7 +663,6 @@ raptor_turtle_emit_subject_properties(raptor_serializer* serializer,
     raptor_abbrev_node** nodes;
     raptor_abbrev_node* predicate;
     raptor_abbrev_node* object;
-    raptor_qname *qname;
 
     nodes = (raptor_abbrev_node**)raptor_avltree_iterator_get(iter);
     if(!nodes)
@@ -585,20 +685,7 @@ raptor_turtle_emit_subject_properties(raptor_serializer* serializer,
         raptor_turtle_writer_newline(turtle_writer);
       }
 
-      qname = raptor_new_qname_from_namespace_uri(context->nstack,
-                                                  predicate->term->value.uri,
-                                                  10);
-
-      if(raptor_abbrev_node_equals(predicate, context->rdf_type)) {
-        if(emit_mkr)
-          raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)"rdf:type", 8);
-        else
-          raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)"a", 1);
-      } else if(qname) {
-        raptor_turtle_writer_qname(turtle_writer, qname);
-      } else {
-        raptor_turtle_writer_reference(turtle_writer, predicate->term->value.uri);
-      }
+      raptor_turtle_emit_predicate(serializer, predicate->term);
       if(emit_mkr) {
         raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)" = ", 3);
         if(numobj > 1)
@@ -606,10 +693,6 @@ raptor_turtle_emit_subject_properties(raptor_serializer* serializer,
       } else {
         raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)" ", 1);
       }
-
-
-      if(qname)
-        raptor_free_qname(qname);
     } else { /* not last object for this predicate */
       raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)", ", 2);
     }
@@ -848,10 +931,9 @@ raptor_turtle_emit_subject(raptor_serializer *serializer,
   int collection = 0;
   int rc = 0;
 
-  if(!raptor_abbrev_subject_valid(subject)) return 0;
-
-  RAPTOR_DEBUG_ABBREV_NODE("Emitting subject node", subject->node);
-
+  /* Checked before validity: these blanks are emitted and invalidated
+   * inside their one referring subject, possibly on another worker
+   * thread */
   if(!depth &&
      subject->node->term->type == RAPTOR_TERM_TYPE_BLANK &&
      subject->node->count_as_subject == 1 &&
@@ -860,6 +942,10 @@ raptor_turtle_emit_subject(raptor_serializer *serializer,
     return 0;
   }
 
+  if(!raptor_abbrev_subject_valid(subject)) return 0;
+
+  RAPTOR_DEBUG_ABBREV_NODE("Emitting subject node", subject->node);
+
   if(raptor_avltree_size(subject->properties) == 0) {
     RAPTOR_DEBUG_ABBREV_NODE("Skipping subject node - no props", subject->node);
     return 0;
@@ -1047,6 +1133,203 @@ raptor_turtle_emit_subject(raptor_serializer *serializer,
 }
 
 
+/* worker thread: format a range of subjects into a string */
+static void
+raptor_turtle_emit_range(void* user_data)
+{
+  raptor_turtle_range* range = (raptor_turtle_range*)user_data;
+  raptor_serializer* serializer = &range->serializer;
+  raptor_turtle_context* context = &range->context;
+  raptor_turtle_writer* turtle_writer;
+  raptor_iostream* iostr;
+  int i;
+
+  range->rc = 1;
+
+  iostr = raptor_new_iostream_to_string(serializer->world,
+                                        (void**)&range->string,
+                                        &range->length, NULL);
+  if(!iostr)
+    return;
+
+  /* the base URI is already written by the serializer's writer */
+  turtle_writer = raptor_new_turtle_writer(serializer->world,
+                                           serializer->base_uri, 0,
+                                           range->nstack, iostr,
+                                           context->turtle_writer_flags);
+  if(turtle_writer) {
+    raptor_turtle_writer_set_option(turtle_writer,
+                                    RAPTOR_OPTION_WRITER_AUTO_INDENT, 1);
+    raptor_turtle_writer_set_option(turtle_writer,
+                                    RAPTOR_OPTION_WRITER_INDENT_WIDTH, 2);
+
+    context->turtle_writer = turtle_writer;
+    serializer->iostream = iostr;
+
+    range->rc = 0;
+    for(i = range->start; i < range->end; i++) {
+      raptor_abbrev_subject* subject;
+
+      subject = (raptor_abbrev_subject*)raptor_sequence_get_at(range->subjects,
+                                                               i);
+      range->rc = raptor_turtle_emit_subject(serializer, subject, 0);
+      if(range->rc)
+        break;
+    }
+
+    raptor_free_turtle_writer(turtle_writer);
+    context->turtle_writer = NULL;
+    serializer->iostream = NULL;
+  }
+
+  /* sets range->string */
+  raptor_free_iostream(iostr);
+  if(!range->string)
+    range->rc = 1;
+}
+
+
+/* give the next range of @subjects from *@next_p to a worker */
+static void
+raptor_turtle_submit_range(raptor_serializer* serializer,
+                           raptor_turtle_range* range,
+                           raptor_sequence* subjects, int* next_p)
+{
+  raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
+  int size = raptor_sequence_size(subjects);
+
+  range->subjects = subjects;
+  range->start = *next_p;
+  range->end = range->start + RAPTOR_TURTLE_RANGE_SUBJECTS;
+  if(range->end > size)
+    range->end = size;
+  *next_p = range->end;
+
+  range->string = NULL;
+  range->length = 0;
+  range->rc = 0;
+
+  raptor_thread_pool_submit(context->pool, &range->task);
+}
+
+
+/*
+ * raptor_turtle_emit_subjects_threaded:
+ * @serializer: #raptor_serializer object
+ * @subjects: sequence of top-level subjects
+ *
+ * Format ranges of @subjects on the worker threads and write their
+ * Turtle in the order of @subjects.  The output is the same as
+ * emitting them in turn on this thread.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_turtle_emit_subjects_threaded(raptor_serializer* serializer,
+                                     raptor_sequence* subjects)
+{
+  raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
+  int size = raptor_sequence_size(subjects);
+  int next = 0;
+  int head = 0;
+  int running;
+  int rc = 0;
+
+  for(running = 0;
+      running < context->ranges_count && next < size;
+      running++)
+    raptor_turtle_submit_range(serializer, &context->ranges[running],
+                               subjects, &next);
+
+  while(running) {
+    /* ranges are reused in turn so the oldest is always next */
+    raptor_turtle_range* range = &context->ranges[head];
+
+    raptor_thread_pool_wait(context->pool, &range->task);
+    head = (head + 1) % context->ranges_count;
+    running--;
+
+    if(!rc) {
+      rc = range->rc;
+      if(!rc && range->length)
+        rc = raptor_iostream_counted_string_write(range->string,
+                                                  range->length,
+                                                  serializer->iostream);
+    }
+    if(range->string) {
+      raptor_free_memory(range->string);
+      range->string = NULL;
+    }
+
+    /* after a failure just wait for the workers */
+    if(!rc && next < size) {
+      raptor_turtle_submit_range(serializer, range, subjects, &next);
+      running++;
+    }
+  }
+
+  return rc;
+}
+
+
+/*
+ * raptor_turtle_ranges_start:
+ * @serializer: #raptor_serializer object
+ *
+ * Give the worker ranges their copies of the serializer and of its
+ * namespace stack, which must have all namespaces declared.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_turtle_ranges_start(raptor_serializer* serializer)
+{
+  raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
+  int i;
+  int j;
+
+  for(i = 0; i < context->ranges_count; i++) {
+    raptor_turtle_range* range = &context->ranges[i];
+
+    range->serializer = *serializer;
+    range->serializer.context = &range->context;
+    range->context = *context;
+
+    range->nstack = raptor_new_namespaces(serializer->world, 1);
+    if(!range->nstack)
+      return 1;
+
+    /* same order as raptor_turtle_ensure_writen_header() */
+    for(j = 0; j < raptor_sequence_size(context->namespaces); j++) {
+      raptor_namespace* ns;
+
+      ns = (raptor_namespace*)raptor_sequence_get_at(context->namespaces, j);
+      if(raptor_namespace_stack_start_namespace(range->nstack, ns, 0))
+        return 1;
+    }
+    range->context.nstack = range->nstack;
+  }
+
+  return 0;
+}
+
+
+static void
+raptor_turtle_ranges_end(raptor_turtle_context* context)
+{
+  int i;
+
+  for(i = 0; i < context->ranges_count; i++) {
+    raptor_turtle_range* range = &context->ranges[i];
+
+    if(range->nstack) {
+      raptor_free_namespaces(range->nstack);
+      range->nstack = NULL;
+    }
+  }
+}
+
+
 /*
  * raptor_turtle_emit:
  * @serializer: #raptor_serializer object
@@ -1059,41 +1342,131 @@ static int
 raptor_turtle_emit(raptor_serializer *serializer)
 {
   raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
-  raptor_abbrev_subject* subject;
-  raptor_abbrev_subject* blank;
-  int rc;
-  raptor_avltree_iterator* iter = NULL;
+  raptor_abbrev_table* tables[2];
+  int threaded = 0;
+  int rc = 0;
+  int t;
 
-  iter = raptor_new_avltree_iterator(context->subjects, NULL, NULL, 1);
-  while(iter) {
-    subject = (raptor_abbrev_subject *)raptor_avltree_iterator_get(iter);
-    if(subject) {
-      rc = raptor_turtle_emit_subject(serializer, subject, 0);
-      if(rc) {
-        raptor_free_avltree_iterator(iter);
-        return rc;
-      }
-    }
-    if(raptor_avltree_iterator_next(iter)) break;
+  if(context->pool) {
+    threaded = !raptor_turtle_ranges_start(serializer);
+    if(!threaded)
+      raptor_turtle_ranges_end(context);
   }
-  if(iter) raptor_free_avltree_iterator(iter);
 
-  /* Emit any remaining blank nodes. */
-  iter = raptor_new_avltree_iterator(context->blanks, NULL, NULL, 1);
-  while(iter) {
-    blank = (raptor_abbrev_subject *)raptor_avltree_iterator_get(iter);
-    if(blank) {
-      rc = raptor_turtle_emit_subject(serializer, blank, 0);
-      if(rc) {
-        raptor_free_avltree_iterator(iter);
-        return rc;
+  tables[0] = context->subjects;
+  /* Emit any remaining blank nodes after the URI subjects. */
+  tables[1] = context->blanks;
+
+  for(t = 0; t < 2 && !rc; t++) {
+    raptor_sequence* seq;
+    raptor_abbrev_subject* subject;
+    int i;
+
+    seq = raptor_abbrev_subjects_sort(tables[t]);
+    if(!seq) {
+      rc = 1;
+      break;
+    }
+
+    if(threaded)
+      rc = raptor_turtle_emit_subjects_threaded(serializer, seq);
+    else {
+      for(i = 0;
+          (subject = (raptor_abbrev_subject*)raptor_sequence_get_at(seq, i));
+          i++) {
+        rc = raptor_turtle_emit_subject(serializer, subject, 0);
+        if(rc)
+          break;
       }
     }
-    if(raptor_avltree_iterator_next(iter)) break;
+    raptor_free_sequence(seq);
   }
-  if(iter) raptor_free_avltree_iterator(iter);
 
-  return 0;
+  if(threaded)
+    raptor_turtle_ranges_end(context);
+
+  return rc;
+}
+
+
+static void
+raptor_turtle_free_threads(raptor_turtle_context* context)
+{
+  /* waits for any running workers */
+  if(context->pool) {
+    raptor_free_thread_pool(context->pool);
+    context->pool = NULL;
+  }
+
+  if(context->ranges) {
+    raptor_turtle_ranges_end(context);
+    RAPTOR_FREE(raptor_turtle_range*, context->ranges);
+    context->ranges = NULL;
+  }
+
+  context->ranges_count = 0;
+  context->threads = 0;
+}
+
+
+/*
+ * raptor_turtle_serialize_set_threads:
+ * @serializer: #raptor_serializer object
+ * @threads: number of worker threads
+ *
+ * Set up the worker threads for RAPTOR_OPTION_SERIALIZE_THREADS.  If
+ * they cannot be started, subjects are emitted on the calling thread.
+ */
+static void
+raptor_turtle_serialize_set_threads(raptor_serializer* serializer,
+                                    int threads)
+{
+  raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
+  int i;
+
+  /* mKR emitting keeps state across subjects; streaming never emits */
+  if(threads < 2 || context->emit_mkr || context->streaming)
+    threads = 0;
+
+  if(threads == context->threads)
+    return;
+
+  raptor_turtle_free_threads(context);
+
+  if(!threads)
+    return;
+
+  /* workers make qnames which copy URIs */
+  if(raptor_uri_init_locking(serializer->world))
+    return;
+
+  context->pool = raptor_new_thread_pool(threads);
+  if(!context->pool)
+    return;
+
+  /* not worth it if tasks would run on this thread */
+  if(!raptor_thread_pool_get_threads_count(context->pool))
+    goto failed;
+
+  context->ranges_count = threads << 1;
+  context->ranges = RAPTOR_CALLOC(raptor_turtle_range*,
+                                  (size_t)context->ranges_count,
+                                  sizeof(raptor_turtle_range));
+  if(!context->ranges)
+    goto failed;
+
+  for(i = 0; i < context->ranges_count; i++) {
+    raptor_turtle_range* range = &context->ranges[i];
+
+    range->task.handler = raptor_turtle_emit_range;
+    range->task.user_data = range;
+  }
+
+  context->threads = threads;
+  return;
+
+  failed:
+  raptor_turtle_free_threads(context);
 }
 
 
@@ -1129,16 +1502,16 @@ raptor_turtle_serialize_init(raptor_serializer* serializer, const char *name)
   context->namespaces = raptor_new_sequence(NULL, NULL);
 
   context->subjects =
-    raptor_new_avltree((raptor_data_compare_handler)raptor_abbrev_subject_compare,
-                       (raptor_data_free_handler)raptor_free_abbrev_subject, 0);
+    raptor_new_abbrev_table(serializer->world,
+                            (raptor_data_free_handler)raptor_free_abbrev_subject);
 
   context->blanks =
-    raptor_new_avltree((raptor_data_compare_handler)raptor_abbrev_subject_compare,
-                       (raptor_data_free_handler)raptor_free_abbrev_subject, 0);
+    raptor_new_abbrev_table(serializer->world,
+                            (raptor_data_free_handler)raptor_free_abbrev_subject);
 
   context->nodes =
-    raptor_new_avltree((raptor_data_compare_handler)raptor_abbrev_node_compare,
-                       (raptor_data_free_handler)raptor_free_abbrev_node, 0);
+    raptor_new_abbrev_table(serializer->world,
+                            (raptor_data_free_handler)raptor_free_abbrev_node);
 
   rdf_type_uri = raptor_new_uri_for_rdf_concept(serializer->world,
                                                 (const unsigned char*)"type");
@@ -1176,6 +1549,8 @@ raptor_turtle_serialize_init(raptor_serializer* serializer, const char *name)
     return 1;
   }
 
+  raptor_statement_init(&context->last_statement, serializer->world);
+
   return 0;
 }
 
@@ -1191,6 +1566,15 @@ raptor_turtle_serialize_terminate(raptor_serializer* serializer)
     context->turtle_writer = NULL;
   }
 
+  raptor_statement_clear(&context->last_statement);
+
+  if(context->sorter) {
+    raptor_free_statement_sorter(context->sorter);
+    context->sorter = NULL;
+  }
+
+  raptor_turtle_free_threads(context);
+
   if(context->rdf_nspace) {
     raptor_free_namespace(context->rdf_nspace);
     context->rdf_nspace = NULL;
@@ -1211,17 +1595,17 @@ raptor_turtle_serialize_terminate(raptor_serializer* serializer)
   }
 
   if(context->subjects) {
-    raptor_free_avltree(context->subjects);
+    raptor_free_abbrev_table(context->subjects);
     context->subjects = NULL;
   }
 
   if(context->blanks) {
-    raptor_free_avltree(context->blanks);
+    raptor_free_abbrev_table(context->blanks);
     context->blanks = NULL;
   }
 
   if(context->nodes) {
-    raptor_free_avltree(context->nodes);
+    raptor_free_abbrev_table(context->nodes);
     context->nodes = NULL;
   }
 
@@ -1356,6 +1740,31 @@ raptor_turtle_serialize_start(raptor_serializer* serializer)
 
   context->turtle_writer = turtle_writer;
 
+  context->streaming = !context->emit_mkr &&
+    RAPTOR_OPTIONS_GET_NUMERIC(serializer, RAPTOR_OPTION_TURTLE_STREAMING);
+  raptor_statement_clear(&context->last_statement);
+
+  if(context->sorter) {
+    raptor_free_statement_sorter(context->sorter);
+    context->sorter = NULL;
+  }
+
+  if(context->streaming) {
+    int memory_limit;
+
+    memory_limit = RAPTOR_OPTIONS_GET_NUMERIC(serializer,
+                                              RAPTOR_OPTION_SORT_MEMORY_LIMIT);
+    if(memory_limit > 0) {
+      context->sorter = raptor_new_statement_sorter(serializer->world,
+                                                    (size_t)memory_limit);
+      if(!context->sorter)
+        return 1;
+    }
+  }
+
+  raptor_turtle_serialize_set_threads(serializer,
+                                      RAPTOR_OPTIONS_GET_NUMERIC(serializer, RAPTOR_OPTION_SERIALIZE_THREADS));
+
   return 0;
 }
 
@@ -1384,6 +1793,125 @@ raptor_turtle_ensure_writen_header(raptor_serializer* serializer,
   context->written_header = 1;
 }
 
+/* streaming: emit a subject, object or graph term as it is */
+static void
+raptor_turtle_emit_term(raptor_serializer* serializer, raptor_term* term)
+{
+  raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
+  raptor_turtle_writer* turtle_writer = context->turtle_writer;
+
+  switch(term->type) {
+    case RAPTOR_TERM_TYPE_URI:
+      raptor_turtle_emit_uri(serializer, term->value.uri);
+      break;
+
+    case RAPTOR_TERM_TYPE_LITERAL:
+      raptor_turtle_writer_literal(turtle_writer, context->nstack,
+                                   term->value.literal.string,
+                                   term->value.literal.language,
+                                   term->value.literal.datatype);
+      break;
+
+    case RAPTOR_TERM_TYPE_BLANK:
+      raptor_turtle_writer_bnodeid(turtle_writer,
+                                   term->value.blank.string,
+                                   term->value.blank.string_len);
+      break;
+
+    case RAPTOR_TERM_TYPE_UNKNOWN:
+    default:
+      break;
+  }
+}
+
+
+/* streaming: end the subject block being written, if any */
+static void
+raptor_turtle_end_streamed_subject(raptor_serializer* serializer)
+{
+  raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
+  raptor_turtle_writer* turtle_writer = context->turtle_writer;
+
+  if(!context->last_statement.subject)
+    return;
+
+  /* see raptor_turtle_emit_subject() for why there is a space */
+  raptor_turtle_writer_decrease_indent(turtle_writer);
+  raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)" .", 2);
+  raptor_turtle_writer_newline(turtle_writer);
+  raptor_turtle_writer_newline(turtle_writer);
+
+  raptor_statement_clear(&context->last_statement);
+}
+
+
+/*
+ * raptor_turtle_serialize_statement_streaming:
+ * @serializer: #raptor_serializer object
+ * @statement: statement
+ *
+ * Write a statement straight away, continuing the subject block of
+ * the last statement with ; or , where it has the same subject or
+ * the same subject and predicate.  Only the last statement is kept
+ * so blank nodes are not nested and lists are not abbreviated.
+ *
+ * Return value: non-0 on failure
+ **/
+static int
+raptor_turtle_serialize_statement_streaming(raptor_serializer* serializer,
+                                            raptor_statement *statement)
+{
+  raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
+  raptor_turtle_writer* turtle_writer = context->turtle_writer;
+  raptor_statement* last = &context->last_statement;
+
+  if(!turtle_writer)
+    return 1;
+
+  raptor_turtle_ensure_writen_header(serializer, context);
+
+  if(last->subject && raptor_term_equals(last->subject, statement->subject)) {
+    if(raptor_term_equals(last->predicate, statement->predicate)) {
+      /* repeat of the last statement */
+      if(raptor_term_equals(last->object, statement->object))
+        return 0;
+
+      raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)", ", 2);
+    } else {
+      raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)" ;", 2);
+      raptor_turtle_writer_newline(turtle_writer);
+      raptor_turtle_emit_predicate(serializer, statement->predicate);
+      raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)" ", 1);
+    }
+  } else {
+    raptor_turtle_end_streamed_subject(serializer);
+
+    raptor_turtle_emit_term(serializer, statement->subject);
+    raptor_turtle_writer_increase_indent(turtle_writer);
+    raptor_turtle_writer_newline(turtle_writer);
+    raptor_turtle_emit_predicate(serializer, statement->predicate);
+    raptor_turtle_writer_raw_counted(turtle_writer, (const unsigned char*)" ", 1);
+  }
+
+  raptor_turtle_emit_term(serializer, statement->object);
+
+  if(last->subject != statement->subject) {
+    raptor_free_term(last->subject);
+    last->subject = raptor_term_copy(statement->subject);
+  }
+  if(last->predicate != statement->predicate) {
+    raptor_free_term(last->predicate);
+    last->predicate = raptor_term_copy(statement->predicate);
+  }
+  if(last->object != statement->object) {
+    raptor_free_term(last->object);
+    last->object = raptor_term_copy(statement->object);
+  }
+
+  return (!last->subject || !last->predicate || !last->object);
+}
+
+
 /* serialize a statement */
 static int
 raptor_turtle_serialize_statement(raptor_serializer* serializer,
@@ -1404,13 +1932,6 @@ raptor_turtle_serialize_statement(raptor_serializer* serializer,
     return 1;
   }
 
-  subject = raptor_abbrev_subject_lookup(context->nodes, context->subjects,
-                                         context->blanks,
-                                         statement->subject);
-  if(!subject) {
-    return 1;
-  }
-
   object_type = statement->object->type;
 
   if(!(object_type == RAPTOR_TERM_TYPE_URI ||
@@ -1422,29 +1943,40 @@ raptor_turtle_serialize_statement(raptor_serializer* serializer,
     return 1;
   }
 
+  if(statement->predicate->type != RAPTOR_TERM_TYPE_URI) {
+    raptor_log_error_formatted(serializer->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                               "Do not know how to serialize node type %u",
+                               statement->predicate->type);
+    return 1;
+  }
+
+  if(context->sorter)
+    return raptor_statement_sorter_add(context->sorter, statement);
+
+  if(context->streaming)
+    return raptor_turtle_serialize_statement_streaming(serializer, statement);
+
+  subject = raptor_abbrev_subject_lookup(context->nodes, context->subjects,
+                                         context->blanks,
+                                         statement->subject);
+  if(!subject) {
+    return 1;
+  }
+
   object = raptor_abbrev_node_lookup(context->nodes, statement->object);
   if(!object)
     return 1;
 
+  predicate = raptor_abbrev_node_lookup(context->nodes, statement->predicate);
+  if(!predicate)
+    return 1;
 
-  if(statement->predicate->type == RAPTOR_TERM_TYPE_URI) {
-    predicate = raptor_abbrev_node_lookup(context->nodes, statement->predicate);
-    if(!predicate)
-      return 1;
-	
-    rv = raptor_abbrev_subject_add_property(subject, predicate, object);
-    if(rv < 0) {
-      raptor_log_error_formatted(serializer->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                                 "Unable to add properties to subject %p",
-                                 subject);
-      return rv;
-    }
-
-  } else {
+  rv = raptor_abbrev_subject_add_property(subject, predicate, object);
+  if(rv < 0) {
     raptor_log_error_formatted(serializer->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                               "Do not know how to serialize node type %u",
-                               statement->predicate->type);
-    return 1;
+                               "Unable to add properties to subject %p",
+                               subject);
+    return rv;
   }
 
   if(object_type == RAPTOR_TERM_TYPE_URI ||
@@ -1460,15 +1992,30 @@ static int
 raptor_turtle_serialize_end(raptor_serializer* serializer)
 {
   raptor_turtle_context* context = (raptor_turtle_context*)serializer->context;
+  int rc = 0;
 
   raptor_turtle_ensure_writen_header(serializer, context);
 
-  raptor_turtle_emit(serializer);
+  if(context->sorter) {
+    raptor_statement* statement;
+
+    while((statement = raptor_statement_sorter_next(context->sorter)))
+      raptor_turtle_serialize_statement_streaming(serializer, statement);
+
+    rc = raptor_statement_sorter_failed(context->sorter);
+    raptor_free_statement_sorter(context->sorter);
+    context->sorter = NULL;
+  }
+
+  if(context->streaming)
+    raptor_turtle_end_streamed_subject(serializer);
+  else
+    raptor_turtle_emit(serializer);
 
   /* reset serializer for reuse */
   context->written_header = 0;
 
-  return 0;
+  return rc;
 }
 
 
@@ -50,21 +50,38 @@
  *  Destroy Set
  *  Check a (base, ID) pair present add it if not, return if added/not
  *
+ * Each base URI has an open addressing hash table (linear probing) of
+ * 64 bit fingerprints of its IDs, about 11-21 bytes per ID.  Two
+ * different IDs with the same fingerprint would make the second one
+ * look like a duplicate; with n IDs under one base the chance of that
+ * is about n*n/2^65.  In exact mode the ID strings are kept as well
+ * and compared when fingerprints match.
+ *
+ * The base ID sets are found through a second hash table keyed by
+ * the URI hash, with the last one used checked first.
  */
 
+typedef unsigned long long raptor_id_fingerprint;
+
+/* initial slots in a base ID set; a power of 2 */
+#define RAPTOR_ID_SET_INITIAL_SIZE 64
+
+/* initial slots in the table of base ID sets; a power of 2 */
+#define RAPTOR_ID_SET_INITIAL_BASES 8
+
 struct raptor_base_id_set_s
 {
-  raptor_world* world;
-
   /* The base URI of this set of IDs */
   raptor_uri *uri;
-  
-  /* neighbour ID sets */
-  struct raptor_base_id_set_s* prev;
-  struct raptor_base_id_set_s* next;
 
-  /* binary tree */
-  raptor_avltree* tree;
+  /* ID fingerprints; 0 marks an empty slot */
+  raptor_id_fingerprint* fingerprints;
+  /* exact mode: ID strings in the same slots as their fingerprints */
+  const unsigned char** ids;
+
+  /* number of slots (a power of 2) and used slots */
+  size_t size;
+  size_t count;
 };
 typedef struct raptor_base_id_set_s raptor_base_id_set;
 
@@ -73,8 +90,19 @@ struct raptor_id_set_s
 {
   raptor_world* world;
 
-  /* start of trees, 1 per base URI */
-  struct raptor_base_id_set_s* first;
+  /* non-0 to keep and compare the ID strings */
+  int exact;
+
+  /* hash table of base ID sets by base URI hash */
+  raptor_base_id_set** bases;
+  size_t bases_size;
+  size_t bases_count;
+
+  /* base ID set used by the last call */
+  raptor_base_id_set* last;
+
+  /* exact mode: storage for the ID strings */
+  raptor_arena* arena;
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
   int hits;
@@ -83,24 +111,66 @@ struct raptor_id_set_s
 };
 
 
+/*
+ * raptor_id_set_fingerprint:
+ * @id: identifier
+ * @id_len: length of identifier
+ *
+ * INTERNAL - 64 bit FNV-1a hash of an ID with the bits mixed so the
+ * low bits can index a table.  Never 0.
+ *
+ * Return value: fingerprint
+ */
+static raptor_id_fingerprint
+raptor_id_set_fingerprint(const unsigned char *id, size_t id_len)
+{
+  raptor_id_fingerprint h = 0xcbf29ce484222325ULL;
+  size_t i;
+
+  for(i = 0; i < id_len; i++) {
+    h ^= id[i];
+    h *= 0x100000001b3ULL;
+  }
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h ? h : 1;
+}
+
+
 /* functions implementing the ID set api */
 
 /**
  * raptor_new_id_set:
  * @world: raptor_world object
+ * @exact: non-0 to keep the ID strings so that no ID is taken for a
+ *   duplicate because of a fingerprint collision
  *
  * INTERNAL - Constructor - create a new ID set.
  * 
  * Return value: non 0 on failure
  **/
 raptor_id_set*
-raptor_new_id_set(raptor_world* world)
+raptor_new_id_set(raptor_world* world, int exact)
 {
   raptor_id_set* set = RAPTOR_CALLOC(raptor_id_set*, 1, sizeof(*set));
   if(!set)
     return NULL;
 
   set->world = world;
+  set->exact = exact;
+
+  if(exact) {
+    set->arena = raptor_new_arena(0);
+    if(!set->arena) {
+      RAPTOR_FREE(raptor_id_set, set);
+      return NULL;
+    }
+  }
 
   return set;
 }
@@ -116,8 +186,10 @@ raptor_new_id_set(raptor_world* world)
 static void
 raptor_free_base_id_set(raptor_base_id_set *base) 
 {
-  if(base->tree)
-    raptor_free_avltree(base->tree);
+  if(base->fingerprints)
+    RAPTOR_FREE(raptor_id_fingerprint*, base->fingerprints);
+  if(base->ids)
+    RAPTOR_FREE(cstringpointer, base->ids);
   if(base->uri)
     raptor_free_uri(base->uri);
   RAPTOR_FREE(raptor_base_id_set, base);
@@ -134,20 +206,162 @@ raptor_free_base_id_set(raptor_base_id_set *base)
 void
 raptor_free_id_set(raptor_id_set *set) 
 {
-  raptor_base_id_set *base;
+  size_t i;
 
   RAPTOR_ASSERT_OBJECT_POINTER_RETURN(set, raptor_id_set);
 
-  base = set->first;
-  while(base) {
-    raptor_base_id_set *next = base->next;
-    raptor_free_base_id_set(base);
-    base = next;
+  if(set->bases) {
+    for(i = 0; i < set->bases_size; i++) {
+      if(set->bases[i])
+        raptor_free_base_id_set(set->bases[i]);
+    }
+    RAPTOR_FREE(raptor_base_id_set_array, set->bases);
   }
+
+  if(set->arena)
+    raptor_free_arena(set->arena);
+
   RAPTOR_FREE(raptor_id_set, set);
 }
 
 
+/* add a base ID set to a table known to have an empty slot */
+static void
+raptor_id_set_put_base(raptor_base_id_set** bases, size_t size,
+                       raptor_base_id_set* base)
+{
+  size_t mask = size - 1;
+  size_t i;
+
+  for(i = raptor_uri_get_hash(base->uri) & mask; bases[i]; i = (i + 1) & mask)
+    ;
+  bases[i] = base;
+}
+
+
+/*
+ * raptor_id_set_get_base:
+ * @set: #raptor_id_set
+ * @base_uri: base URI
+ *
+ * INTERNAL - Find the base ID set for a base URI, adding it if new
+ *
+ * Return value: base ID set or NULL on failure
+ */
+static raptor_base_id_set*
+raptor_id_set_get_base(raptor_id_set* set, raptor_uri *base_uri)
+{
+  raptor_base_id_set* base;
+  size_t mask;
+  size_t i;
+
+  if(set->last && raptor_uri_equals(set->last->uri, base_uri))
+    return set->last;
+
+  if(set->bases) {
+    mask = set->bases_size - 1;
+    for(i = raptor_uri_get_hash(base_uri) & mask;
+        (base = set->bases[i]);
+        i = (i + 1) & mask) {
+      if(raptor_uri_equals(base->uri, base_uri)) {
+        set->last = base;
+        return base;
+      }
+    }
+  }
+
+  /* a set for this base_uri not found; keep the table at most half full */
+  if((set->bases_count + 1) * 2 > set->bases_size) {
+    size_t new_size = set->bases_size ? set->bases_size * 2 : RAPTOR_ID_SET_INITIAL_BASES;
+    raptor_base_id_set** new_bases;
+
+    new_bases = RAPTOR_CALLOC(raptor_base_id_set**, new_size,
+                              sizeof(raptor_base_id_set*));
+    if(!new_bases)
+      return NULL;
+
+    for(i = 0; i < set->bases_size; i++) {
+      if(set->bases[i])
+        raptor_id_set_put_base(new_bases, new_size, set->bases[i]);
+    }
+    if(set->bases)
+      RAPTOR_FREE(raptor_base_id_set_array, set->bases);
+    set->bases = new_bases;
+    set->bases_size = new_size;
+  }
+
+  base = RAPTOR_CALLOC(raptor_base_id_set*, 1, sizeof(*base));
+  if(!base)
+    return NULL;
+
+  base->uri = raptor_uri_copy(base_uri);
+
+  raptor_id_set_put_base(set->bases, set->bases_size, base);
+  set->bases_count++;
+  set->last = base;
+
+  return base;
+}
+
+
+/*
+ * raptor_base_id_set_grow:
+ * @set: #raptor_id_set
+ * @base: base ID set
+ *
+ * INTERNAL - Double the slots of a base ID set (or make the first ones)
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_base_id_set_grow(raptor_id_set* set, raptor_base_id_set* base)
+{
+  size_t new_size = base->size ? base->size * 2 : RAPTOR_ID_SET_INITIAL_SIZE;
+  size_t mask = new_size - 1;
+  raptor_id_fingerprint* fingerprints;
+  const unsigned char** ids = NULL;
+  size_t i;
+
+  fingerprints = RAPTOR_CALLOC(raptor_id_fingerprint*, new_size,
+                               sizeof(raptor_id_fingerprint));
+  if(!fingerprints)
+    return 1;
+
+  if(set->exact) {
+    ids = RAPTOR_CALLOC(const unsigned char**, new_size,
+                        sizeof(const unsigned char*));
+    if(!ids) {
+      RAPTOR_FREE(raptor_id_fingerprint*, fingerprints);
+      return 1;
+    }
+  }
+
+  for(i = 0; i < base->size; i++) {
+    raptor_id_fingerprint fp = base->fingerprints[i];
+    size_t j;
+
+    if(!fp)
+      continue;
+
+    for(j = (size_t)fp & mask; fingerprints[j]; j = (j + 1) & mask)
+      ;
+    fingerprints[j] = fp;
+    if(ids)
+      ids[j] = base->ids[i];
+  }
+
+  if(base->fingerprints)
+    RAPTOR_FREE(raptor_id_fingerprint*, base->fingerprints);
+  if(base->ids)
+    RAPTOR_FREE(cstringpointer, base->ids);
+
+  base->fingerprints = fingerprints;
+  base->ids = ids;
+  base->size = new_size;
+
+  return 0;
+}
+
 
 /**
  * raptor_id_set_add:
@@ -165,73 +379,59 @@ raptor_id_set_add(raptor_id_set* set, raptor_uri *base_uri,
                   const unsigned char *id, size_t id_len)
 {
   raptor_base_id_set *base;
-  char* item;
+  raptor_id_fingerprint fp;
+  size_t mask;
+  size_t i;
   
   if(!base_uri || !id || !id_len)
     return -1;
 
-  base = set->first;
-  while(base) {
-    if(raptor_uri_equals(base->uri, base_uri))
-      break;
-    base = base->next;
-  }
+  base = raptor_id_set_get_base(set, base_uri);
+  if(!base)
+    return -1;
 
-  if(!base) {
-    /* a set for this base_uri not found */
-    base = RAPTOR_CALLOC(raptor_base_id_set*, 1, sizeof(*base));
-    if(!base)
+  /* keep the table at most 3/4 full */
+  if((base->count + 1) * 4 > base->size * 3) {
+    if(raptor_base_id_set_grow(set, base))
       return -1;
+  }
 
-    base->world = set->world;
-
-    base->uri = raptor_uri_copy(base_uri);
+  fp = raptor_id_set_fingerprint(id, id_len);
+  mask = base->size - 1;
 
-    base->tree = raptor_new_avltree((raptor_data_compare_handler)strcmp,
-                                    free, 0);
-  
-    /* Add to the start of the list */
-    if(set->first)
-      set->first->prev = base;
-    /* base->prev = NULL; */
-    base->next = set->first;
-
-    set->first = base;
-  } else {
-    /* If not at the start of the list, move there */
-    if(base != set->first) {
-      /* remove from the list */
-      base->prev->next = base->next;
-      if(base->next)
-        base->next->prev = base->prev;
-      /* add at the start of the list */
-      set->first->prev = base;
-      base->prev = NULL;
-      base->next = set->first;
-    }
-  }
-  
-  item = (char*)raptor_avltree_search(base->tree, id);
+  for(i = (size_t)fp & mask; base->fingerprints[i]; i = (i + 1) & mask) {
+    if(base->fingerprints[i] != fp)
+      continue;
 
-  /* if already there, error */
-  if(item) {
+    if(!set->exact ||
+       (!memcmp(base->ids[i], id, id_len) && !base->ids[i][id_len])) {
+      /* if already there, error */
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-    set->misses++;
+      set->misses++;
 #endif
-    return 1;
+      return 1;
+    }
   }
-  
+
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
   set->hits++;
 #endif
-  
-  item = RAPTOR_MALLOC(char*, id_len + 1);
-  if(!item)
-    return 1;
 
-  memcpy(item, id, id_len + 1);
+  if(set->exact) {
+    unsigned char* item;
+
+    item = (unsigned char*)raptor_arena_alloc(set->arena, id_len + 1);
+    if(!item)
+      return -1;
+    memcpy(item, id, id_len);
+    item[id_len] = '\0';
+    base->ids[i] = item;
+  }
 
-  return raptor_avltree_add(base->tree, item);
+  base->fingerprints[i] = fp;
+  base->count++;
+
+  return 0;
 }
 
 
@@ -251,64 +451,104 @@ raptor_id_set_stats_print(raptor_id_set* set, FILE *stream) {
 int main(int argc, char *argv[]);
 
 
-int
-main(int argc, char *argv[]) 
+/* number of generated IDs added per base to make the sets grow */
+#define TEST_MANY_IDS 20000
+
+static int
+test_id_set(raptor_world *world, const char *program, int exact)
 {
-  raptor_world *world;
-  const char *program = raptor_basename(argv[0]);
   const char *items[8] = { "ron", "amy", "jen", "bij", "jib", "daj", "jim", NULL };
+  const char *bases[4] = { "http://example.org/base#",
+                           "http://example.org/other#",
+                           "http://example.org/third/", NULL };
+  raptor_uri *base_uris[3];
   raptor_id_set *set;
-  raptor_uri *base_uri;
+  char buffer[32];
+  int b;
   int i = 0;
+  int errors = 0;
   
-  world = raptor_new_world();
-  if(!world || raptor_world_open(world))
-    exit(1);
-    
-  base_uri = raptor_new_uri(world, (const unsigned char*)"http://example.org/base#");
+  for(b = 0; bases[b]; b++)
+    base_uris[b] = raptor_new_uri(world, (const unsigned char*)bases[b]);
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-  fprintf(stderr, "%s: Creating set\n", program);
+  fprintf(stderr, "%s: Creating set (exact %d)\n", program, exact);
 #endif
 
-  set = raptor_new_id_set(world);
+  set = raptor_new_id_set(world, exact);
   if(!set) {
     fprintf(stderr, "%s: Failed to create set\n", program);
     exit(1);
   }
 
-  for(i = 0; items[i]; i++) {
-    size_t len = strlen(items[i]);
-    int rc;
+  /* the same IDs under each base are all different items */
+  for(b = 0; bases[b]; b++) {
+    for(i = 0; items[i]; i++) {
+      size_t len = strlen(items[i]);
+      int rc;
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-    fprintf(stderr, "%s: Adding set item '%s'\n", program, items[i]);
+      fprintf(stderr, "%s: Adding set item '%s'\n", program, items[i]);
 #endif
   
-    rc = raptor_id_set_add(set, base_uri, (const unsigned char*)items[i], len);
-if(rc) {
-      fprintf(stderr, "%s: Adding set item %d '%s' failed, returning error %d\n",
-              program, i, items[i], rc);
-      exit(1);
+      rc = raptor_id_set_add(set, base_uris[b], (const unsigned char*)items[i], len);
+      if(rc) {
+        fprintf(stderr, "%s: Adding set item %d '%s' to base %s failed, returning error %d\n",
+                program, i, items[i], bases[b], rc);
+        errors++;
+      }
     }
   }
 
-  for(i = 0; items[i]; i++) {
-    size_t len = strlen(items[i]);
-    int rc;
+  for(b = 0; bases[b]; b++) {
+    for(i = 0; items[i]; i++) {
+      size_t len = strlen(items[i]);
+      int rc;
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-    fprintf(stderr, "%s: Adding duplicate set item '%s'\n", program, items[i]);
+      fprintf(stderr, "%s: Adding duplicate set item '%s'\n", program, items[i]);
 #endif
 
-    rc = raptor_id_set_add(set, base_uri, (const unsigned char*)items[i], len);
-    if(rc <= 0) {
-      fprintf(stderr, "%s: Adding duplicate set item %d '%s' succeeded, should have failed, returning error %d\n",
-              program, i, items[i], rc);
-      exit(1);
+      rc = raptor_id_set_add(set, base_uris[b], (const unsigned char*)items[i], len);
+      if(rc <= 0) {
+        fprintf(stderr, "%s: Adding duplicate set item %d '%s' to base %s succeeded, should have failed, returning error %d\n",
+                program, i, items[i], bases[b], rc);
+        errors++;
+      }
+    }
+  }
+
+  /* interleave bases while the tables grow */
+  for(i = 0; i < TEST_MANY_IDS; i++) {
+    size_t len = (size_t)sprintf(buffer, "id%d", i);
+
+    for(b = 0; bases[b]; b++) {
+      if(raptor_id_set_add(set, base_uris[b], (const unsigned char*)buffer, len)) {
+        fprintf(stderr, "%s: Adding set item '%s' to base %s failed\n",
+                program, buffer, bases[b]);
+        errors++;
+        break;
+      }
+    }
+  }
+
+  for(i = 0; i < TEST_MANY_IDS; i++) {
+    size_t len = (size_t)sprintf(buffer, "id%d", i);
+
+    if(raptor_id_set_add(set, base_uris[i % 3], (const unsigned char*)buffer, len) <= 0) {
+      fprintf(stderr, "%s: Adding duplicate set item '%s' succeeded, should have failed\n",
+              program, buffer);
+      errors++;
+      break;
     }
   }
 
+  /* a prefix of an ID is a different ID */
+  if(raptor_id_set_add(set, base_uris[0], (const unsigned char*)"ro", 2)) {
+    fprintf(stderr, "%s: Adding set item 'ro' failed\n", program);
+    errors++;
+  }
+
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
   raptor_id_set_stats_print(set, stderr);
 #endif
@@ -318,12 +558,30 @@ if(rc) {
 #endif
   raptor_free_id_set(set);
 
-  raptor_free_uri(base_uri);
+  for(b = 0; bases[b]; b++)
+    raptor_free_uri(base_uris[b]);
+
+  return errors;
+}
+
+
+int
+main(int argc, char *argv[]) 
+{
+  raptor_world *world;
+  const char *program = raptor_basename(argv[0]);
+  int errors = 0;
   
+  world = raptor_new_world();
+  if(!world || raptor_world_open(world))
+    exit(1);
+    
+  errors += test_id_set(world, program, 0);
+  errors += test_id_set(world, program, 1);
+
   raptor_free_world(world);
   
-  /* keep gcc -Wall happy */
-  return(0);
+  return errors ? 1 : 0;
 }
 
 #endif
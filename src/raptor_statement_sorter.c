@@ -0,0 +1,1223 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * raptor_statement_sorter.c - Raptor statement sorter spilling to disk
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <raptor_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SERIALIZER
+
+/* Raptor includes */
+#include "raptor2.h"
+#include "raptor_internal.h"
+
+
+/*
+ * A statement sorter takes statements in any order and gives them
+ * back in raptor_statement_compare() order - by subject, predicate,
+ * object then graph - without duplicates.
+ *
+ * Statements are kept in memory until their estimated size passes
+ * the memory limit.  Then they are sorted and written as a run to a
+ * temporary file from tmpfile().  Without a limit, the statements in
+ * memory are sorted and their duplicates dropped each time they
+ * double in number, so memory stays within about twice that of the
+ * distinct statements.  When reading back, the runs and the
+ * statements still in memory are merged through a binary heap.
+ *
+ * If there are too many runs, the newest runs of the same level are
+ * merged into one run of the next level.  Runs are kept from the
+ * highest level to the lowest so each statement is written about
+ * once per level.
+ *
+ * A run is a sequence of terms for subject, predicate, object and
+ * graph.  Each term is a type byte (0 for none) followed by counted
+ * strings: the URI, the blank node id or, for a literal, the value, a
+ * flags byte and the language and datatype URI when flagged.  Counts
+ * are 7 bits per byte with the high bit set on all but the last byte.
+ */
+
+/* Most runs kept before some are merged */
+#define RAPTOR_STATEMENT_SORTER_MAX_RUNS 64
+
+/* Fewest statements in memory before duplicates are dropped */
+#define RAPTOR_STATEMENT_SORTER_COMPACT_MIN 4096
+
+/* Literal flags in a run */
+#define RAPTOR_STATEMENT_SORTER_LANGUAGE 1
+#define RAPTOR_STATEMENT_SORTER_DATATYPE 2
+
+/* a source of sorted statements: a run or the statements in memory */
+typedef struct {
+  /* run file or NULL for the in-memory statements */
+  FILE* fh;
+  /* next in-memory statement */
+  int offset;
+  /* current statement (a reference is held) or NULL at the end */
+  raptor_statement* statement;
+} raptor_statement_sorter_source;
+
+struct raptor_statement_sorter_s {
+  raptor_world* world;
+
+  /* bytes of statements to hold in memory or 0 for no limit */
+  size_t memory_limit;
+  /* estimated bytes of the statements in @statements */
+  size_t memory_used;
+  /* statements not yet in a run */
+  raptor_sequence* statements;
+  /* without a memory limit, number of statements at which duplicates
+   * are next dropped */
+  int compact_size;
+  /* statements at the start of @statements already sorted without
+   * duplicates */
+  int sorted_count;
+
+  /* run files and their merge levels */
+  FILE** runs;
+  int* runs_levels;
+  int runs_count;
+
+  /* non-0 once reading has started */
+  int reading;
+  /* sources being merged and those with a statement as a binary
+   * heap on their statements
+   */
+  raptor_statement_sorter_source* sources;
+  int sources_count;
+  raptor_statement_sorter_source** heap;
+  int heap_count;
+
+  /* last statement returned (a reference is held) or NULL */
+  raptor_statement* last;
+
+  /* buffer for strings read from runs */
+  unsigned char* buffer;
+  size_t buffer_size;
+
+  /* non-0 if statements could not be read back from a run */
+  int failed;
+};
+
+
+static void raptor_statement_sorter_merge_end(raptor_statement_sorter* sorter);
+
+
+static int
+raptor_statement_sorter_compare(const void* a, const void* b)
+{
+  return raptor_statement_compare(*(raptor_statement* const*)a,
+                                  *(raptor_statement* const*)b);
+}
+
+
+/**
+ * raptor_new_statement_sorter:
+ * @world: raptor world
+ * @memory_limit: estimated bytes of statements to keep in memory before writing a run to a temporary file or 0 for no limit
+ *
+ * INTERNAL - Constructor for a statement sorter
+ *
+ * Return value: new sorter or NULL on failure
+ **/
+raptor_statement_sorter*
+raptor_new_statement_sorter(raptor_world* world, size_t memory_limit)
+{
+  raptor_statement_sorter* sorter;
+
+  sorter = RAPTOR_CALLOC(raptor_statement_sorter*, 1, sizeof(*sorter));
+  if(!sorter)
+    return NULL;
+
+  sorter->world = world;
+  sorter->memory_limit = memory_limit;
+  sorter->compact_size = RAPTOR_STATEMENT_SORTER_COMPACT_MIN;
+  sorter->statements =
+    raptor_new_sequence((raptor_data_free_handler)raptor_free_statement, NULL);
+  if(!sorter->statements) {
+    RAPTOR_FREE(raptor_statement_sorter, sorter);
+    return NULL;
+  }
+
+  return sorter;
+}
+
+
+/**
+ * raptor_free_statement_sorter:
+ * @sorter: sorter
+ *
+ * INTERNAL - Destructor for a statement sorter; removes its temporary files
+ **/
+void
+raptor_free_statement_sorter(raptor_statement_sorter* sorter)
+{
+  int i;
+
+  RAPTOR_ASSERT_OBJECT_POINTER_RETURN(sorter, raptor_statement_sorter);
+
+  raptor_statement_sorter_merge_end(sorter);
+
+  if(sorter->runs) {
+    for(i = 0; i < sorter->runs_count; i++)
+      fclose(sorter->runs[i]);
+    RAPTOR_FREE(FILE**, sorter->runs);
+  }
+  if(sorter->runs_levels)
+    RAPTOR_FREE(int*, sorter->runs_levels);
+
+  if(sorter->last)
+    raptor_free_statement(sorter->last);
+  if(sorter->statements)
+    raptor_free_sequence(sorter->statements);
+  if(sorter->buffer)
+    RAPTOR_FREE(char*, sorter->buffer);
+
+  RAPTOR_FREE(raptor_statement_sorter, sorter);
+}
+
+
+/* estimated bytes used by a term */
+static size_t
+raptor_statement_sorter_term_size(raptor_term* term)
+{
+  size_t size;
+
+  if(!term)
+    return 0;
+
+  size = sizeof(*term);
+  if(term->type == RAPTOR_TERM_TYPE_LITERAL)
+    size += term->value.literal.string_len + 1 +
+            term->value.literal.language_len;
+  else if(term->type == RAPTOR_TERM_TYPE_BLANK)
+    size += term->value.blank.string_len + 1;
+
+  return size;
+}
+
+
+static void
+raptor_statement_sorter_write_string(FILE* fh, const unsigned char* string,
+                                     size_t length)
+{
+  size_t count = length;
+
+  while(count > 0x7f) {
+    putc((int)((count & 0x7f) | 0x80), fh);
+    count >>= 7;
+  }
+  putc((int)count, fh);
+
+  if(length)
+    fwrite(string, 1, length, fh);
+}
+
+
+static void
+raptor_statement_sorter_write_term(FILE* fh, raptor_term* term)
+{
+  const unsigned char* string;
+  size_t length;
+
+  if(!term) {
+    putc(0, fh);
+    return;
+  }
+
+  putc((int)term->type, fh);
+
+  switch(term->type) {
+    case RAPTOR_TERM_TYPE_URI:
+      string = raptor_uri_as_counted_string(term->value.uri, &length);
+      raptor_statement_sorter_write_string(fh, string, length);
+      break;
+
+    case RAPTOR_TERM_TYPE_BLANK:
+      raptor_statement_sorter_write_string(fh, term->value.blank.string,
+                                           term->value.blank.string_len);
+      break;
+
+    case RAPTOR_TERM_TYPE_LITERAL:
+      raptor_statement_sorter_write_string(fh, term->value.literal.string,
+                                           term->value.literal.string_len);
+      putc((term->value.literal.language ?
+            RAPTOR_STATEMENT_SORTER_LANGUAGE : 0) |
+           (term->value.literal.datatype ?
+            RAPTOR_STATEMENT_SORTER_DATATYPE : 0), fh);
+      if(term->value.literal.language)
+        raptor_statement_sorter_write_string(fh,
+                                             term->value.literal.language,
+                                             term->value.literal.language_len);
+      if(term->value.literal.datatype) {
+        string = raptor_uri_as_counted_string(term->value.literal.datatype,
+                                              &length);
+        raptor_statement_sorter_write_string(fh, string, length);
+      }
+      break;
+
+    case RAPTOR_TERM_TYPE_UNKNOWN:
+    default:
+      break;
+  }
+}
+
+
+/*
+ * raptor_statement_sorter_read_string:
+ * @sorter: sorter
+ * @fh: run file
+ * @offset: where to read the string into the sorter buffer
+ * @length_p: pointer to store the string length
+ *
+ * INTERNAL - Read a counted string from a run into the sorter buffer
+ *
+ * The string is NUL terminated.  The buffer may move so strings are
+ * found by offset.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_statement_sorter_read_string(raptor_statement_sorter* sorter,
+                                    FILE* fh, size_t offset,
+                                    size_t* length_p)
+{
+  size_t length = 0;
+  int shift = 0;
+  int c;
+
+  do {
+    c = getc(fh);
+    if(c == EOF || shift > 56)
+      return 1;
+    length |= (size_t)(c & 0x7f) << shift;
+    shift += 7;
+  } while(c & 0x80);
+
+  if(offset + length + 1 > sorter->buffer_size) {
+    size_t size = (offset + length + 1) * 2;
+    unsigned char* buffer;
+
+    buffer = RAPTOR_REALLOC(unsigned char*, sorter->buffer, size);
+    if(!buffer)
+      return 1;
+    sorter->buffer = buffer;
+    sorter->buffer_size = size;
+  }
+
+  if(length && fread(sorter->buffer + offset, 1, length, fh) != length)
+    return 1;
+  sorter->buffer[offset + length] = '\0';
+
+  *length_p = length;
+  return 0;
+}
+
+
+/*
+ * raptor_statement_sorter_read_term:
+ * @sorter: sorter
+ * @fh: run file
+ * @term_p: pointer to store the term or NULL if there is none
+ *
+ * INTERNAL - Read a term from a run
+ *
+ * Return value: <0 on failure, >0 at the end of the run
+ */
+static int
+raptor_statement_sorter_read_term(raptor_statement_sorter* sorter, FILE* fh,
+                                  raptor_term** term_p)
+{
+  raptor_world* world = sorter->world;
+  raptor_uri* datatype = NULL;
+  size_t length;
+  size_t language_len = 0;
+  size_t datatype_len;
+  int flags;
+  int type;
+
+  *term_p = NULL;
+
+  type = getc(fh);
+  if(type == EOF)
+    return 1;
+  if(!type)
+    return 0;
+
+  if(raptor_statement_sorter_read_string(sorter, fh, 0, &length))
+    return -1;
+
+  switch(type) {
+    case RAPTOR_TERM_TYPE_URI:
+      *term_p = raptor_new_term_from_counted_uri_string(world, sorter->buffer,
+                                                        length);
+      break;
+
+    case RAPTOR_TERM_TYPE_BLANK:
+      *term_p = raptor_new_term_from_counted_blank(world, sorter->buffer,
+                                                   length);
+      break;
+
+    case RAPTOR_TERM_TYPE_LITERAL:
+      flags = getc(fh);
+      if(flags == EOF)
+        return -1;
+      if((flags & RAPTOR_STATEMENT_SORTER_LANGUAGE) &&
+         raptor_statement_sorter_read_string(sorter, fh, length + 1,
+                                             &language_len))
+        return -1;
+      if(flags & RAPTOR_STATEMENT_SORTER_DATATYPE) {
+        size_t offset = length + 1 + language_len + 1;
+
+        if(raptor_statement_sorter_read_string(sorter, fh, offset,
+                                               &datatype_len))
+          return -1;
+        datatype = raptor_new_uri_from_counted_string(world,
+                                                      sorter->buffer + offset,
+                                                      datatype_len);
+        if(!datatype)
+          return -1;
+      }
+      *term_p = raptor_new_term_from_counted_literal(world, sorter->buffer,
+                                                     length, datatype,
+                                                     (flags & RAPTOR_STATEMENT_SORTER_LANGUAGE) ? sorter->buffer + length + 1 : NULL,
+                                                     (unsigned char)language_len);
+      if(datatype)
+        raptor_free_uri(datatype);
+      break;
+
+    default:
+      return -1;
+  }
+
+  return *term_p ? 0 : -1;
+}
+
+
+/* read the next statement of a run or NULL at the end or on failure */
+static raptor_statement*
+raptor_statement_sorter_read_statement(raptor_statement_sorter* sorter,
+                                       FILE* fh)
+{
+  raptor_statement* statement;
+  int rc;
+
+  rc = getc(fh);
+  if(rc == EOF) {
+    if(ferror(fh))
+      goto failed;
+    return NULL;
+  }
+  ungetc(rc, fh);
+
+  statement = raptor_new_statement(sorter->world);
+  if(!statement) {
+    sorter->failed = 1;
+    return NULL;
+  }
+
+  rc = raptor_statement_sorter_read_term(sorter, fh, &statement->subject);
+  if(!rc)
+    rc = raptor_statement_sorter_read_term(sorter, fh, &statement->predicate);
+  if(!rc)
+    rc = raptor_statement_sorter_read_term(sorter, fh, &statement->object);
+  if(!rc)
+    rc = raptor_statement_sorter_read_term(sorter, fh, &statement->graph);
+
+  if(rc) {
+    raptor_free_statement(statement);
+    goto failed;
+  }
+
+  return statement;
+
+  failed:
+  raptor_log_error(sorter->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                   "Failed to read statements back from a temporary file");
+  sorter->failed = 1;
+  return NULL;
+}
+
+
+/* advance a source to its next statement */
+static void
+raptor_statement_sorter_source_next(raptor_statement_sorter* sorter,
+                                    raptor_statement_sorter_source* source)
+{
+  if(source->statement)
+    raptor_free_statement(source->statement);
+
+  if(source->fh)
+    source->statement = raptor_statement_sorter_read_statement(sorter,
+                                                               source->fh);
+  else {
+    source->statement =
+      (raptor_statement*)raptor_sequence_get_at(sorter->statements,
+                                                source->offset++);
+    if(source->statement)
+      source->statement = raptor_statement_copy(source->statement);
+  }
+}
+
+
+/* restore the heap order from heap index @i down */
+static void
+raptor_statement_sorter_heap_down(raptor_statement_sorter* sorter, int i)
+{
+  raptor_statement_sorter_source** heap = sorter->heap;
+  int count = sorter->heap_count;
+
+  while(1) {
+    int smallest = i;
+    int child = 2 * i + 1;
+    raptor_statement_sorter_source* tmp;
+
+    if(child < count &&
+       raptor_statement_compare(heap[child]->statement,
+                                heap[smallest]->statement) < 0)
+      smallest = child;
+    child++;
+    if(child < count &&
+       raptor_statement_compare(heap[child]->statement,
+                                heap[smallest]->statement) < 0)
+      smallest = child;
+    if(smallest == i)
+      break;
+
+    tmp = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = tmp;
+    i = smallest;
+  }
+}
+
+
+/*
+ * raptor_statement_sorter_merge_start:
+ * @sorter: sorter
+ * @first: index of the first run to merge
+ * @with_memory: non-0 to merge the in-memory statements with the runs
+ *
+ * INTERNAL - Start merging runs from @first (and statements in memory)
+ *
+ * The in-memory statements must be sorted.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_statement_sorter_merge_start(raptor_statement_sorter* sorter,
+                                    int first, int with_memory)
+{
+  int count = sorter->runs_count - first + (with_memory ? 1 : 0);
+  int i;
+
+  sorter->sources = RAPTOR_CALLOC(raptor_statement_sorter_source*, count + 1,
+                                  sizeof(raptor_statement_sorter_source));
+  sorter->heap = RAPTOR_CALLOC(raptor_statement_sorter_source**, count + 1,
+                               sizeof(raptor_statement_sorter_source*));
+  if(!sorter->sources || !sorter->heap)
+    return 1;
+  sorter->sources_count = count;
+
+  sorter->heap_count = 0;
+  for(i = 0; i < count; i++) {
+    raptor_statement_sorter_source* source = &sorter->sources[i];
+
+    if(first + i < sorter->runs_count) {
+      source->fh = sorter->runs[first + i];
+      rewind(source->fh);
+    }
+
+    raptor_statement_sorter_source_next(sorter, source);
+    if(source->statement)
+      sorter->heap[sorter->heap_count++] = source;
+  }
+
+  for(i = sorter->heap_count / 2 - 1; i >= 0; i--)
+    raptor_statement_sorter_heap_down(sorter, i);
+
+  return 0;
+}
+
+
+/* the next merged statement (a reference is passed) or NULL at the end */
+static raptor_statement*
+raptor_statement_sorter_merge_next(raptor_statement_sorter* sorter)
+{
+  raptor_statement_sorter_source* source;
+  raptor_statement* statement;
+
+  if(!sorter->heap_count)
+    return NULL;
+
+  source = sorter->heap[0];
+  statement = raptor_statement_copy(source->statement);
+
+  raptor_statement_sorter_source_next(sorter, source);
+  if(!source->statement)
+    sorter->heap[0] = sorter->heap[--sorter->heap_count];
+  raptor_statement_sorter_heap_down(sorter, 0);
+
+  return statement;
+}
+
+
+/* stop merging; the sources are at their end or abandoned */
+static void
+raptor_statement_sorter_merge_end(raptor_statement_sorter* sorter)
+{
+  int i;
+
+  if(sorter->sources) {
+    for(i = 0; i < sorter->sources_count; i++) {
+      if(sorter->sources[i].statement)
+        raptor_free_statement(sorter->sources[i].statement);
+    }
+    RAPTOR_FREE(raptor_statement_sorter_source*, sorter->sources);
+    sorter->sources = NULL;
+  }
+  sorter->sources_count = 0;
+
+  if(sorter->heap) {
+    RAPTOR_FREE(raptor_statement_sorter_source**, sorter->heap);
+    sorter->heap = NULL;
+  }
+  sorter->heap_count = 0;
+}
+
+
+/* new run file or NULL on failure */
+static FILE*
+raptor_statement_sorter_new_run(raptor_statement_sorter* sorter)
+{
+  FILE* fh;
+
+  fh = tmpfile();
+  if(!fh) {
+    raptor_log_error(sorter->world, RAPTOR_LOG_LEVEL_WARN, NULL,
+                     "Failed to create a temporary file for sorting statements; keeping them in memory");
+    return NULL;
+  }
+
+  return fh;
+}
+
+
+/* flush a written run, closing it on failure */
+static int
+raptor_statement_sorter_end_run(raptor_statement_sorter* sorter, FILE* fh)
+{
+  if(fflush(fh) || ferror(fh)) {
+    raptor_log_error(sorter->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                     "Failed to write statements to a temporary file");
+    fclose(fh);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+static void
+raptor_statement_sorter_write_statement(FILE* fh, raptor_statement* statement)
+{
+  raptor_statement_sorter_write_term(fh, statement->subject);
+  raptor_statement_sorter_write_term(fh, statement->predicate);
+  raptor_statement_sorter_write_term(fh, statement->object);
+  raptor_statement_sorter_write_term(fh, statement->graph);
+}
+
+
+/* merge the newest runs of the lowest level into one run */
+static int
+raptor_statement_sorter_merge_runs(raptor_statement_sorter* sorter)
+{
+  raptor_statement* statement;
+  raptor_statement* last = NULL;
+  FILE* fh;
+  int first;
+  int level;
+  int i;
+
+  first = sorter->runs_count - 1;
+  level = sorter->runs_levels[first];
+  while(first > 0 && sorter->runs_levels[first - 1] == level)
+    first--;
+  if(sorter->runs_count - first < 2)
+    /* too few runs on the lowest level; merge all */
+    first = 0;
+
+  fh = raptor_statement_sorter_new_run(sorter);
+  if(!fh)
+    return 1;
+
+  if(raptor_statement_sorter_merge_start(sorter, first, 0)) {
+    raptor_statement_sorter_merge_end(sorter);
+    fclose(fh);
+    return 1;
+  }
+
+  while((statement = raptor_statement_sorter_merge_next(sorter))) {
+    if(last && !raptor_statement_compare(last, statement)) {
+      raptor_free_statement(statement);
+      continue;
+    }
+    raptor_statement_sorter_write_statement(fh, statement);
+    if(last)
+      raptor_free_statement(last);
+    last = statement;
+  }
+  if(last)
+    raptor_free_statement(last);
+  raptor_statement_sorter_merge_end(sorter);
+
+  if(sorter->failed) {
+    fclose(fh);
+    return 1;
+  }
+
+  if(raptor_statement_sorter_end_run(sorter, fh))
+    return 1;
+
+  level = sorter->runs_levels[first] + 1;
+  for(i = first; i < sorter->runs_count; i++)
+    fclose(sorter->runs[i]);
+  sorter->runs[first] = fh;
+  sorter->runs_levels[first] = level;
+  sorter->runs_count = first + 1;
+
+  return 0;
+}
+
+
+/* sort the statements in memory and write them as a run */
+static int
+raptor_statement_sorter_spill(raptor_statement_sorter* sorter)
+{
+  raptor_statement* statement;
+  raptor_statement* last = NULL;
+  FILE* fh;
+  int i;
+
+  if(!sorter->runs) {
+    sorter->runs = RAPTOR_CALLOC(FILE**, RAPTOR_STATEMENT_SORTER_MAX_RUNS,
+                                 sizeof(FILE*));
+    sorter->runs_levels = RAPTOR_CALLOC(int*, RAPTOR_STATEMENT_SORTER_MAX_RUNS,
+                                        sizeof(int));
+    if(!sorter->runs || !sorter->runs_levels)
+      return 1;
+  }
+
+  if(sorter->runs_count == RAPTOR_STATEMENT_SORTER_MAX_RUNS &&
+     raptor_statement_sorter_merge_runs(sorter))
+    return 1;
+
+  fh = raptor_statement_sorter_new_run(sorter);
+  if(!fh)
+    return 1;
+
+  raptor_sequence_sort(sorter->statements, raptor_statement_sorter_compare);
+  for(i = 0;
+      (statement = (raptor_statement*)raptor_sequence_get_at(sorter->statements, i));
+      i++) {
+    if(last && !raptor_statement_compare(last, statement))
+      continue;
+    raptor_statement_sorter_write_statement(fh, statement);
+    last = statement;
+  }
+
+  if(raptor_statement_sorter_end_run(sorter, fh))
+    return 1;
+  sorter->runs[sorter->runs_count] = fh;
+  sorter->runs_levels[sorter->runs_count] = 0;
+  sorter->runs_count++;
+
+  raptor_free_sequence(sorter->statements);
+  sorter->statements =
+    raptor_new_sequence((raptor_data_free_handler)raptor_free_statement, NULL);
+  sorter->memory_used = 0;
+  sorter->sorted_count = 0;
+
+  return (sorter->statements == NULL);
+}
+
+
+/*
+ * raptor_statement_sorter_compact:
+ * @sorter: sorter
+ *
+ * INTERNAL - Sort the statements in memory and drop their duplicates
+ *
+ * Only the statements added since the last call are sorted; they are
+ * then merged with the earlier ones which are already in order.
+ *
+ * Return value: non-0 on failure, leaving the statements unchanged
+ */
+static int
+raptor_statement_sorter_compact(raptor_statement_sorter* sorter)
+{
+  raptor_sequence* seq = sorter->statements;
+  raptor_statement** items;
+  raptor_statement** merged;
+  raptor_statement* last = NULL;
+  int size = raptor_sequence_size(seq);
+  int sorted = sorter->sorted_count;
+  int i, j, count;
+
+  if(sorted == size)
+    return 0;
+
+  items = RAPTOR_MALLOC(raptor_statement**, sizeof(*items) * (size_t)size);
+  merged = RAPTOR_MALLOC(raptor_statement**, sizeof(*merged) * (size_t)size);
+  if(!items || !merged) {
+    if(items)
+      RAPTOR_FREE(raptor_statement**, items);
+    if(merged)
+      RAPTOR_FREE(raptor_statement**, merged);
+    return 1;
+  }
+
+  for(i = 0; i < size; i++)
+    items[i] = (raptor_statement*)raptor_sequence_delete_at(seq, i);
+
+  qsort(items + sorted, (size_t)(size - sorted), sizeof(*items),
+        raptor_statement_sorter_compare);
+
+  for(i = 0, j = sorted, count = 0; i < sorted || j < size; ) {
+    raptor_statement* statement;
+
+    if(j == size ||
+       (i < sorted && raptor_statement_compare(items[i], items[j]) <= 0))
+      statement = items[i++];
+    else
+      statement = items[j++];
+
+    if(last && !raptor_statement_compare(last, statement)) {
+      raptor_free_statement(statement);
+      continue;
+    }
+    merged[count++] = last = statement;
+  }
+
+  /* the sequence holds only NULLs now so nothing is freed */
+  for(i = 0; i < count; i++)
+    raptor_sequence_set_at(seq, i, merged[i]);
+  while(raptor_sequence_size(seq) > count)
+    raptor_sequence_pop(seq);
+
+  sorter->sorted_count = count;
+
+  RAPTOR_FREE(raptor_statement**, items);
+  RAPTOR_FREE(raptor_statement**, merged);
+
+  return 0;
+}
+
+
+/**
+ * raptor_statement_sorter_add:
+ * @sorter: sorter
+ * @statement: statement
+ *
+ * INTERNAL - Add a statement to a sorter
+ *
+ * The statement is copied.  Statements cannot be added once
+ * raptor_statement_sorter_next() has been called.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+raptor_statement_sorter_add(raptor_statement_sorter* sorter,
+                            raptor_statement* statement)
+{
+  raptor_statement* s;
+
+  if(sorter->reading)
+    return 1;
+
+  s = raptor_statement_copy(statement);
+  if(!s)
+    return 1;
+  if(raptor_sequence_push(sorter->statements, s))
+    return 1;
+
+  if(!sorter->memory_limit) {
+    if(raptor_sequence_size(sorter->statements) >= sorter->compact_size) {
+      /* on failure try again after as many more statements */
+      raptor_statement_sorter_compact(sorter);
+      sorter->compact_size = raptor_sequence_size(sorter->statements) << 1;
+      if(sorter->compact_size < RAPTOR_STATEMENT_SORTER_COMPACT_MIN)
+        sorter->compact_size = RAPTOR_STATEMENT_SORTER_COMPACT_MIN;
+    }
+    return 0;
+  }
+
+  sorter->memory_used += sizeof(*s) + sizeof(void*) +
+                         raptor_statement_sorter_term_size(s->subject) +
+                         raptor_statement_sorter_term_size(s->predicate) +
+                         raptor_statement_sorter_term_size(s->object) +
+                         raptor_statement_sorter_term_size(s->graph);
+
+  if(sorter->memory_used >= sorter->memory_limit &&
+     raptor_statement_sorter_spill(sorter)) {
+    if(!sorter->statements || sorter->failed)
+      return 1;
+    /* keep the rest in memory */
+    sorter->memory_limit = 0;
+  }
+
+  return 0;
+}
+
+
+/**
+ * raptor_statement_sorter_next:
+ * @sorter: sorter
+ *
+ * INTERNAL - Get the next statement of a sorter in order
+ *
+ * The first call ends adding statements.  The statement returned is
+ * owned by the sorter and valid until the next call; use
+ * raptor_statement_copy() to keep it longer.
+ *
+ * Return value: statement or NULL when there are no more or on
+ * failure - see raptor_statement_sorter_failed()
+ **/
+raptor_statement*
+raptor_statement_sorter_next(raptor_statement_sorter* sorter)
+{
+  raptor_statement* statement;
+
+  if(!sorter->reading) {
+    sorter->reading = 1;
+    if(raptor_statement_sorter_compact(sorter))
+      raptor_sequence_sort(sorter->statements, raptor_statement_sorter_compare);
+    if(raptor_statement_sorter_merge_start(sorter, 0, 1)) {
+      raptor_statement_sorter_merge_end(sorter);
+      sorter->failed = 1;
+      return NULL;
+    }
+  }
+
+  while((statement = raptor_statement_sorter_merge_next(sorter))) {
+    if(!sorter->last || raptor_statement_compare(sorter->last, statement))
+      break;
+    /* drop a duplicate */
+    raptor_free_statement(statement);
+  }
+
+  if(sorter->last)
+    raptor_free_statement(sorter->last);
+  sorter->last = statement;
+
+  return statement;
+}
+
+
+
+/**
+ * raptor_statement_sorter_failed:
+ * @sorter: sorter
+ *
+ * INTERNAL - Check if a sorter failed to give back all its statements
+ *
+ * raptor_statement_sorter_next() returns NULL both at the end and
+ * when statements cannot be read back from a temporary file.
+ *
+ * Return value: non-0 if statements were lost
+ **/
+int
+raptor_statement_sorter_failed(raptor_statement_sorter* sorter)
+{
+  return sorter->failed;
+}
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+#define TEST_STATEMENTS_COUNT 5000
+
+static raptor_statement*
+test_make_statement(raptor_world* world, int i)
+{
+  char buffer[64];
+  raptor_statement* statement;
+
+  statement = raptor_new_statement(world);
+  if(!statement)
+    return NULL;
+
+  /* subjects repeat and come out of order */
+  if(i % 3) {
+    sprintf(buffer, "http://example.org/s%d", (i * 7919) % 1000);
+    statement->subject =
+      raptor_new_term_from_uri_string(world, (const unsigned char*)buffer);
+  } else {
+    sprintf(buffer, "b%d", (i * 7919) % 500);
+    statement->subject =
+      raptor_new_term_from_blank(world, (const unsigned char*)buffer);
+  }
+  sprintf(buffer, "http://example.org/p%d", i % 7);
+  statement->predicate =
+    raptor_new_term_from_uri_string(world, (const unsigned char*)buffer);
+  sprintf(buffer, "value %d", i % 1250);
+  if(i % 2)
+    statement->object =
+      raptor_new_term_from_literal(world, (const unsigned char*)buffer, NULL,
+                                   (const unsigned char*)"en");
+  else {
+    raptor_uri* datatype;
+
+    datatype = raptor_new_uri(world,
+                              (const unsigned char*)"http://example.org/dt");
+    statement->object =
+      raptor_new_term_from_literal(world, (const unsigned char*)buffer,
+                                   datatype, NULL);
+    raptor_free_uri(datatype);
+  }
+  if(i % 5 == 0)
+    statement->graph =
+      raptor_new_term_from_uri_string(world,
+                                      (const unsigned char*)"http://example.org/g");
+
+  return statement;
+}
+
+
+static int
+test_sorter(const char* program, raptor_world* world, size_t memory_limit,
+            raptor_avltree* expected, int expect_runs)
+{
+  raptor_statement_sorter* sorter;
+  raptor_avltree_iterator* iter;
+  raptor_statement* statement;
+  int failures = 0;
+  int count = 0;
+  int i;
+
+  sorter = raptor_new_statement_sorter(world, memory_limit);
+  if(!sorter)
+    return 1;
+
+  for(i = 0; i < TEST_STATEMENTS_COUNT; i++) {
+    statement = test_make_statement(world, i);
+    if(!statement || raptor_statement_sorter_add(sorter, statement)) {
+      fprintf(stderr, "%s: Failed to add statement %d\n", program, i);
+      raptor_free_statement(statement);
+      raptor_free_statement_sorter(sorter);
+      return 1;
+    }
+    raptor_free_statement(statement);
+  }
+
+  if(expect_runs && sorter->runs_count < 2) {
+    fprintf(stderr, "%s: Memory limit %d made %d runs, expected several\n",
+            program, (int)memory_limit, sorter->runs_count);
+    failures++;
+  }
+
+  iter = raptor_new_avltree_iterator(expected, NULL, NULL, 1);
+  while((statement = raptor_statement_sorter_next(sorter))) {
+    raptor_statement* expected_statement = NULL;
+
+    if(iter)
+      expected_statement = (raptor_statement*)raptor_avltree_iterator_get(iter);
+    if(!expected_statement ||
+       !raptor_statement_equals(statement, expected_statement)) {
+      fprintf(stderr, "%s: Memory limit %d statement %d is wrong\n",
+              program, (int)memory_limit, count);
+      failures++;
+      break;
+    }
+    count++;
+    if(raptor_avltree_iterator_next(iter)) {
+      raptor_free_avltree_iterator(iter);
+      iter = NULL;
+    }
+  }
+  if(iter)
+    raptor_free_avltree_iterator(iter);
+
+  if(!failures && count != raptor_avltree_size(expected)) {
+    fprintf(stderr, "%s: Memory limit %d returned %d statements, expected %d\n",
+            program, (int)memory_limit, count, raptor_avltree_size(expected));
+    failures++;
+  }
+
+  raptor_free_statement_sorter(sorter);
+
+  return failures;
+}
+
+
+/* duplicates without a memory limit are dropped while adding */
+static int
+test_sorter_duplicates(const char* program, raptor_world* world,
+                       raptor_avltree* expected)
+{
+  raptor_statement_sorter* sorter;
+  raptor_statement* statement;
+  int unique = raptor_avltree_size(expected);
+  int most = 0;
+  int failures = 0;
+  int count = 0;
+  int i;
+
+  sorter = raptor_new_statement_sorter(world, 0);
+  if(!sorter)
+    return 1;
+
+  for(i = 0; i < 10 * TEST_STATEMENTS_COUNT; i++) {
+    statement = test_make_statement(world, i % TEST_STATEMENTS_COUNT);
+    if(!statement || raptor_statement_sorter_add(sorter, statement)) {
+      fprintf(stderr, "%s: Failed to add statement %d\n", program, i);
+      raptor_free_statement(statement);
+      raptor_free_statement_sorter(sorter);
+      return 1;
+    }
+    raptor_free_statement(statement);
+    if(raptor_sequence_size(sorter->statements) > most)
+      most = raptor_sequence_size(sorter->statements);
+  }
+
+  if(most > 2 * unique && most > RAPTOR_STATEMENT_SORTER_COMPACT_MIN) {
+    fprintf(stderr, "%s: Held %d statements for %d distinct ones\n",
+            program, most, unique);
+    failures++;
+  }
+
+  while(raptor_statement_sorter_next(sorter))
+    count++;
+  if(count != unique) {
+    fprintf(stderr, "%s: Returned %d statements from duplicates, expected %d\n",
+            program, count, unique);
+    failures++;
+  }
+
+  raptor_free_statement_sorter(sorter);
+
+  return failures;
+}
+
+
+static void
+test_discard_log(void* user_data, raptor_log_message* message)
+{
+  (*(int*)user_data)++;
+}
+
+
+/* a run that cannot be read back fails rather than ending early */
+static int
+test_sorter_read_failure(const char* program, raptor_world* world)
+{
+  raptor_statement_sorter* sorter;
+  raptor_statement* statement;
+  int errors = 0;
+  int failures = 0;
+  int i;
+
+  sorter = raptor_new_statement_sorter(world, 100000);
+  if(!sorter)
+    return 1;
+
+  for(i = 0; i < TEST_STATEMENTS_COUNT; i++) {
+    statement = test_make_statement(world, i);
+    if(!statement || raptor_statement_sorter_add(sorter, statement)) {
+      raptor_free_statement(statement);
+      raptor_free_statement_sorter(sorter);
+      return 1;
+    }
+    raptor_free_statement(statement);
+  }
+  if(!sorter->runs_count) {
+    raptor_free_statement_sorter(sorter);
+    return 1;
+  }
+
+  /* an unknown term type at the start of the first run */
+  rewind(sorter->runs[0]);
+  fputc(0x7f, sorter->runs[0]);
+  fflush(sorter->runs[0]);
+
+  raptor_world_set_log_handler(world, &errors, test_discard_log);
+  while(raptor_statement_sorter_next(sorter))
+    ;
+  raptor_world_set_log_handler(world, NULL, NULL);
+
+  if(!raptor_statement_sorter_failed(sorter) || !errors) {
+    fprintf(stderr, "%s: Reading a corrupt run did not fail\n", program);
+    failures++;
+  }
+
+  raptor_free_statement_sorter(sorter);
+
+  return failures;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = raptor_basename(argv[0]);
+  raptor_world *world;
+  raptor_avltree* expected;
+  int failures = 0;
+  int i;
+
+  world = raptor_new_world();
+  if(!world || raptor_world_open(world))
+    exit(1);
+
+  /* the sorted statements without duplicates */
+  expected = raptor_new_avltree((raptor_data_compare_handler)raptor_statement_compare,
+                                (raptor_data_free_handler)raptor_free_statement,
+                                0);
+  for(i = 0; i < TEST_STATEMENTS_COUNT; i++)
+    raptor_avltree_add(expected, test_make_statement(world, i));
+
+  /* in memory */
+  failures += test_sorter(program, world, 0, expected, 0);
+  /* a few runs */
+  failures += test_sorter(program, world, 100000, expected, 1);
+  /* enough runs to merge runs while adding */
+  failures += test_sorter(program, world, 2000, expected, 1);
+  failures += test_sorter_duplicates(program, world, expected);
+  failures += test_sorter_read_failure(program, world);
+
+  raptor_free_avltree(expected);
+  raptor_free_world(world);
+
+  return failures;
+}
+
+#endif /* STANDALONE */
@@ -32,6 +32,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_TERM
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -413,7 +415,9 @@ raptor_new_term_from_counted_string(raptor_world* world,
   locator.line = -1;
 
   bytes_read = raptor_ntriples_parse_term(world, &locator,
-                                          string, &length, &term, 1);
+                                          string, &length, &term,
+                                          RAPTOR_NTRIPLES_TERM_ALLOW_TURTLE,
+                                          NULL);
 
   if(!bytes_read || length != 0) {
     if(term)
@@ -431,6 +435,10 @@ raptor_new_term_from_counted_string(raptor_world* world,
  *
  * Copy constructor - get a copy of a statement term
  *
+ * Terms passed to a statement handler by a parser using
+ * #RAPTOR_OPTION_PARSE_ARENA are only valid during the call; the
+ * copy returned for them is a new term that can be kept.
+ *
  * Return value: new term object or NULL on failure
  */
 raptor_term*
@@ -439,7 +447,37 @@ raptor_term_copy(raptor_term* term)
   if(!term)
     return NULL;
 
-  term->usage++;
+  /* owned by an arena - not usage counted */
+  if(term->usage < 0) {
+    switch(term->type) {
+      case RAPTOR_TERM_TYPE_URI:
+        return raptor_new_term_from_uri(term->world, term->value.uri);
+
+      case RAPTOR_TERM_TYPE_LITERAL:
+        return raptor_new_term_from_counted_literal(term->world,
+                                                    term->value.literal.string,
+                                                    term->value.literal.string_len,
+                                                    term->value.literal.datatype,
+                                                    term->value.literal.language,
+                                                    term->value.literal.language_len);
+
+      case RAPTOR_TERM_TYPE_BLANK:
+        return raptor_new_term_from_counted_blank(term->world,
+                                                  term->value.blank.string,
+                                                  term->value.blank.string_len);
+
+      case RAPTOR_TERM_TYPE_UNKNOWN:
+      default:
+        return NULL;
+    }
+  }
+
+#ifdef RAPTOR_THREAD_SAFE_WORLD
+  if(term->world->thread_safe)
+    RAPTOR_ATOMIC_INCREMENT(&term->usage);
+  else
+#endif
+    term->usage++;
   return term;
 }
 
@@ -456,7 +494,17 @@ raptor_free_term(raptor_term *term)
 {
   if(!term)
     return;
+
+  /* owned by an arena - freed when it is reset */
+  if(term->usage < 0)
+    return;
   
+#ifdef RAPTOR_THREAD_SAFE_WORLD
+  if(term->world->thread_safe) {
+    if(RAPTOR_ATOMIC_DECREMENT(&term->usage))
+      return;
+  } else
+#endif
   if(--term->usage)
     return;
   
@@ -780,6 +828,177 @@ static unsigned int bnodeid1_len = 6; /* strlen(bnode_id1) */
 static raptor_term_type bnodeid1_type = RAPTOR_TERM_TYPE_BLANK;
 static const unsigned char* language1 = (const unsigned char*)"en";
 
+
+/* allocator that counts the blocks it has handed out and tags each
+ * with a header so that freeing memory it did not allocate is seen */
+struct test_allocations {
+  int outstanding;
+  int foreign;
+};
+
+#define TEST_ALLOC_MAGIC 0x52415054UL
+#define TEST_ALLOC_HEADER_SIZE 16
+
+static void*
+test_malloc(void* user_data, size_t size)
+{
+  unsigned char* p = (unsigned char*)malloc(TEST_ALLOC_HEADER_SIZE + size);
+
+  if(!p)
+    return NULL;
+  ((struct test_allocations*)user_data)->outstanding++;
+  *(unsigned long*)p = TEST_ALLOC_MAGIC;
+  return p + TEST_ALLOC_HEADER_SIZE;
+}
+
+static int
+test_allocated(void* user_data, void* ptr)
+{
+  unsigned char* p = (unsigned char*)ptr - TEST_ALLOC_HEADER_SIZE;
+
+  if(*(unsigned long*)p == TEST_ALLOC_MAGIC)
+    return 1;
+  ((struct test_allocations*)user_data)->foreign++;
+  return 0;
+}
+
+static void*
+test_realloc(void* user_data, void* ptr, size_t size)
+{
+  unsigned char* p;
+
+  if(!ptr)
+    return test_malloc(user_data, size);
+  if(!test_allocated(user_data, ptr))
+    return NULL;
+  p = (unsigned char*)realloc((unsigned char*)ptr - TEST_ALLOC_HEADER_SIZE,
+                              TEST_ALLOC_HEADER_SIZE + size);
+  return p ? p + TEST_ALLOC_HEADER_SIZE : NULL;
+}
+
+static void
+test_free(void* user_data, void* ptr)
+{
+  if(!ptr || !test_allocated(user_data, ptr))
+    return;
+  ((struct test_allocations*)user_data)->outstanding--;
+  free((unsigned char*)ptr - TEST_ALLOC_HEADER_SIZE);
+}
+
+
+static void
+test_count_log(void* user_data, raptor_log_message* message)
+{
+  (*(int*)user_data)++;
+}
+
+
+static int
+test_allocator(const char* program)
+{
+  raptor_world *world;
+  raptor_allocator allocator;
+  raptor_memory_counters counters;
+  raptor_term* term;
+  raptor_parser* parser;
+  raptor_uri* base_uri;
+  struct test_allocations allocations = { 0, 0 };
+  int errors = 0;
+  int rc = 0;
+
+  memset(&allocator, '\0', sizeof(allocator));
+  allocator.user_data = &allocations;
+  allocator.malloc_handler = test_malloc;
+  allocator.realloc_handler = test_realloc;
+  allocator.free_handler = test_free;
+
+  world = raptor_new_world();
+  if(!world)
+    return 1;
+
+  if(raptor_world_set_allocator(world, &allocator)) {
+    fprintf(stderr, "%s: raptor_world_set_allocator() failed\n", program);
+    raptor_free_world(world);
+    return 1;
+  }
+  raptor_world_set_flag(world, RAPTOR_WORLD_FLAG_MEMORY_COUNTERS, 1);
+  raptor_world_set_log_handler(world, &errors, test_count_log);
+  if(raptor_world_open(world))
+    exit(1);
+
+  if(!raptor_world_set_allocator(world, NULL)) {
+    fprintf(stderr, "%s: raptor_world_set_allocator() succeeded on an open world\n", program);
+    rc = 1;
+  }
+
+  term = raptor_new_term_from_counted_literal(world, literal_string1,
+                                              literal_string1_len,
+                                              NULL, language1, 2);
+  if(!term || !allocations.outstanding) {
+    fprintf(stderr, "%s: term was not made with the allocator\n", program);
+    rc = 1;
+  }
+  raptor_free_term(term);
+
+  if(raptor_world_get_memory_counters(world, RAPTOR_DOMAIN_TERM, &counters) ||
+     counters.allocations < 3 || counters.frees < 3 ||
+     counters.bytes < literal_string1_len + 1) {
+    fprintf(stderr, "%s: term memory counted %lu allocations %lu frees %lu bytes\n",
+            program, counters.allocations, counters.frees,
+            (unsigned long)counters.bytes);
+    rc = 1;
+  }
+
+  /* the formatted error message must come from the allocator too */
+  if(raptor_world_is_parser_name(world, "ntriples")) {
+    static const char bad_line[] = "<http://example.org/s> <bad\n";
+
+    parser = raptor_new_parser(world, "ntriples");
+    base_uri = raptor_new_uri(world, (const unsigned char*)"http://example.org/");
+    if(!parser || !base_uri ||
+       raptor_parser_parse_start(parser, base_uri)) {
+      fprintf(stderr, "%s: parser could not be made with the allocator\n",
+              program);
+      rc = 1;
+    } else {
+      raptor_parser_parse_chunk(parser, (const unsigned char*)bad_line,
+                                sizeof(bad_line) - 1, 1);
+      if(!errors) {
+        fprintf(stderr, "%s: parsing '%s' logged no error\n", program,
+                bad_line);
+        rc = 1;
+      }
+    }
+    if(parser)
+      raptor_free_parser(parser);
+    if(base_uri)
+      raptor_free_uri(base_uri);
+  }
+
+  raptor_free_world(world);
+
+  if(allocations.outstanding) {
+    fprintf(stderr, "%s: %d blocks from the allocator were not freed\n",
+            program, allocations.outstanding);
+    rc = 1;
+  }
+
+  if(allocations.foreign) {
+    fprintf(stderr, "%s: %d blocks not from the allocator were freed with it\n",
+            program, allocations.foreign);
+    rc = 1;
+  }
+
+  /* back to the C library */
+  world = raptor_new_world();
+  if(!world || raptor_world_set_allocator(world, NULL))
+    rc = 1;
+  raptor_free_world(world);
+
+  return rc;
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -1033,6 +1252,9 @@ main(int argc, char *argv[])
   
   raptor_free_world(world);
 
+  if(!rc)
+    rc = test_allocator(program);
+
   return rc;
 }
 
@@ -0,0 +1,764 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * raptor_thread.c - Raptor mutexes and worker thread pool
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <raptor_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* Raptor includes */
+#include "raptor2.h"
+#include "raptor_internal.h"
+
+
+/*
+ * Without POSIX threads a mutex does nothing and a thread pool runs
+ * each task on the calling thread when it is submitted.  Callers do
+ * not need to know which they got.
+ */
+
+struct raptor_mutex_s {
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t mutex;
+#else
+  int unused;
+#endif
+};
+
+
+struct raptor_thread_pool_s {
+  /* tasks waiting for a thread */
+  raptor_thread_task* queue_head;
+  raptor_thread_task* queue_tail;
+
+  /* finished tasks not yet collected, in completion order */
+  raptor_thread_task* done_head;
+  raptor_thread_task* done_tail;
+
+  /* number of submitted tasks not yet collected */
+  int outstanding;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t mutex;
+  /* signalled when a task is queued or the pool is shutting down */
+  pthread_cond_t work_cond;
+  /* signalled when a task finishes */
+  pthread_cond_t done_cond;
+
+  pthread_t* threads;
+  int threads_count;
+
+  /* non-0 when the mutex and conditions above were initialised */
+  int locking;
+
+  int shutdown;
+#endif
+};
+
+
+/**
+ * raptor_new_mutex:
+ *
+ * INTERNAL - Constructor - create a mutex
+ *
+ * Return value: new mutex or NULL on failure
+ */
+raptor_mutex*
+raptor_new_mutex(void)
+{
+  raptor_mutex* mutex;
+
+  mutex = RAPTOR_CALLOC(raptor_mutex*, 1, sizeof(*mutex));
+  if(!mutex)
+    return NULL;
+
+#ifdef HAVE_PTHREAD_H
+  if(pthread_mutex_init(&mutex->mutex, NULL)) {
+    RAPTOR_FREE(raptor_mutex, mutex);
+    return NULL;
+  }
+#endif
+
+  return mutex;
+}
+
+
+/**
+ * raptor_free_mutex:
+ * @mutex: mutex (or NULL)
+ *
+ * INTERNAL - Destructor - destroy a mutex
+ */
+void
+raptor_free_mutex(raptor_mutex* mutex)
+{
+  if(!mutex)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&mutex->mutex);
+#endif
+  RAPTOR_FREE(raptor_mutex, mutex);
+}
+
+
+/**
+ * raptor_mutex_lock:
+ * @mutex: mutex
+ *
+ * INTERNAL - Lock a mutex
+ */
+void
+raptor_mutex_lock(raptor_mutex* mutex)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+
+/**
+ * raptor_mutex_unlock:
+ * @mutex: mutex
+ *
+ * INTERNAL - Unlock a mutex
+ */
+void
+raptor_mutex_unlock(raptor_mutex* mutex)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+
+/* add a finished task to the done list; called with the pool locked */
+static void
+raptor_thread_pool_add_done(raptor_thread_pool* pool,
+                            raptor_thread_task* task)
+{
+  task->state = RAPTOR_THREAD_TASK_DONE;
+  task->next = NULL;
+  if(pool->done_tail)
+    pool->done_tail->next = task;
+  else
+    pool->done_head = task;
+  pool->done_tail = task;
+}
+
+
+/* remove a finished task from the done list; called with the pool locked */
+static void
+raptor_thread_pool_remove_done(raptor_thread_pool* pool,
+                               raptor_thread_task* task)
+{
+  raptor_thread_task* prev = NULL;
+  raptor_thread_task* t;
+
+  for(t = pool->done_head; t; prev = t, t = t->next) {
+    if(t != task)
+      continue;
+
+    if(prev)
+      prev->next = t->next;
+    else
+      pool->done_head = t->next;
+    if(pool->done_tail == t)
+      pool->done_tail = prev;
+    break;
+  }
+
+  task->next = NULL;
+  task->state = RAPTOR_THREAD_TASK_IDLE;
+  pool->outstanding--;
+}
+
+
+#ifdef HAVE_PTHREAD_H
+static void*
+raptor_thread_pool_worker(void* arg)
+{
+  raptor_thread_pool* pool = (raptor_thread_pool*)arg;
+
+  pthread_mutex_lock(&pool->mutex);
+  while(1) {
+    raptor_thread_task* task;
+
+    while(!pool->queue_head && !pool->shutdown)
+      pthread_cond_wait(&pool->work_cond, &pool->mutex);
+
+    task = pool->queue_head;
+    if(!task)
+      /* shutting down and nothing left to do */
+      break;
+
+    pool->queue_head = task->next;
+    if(!pool->queue_head)
+      pool->queue_tail = NULL;
+
+    pthread_mutex_unlock(&pool->mutex);
+    task->handler(task->user_data);
+    pthread_mutex_lock(&pool->mutex);
+
+    raptor_thread_pool_add_done(pool, task);
+    pthread_cond_broadcast(&pool->done_cond);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+#endif
+
+
+/**
+ * raptor_new_thread_pool:
+ * @threads: number of worker threads
+ *
+ * INTERNAL - Constructor - create a pool of worker threads
+ *
+ * If @threads is less than 1 or threads are not available, tasks
+ * are run on the calling thread when they are submitted.
+ *
+ * Return value: new thread pool or NULL on failure
+ */
+raptor_thread_pool*
+raptor_new_thread_pool(int threads)
+{
+  raptor_thread_pool* pool;
+#ifdef HAVE_PTHREAD_H
+  int i;
+#endif
+
+  pool = RAPTOR_CALLOC(raptor_thread_pool*, 1, sizeof(*pool));
+  if(!pool)
+    return NULL;
+
+#ifdef HAVE_PTHREAD_H
+  if(threads < 1)
+    return pool;
+
+  if(pthread_mutex_init(&pool->mutex, NULL)) {
+    RAPTOR_FREE(raptor_thread_pool, pool);
+    return NULL;
+  }
+  pthread_cond_init(&pool->work_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+  pool->locking = 1;
+
+  pool->threads = RAPTOR_CALLOC(pthread_t*, (size_t)threads,
+                                sizeof(pthread_t));
+  if(!pool->threads) {
+    raptor_free_thread_pool(pool);
+    return NULL;
+  }
+
+  for(i = 0; i < threads; i++) {
+    if(pthread_create(&pool->threads[i], NULL, raptor_thread_pool_worker,
+                      pool))
+      break;
+    pool->threads_count++;
+  }
+
+  if(!pool->threads_count) {
+    raptor_free_thread_pool(pool);
+    return NULL;
+  }
+
+#endif
+
+  return pool;
+}
+
+
+/**
+ * raptor_free_thread_pool:
+ * @pool: thread pool (or NULL)
+ *
+ * INTERNAL - Destructor - destroy a thread pool
+ *
+ * Waits for any submitted tasks to finish first.
+ */
+void
+raptor_free_thread_pool(raptor_thread_pool* pool)
+{
+#ifdef HAVE_PTHREAD_H
+  int i;
+#endif
+
+  if(!pool)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  if(pool->threads) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(i = 0; i < pool->threads_count; i++)
+      pthread_join(pool->threads[i], NULL);
+
+    RAPTOR_FREE(pthread_t*, pool->threads);
+  }
+
+  if(pool->locking) {
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->mutex);
+  }
+#endif
+
+  RAPTOR_FREE(raptor_thread_pool, pool);
+}
+
+
+/**
+ * raptor_thread_pool_get_threads_count:
+ * @pool: thread pool
+ *
+ * INTERNAL - Get the number of worker threads in the pool
+ *
+ * Return value: number of threads; 0 if tasks run on the calling thread
+ */
+int
+raptor_thread_pool_get_threads_count(raptor_thread_pool* pool)
+{
+#ifdef HAVE_PTHREAD_H
+  return pool->threads_count;
+#else
+  return 0;
+#endif
+}
+
+
+/**
+ * raptor_thread_pool_submit:
+ * @pool: thread pool
+ * @task: task with handler and user data set
+ *
+ * INTERNAL - Queue a task to be run by a worker thread
+ *
+ * The @task is owned by the caller and must not be modified or freed
+ * until it has been collected with raptor_thread_pool_wait() or
+ * raptor_thread_pool_wait_any().
+ */
+void
+raptor_thread_pool_submit(raptor_thread_pool* pool, raptor_thread_task* task)
+{
+  task->next = NULL;
+
+#ifdef HAVE_PTHREAD_H
+  if(pool->threads_count) {
+    pthread_mutex_lock(&pool->mutex);
+    task->state = RAPTOR_THREAD_TASK_QUEUED;
+    if(pool->queue_tail)
+      pool->queue_tail->next = task;
+    else
+      pool->queue_head = task;
+    pool->queue_tail = task;
+    pool->outstanding++;
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    return;
+  }
+#endif
+
+  task->handler(task->user_data);
+  pool->outstanding++;
+  raptor_thread_pool_add_done(pool, task);
+}
+
+
+/**
+ * raptor_thread_pool_wait:
+ * @pool: thread pool
+ * @task: submitted task
+ *
+ * INTERNAL - Wait for a submitted task to finish and collect it
+ */
+void
+raptor_thread_pool_wait(raptor_thread_pool* pool, raptor_thread_task* task)
+{
+#ifdef HAVE_PTHREAD_H
+  if(pool->threads_count) {
+    pthread_mutex_lock(&pool->mutex);
+    while(task->state != RAPTOR_THREAD_TASK_DONE)
+      pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    raptor_thread_pool_remove_done(pool, task);
+    pthread_mutex_unlock(&pool->mutex);
+    return;
+  }
+#endif
+
+  raptor_thread_pool_remove_done(pool, task);
+}
+
+
+/**
+ * raptor_thread_pool_wait_any:
+ * @pool: thread pool
+ *
+ * INTERNAL - Wait for any submitted task to finish and collect it
+ *
+ * Tasks are returned in the order they finished.
+ *
+ * Return value: finished task or NULL if there are no submitted tasks left
+ */
+raptor_thread_task*
+raptor_thread_pool_wait_any(raptor_thread_pool* pool)
+{
+  raptor_thread_task* task;
+
+#ifdef HAVE_PTHREAD_H
+  if(pool->threads_count) {
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->outstanding && !pool->done_head)
+      pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    task = pool->done_head;
+    if(task)
+      raptor_thread_pool_remove_done(pool, task);
+    pthread_mutex_unlock(&pool->mutex);
+    return task;
+  }
+#endif
+
+  task = pool->done_head;
+  if(task)
+    raptor_thread_pool_remove_done(pool, task);
+  return task;
+}
+
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+#define TEST_TASKS_COUNT 64
+#define TEST_LOOPS 1000
+
+typedef struct
+{
+  raptor_thread_task task;
+  raptor_mutex* mutex;
+  int* shared_counter;
+  int index;
+  long result;
+} test_task;
+
+
+static void
+test_task_handler(void* user_data)
+{
+  test_task* t = (test_task*)user_data;
+  int i;
+
+  t->result = 0;
+  for(i = 0; i < TEST_LOOPS; i++) {
+    t->result += t->index;
+
+    raptor_mutex_lock(t->mutex);
+    (*t->shared_counter)++;
+    raptor_mutex_unlock(t->mutex);
+  }
+}
+
+
+static int
+test_pool(const char* program, int threads)
+{
+  raptor_thread_pool* pool;
+  raptor_mutex* mutex;
+  test_task tasks[TEST_TASKS_COUNT];
+  int seen[TEST_TASKS_COUNT];
+  int shared_counter = 0;
+  int i;
+  int rc = 0;
+
+  pool = raptor_new_thread_pool(threads);
+  mutex = raptor_new_mutex();
+  if(!pool || !mutex) {
+    fprintf(stderr, "%s: Failed to create pool with %d threads\n",
+            program, threads);
+    return 1;
+  }
+
+  /* collect tasks in submission order */
+  for(i = 0; i < TEST_TASKS_COUNT; i++) {
+    tasks[i].task.handler = test_task_handler;
+    tasks[i].task.user_data = &tasks[i];
+    tasks[i].mutex = mutex;
+    tasks[i].shared_counter = &shared_counter;
+    tasks[i].index = i;
+    raptor_thread_pool_submit(pool, &tasks[i].task);
+  }
+
+  for(i = 0; i < TEST_TASKS_COUNT; i++) {
+    raptor_thread_pool_wait(pool, &tasks[i].task);
+    if(tasks[i].result != (long)i * TEST_LOOPS) {
+      fprintf(stderr, "%s: %d threads: task %d returned %ld expected %ld\n",
+              program, threads, i, tasks[i].result, (long)i * TEST_LOOPS);
+      rc = 1;
+    }
+  }
+
+  if(raptor_thread_pool_wait_any(pool)) {
+    fprintf(stderr, "%s: %d threads: wait any returned a task after all were collected\n",
+            program, threads);
+    rc = 1;
+  }
+
+  /* collect the same tasks again in completion order */
+  for(i = 0; i < TEST_TASKS_COUNT; i++) {
+    seen[i] = 0;
+    raptor_thread_pool_submit(pool, &tasks[i].task);
+  }
+
+  for(i = 0; i < TEST_TASKS_COUNT; i++) {
+    raptor_thread_task* task = raptor_thread_pool_wait_any(pool);
+    test_task* t;
+
+    if(!task) {
+      fprintf(stderr, "%s: %d threads: wait any returned no task after %d\n",
+              program, threads, i);
+      rc = 1;
+      break;
+    }
+    t = (test_task*)task->user_data;
+    if(seen[t->index]++) {
+      fprintf(stderr, "%s: %d threads: task %d returned twice\n",
+              program, threads, t->index);
+      rc = 1;
+    }
+  }
+
+  if(shared_counter != 2 * TEST_TASKS_COUNT * TEST_LOOPS) {
+    fprintf(stderr, "%s: %d threads: shared counter is %d expected %d\n",
+            program, threads, shared_counter,
+            2 * TEST_TASKS_COUNT * TEST_LOOPS);
+    rc = 1;
+  }
+
+  raptor_free_mutex(mutex);
+  raptor_free_thread_pool(pool);
+
+  return rc;
+}
+
+
+#if defined(RAPTOR_THREAD_SAFE_WORLD) && defined(RAPTOR_PARSER_NTRIPLES)
+
+#define TEST_WORLD_TASKS_COUNT 8
+#define TEST_WORLD_LINES 2000
+
+typedef struct
+{
+  raptor_thread_task task;
+  raptor_world* world;
+  const unsigned char* content;
+  size_t content_length;
+  /* copies of the statement terms; freed after parsing */
+  raptor_term** terms;
+  int statements_count;
+  int rc;
+} test_world_task;
+
+
+static void
+test_world_statement_handler(void* user_data, raptor_statement* statement)
+{
+  test_world_task* t = (test_world_task*)user_data;
+
+  if(t->statements_count < TEST_WORLD_LINES) {
+    raptor_term** terms = &t->terms[t->statements_count * 3];
+
+    terms[0] = raptor_term_copy(statement->subject);
+    terms[1] = raptor_term_copy(statement->predicate);
+    terms[2] = raptor_term_copy(statement->object);
+  }
+  t->statements_count++;
+}
+
+
+static void
+test_world_task_handler(void* user_data)
+{
+  test_world_task* t = (test_world_task*)user_data;
+  raptor_parser* parser;
+  raptor_uri* base_uri;
+  int i;
+
+  t->statements_count = 0;
+  t->rc = 1;
+
+  parser = raptor_new_parser(t->world, "ntriples");
+  base_uri = raptor_new_uri(t->world,
+                            (const unsigned char*)"http://example.org/base");
+  if(!parser || !base_uri)
+    goto tidy;
+
+  raptor_parser_set_statement_handler(parser, t, test_world_statement_handler);
+  if(raptor_parser_parse_start(parser, base_uri) ||
+     raptor_parser_parse_chunk(parser, t->content, t->content_length, 1))
+    goto tidy;
+
+  for(i = 0; i < TEST_WORLD_LINES; i++) {
+    unsigned char* id = raptor_world_generate_bnodeid(t->world);
+    if(!id)
+      goto tidy;
+    raptor_free_memory(id);
+  }
+
+  t->rc = 0;
+
+  tidy:
+  for(i = 0; i < TEST_WORLD_LINES * 3; i++) {
+    if(t->terms[i]) {
+      raptor_free_term(t->terms[i]);
+      t->terms[i] = NULL;
+    }
+  }
+  if(base_uri)
+    raptor_free_uri(base_uri);
+  if(parser)
+    raptor_free_parser(parser);
+}
+
+
+/* run parsers on several threads against one thread safe world */
+static int
+test_thread_safe_world(const char* program, int threads)
+{
+  raptor_world* world;
+  raptor_thread_pool* pool = NULL;
+  test_world_task tasks[TEST_WORLD_TASKS_COUNT];
+  raptor_stringbuffer* sb = NULL;
+  char line[256];
+  int i;
+  int rc = 1;
+
+  memset(tasks, '\0', sizeof(tasks));
+
+  world = raptor_new_world();
+  if(!world ||
+     raptor_world_set_flag(world, RAPTOR_WORLD_FLAG_THREAD_SAFE, 1) ||
+     raptor_world_open(world)) {
+    fprintf(stderr, "%s: Failed to open a thread safe world\n", program);
+    goto tidy;
+  }
+
+  /* all the threads intern the same few URIs */
+  sb = raptor_new_stringbuffer();
+  if(!sb)
+    goto tidy;
+  for(i = 0; i < TEST_WORLD_LINES; i++) {
+    snprintf(line, sizeof(line),
+             "<http://example.org/s%d> <http://example.org/p%d> _:b%d .\n"
+             "<http://example.org/s%d> <http://example.org/p%d> \"%d\"^^<http://www.w3.org/2001/XMLSchema#integer> .\n",
+             i % 50, i % 7, i % 100, i % 50, i % 7, i);
+    raptor_stringbuffer_append_string(sb, (const unsigned char*)line, 1);
+  }
+
+  pool = raptor_new_thread_pool(threads);
+  if(!pool)
+    goto tidy;
+
+  for(i = 0; i < TEST_WORLD_TASKS_COUNT; i++) {
+    tasks[i].task.handler = test_world_task_handler;
+    tasks[i].task.user_data = &tasks[i];
+    tasks[i].world = world;
+    tasks[i].content = raptor_stringbuffer_as_string(sb);
+    tasks[i].content_length = raptor_stringbuffer_length(sb);
+    tasks[i].terms = RAPTOR_CALLOC(raptor_term**, TEST_WORLD_LINES * 3,
+                                   sizeof(raptor_term*));
+    if(!tasks[i].terms)
+      goto tidy;
+  }
+
+  for(i = 0; i < TEST_WORLD_TASKS_COUNT; i++)
+    raptor_thread_pool_submit(pool, &tasks[i].task);
+
+  rc = 0;
+  for(i = 0; i < TEST_WORLD_TASKS_COUNT; i++) {
+    raptor_thread_pool_wait(pool, &tasks[i].task);
+    if(tasks[i].rc || tasks[i].statements_count != 2 * TEST_WORLD_LINES) {
+      fprintf(stderr, "%s: %d threads: parser %d returned %d statements expected %d\n",
+              program, threads, i, tasks[i].statements_count,
+              2 * TEST_WORLD_LINES);
+      rc = 1;
+    }
+  }
+
+  if(world->default_generate_bnodeid_handler_base !=
+     TEST_WORLD_TASKS_COUNT * TEST_WORLD_LINES) {
+    fprintf(stderr, "%s: %d threads: generated %d blank node IDs expected %d\n",
+            program, threads, world->default_generate_bnodeid_handler_base,
+            TEST_WORLD_TASKS_COUNT * TEST_WORLD_LINES);
+    rc = 1;
+  }
+
+  tidy:
+  if(pool)
+    raptor_free_thread_pool(pool);
+  for(i = 0; i < TEST_WORLD_TASKS_COUNT; i++) {
+    if(tasks[i].terms)
+      RAPTOR_FREE(raptor_term**, tasks[i].terms);
+  }
+  if(sb)
+    raptor_free_stringbuffer(sb);
+  if(world)
+    raptor_free_world(world);
+
+  return rc;
+}
+#endif
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = raptor_basename(argv[0]);
+  int failures = 0;
+
+  /* no threads: tasks run when they are submitted */
+  failures += test_pool(program, 0);
+  failures += test_pool(program, 1);
+  failures += test_pool(program, 4);
+
+#if defined(RAPTOR_THREAD_SAFE_WORLD) && defined(RAPTOR_PARSER_NTRIPLES)
+  failures += test_thread_safe_world(program, 4);
+#endif
+
+  return failures;
+}
+
+#endif /* STANDALONE */
@@ -43,6 +43,8 @@
 #endif
 #include <math.h>
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_TURTLE_WRITER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -608,6 +610,10 @@ raptor_turtle_writer_set_option(raptor_turtle_writer *turtle_writer,
     case RAPTOR_OPTION_HTML_LINK:
     case RAPTOR_OPTION_WWW_TIMEOUT:
     case RAPTOR_OPTION_STRICT:
+    case RAPTOR_OPTION_PARSE_THREADS:
+    case RAPTOR_OPTION_PARSE_UNORDERED:
+    case RAPTOR_OPTION_PARSE_ARENA:
+    case RAPTOR_OPTION_CHECK_RDF_ID_EXACT:
       
     /* Shared */
     case RAPTOR_OPTION_NO_NET:
@@ -634,6 +640,9 @@ raptor_turtle_writer_set_option(raptor_turtle_writer *turtle_writer,
     
     /* Turtle serializer option */
     case RAPTOR_OPTION_WRITE_BASE_URI:
+    case RAPTOR_OPTION_TURTLE_STREAMING:
+    case RAPTOR_OPTION_SORT_MEMORY_LIMIT:
+    case RAPTOR_OPTION_SERIALIZE_THREADS:
 
     /* WWW option */
     case RAPTOR_OPTION_WWW_HTTP_CACHE_CONTROL:
@@ -732,6 +741,10 @@ raptor_turtle_writer_get_option(raptor_turtle_writer *turtle_writer,
     case RAPTOR_OPTION_HTML_LINK:
     case RAPTOR_OPTION_WWW_TIMEOUT:
     case RAPTOR_OPTION_STRICT:
+    case RAPTOR_OPTION_PARSE_THREADS:
+    case RAPTOR_OPTION_PARSE_UNORDERED:
+    case RAPTOR_OPTION_PARSE_ARENA:
+    case RAPTOR_OPTION_CHECK_RDF_ID_EXACT:
 
     /* Shared */
     case RAPTOR_OPTION_NO_NET:
@@ -758,6 +771,9 @@ raptor_turtle_writer_get_option(raptor_turtle_writer *turtle_writer,
     
     /* Turtle serializer option */
     case RAPTOR_OPTION_WRITE_BASE_URI:
+    case RAPTOR_OPTION_TURTLE_STREAMING:
+    case RAPTOR_OPTION_SORT_MEMORY_LIMIT:
+    case RAPTOR_OPTION_SERIALIZE_THREADS:
 
     /* WWW option */
     case RAPTOR_OPTION_WWW_HTTP_CACHE_CONTROL:
@@ -51,6 +51,8 @@
 #include <sys/stat.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_URI
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -72,11 +74,368 @@ struct raptor_uri_s {
   unsigned int length;
   /* usage count */
   int usage;
+  /* hash of string; see raptor_uri_hash() */
+  unsigned int hash;
 };
 
 
 #ifndef STANDALONE
 
+/*
+ * URI intern table
+ *
+ * Open addressing hash table with linear probing.  Each slot keeps
+ * the hash next to the URI pointer so probing only reads the URI
+ * when the hashes match.  Entries are deleted by shifting later
+ * entries of the probe sequence back so no tombstones are needed.
+ *
+ * When the table passes half full, a table of twice the size is made
+ * and the entries of the old table are moved over a few at a time on
+ * each insertion rather than all at once.  Until that is done, the
+ * old table is also searched; entries moved or deleted from it are
+ * replaced by RAPTOR_URI_TABLE_MOVED so its probe sequences stay
+ * unbroken.
+ */
+typedef struct {
+  unsigned int hash;
+  /* NULL if empty */
+  raptor_uri* uri;
+} raptor_uri_table_slot;
+
+typedef struct {
+  /* table; size is a power of 2 */
+  raptor_uri_table_slot* slots;
+  size_t size;
+  size_t count;
+
+  /* table being emptied into @slots or NULL */
+  raptor_uri_table_slot* old_slots;
+  size_t old_size;
+  size_t old_count;
+  /* next slot of @old_slots to move */
+  size_t old_offset;
+} raptor_uri_table;
+
+/* Initial table size */
+#define RAPTOR_URI_TABLE_MIN_SIZE 1024
+
+/* Old table slots moved over per insertion while resizing */
+#define RAPTOR_URI_TABLE_MOVE_STEP 64
+
+static char raptor_uri_table_moved_marker;
+#define RAPTOR_URI_TABLE_MOVED ((raptor_uri*)(void*)&raptor_uri_table_moved_marker)
+
+
+/*
+ * URI intern table shard
+ *
+ * URIs are spread over the shards of a world by hash so threads of a
+ * thread safe world rarely wait for the same lock.
+ */
+struct raptor_uri_shard_s {
+  /* NULL if URI interning is disabled */
+  raptor_uri_table* table;
+  /* NULL unless world->uris_locking is set */
+  raptor_mutex* mutex;
+};
+
+/* Shards in a thread safe world; a power of 2 up to 256 */
+#define RAPTOR_URI_THREAD_SAFE_SHARDS 16
+
+#ifdef HAVE_ATOMIC_BUILTINS
+/* with locking, copies change the usage count without the shard lock */
+#define RAPTOR_URI_USAGE_INCREMENT(uri)                 \
+  do {                                                  \
+    if((uri)->world->uris_locking)                      \
+      RAPTOR_ATOMIC_INCREMENT(&(uri)->usage);           \
+    else                                                \
+      (uri)->usage++;                                   \
+  } while(0)
+#else
+/* with locking, the usage count only changes with the shard lock held */
+#define RAPTOR_URI_USAGE_INCREMENT(uri) (uri)->usage++
+#endif
+
+
+/*
+ * raptor_uri_hash:
+ * @string: URI string
+ * @length: length of @string
+ *
+ * INTERNAL - Hash a URI string (MurmurHash3 32 bit, seed 0)
+ *
+ * Return value: hash
+ */
+static unsigned int
+raptor_uri_hash(const unsigned char *string, size_t length)
+{
+  unsigned int h = 0;
+  unsigned int k;
+  size_t len = length;
+
+  for(; len >= 4; string += 4, len -= 4) {
+    k = (unsigned int)string[0] | ((unsigned int)string[1] << 8) |
+        ((unsigned int)string[2] << 16) | ((unsigned int)string[3] << 24);
+    k *= 0xcc9e2d51U;
+    k = (k << 15) | (k >> 17);
+    k *= 0x1b873593U;
+
+    h ^= k;
+    h = (h << 13) | (h >> 19);
+    h = h * 5 + 0xe6546b64U;
+  }
+
+  k = 0;
+  switch(len) {
+    case 3:
+      k ^= (unsigned int)string[2] << 16;
+      /* FALLTHROUGH */
+    case 2:
+      k ^= (unsigned int)string[1] << 8;
+      /* FALLTHROUGH */
+    case 1:
+      k ^= (unsigned int)string[0];
+      k *= 0xcc9e2d51U;
+      k = (k << 15) | (k >> 17);
+      k *= 0x1b873593U;
+      h ^= k;
+      break;
+    default:
+      break;
+  }
+
+  h ^= (unsigned int)length;
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+
+  return h;
+}
+
+
+/* the shard for a URI hash or NULL if the world has none */
+static raptor_uri_shard*
+raptor_uri_get_shard(raptor_world* world, unsigned int hash)
+{
+  if(!world->uri_shards)
+    return NULL;
+
+  /* the tables use the low bits of the hash so mix in all of them */
+  hash = (hash * 0x9e3779b1U) >> 24;
+  return &world->uri_shards[hash & (world->uri_shards_count - 1)];
+}
+
+
+static raptor_uri_table*
+raptor_new_uri_table(void)
+{
+  raptor_uri_table* table;
+
+  table = RAPTOR_CALLOC(raptor_uri_table*, 1, sizeof(*table));
+  if(!table)
+    return NULL;
+
+  table->slots = RAPTOR_CALLOC(raptor_uri_table_slot*,
+                               RAPTOR_URI_TABLE_MIN_SIZE,
+                               sizeof(raptor_uri_table_slot));
+  if(!table->slots) {
+    RAPTOR_FREE(raptor_uri_table, table);
+    return NULL;
+  }
+  table->size = RAPTOR_URI_TABLE_MIN_SIZE;
+
+  return table;
+}
+
+
+static void
+raptor_free_uri_table(raptor_uri_table* table)
+{
+  /* the table does not own the URIs */
+  if(table->old_slots)
+    RAPTOR_FREE(raptor_uri_table_slot*, table->old_slots);
+  RAPTOR_FREE(raptor_uri_table_slot*, table->slots);
+  RAPTOR_FREE(raptor_uri_table, table);
+}
+
+
+/* add a URI known not to be in the table to @slots */
+static void
+raptor_uri_table_put(raptor_uri_table* table, raptor_uri* uri,
+                     unsigned int hash)
+{
+  size_t mask = table->size - 1;
+  size_t i;
+
+  for(i = hash & mask; table->slots[i].uri; i = (i + 1) & mask)
+    ;
+  table->slots[i].hash = hash;
+  table->slots[i].uri = uri;
+  table->count++;
+}
+
+
+/* move up to @step slots of the old table into the new one */
+static void
+raptor_uri_table_move(raptor_uri_table* table, size_t step)
+{
+  while(step-- && table->old_offset < table->old_size) {
+    raptor_uri_table_slot* slot = &table->old_slots[table->old_offset];
+
+    if(slot->uri && slot->uri != RAPTOR_URI_TABLE_MOVED) {
+      raptor_uri_table_put(table, slot->uri, slot->hash);
+      slot->uri = RAPTOR_URI_TABLE_MOVED;
+      table->old_count--;
+    }
+    table->old_offset++;
+  }
+
+  if(table->old_offset == table->old_size || !table->old_count) {
+    RAPTOR_FREE(raptor_uri_table_slot*, table->old_slots);
+    table->old_slots = NULL;
+    table->old_size = 0;
+    table->old_count = 0;
+    table->old_offset = 0;
+  }
+}
+
+
+/*
+ * raptor_uri_table_find:
+ * @table: table
+ * @string: URI string
+ * @length: length of @string
+ * @hash: hash of @string
+ *
+ * INTERNAL - Find an interned URI
+ *
+ * Return value: URI or NULL if not in the table
+ */
+static raptor_uri*
+raptor_uri_table_find(raptor_uri_table* table,
+                      const unsigned char *string, size_t length,
+                      unsigned int hash)
+{
+  raptor_uri_table_slot* slots = table->slots;
+  size_t mask = table->size - 1;
+  raptor_uri* uri;
+  size_t i;
+
+  for(i = hash & mask; (uri = slots[i].uri); i = (i + 1) & mask) {
+    if(slots[i].hash == hash && uri->length == length &&
+       !memcmp(uri->string, string, length))
+      return uri;
+  }
+
+  if(table->old_slots) {
+    slots = table->old_slots;
+    mask = table->old_size - 1;
+    for(i = hash & mask; (uri = slots[i].uri); i = (i + 1) & mask) {
+      if(slots[i].hash == hash && uri != RAPTOR_URI_TABLE_MOVED &&
+         uri->length == length && !memcmp(uri->string, string, length))
+        return uri;
+    }
+  }
+
+  return NULL;
+}
+
+
+/*
+ * raptor_uri_table_add:
+ * @table: table
+ * @uri: URI not already in the table
+ *
+ * INTERNAL - Intern a URI
+ *
+ * Return value: non-0 on failure
+ */
+static int
+raptor_uri_table_add(raptor_uri_table* table, raptor_uri* uri)
+{
+  if(table->old_slots)
+    raptor_uri_table_move(table, RAPTOR_URI_TABLE_MOVE_STEP);
+
+  /* Start growing at half full.  The old table is emptied after
+   * old_size / RAPTOR_URI_TABLE_MOVE_STEP more insertions, well before
+   * the new one is half full in turn.
+   */
+  if(!table->old_slots && (table->count + 1) > (table->size >> 1)) {
+    raptor_uri_table_slot* slots;
+    size_t size = table->size << 1;
+
+    slots = RAPTOR_CALLOC(raptor_uri_table_slot*, size,
+                          sizeof(raptor_uri_table_slot));
+    if(!slots)
+      return 1;
+
+    table->old_slots = table->slots;
+    table->old_size = table->size;
+    table->old_count = table->count;
+    table->old_offset = 0;
+
+    table->slots = slots;
+    table->size = size;
+    table->count = 0;
+  }
+
+  raptor_uri_table_put(table, uri, uri->hash);
+
+  return 0;
+}
+
+
+/*
+ * raptor_uri_table_delete:
+ * @table: table
+ * @uri: URI
+ *
+ * INTERNAL - Remove an interned URI; the URI is not freed
+ */
+static void
+raptor_uri_table_delete(raptor_uri_table* table, raptor_uri* uri)
+{
+  raptor_uri_table_slot* slots = table->slots;
+  size_t mask = table->size - 1;
+  size_t i;
+  size_t j;
+
+  for(i = uri->hash & mask; slots[i].uri; i = (i + 1) & mask) {
+    if(slots[i].uri != uri)
+      continue;
+
+    /* shift back later entries that probed past slot i */
+    for(j = (i + 1) & mask; slots[j].uri; j = (j + 1) & mask) {
+      size_t home = slots[j].hash & mask;
+
+      /* leave entries whose home slot is cyclically in (i, j] */
+      if(i <= j ? (i < home && home <= j) : (i < home || home <= j))
+        continue;
+
+      slots[i] = slots[j];
+      i = j;
+    }
+    slots[i].uri = NULL;
+    table->count--;
+    return;
+  }
+
+  if(table->old_slots) {
+    slots = table->old_slots;
+    mask = table->old_size - 1;
+    for(i = uri->hash & mask; slots[i].uri; i = (i + 1) & mask) {
+      if(slots[i].uri == uri) {
+        slots[i].uri = RAPTOR_URI_TABLE_MOVED;
+        table->old_count--;
+        return;
+      }
+    }
+  }
+}
+
+
 /**
  * raptor_new_uri_from_counted_string:
  * @world: raptor_world object
@@ -97,6 +456,8 @@ raptor_new_uri_from_counted_string(raptor_world* world,
 {
   raptor_uri* new_uri;
   unsigned char *new_string;
+  unsigned int hash;
+  raptor_uri_shard* shard;
   
   RAPTOR_CHECK_CONSTRUCTOR_WORLD(world);
 
@@ -105,24 +466,22 @@ raptor_new_uri_from_counted_string(raptor_world* world,
 
   raptor_world_open(world);
 
-  if(world->uris_tree) {
-    raptor_uri key; /* on stack - not allocated */
-
-    /* just to be safe */
-    memset(&key, 0, sizeof(key));
+  hash = raptor_uri_hash(uri_string, length);
+  shard = raptor_uri_get_shard(world, hash);
 
-    key.string = (unsigned char*)uri_string;
-    key.length = (unsigned int)length;
+  if(shard && shard->mutex)
+    raptor_mutex_lock(shard->mutex);
 
-    /* if existing URI found in tree, return it */
-    new_uri = (raptor_uri*)raptor_avltree_search(world->uris_tree, &key);
+  if(shard && shard->table) {
+    /* if existing URI found in table, return it */
+    new_uri = raptor_uri_table_find(shard->table, uri_string, length, hash);
     if(new_uri) {
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
       RAPTOR_DEBUG3("Found existing URI %s with current usage %d\n",
                     uri_string, new_uri->usage);
 #endif
       
-      new_uri->usage++;
+      RAPTOR_URI_USAGE_INCREMENT(new_uri);
       
       goto unlock;
     }
@@ -137,36 +496,33 @@ raptor_new_uri_from_counted_string(raptor_world* world,
   fputs("' in hash\n", RAPTOR_DEBUG_FH);
 #endif
 
-  new_uri = RAPTOR_CALLOC(raptor_uri*, 1, sizeof(*new_uri));
+  /* one allocation: the string is stored after the object */
+  new_uri = RAPTOR_MALLOC(raptor_uri*, sizeof(*new_uri) + length + 1);
   if(!new_uri)
     goto unlock;
 
   new_uri->world = world;
   new_uri->length = (unsigned int)length;
+  new_uri->hash = hash;
 
-  new_string = RAPTOR_MALLOC(unsigned char*, length + 1);
-  if(!new_string) {
-    RAPTOR_FREE(raptor_uri, new_uri);
-    new_uri=NULL;
-    goto unlock;
-  }
-  
+  new_string = (unsigned char*)(new_uri + 1);
   memcpy((char*)new_string, (const char*)uri_string, length);
   new_string[length] = '\0';
   new_uri->string = new_string;
 
   new_uri->usage = 1; /* for user */
 
-  /* store in tree */
-  if(world->uris_tree) {
-    if(raptor_avltree_add(world->uris_tree, new_uri)) {
-      RAPTOR_FREE(char*, new_string);
+  /* store in table */
+  if(shard && shard->table) {
+    if(raptor_uri_table_add(shard->table, new_uri)) {
       RAPTOR_FREE(raptor_uri, new_uri);
       new_uri = NULL;
     }
   }
 
  unlock:
+  if(shard && shard->mutex)
+    raptor_mutex_unlock(shard->mutex);
 
   return new_uri;
 }
@@ -260,6 +616,31 @@ raptor_new_uri_relative_to_base_counted(raptor_world* world,
                                         raptor_uri *base_uri, 
                                         const unsigned char *uri_string,
                                         size_t uri_len)
+{
+  return raptor_new_uri_relative_to_base_detail(world, base_uri, NULL,
+                                                uri_string, uri_len);
+}
+
+
+/*
+ * raptor_new_uri_relative_to_base_detail:
+ * @world: raptor_world object
+ * @base_uri: existing base URI
+ * @base_detail: components of @base_uri from raptor_new_uri_detail() or NULL
+ * @uri_string: relative URI string
+ * @uri_len: length of URI string (or 0)
+ * 
+ * INTERNAL - Constructor - raptor_new_uri_relative_to_base_counted()
+ * for a base URI that has already been split into components.
+ * 
+ * Return value: a new #raptor_uri object or NULL on failure.
+ */
+raptor_uri*
+raptor_new_uri_relative_to_base_detail(raptor_world* world,
+                                       raptor_uri *base_uri, 
+                                       raptor_uri_detail *base_detail,
+                                       const unsigned char *uri_string,
+                                       size_t uri_len)
 {
   unsigned char *buffer;
   size_t buffer_length;
@@ -286,8 +667,10 @@ raptor_new_uri_relative_to_base_counted(raptor_world* world,
   if(!buffer)
     return NULL;
   
-  actual_length = raptor_uri_resolve_uri_reference(base_uri->string, uri_string,
-                                                   buffer, buffer_length);
+  actual_length = raptor_uri_resolve_uri_reference_detail(base_uri->string,
+                                                          base_detail,
+                                                          uri_string,
+                                                          buffer, buffer_length);
 
   new_uri = raptor_new_uri_from_counted_string(world, buffer, actual_length);
   RAPTOR_FREE(char*, buffer);
@@ -471,26 +854,59 @@ raptor_new_uri_from_uri_or_file_string(raptor_world* world,
 void
 raptor_free_uri(raptor_uri *uri)
 {
+  raptor_uri_shard* shard;
+  raptor_mutex *mutex;
+  int usage;
+
   if(!uri)
     return;
 
-  uri->usage--;
+  shard = raptor_uri_get_shard(uri->world, uri->hash);
+  mutex = shard ? shard->mutex : NULL;
+
+#ifdef HAVE_ATOMIC_BUILTINS
+  if(mutex) {
+    /* Drop a reference that is not the last without the lock.  The
+     * last is dropped with the lock held so a lookup cannot find the
+     * URI while it is freed.
+     */
+    usage = RAPTOR_ATOMIC_LOAD(&uri->usage);
+    while(usage > 1) {
+      if(RAPTOR_ATOMIC_COMPARE_AND_SWAP(&uri->usage, &usage, usage - 1))
+        return;
+    }
+  }
+#endif
+
+  if(mutex)
+    raptor_mutex_lock(mutex);
+
+#ifdef HAVE_ATOMIC_BUILTINS
+  if(mutex)
+    usage = RAPTOR_ATOMIC_DECREMENT(&uri->usage);
+  else
+#endif
+    usage = --uri->usage;
   
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-  RAPTOR_DEBUG3("URI %s usage count now %d\n", uri->string, uri->usage);
+  RAPTOR_DEBUG3("URI %s usage count now %d\n", uri->string, usage);
 #endif
 
   /* decrement usage, don't free if not 0 yet*/
-  if(uri->usage > 0) {
+  if(usage > 0) {
+    if(mutex)
+      raptor_mutex_unlock(mutex);
     return;
   }
 
   /* this does not free the uri */
-  if(uri->world->uris_tree)
-    raptor_avltree_delete(uri->world->uris_tree, uri);
+  if(shard && shard->table)
+    raptor_uri_table_delete(shard->table, uri);
+
+  if(mutex)
+    raptor_mutex_unlock(mutex);
 
-  if(uri->string)
-    RAPTOR_FREE(char*, uri->string);
+  /* the string is part of the same allocation */
   RAPTOR_FREE(raptor_uri, uri);
 }
 
@@ -513,8 +929,8 @@ raptor_uri_equals(raptor_uri* uri1, raptor_uri* uri2)
     /* Both not-NULL - compare for equality */
     if(uri1 == uri2)
       return 1;
-    else if (uri1->length != uri2->length)
-      /* Different if lengths are different */
+    else if (uri1->length != uri2->length || uri1->hash != uri2->hash)
+      /* Different if lengths or hashes are different */
       return 0;
     else
       /* Same length compare: do not need strncmp() NUL checking */
@@ -578,7 +994,19 @@ raptor_uri_copy(raptor_uri *uri)
 {
   RAPTOR_ASSERT_OBJECT_POINTER_RETURN_VALUE(uri, raptor_uri, NULL);
   
-  uri->usage++;
+  if(uri->world->uris_locking) {
+#ifdef HAVE_ATOMIC_BUILTINS
+    RAPTOR_ATOMIC_INCREMENT(&uri->usage);
+#else
+    raptor_uri_shard* shard = raptor_uri_get_shard(uri->world, uri->hash);
+
+    raptor_mutex_lock(shard->mutex);
+    uri->usage++;
+    raptor_mutex_unlock(shard->mutex);
+#endif
+  } else
+    uri->usage++;
+
   return uri;
 }
 
@@ -1161,20 +1589,34 @@ raptor_new_uri_for_retrieval(raptor_uri* old_uri)
 int
 raptor_uri_init(raptor_world* world)
 {
-  if(world->uri_interning && !world->uris_tree) {
-    world->uris_tree = raptor_new_avltree((raptor_data_compare_handler)raptor_uri_compare,
-                                          /* free */ NULL, 0);
-    if(!world->uris_tree) {
+  unsigned int i;
+
+  if(world->uri_shards)
+    return 0;
+
+  world->uri_shards_count = world->thread_safe ?
+                            RAPTOR_URI_THREAD_SAFE_SHARDS : 1;
+  world->uri_shards = RAPTOR_CALLOC(raptor_uri_shard*,
+                                    world->uri_shards_count,
+                                    sizeof(raptor_uri_shard));
+  if(!world->uri_shards)
+    return 1;
+
+  for(i = 0; world->uri_interning && i < world->uri_shards_count; i++) {
+    world->uri_shards[i].table = raptor_new_uri_table();
+    if(!world->uri_shards[i].table) {
 #ifdef RAPTOR_DEBUG
-      RAPTOR_FATAL1("Failed to create raptor URI avltree");
+      RAPTOR_FATAL1("Failed to create raptor URI table");
 #else
       raptor_log_error(world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                       "Failed to create raptor URI avltree");
+                       "Failed to create raptor URI table");
 #endif
     }
-    
   }
 
+  if(world->thread_safe)
+    return raptor_uri_init_locking(world);
+
   return 0;
 }
 
@@ -1182,10 +1624,60 @@ raptor_uri_init(raptor_world* world)
 void
 raptor_uri_finish(raptor_world* world)
 {
-  if(world->uris_tree) {
-    raptor_free_avltree(world->uris_tree);
-    world->uris_tree = NULL;
+  unsigned int i;
+
+  if(!world->uri_shards)
+    return;
+
+  for(i = 0; i < world->uri_shards_count; i++) {
+    raptor_uri_shard* shard = &world->uri_shards[i];
+
+    if(shard->table)
+      raptor_free_uri_table(shard->table);
+    if(shard->mutex)
+      raptor_free_mutex(shard->mutex);
+  }
+
+  RAPTOR_FREE(raptor_uri_shard*, world->uri_shards);
+  world->uri_shards = NULL;
+  world->uris_locking = 0;
+}
+
+
+/*
+ * raptor_uri_init_locking:
+ * @world: raptor world
+ *
+ * INTERNAL - Make URI construction, copying and destruction safe to
+ * call from several threads at once
+ *
+ * Must be called before the threads start.  Once enabled, locking
+ * stays on until the world is freed.
+ *
+ * Return value: non-0 on failure
+ */
+int
+raptor_uri_init_locking(raptor_world* world)
+{
+  unsigned int i;
+
+  if(world->uris_locking)
+    return 0;
+
+  if(!world->uri_shards)
+    return 1;
+
+  for(i = 0; i < world->uri_shards_count; i++) {
+    if(!world->uri_shards[i].mutex) {
+      world->uri_shards[i].mutex = raptor_new_mutex();
+      if(!world->uri_shards[i].mutex)
+        return 1;
+    }
   }
+
+  world->uris_locking = 1;
+
+  return 0;
 }
 
 
@@ -1656,6 +2148,23 @@ raptor_uri_get_world(raptor_uri *uri)
 }
 
 
+/*
+ * raptor_uri_get_hash:
+ * @uri: #raptor_uri object
+ *
+ * INTERNAL - Get the hash of the URI string
+ *
+ * URIs that are equal by raptor_uri_equals() have the same hash.
+ *
+ * Return value: hash
+ **/
+unsigned int
+raptor_uri_get_hash(raptor_uri *uri)
+{
+  return uri->hash;
+}
+
+
 /**
  * raptor_uri_filename_exists:
  * @path: file path
@@ -1798,6 +2307,9 @@ raptor_uri_uri_string_is_absolute(const unsigned char* uri_string)
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
 
 /* one more prototype */
 int main(int argc, char *argv[]);
@@ -1909,6 +2421,157 @@ assert_uri_to_relative(raptor_world *world, const char *base, const char *uri, c
 }
 
 
+#define INTERN_URIS_COUNT 20000
+
+static int
+assert_uri_interning(raptor_world *world)
+{
+  raptor_uri** uris;
+  char uri_string[40];
+  int failures = 0;
+  int i;
+
+  uris = RAPTOR_CALLOC(raptor_uri**, INTERN_URIS_COUNT, sizeof(raptor_uri*));
+  if(!uris)
+    return 1;
+
+  /* grow the intern table several times, deleting some URIs while
+   * it is being resized */
+  for(i = 0; i < INTERN_URIS_COUNT; i++) {
+    snprintf(uri_string, sizeof(uri_string), "http://example.org/%d", i);
+    uris[i] = raptor_new_uri(world, (const unsigned char*)uri_string);
+    if(!uris[i]) {
+      fprintf(stderr, "%s: raptor_new_uri(%s) FAILED\n", program, uri_string);
+      failures++;
+      goto tidy;
+    }
+
+    if(i % 3 == 2) {
+      raptor_free_uri(uris[i - 1]);
+      uris[i - 1] = NULL;
+    }
+  }
+
+  for(i = 0; i < INTERN_URIS_COUNT; i++) {
+    raptor_uri* uri;
+
+    snprintf(uri_string, sizeof(uri_string), "http://example.org/%d", i);
+    uri = raptor_new_uri(world, (const unsigned char*)uri_string);
+    if(!uri || strcmp((const char*)uri->string, uri_string)) {
+      fprintf(stderr, "%s: raptor_new_uri(%s) FAILED\n", program, uri_string);
+      failures++;
+    } else if(uris[i] && uri != uris[i]) {
+      fprintf(stderr, "%s: raptor_new_uri(%s) FAILED to return interned URI\n",
+              program, uri_string);
+      failures++;
+    }
+
+    if(uri)
+      raptor_free_uri(uri);
+  }
+
+  tidy:
+  for(i = 0; i < INTERN_URIS_COUNT; i++) {
+    if(uris[i])
+      raptor_free_uri(uris[i]);
+  }
+  RAPTOR_FREE(raptor_uri**, uris);
+
+  return failures;
+}
+
+
+#ifdef HAVE_GETTIMEOFDAY
+static double
+bench_seconds(struct timeval *tv_start)
+{
+  struct timeval tv_end;
+
+  gettimeofday(&tv_end, NULL);
+  return (double)(tv_end.tv_sec - tv_start->tv_sec) +
+    (double)(tv_end.tv_usec - tv_start->tv_usec) / 1000000.0;
+}
+
+
+/* a prime step visits 0..count-1 in a scattered order unless it
+ * divides count */
+static unsigned long
+bench_step(unsigned long count, unsigned long prime)
+{
+  return (count % prime) ? prime : 1;
+}
+
+
+/*
+ * Intern @count distinct URIs in a permuted order, look each one up
+ * once in a different order, then free them all, timing each phase.
+ * Only the public URI API is used so the same function can be built
+ * against an older tree for a before/after comparison.
+ */
+static int
+bench_uri_interning(raptor_world *world, unsigned long count)
+{
+  raptor_uri** uris;
+  char uri_string[64];
+  struct timeval tv_start;
+  unsigned long step;
+  unsigned long i;
+  unsigned long n;
+  double intern_secs, lookup_secs, free_secs;
+  int failures = 0;
+
+  uris = (raptor_uri**)calloc(count, sizeof(raptor_uri*));
+  if(!uris)
+    return 1;
+
+  step = bench_step(count, 1000003UL);
+  gettimeofday(&tv_start, NULL);
+  for(i = 0, n = 0; i < count; i++, n = (n + step) % count) {
+    snprintf(uri_string, sizeof(uri_string), "http://example.org/resource/%lu",
+             n);
+    uris[n] = raptor_new_uri(world, (const unsigned char*)uri_string);
+    if(!uris[n]) {
+      failures++;
+      break;
+    }
+  }
+  intern_secs = bench_seconds(&tv_start);
+
+  step = bench_step(count, 999983UL);
+  gettimeofday(&tv_start, NULL);
+  for(i = 0, n = 0; !failures && i < count; i++, n = (n + step) % count) {
+    raptor_uri* uri;
+
+    snprintf(uri_string, sizeof(uri_string), "http://example.org/resource/%lu",
+             n);
+    uri = raptor_new_uri(world, (const unsigned char*)uri_string);
+    if(uri != uris[n])
+      failures++;
+    if(uri)
+      raptor_free_uri(uri);
+  }
+  lookup_secs = bench_seconds(&tv_start);
+
+  gettimeofday(&tv_start, NULL);
+  for(i = 0; i < count; i++) {
+    if(uris[i])
+      raptor_free_uri(uris[i]);
+  }
+  free_secs = bench_seconds(&tv_start);
+
+  free(uris);
+
+  if(failures)
+    fprintf(stderr, "%s: URI interning benchmark FAILED\n", program);
+  else
+    fprintf(stdout, "%s: %lu URIs intern %.3fs  lookup %.3fs  free %.3fs\n",
+            program, count, intern_secs, lookup_secs, free_secs);
+
+  return failures;
+}
+#endif
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -2080,6 +2743,15 @@ main(int argc, char *argv[])
     raptor_free_uri(u2);
   }
 
+  failures += assert_uri_interning(world);
+
+#ifdef HAVE_GETTIMEOFDAY
+  /* Benchmark with: raptor_uri_test MILLIONS-OF-URIS */
+  if(!failures && argc > 1)
+    failures += bench_uri_interning(world,
+                                    (unsigned long)atol(argv[1]) * 1000000UL);
+#endif
+
   raptor_free_world(world);
 
   return failures ;
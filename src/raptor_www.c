@@ -37,6 +37,8 @@
 #include <sys/stat.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_WWW
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
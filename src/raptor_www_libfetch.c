@@ -39,6 +39,8 @@
 #endif
 #include <fetch.h>
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_WWW
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -31,6 +31,8 @@
 #include <string.h>
 #include <stdarg.h>
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_WWW
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -38,6 +38,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_SAX2
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -148,6 +150,9 @@ raptor_free_xml_element(raptor_xml_element *element)
   if(element->base_uri)
     raptor_free_uri(element->base_uri);
 
+  if(element->base_uri_detail)
+    raptor_free_uri_detail(element->base_uri_detail);
+
   if(element->xml_language)
     RAPTOR_FREE(char*, element->xml_language);
 
@@ -189,6 +194,8 @@ void
 raptor_xml_element_set_attributes(raptor_xml_element* xml_element,
                                    raptor_qname **attributes, int count)
 {
+  if(attributes != xml_element->attributes)
+    xml_element->attributes_size = RAPTOR_BAD_CAST(unsigned int, count);
   xml_element->attributes = attributes;
   xml_element->attribute_count = count;
 }
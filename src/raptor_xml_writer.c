@@ -38,6 +38,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_XML_WRITER
+
 /* Raptor includes */
 #include "raptor2.h"
 #include "raptor_internal.h"
@@ -246,7 +246,9 @@ raptor_snprintf(char *buffer, size_t size, const char *format, ...)
  * Format output into a new buffer and return it
  *
  * This is a wrapper around the (GNU) vasprintf function that is not
- * always avaiable.
+ * always avaiable.  The buffer must be freed with raptor_free_memory()
+ * since it comes from the raptor_world_set_allocator() handlers when
+ * they are set.
  * 
  * Return value: number of bytes allocated (excluding NUL) or < 0 on failure
  **/
@@ -254,16 +256,18 @@ int
 raptor_vasprintf(char **ret, const char *format, va_list arguments)
 {
   int length;
-#ifndef HAVE_VASPRINTF
   va_list args_copy;
-#endif
 
   RAPTOR_ASSERT_OBJECT_POINTER_RETURN_VALUE(ret, char**, -1);
   RAPTOR_ASSERT_OBJECT_POINTER_RETURN_VALUE(format, char*, -1);
 
-#ifdef HAVE_VASPRINTF
-  length = vasprintf(ret, format, arguments);
-#else
+#if defined(HAVE_VASPRINTF) && !defined(RAPTOR_MEMORY_SIGN)
+  /* vasprintf() allocates from the C library so it can only be used
+   * when RAPTOR_FREE() frees there too */
+  if(!raptor_memory_hooked)
+    return vasprintf(ret, format, arguments);
+#endif
+
   va_copy(args_copy, arguments);
   length = raptor_vsnprintf2(NULL, 0, format, args_copy);
   va_end(args_copy);
@@ -278,7 +282,6 @@ raptor_vasprintf(char **ret, const char *format, va_list arguments)
   va_copy(args_copy, arguments);
   length = raptor_vsnprintf2(*ret, length + 1, format, args_copy);
   va_end(args_copy);
-#endif
 
   return length;
 }
@@ -43,11 +43,14 @@ extern void turtle_token_free(raptor_world* world, int token, YYSTYPE *lval);
  * Turtle parser object
  */
 struct raptor_turtle_parser_s {
-  /* buffer */
+  /* input not yet lexed: the part of the last line seen so far */
   char *buffer;
 
   /* buffer length */
   size_t buffer_length;
+
+  /* buffer allocated size */
+  size_t buffer_size;
   
   raptor_namespace_stack namespaces; /* static */
 
@@ -59,17 +62,13 @@ struct raptor_turtle_parser_s {
 
   int scanner_set;
 
+  /* push parser state, kept across chunks */
+  turtle_parser_pstate* pstate;
+
   int lineno;
-  int lineno_last_good;
 
-  /* for the chunk parser, how much of the input has been consumed */
+  /* for the chunk parser, how much of the chunk has been lexed */
   size_t consumed;
-  /* likewise, how much of the input has been successfully processed */
-  size_t processed;
-  /* indicates what can be processed at most */
-  size_t consumable;
-  /* real end-of-buffer indicator, as we kill the last line */
-  size_t end_of_buffer;
 
   /* a sequence holding deferred statements */
   raptor_sequence *deferred;
@@ -83,6 +82,9 @@ struct raptor_turtle_parser_s {
   /* TRIG graph name */
   raptor_term* graph_name;
 
+  /* last predicate URI that passed the ordinal check */
+  raptor_uri* checked_predicate_uri;
+
   /* Allow TRIG extensions */
   int trig;
 
@@ -44,6 +44,8 @@
 #include <stdlib.h>
 #endif
 
+#define RAPTOR_MEMORY_DOMAIN RAPTOR_DOMAIN_PARSER
+
 #include "raptor2.h"
 #include "raptor_internal.h"
 
@@ -87,9 +89,6 @@ const char * turtle_token_print(raptor_world* world, int token, YYSTYPE *lval);
 /* the lexer does not seem to track this */
 #undef RAPTOR_TURTLE_USE_ERROR_COLUMNS
 
-/* set api.push-pull to "push" if this is defined */
-#undef TURTLE_PUSH_PARSE
-
 /* Prototypes */ 
 int turtle_parser_error(raptor_parser* rdf_parser, void* scanner, const char *msg);
 
@@ -129,8 +128,8 @@ static void raptor_turtle_handle_statement(raptor_parser *parser, raptor_stateme
 /* Pure parser - want a reentrant parser  */
 %define api.pure full
 
-/* Push or pull parser? */
-%define api.push-pull pull
+/* Push parser - tokens are pushed in as each chunk is lexed */
+%define api.push-pull push
 
 /* Pure parser argument: lexer - yylex() and parser - yyparse() */
 %lex-param { yyscan_t yyscanner }
@@ -304,15 +303,6 @@ dotTriplesList: triples
 ;
 
 statementList: statementList statement
-{
-  raptor_turtle_parser* turtle_parser;
-
-  turtle_parser = (raptor_turtle_parser*)rdf_parser->context;
-
-  /* sync up consumed/processed so we know what to unwind */
-  turtle_parser->processed = turtle_parser->consumed;
-  turtle_parser->lineno_last_good = turtle_parser->lineno;
-}
 | statementList error
 | %empty
 ;
@@ -1284,14 +1274,6 @@ turtle_parser_error(raptor_parser* rdf_parser, void* scanner, const char *msg)
 
   turtle_parser = (raptor_turtle_parser*)rdf_parser->context;
 
-  if(turtle_parser->consumed == turtle_parser->consumable &&
-     turtle_parser->processed < turtle_parser->consumed &&
-     !turtle_parser->is_end) {
-    /* we encountered an error on or around the last byte of the buffer
-     * sorting it in the next run aye? */
-    return 0;
-  }
-  
   if(turtle_parser->error_count++)
     return 0;
 
@@ -1358,100 +1340,93 @@ turtle_qname_to_uri(raptor_parser *rdf_parser, unsigned char *name, size_t name_
 
 
 
-#ifndef TURTLE_PUSH_PARSE
-static int
-turtle_parse(raptor_parser *rdf_parser, const char *string, size_t length)
-{
-  raptor_turtle_parser* turtle_parser = (raptor_turtle_parser*)rdf_parser->context;
-  int rc;
-  
-  if(!string || !*string)
-    return 0;
-  
-  if(turtle_lexer_lex_init(&turtle_parser->scanner))
-    return 1;
-  turtle_parser->scanner_set = 1;
-
-#if defined(YYDEBUG) && YYDEBUG > 0
-  turtle_lexer_set_debug(1 ,&turtle_parser->scanner);
-  turtle_parser_debug = 1;
-#endif
-
-  turtle_lexer_set_extra(rdf_parser, turtle_parser->scanner);
-  (void)turtle_lexer__scan_bytes((char *)string, (int)length, turtle_parser->scanner);
-
-  rc = turtle_parser_parse(rdf_parser, turtle_parser->scanner);
-
-  turtle_lexer_lex_destroy(turtle_parser->scanner);
-  turtle_parser->scanner_set = 0;
-
-  return rc;
-}
-#endif
-
-
-#ifdef TURTLE_PUSH_PARSE
+/*
+ * turtle_push_parse:
+ * @rdf_parser: parser
+ * @string: input to lex; ends at a newline unless it is the end of the document
+ * @length: length of @string; @string must have 2 more writable bytes
+ *
+ * Lexes @string once and pushes the tokens into the push parser.  The
+ * lexer start condition, a long literal in progress and the parser
+ * stack all carry over to the next call so a statement can span chunks.
+ *
+ * Return value: non 0 on failure
+ */
 static int
-turtle_push_parse(raptor_parser *rdf_parser, 
-                  const char *string, size_t length)
+turtle_push_parse(raptor_parser *rdf_parser, char *string, size_t length)
 {
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
   raptor_world* world = rdf_parser->world;
 #endif
   raptor_turtle_parser* turtle_parser;
-  void *buffer;
-  int status;
-  yypstate *ps;
+  YYSTYPE lval;
+  int status = YYPUSH_MORE;
+  int finish;
 
   turtle_parser = (raptor_turtle_parser*)rdf_parser->context;
+  finish = turtle_parser->is_end;
+
+  if(length) {
+    YY_BUFFER_STATE buffer;
+    char saved[2];
+
+    /* flex needs the buffer to end with two YY_END_OF_BUFFER_CHARs;
+     * the bytes there are the next line so put them back afterwards */
+    saved[0] = string[length];
+    saved[1] = string[length + 1];
+    string[length] = string[length + 1] = '\0';
+
+    buffer = turtle_lexer__scan_buffer(string, length + 2,
+                                       turtle_parser->scanner);
+    if(!buffer) {
+      string[length] = saved[0];
+      string[length + 1] = saved[1];
+      return 1;
+    }
+    turtle_parser->consumed = 0;
 
-  if(!string || !*string)
-    return 0;
-  
-  if(turtle_lexer_lex_init(&turtle_parser->scanner))
-    return 1;
-  turtle_parser->scanner_set = 1;
-
-#if defined(YYDEBUG) && YYDEBUG > 0
-  turtle_lexer_set_debug(1 ,&turtle_parser->scanner);
-  turtle_parser_debug = 1;
-#endif
-
-  turtle_lexer_set_extra(rdf_parser, turtle_parser->scanner);
-  buffer = turtle_lexer__scan_bytes(string, length, turtle_parser->scanner);
-
-  /* returns a parser instance or 0 on out of memory */
-  ps = yypstate_new();
-  if(!ps)
-    return 1;
-
-  do {
-    YYSTYPE lval;
-    int token;
+    while(status == YYPUSH_MORE) {
+      int token;
 
-    memset(&lval, 0, sizeof(YYSTYPE));
-    
-    token = turtle_lexer_lex(&lval, turtle_parser->scanner);
+      memset(&lval, 0, sizeof(YYSTYPE));
+      token = turtle_lexer_lex(&lval, turtle_parser->scanner);
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-    printf("token %s\n", turtle_token_print(world, token, &lval));
+      printf("token %s\n", turtle_token_print(world, token, &lval));
 #endif
 
-    status = yypush_parse(ps, token, &lval, rdf_parser, turtle_parser->scanner);
+      if(!token || token == EOF) {
+        /* the lexer stops early only after an error */
+        if(turtle_parser->consumed < length)
+          finish = 1;
+        break;
+      }
 
-    /* turtle_token_free(world, token, &lval); */
+      status = turtle_parser_push_parse(turtle_parser->pstate, token, &lval,
+                                        rdf_parser, turtle_parser->scanner);
+    }
 
-    if(!token || token == EOF || token == ERROR_TOKEN)
-      break;
-  } while (status == YYPUSH_MORE);
-  yypstate_delete(ps);
+    turtle_lexer__delete_buffer(buffer, turtle_parser->scanner);
+    string[length] = saved[0];
+    string[length + 1] = saved[1];
+  }
+
+  if(finish && status == YYPUSH_MORE) {
+    /* end of input */
+    memset(&lval, 0, sizeof(YYSTYPE));
+    status = turtle_parser_push_parse(turtle_parser->pstate, 0, &lval,
+                                      rdf_parser, turtle_parser->scanner);
+  }
 
-  turtle_lexer_lex_destroy(turtle_parser->scanner);
-  turtle_parser->scanner_set = 0;
+  if(status != YYPUSH_MORE) {
+    /* parse over: accepted, aborted or out of memory */
+    turtle_parser_pstate_delete(turtle_parser->pstate);
+    turtle_parser->pstate = NULL;
+    return status;
+  }
 
   return 0;
 }
-#endif
 
 
 /**
@@ -1487,11 +1462,21 @@ raptor_turtle_parse_terminate(raptor_parser *rdf_parser) {
 
   raptor_namespaces_clear(&turtle_parser->namespaces);
 
+  if(turtle_parser->pstate) {
+    turtle_parser_pstate_delete(turtle_parser->pstate);
+    turtle_parser->pstate = NULL;
+  }
+
   if(turtle_parser->scanner_set) {
     turtle_lexer_lex_destroy(turtle_parser->scanner);
     turtle_parser->scanner_set = 0;
   }
 
+  if(turtle_parser->sb) {
+    raptor_free_stringbuffer(turtle_parser->sb);
+    turtle_parser->sb = NULL;
+  }
+
   if(turtle_parser->buffer)
     RAPTOR_FREE(cdata, turtle_parser->buffer);
 
@@ -1499,6 +1484,11 @@ raptor_turtle_parse_terminate(raptor_parser *rdf_parser) {
     raptor_free_term(turtle_parser->graph_name);
     turtle_parser->graph_name = NULL;
   }
+
+  if(turtle_parser->checked_predicate_uri) {
+    raptor_free_uri(turtle_parser->checked_predicate_uri);
+    turtle_parser->checked_predicate_uri = NULL;
+  }
 }
 
 
@@ -1520,47 +1510,44 @@ raptor_turtle_clone_statement(raptor_parser *parser, raptor_statement *t)
     parser->emitted_default_graph++;
   }
   
-  /* Two choices for subject for Turtle */
-  if(t->subject->type == RAPTOR_TERM_TYPE_BLANK) {
-    statement->subject = raptor_new_term_from_blank(parser->world,
-                                                    t->subject->value.blank.string);
-  } else {
-    /* RAPTOR_TERM_TYPE_URI */
-    RAPTOR_ASSERT(t->subject->type != RAPTOR_TERM_TYPE_URI,
-                  "subject type is not resource");
-    statement->subject = raptor_new_term_from_uri(parser->world,
-                                                  t->subject->value.uri);
-  }
+  /* The grammar built the terms so share them rather than copying */
+  RAPTOR_ASSERT(t->subject->type != RAPTOR_TERM_TYPE_URI &&
+                t->subject->type != RAPTOR_TERM_TYPE_BLANK,
+                "subject type is not resource");
+  statement->subject = raptor_term_copy(t->subject);
+
+  /* Predicates are URIs but check for bad ordinals.  URIs are interned
+   * so a predicate seen last time is known good by pointer. */
+  if(t->predicate->value.uri != turtle_parser->checked_predicate_uri) {
+    size_t len;
+    unsigned char* predicate_uri_string;
+
+    predicate_uri_string = raptor_uri_as_counted_string(t->predicate->value.uri,
+                                                        &len);
+    if(len > raptor_rdf_namespace_uri_len &&
+       predicate_uri_string[raptor_rdf_namespace_uri_len] == '_' &&
+       !memcmp(predicate_uri_string, raptor_rdf_namespace_uri,
+               raptor_rdf_namespace_uri_len)) {
+      int predicate_ordinal;
+
+      predicate_ordinal = raptor_check_ordinal(predicate_uri_string +
+                                               raptor_rdf_namespace_uri_len + 1);
+      if(predicate_ordinal <= 0) {
+        raptor_parser_error(parser, "Illegal ordinal value %d in property '%s'.", predicate_ordinal, predicate_uri_string);
+        predicate_uri_string = NULL;
+      }
+    }
 
-  /* Predicates are URIs but check for bad ordinals */
-  if(!strncmp((const char*)raptor_uri_as_string(t->predicate->value.uri),
-              "http://www.w3.org/1999/02/22-rdf-syntax-ns#_", 44)) {
-    unsigned char* predicate_uri_string = raptor_uri_as_string(t->predicate->value.uri);
-    int predicate_ordinal = raptor_check_ordinal(predicate_uri_string+44);
-    if(predicate_ordinal <= 0)
-      raptor_parser_error(parser, "Illegal ordinal value %d in property '%s'.", predicate_ordinal, predicate_uri_string);
+    if(predicate_uri_string) {
+      if(turtle_parser->checked_predicate_uri)
+        raptor_free_uri(turtle_parser->checked_predicate_uri);
+      turtle_parser->checked_predicate_uri = raptor_uri_copy(t->predicate->value.uri);
+    }
   }
-  
-  statement->predicate = raptor_new_term_from_uri(parser->world,
-                                                  t->predicate->value.uri);
-  
 
-  /* Three choices for object for Turtle */
-  if(t->object->type == RAPTOR_TERM_TYPE_URI) {
-    statement->object = raptor_new_term_from_uri(parser->world,
-                                                 t->object->value.uri);
-  } else if(t->object->type == RAPTOR_TERM_TYPE_BLANK) {
-    statement->object = raptor_new_term_from_blank(parser->world,
-                                                   t->object->value.blank.string);
-  } else {
-    /* RAPTOR_TERM_TYPE_LITERAL */
-    RAPTOR_ASSERT(t->object->type != RAPTOR_TERM_TYPE_LITERAL,
-                  "object type is not literal");
-    statement->object = raptor_new_term_from_literal(parser->world,
-                                                     t->object->value.literal.string,
-                                                     t->object->value.literal.datatype,
-                                                     t->object->value.literal.language);
-  }
+  statement->predicate = raptor_term_copy(t->predicate);
+
+  statement->object = raptor_term_copy(t->object);
 }
 
 static void
@@ -1619,13 +1606,69 @@ raptor_turtle_defer_statement(raptor_parser *parser, raptor_statement *t)
 
 
 
+/*
+ * raptor_turtle_lexable_length:
+ * @buffer: buffered input
+ * @length: length of @buffer
+ * @start: offset of the newly added bytes; no earlier newline is a
+ *   safe place to stop
+ *
+ * Find how much of @buffer can be lexed without cutting a token.
+ *
+ * Tokens do not cross newlines except long literals, which the lexer
+ * carries over to the next chunk, and a graph name followed by '{',
+ * which may have newlines before the '{'.  So stop after the last
+ * newline that does not follow something that could be a graph name.
+ *
+ * Return value: number of bytes or 0 if there is no such newline
+ */
+static size_t
+raptor_turtle_lexable_length(const char *buffer, size_t length, size_t start)
+{
+  size_t i = length;
+
+  while(i > start) {
+    size_t j;
+
+    if(buffer[i - 1] != '\n') {
+      i--;
+      continue;
+    }
+
+    /* find the last non-whitespace before this newline */
+    for(j = i - 1; j > 0; j--) {
+      char c = buffer[j - 1];
+      if(c != ' ' && c != '\t' && c != '\v' && c != '\r' && c != '\n')
+        break;
+    }
+    if(!j)
+      return i;
+
+    switch(buffer[j - 1]) {
+      case '.': case ';': case ',':
+      case '[': case ']': case '(': case ')': case '{': case '}':
+      case '"': case '\'':
+        return i;
+
+      default:
+        /* any newline between j and i has the same answer */
+        i = j - 1;
+        break;
+    }
+  }
+
+  return 0;
+}
+
+
 static int
 raptor_turtle_parse_chunk(raptor_parser* rdf_parser, 
                           const unsigned char *s, size_t len,
                           int is_end)
 {
   raptor_turtle_parser *turtle_parser;
-  char *ptr;
+  size_t old_length;
+  size_t length;
   int rc;
 
   turtle_parser = (raptor_turtle_parser*)rdf_parser->context;
@@ -1634,91 +1677,64 @@ raptor_turtle_parse_chunk(raptor_parser* rdf_parser,
   RAPTOR_DEBUG2("adding %d bytes to line buffer\n", (int)len);
 #endif
 
+  if(!turtle_parser->pstate) {
+    /* parse already ended or never started */
+    return 1;
+  }
+
   if(!len && !is_end) {
     /* nothing to do */
     return 0;
   }
 
-  /* the actual buffer will contained unprocessed characters from
-   * the last run plus the chunk passed here */
-  turtle_parser->end_of_buffer = turtle_parser->consumed + len;
-  if(turtle_parser->end_of_buffer > turtle_parser->buffer_length) {
-    /* resize */
-    size_t new_buffer_length = turtle_parser->end_of_buffer;
-
-    turtle_parser->buffer = RAPTOR_REALLOC(char*, turtle_parser->buffer,
-                                           new_buffer_length + 1);
-
-    /* adjust stored length */
-    turtle_parser->buffer_length = new_buffer_length;
-  }
-  if(!turtle_parser->buffer && turtle_parser->buffer_length) {
-    /* we tried to alloc a buffer but we failed */
-    raptor_parser_fatal_error(rdf_parser, "Out of memory");
-    return 1;
-  }
-  if(is_end && !turtle_parser->end_of_buffer) {
-    /* Nothing to do */
-    return 0;
+  /* the buffer holds the unlexed last line of earlier chunks plus
+   * this chunk and 2 bytes for the lexer's end of buffer marks */
+  old_length = turtle_parser->buffer_length;
+  if(old_length + len + 2 > turtle_parser->buffer_size) {
+    size_t new_buffer_size = old_length + len + 2;
+    char *new_buffer;
+
+    new_buffer = RAPTOR_REALLOC(char*, turtle_parser->buffer, new_buffer_size);
+    if(!new_buffer) {
+      raptor_parser_fatal_error(rdf_parser, "Out of memory");
+      return 1;
+    }
+    turtle_parser->buffer = new_buffer;
+    turtle_parser->buffer_size = new_buffer_size;
   }
 
-  /* move pointer to end of cdata buffer */
-  ptr = turtle_parser->buffer + turtle_parser->consumed;
-
-  /* now write new stuff at end of cdata buffer */
-  memcpy(ptr, s, len);
-  ptr += len;
-  *ptr = '\0';
-
-  /* reset processed counter */
-  turtle_parser->processed = 0U;
-  /* unconsume */
-  turtle_parser->consumed = 0U;
-  /* reset line numbers */
-  turtle_parser->lineno = turtle_parser->lineno_last_good;
+  if(len)
+    memcpy(turtle_parser->buffer + old_length, s, len);
+  turtle_parser->buffer_length = old_length + len;
 
   /* let everyone know if this is the last chunk */
   turtle_parser->is_end = is_end;
-  if(!is_end) {
-    /* it's safer not to pass the very last line to the lexer
-     * just in case we end up with EOB-in-the-middle-of-X situations */
-    size_t i = turtle_parser->end_of_buffer;
-    while(i > 0U && turtle_parser->buffer[--i] != '\n');
-    /* either i == 0U or i points to the last \n before the end-of-buffer */
-    turtle_parser->consumable = i;
-  } else {
-    /* otherwise the consumable number of bytes coincides with the EOB */
-    turtle_parser->consumable = turtle_parser->end_of_buffer;
-  }
+  if(is_end)
+    length = turtle_parser->buffer_length;
+  else
+    length = raptor_turtle_lexable_length(turtle_parser->buffer,
+                                          turtle_parser->buffer_length,
+                                          old_length);
 
 #if defined(RAPTOR_DEBUG) && RAPTOR_DEBUG > 1
-    RAPTOR_DEBUG3("buffer buffer now '%s' (%ld bytes)\n", 
-                  turtle_parser->buffer, turtle_parser->buffer_length);
+  RAPTOR_DEBUG3("lexing %ld of %ld buffered bytes\n", (long)length,
+                (long)turtle_parser->buffer_length);
 #endif
 
-#ifdef TURTLE_PUSH_PARSE
-  rc = turtle_push_parse(rdf_parser, 
-                         turtle_parser->buffer, turtle_parser->consumable);
-#else
-  rc = turtle_parse(rdf_parser, turtle_parser->buffer, turtle_parser->consumable);
-#endif  
+  rc = turtle_push_parse(rdf_parser, turtle_parser->buffer, length);
+
+  /* release the lexed bytes */
+  turtle_parser->buffer_length -= length;
+  if(turtle_parser->buffer_length && length)
+    memmove(turtle_parser->buffer, turtle_parser->buffer + length,
+            turtle_parser->buffer_length);
 
   if(turtle_parser->error_count) {
     rc = 1;
-  } else if(!is_end) {
-    /* move stuff to the beginning of the buffer */
-    turtle_parser->consumed = turtle_parser->end_of_buffer - turtle_parser->processed;
-    if(turtle_parser->consumed && turtle_parser->processed) {
-      memmove(turtle_parser->buffer,
-              turtle_parser->buffer + turtle_parser->processed,
-              turtle_parser->consumed);
-      /* cancel all deferred eval's */
-      if(turtle_parser->deferred) {
-        raptor_free_sequence(turtle_parser->deferred);
-        turtle_parser->deferred = NULL;
-      }
-    }
-  } else if(rdf_parser->emitted_default_graph) {
+  } else if(!rc && !is_end && !turtle_parser->pstate) {
+    /* the document ended before the input did */
+    rc = 1;
+  } else if(is_end && rdf_parser->emitted_default_graph) {
     /* for non-TRIG - end default graph after last triple */
     raptor_parser_end_graph(rdf_parser, NULL, 0);
     rdf_parser->emitted_default_graph--;
@@ -1741,14 +1757,40 @@ raptor_turtle_parse_start(raptor_parser *rdf_parser)
   locator->column= -1; /* No column info */
   locator->byte= -1; /* No bytes info */
 
-  if(turtle_parser->buffer_length) {
-    RAPTOR_FREE(cdata, turtle_parser->buffer);
-    turtle_parser->buffer = NULL;
-    turtle_parser->buffer_length = 0;
-  }
-  
+  turtle_parser->buffer_length = 0;
   turtle_parser->lineno = 1;
 
+  /* new lexer and parser state for each document */
+  if(turtle_parser->pstate)
+    turtle_parser_pstate_delete(turtle_parser->pstate);
+  turtle_parser->pstate = NULL;
+
+  if(turtle_parser->scanner_set) {
+    turtle_lexer_lex_destroy(turtle_parser->scanner);
+    turtle_parser->scanner_set = 0;
+  }
+
+  if(turtle_parser->sb) {
+    raptor_free_stringbuffer(turtle_parser->sb);
+    turtle_parser->sb = NULL;
+  }
+
+  if(turtle_lexer_lex_init(&turtle_parser->scanner))
+    return 1;
+  turtle_parser->scanner_set = 1;
+
+#if defined(YYDEBUG) && YYDEBUG > 0
+  turtle_lexer_set_debug(1 ,&turtle_parser->scanner);
+  turtle_parser_debug = 1;
+#endif
+
+  turtle_lexer_set_extra(rdf_parser, turtle_parser->scanner);
+
+  /* returns a parser instance or 0 on out of memory */
+  turtle_parser->pstate = turtle_parser_pstate_new();
+  if(!turtle_parser->pstate)
+    return 1;
+
   return 0;
 }
 
@@ -2047,11 +2089,9 @@ main(int argc, char *argv[])
   
   turtle_parser.error_count = 0;
 
-#ifdef TURTLE_PUSH_PARSE
-  turtle_push_parse(&rdf_parser, string, strlen(string));
-#else
-  turtle_parse(&rdf_parser, string, strlen(string));
-#endif
+  if(!raptor_turtle_parse_start(&rdf_parser))
+    raptor_turtle_parse_chunk(&rdf_parser, (const unsigned char*)string,
+                              strlen(string), 1);
 
   raptor_turtle_parse_terminate(&rdf_parser);
   
@@ -184,7 +184,7 @@ relay_namespaces(void* user_data, raptor_namespace *nspace)
 #endif
 
 
-#define GETOPT_STRING "cef:ghi:I:o:O:qrtvw"
+#define GETOPT_STRING "cef:ghi:I:o:O:qrtvwz:Z:"
 
 #ifdef HAVE_GETOPT_LONG
 #define SHOW_NAMESPACES_FLAG 0x100
@@ -209,6 +209,8 @@ static const struct option long_options[] =
   {"trace", 0, 0, 't'},
   {"version", 0, 0, 'v'},
   {"ignore-warnings", 0, 0, 'w'},
+  {"compress", 1, 0, 'z'},
+  {"compress-threads", 1, 0, 'Z'},
   {NULL, 0, 0, 0}
 };
 #endif
@@ -330,6 +332,10 @@ main(int argc, char *argv[])
   raptor_uri *output_base_uri = NULL;
   raptor_sequence* serializer_options = NULL;
   raptor_sequence *namespace_declarations = NULL;
+  raptor_compression_type compression = RAPTOR_COMPRESSION_NONE;
+  int compress_threads = 0;
+  raptor_iostream* output_iostr = NULL;
+  raptor_iostream* compress_iostr = NULL;
 
   /* other variables */
   int rc;
@@ -467,7 +473,9 @@ main(int argc, char *argv[])
               }
 
               name_len = od->name_len;
-              if(!strncmp(optarg, od->name, name_len)) {
+              /* the whole name so that one name may be a prefix of another */
+              if(!strncmp(optarg, od->name, name_len) &&
+                 (name_len == arg_len || optarg[name_len] == '=')) {
                 fv = (option_value*)raptor_calloc_memory(sizeof(option_value),
                                                          1);
 
@@ -606,6 +614,37 @@ main(int argc, char *argv[])
         ignore_errors = 1;
         break;
 
+      case 'z':
+        if(optarg) {
+          if(!strcmp(optarg, "gzip"))
+            compression = RAPTOR_COMPRESSION_GZIP;
+          else if(!strcmp(optarg, "zstd"))
+            compression = RAPTOR_COMPRESSION_ZSTD;
+          else if(!strcmp(optarg, "bzip2"))
+            compression = RAPTOR_COMPRESSION_BZIP2;
+          else {
+            fprintf(stderr,
+                    "%s: invalid argument `%s' for `" HELP_ARG(z, compress) "'\n"
+                    "Valid arguments are `gzip', `zstd' and `bzip2'\n",
+                    program, optarg);
+            usage = 1;
+          }
+
+          if(compression != RAPTOR_COMPRESSION_NONE &&
+             !raptor_compression_is_supported(compression)) {
+            fprintf(stderr,
+                    "%s: `%s' compression is not supported by this build of Raptor\n",
+                    program, optarg);
+            usage = 1;
+          }
+        }
+        break;
+
+      case 'Z':
+        if(optarg)
+          compress_threads = atoi(optarg);
+        break;
+
       case 'v':
         fputs(raptor_version_string, stdout);
         fputc('\n', stdout);
@@ -719,6 +758,8 @@ main(int argc, char *argv[])
     puts(HELP_TEXT("t", "trace           ", "Trace URIs retrieved during parsing"));
     puts(HELP_TEXT("w", "ignore-warnings ", "Ignore warning messages"));
     puts(HELP_TEXT("v", "version         ", "Print the Raptor version"));
+    puts(HELP_TEXT("z TYPE", "compress TYPE", HELP_PAD "Compress the output with 'gzip', 'zstd' or 'bzip2'"));
+    puts(HELP_TEXT("Z N", "compress-threads N", HELP_PAD "Compress on N threads"));
     puts("\nReport bugs to http://bugs.librdf.org/");
 
     raptor_free_world(world);
@@ -900,8 +941,25 @@ main(int argc, char *argv[])
       serializer_options = NULL;
     }
 
-    raptor_serializer_start_to_file_handle(serializer, 
-                                          output_base_uri, stdout);
+    if(compression != RAPTOR_COMPRESSION_NONE) {
+      output_iostr = raptor_new_iostream_to_file_handle(world, stdout);
+      if(output_iostr)
+        compress_iostr = raptor_new_iostream_to_compressed_iostream(world,
+                                                                    output_iostr,
+                                                                    compression,
+                                                                    -1,
+                                                                    compress_threads);
+      if(!compress_iostr) {
+        fprintf(stderr, "%s: Failed to create compressed output\n",
+                program);
+        return(1);
+      }
+
+      raptor_serializer_start_to_iostream(serializer, output_base_uri,
+                                          compress_iostr);
+    } else
+      raptor_serializer_start_to_file_handle(serializer, 
+                                             output_base_uri, stdout);
 
     if(!report_namespace)
       raptor_parser_set_namespace_handler(rdf_parser, serializer,
@@ -933,6 +991,11 @@ main(int argc, char *argv[])
     raptor_serializer_serialize_end(serializer);
     raptor_free_serializer(serializer);
   }
+
+  if(compress_iostr)
+    raptor_free_iostream(compress_iostr);
+  if(output_iostr)
+    raptor_free_iostream(output_iostr);
   
 
   if(!quiet) {